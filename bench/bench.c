@@ -0,0 +1,2966 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include "trajectory.h"
+#include "scenario.h"
+#include "batch.h"
+#include "parallel.h"
+#include "geodesic.h"
+#include "output.h"
+#include "sampling.h"
+#include "latency.h"
+#include "number.h"
+#include "legcache.h"
+#include "telemetry.h"
+#include "spline.h"
+#include "kernels.h"
+#include "sweep.h"
+#include "pyramid.h"
+#include "polyline.h"
+
+// Waypoints per generated batch scenario (0..BENCH_MAX_WAYPOINTS)
+#define BENCH_MAX_WAYPOINTS 10
+
+// The pyramid's grid index loses to a scan of the level when it takes longer
+// than the scan by this factor plus this many seconds (timing noise, and the
+// fixed cost of a query where it falls back to the scan itself)
+#define BENCH_PYRAMID_MARGIN 1.25
+#define BENCH_PYRAMID_SLACK 0.1e-6
+
+// Deterministic generator so every run measures the same corpus
+static uint64_t benchSeed = 0x9e3779b97f4a7c15ULL;
+
+static double randomUniform(double low, double high) {
+    benchSeed ^= benchSeed << 13;
+    benchSeed ^= benchSeed >> 7;
+    benchSeed ^= benchSeed << 17;
+    return low + (high - low) * (double)(benchSeed >> 11) / 9007199254740992.0;
+}
+
+static Coordinates randomCoordinates(void) {
+    Coordinates point;
+    point.latitude = randomUniform(-60.0, 60.0);
+    point.longitude = randomUniform(-180.0, 180.0);
+    point.altitude = randomUniform(0.0, 1000.0);
+    return point;
+}
+
+// Fill scenarios with random routes of 0..maxWaypoints waypoints allocated from arena
+static int generateScenarios(Scenario* scenarios, long count, int maxWaypoints, Arena* arena) {
+    for (long i = 0; i < count; i++) {
+        Scenario* scenario = &scenarios[i];
+        scenario->start = randomCoordinates();
+        scenario->end = randomCoordinates();
+        scenario->missile = defaultMissileAttributes(randomUniform(100.0, 5000.0), randomUniform(100.0, 3000.0));
+        scenario->waypointCount = (int)randomUniform(0.0, maxWaypoints + 1.0);
+        if (scenario->waypointCount > maxWaypoints) scenario->waypointCount = maxWaypoints;
+        scenario->waypoints = (Coordinates*)arenaAlloc(arena, scenario->waypointCount * sizeof(Coordinates));
+        scenario->turnAngles = (double*)arenaAlloc(arena, scenario->waypointCount * sizeof(double));
+        if (!scenario->waypoints || !scenario->turnAngles) {
+            return 0;
+        }
+        for (int w = 0; w < scenario->waypointCount; w++) {
+            scenario->waypoints[w] = randomCoordinates();
+            scenario->turnAngles[w] = randomUniform(-90.0, 90.0);
+        }
+    }
+    return 1;
+}
+
+// Scaling of the parallel scenario engine from 1 to N worker threads
+static int benchThreads(int argc, char* argv[]) {
+    int maxThreads = argc > 0 ? atoi(argv[0]) : availableProcessors();
+    long count = argc > 1 ? atol(argv[1]) : 200000;
+    if (maxThreads < 1) maxThreads = 1;
+    if (count < 1) count = 1;
+
+    Scenario* scenarios = (Scenario*)malloc(count * sizeof(Scenario));
+    BatchResult* results = (BatchResult*)malloc(count * sizeof(BatchResult));
+    Arena arena;
+    initArena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+    if (!scenarios || !results || !generateScenarios(scenarios, count, BENCH_MAX_WAYPOINTS, &arena)) {
+        fprintf(stderr, "Error allocating %ld scenarios\n", count);
+        free(scenarios);
+        free(results);
+        freeArena(&arena);
+        return 1;
+    }
+
+    printf("%-8s %16s %10s %12s\n", "threads", "scenarios/s", "speedup", "efficiency");
+
+    double baseline = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2) {
+        WorkerPool* pool = createWorkerPool(threads);
+        if (!pool) {
+            fprintf(stderr, "Error creating %d worker threads\n", threads);
+            break;
+        }
+
+        for (long i = 0; i < count; i++) {
+            results[i].status = 1;
+        }
+
+        double startTime = monotonicSeconds();
+        evaluateScenarios(pool, scenarios, results, count, 0);
+        double elapsed = monotonicSeconds() - startTime;
+        destroyWorkerPool(pool);
+
+        double throughput = count / elapsed;
+        if (threads == 1) baseline = throughput;
+        printf("%-8d %16.0f %9.2fx %11.1f%%\n", threads, throughput, throughput / baseline,
+               100.0 * throughput / baseline / threads);
+
+        if (threads == maxThreads) break;
+    }
+
+    free(scenarios);
+    free(results);
+    freeArena(&arena);
+    return 0;
+}
+
+// Absolute difference between two bearings, accounting for the 0/360 wrap
+static double bearingError(double a, double b) {
+    double difference = fabs(a - b);
+    return difference > 180.0 ? 360.0 - difference : difference;
+}
+
+// Throughput and accuracy of the batched geodesic kernels against the scalar functions
+static int benchGeodesic(int argc, char* argv[]) {
+    long count = argc > 0 ? atol(argv[0]) : 1000000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    if (count < 1) count = 1;
+    if (rounds < 1) rounds = 1;
+
+    double* values = (double*)malloc(8 * count * sizeof(double));
+    if (!values) {
+        fprintf(stderr, "Error allocating %ld coordinate pairs\n", count);
+        return 1;
+    }
+    double* lat1 = values;
+    double* lon1 = values + count;
+    double* lat2 = values + 2 * count;
+    double* lon2 = values + 3 * count;
+    double* referenceDistances = values + 4 * count;
+    double* referenceBearings = values + 5 * count;
+    double* distances = values + 6 * count;
+    double* bearings = values + 7 * count;
+
+    for (long i = 0; i < count; i++) {
+        // Mix continental and short legs, as in dense waypoint sets
+        lat1[i] = randomUniform(-89.0, 89.0);
+        lon1[i] = randomUniform(-180.0, 180.0);
+        double span = (i % 4 == 0) ? 180.0 : 0.5;
+        lat2[i] = fmax(-89.9, fmin(89.9, lat1[i] + randomUniform(-span, span)));
+        lon2[i] = lon1[i] + randomUniform(-span, span);
+
+        Coordinates start = { lat1[i], lon1[i], 0.0 };
+        Coordinates end = { lat2[i], lon2[i], 0.0 };
+        referenceDistances[i] = calculateDistance(start, end);
+        referenceBearings[i] = calculateBearing(start, end);
+    }
+
+    // Accuracy budget relative to the scalar functions; haversine is ill-conditioned
+    // near antipodal pairs, where last-bit differences grow to micrometres
+    const double distanceTolerance = 1e-6; // km
+    const double bearingTolerance = 1e-8;  // degrees
+    GeodesicKernel defaultKernel = activeGeodesicKernel();
+    int failures = 0;
+    double scalarRate = 0.0;
+
+    printf("%-8s %14s %10s %16s %16s\n", "kernel", "pairs/s", "speedup", "max dist err km", "max bearing err");
+
+    for (int kernel = GEODESIC_KERNEL_SCALAR; kernel <= GEODESIC_KERNEL_AVX512; kernel++) {
+        if (!selectGeodesicKernel((GeodesicKernel)kernel)) {
+            printf("%-8s %14s\n", geodesicKernelName((GeodesicKernel)kernel), "unsupported");
+            continue;
+        }
+
+        double startTime = monotonicSeconds();
+        for (int round = 0; round < rounds; round++) {
+            calculateDistancesAndBearings(lat1, lon1, lat2, lon2, distances, bearings, count);
+        }
+        double rate = (double)count * rounds / (monotonicSeconds() - startTime);
+        if (kernel == GEODESIC_KERNEL_SCALAR) scalarRate = rate;
+
+        double maxDistanceError = 0.0;
+        double maxBearingError = 0.0;
+        for (long i = 0; i < count; i++) {
+            maxDistanceError = fmax(maxDistanceError, fabs(distances[i] - referenceDistances[i]));
+            maxBearingError = fmax(maxBearingError, bearingError(bearings[i], referenceBearings[i]));
+        }
+
+        int accurate = maxDistanceError <= distanceTolerance && maxBearingError <= bearingTolerance;
+        failures += !accurate;
+        printf("%-8s %14.0f %9.2fx %16.3e %16.3e%s\n", geodesicKernelName((GeodesicKernel)kernel), rate,
+               rate / scalarRate, maxDistanceError, maxBearingError, accurate ? "" : "  EXCEEDS TOLERANCE");
+    }
+
+    selectGeodesicKernel(defaultKernel);
+    printf("Runtime selection: %s\n", geodesicKernelName(defaultKernel));
+
+    free(values);
+    return failures ? 1 : 0;
+}
+
+// Original per-sample intermediate point, kept to measure the cached path against
+static Coordinates legacyIntermediatePoint(Coordinates start, Coordinates end, double fraction) {
+    double lat1 = start.latitude * M_PI / 180.0;
+    double lon1 = start.longitude * M_PI / 180.0;
+    double lat2 = end.latitude * M_PI / 180.0;
+    double lon2 = end.longitude * M_PI / 180.0;
+
+    double d = calculateDistance(start, end) / EARTH_RADIUS;
+    double a = sin((1-fraction) * d) / sin(d);
+    double b = sin(fraction * d) / sin(d);
+
+    double x = a * cos(lat1) * cos(lon1) + b * cos(lat2) * cos(lon2);
+    double y = a * cos(lat1) * sin(lon1) + b * cos(lat2) * sin(lon2);
+    double z = a * sin(lat1) + b * sin(lat2);
+
+    Coordinates result;
+    result.latitude = atan2(z, sqrt(x*x + y*y)) * 180.0 / M_PI;
+    result.longitude = atan2(y, x) * 180.0 / M_PI;
+    result.altitude = 10000.0 * sin(fraction * M_PI);
+    return result;
+}
+
+// Per-leg and per-segment cost with and without the cached unit vectors
+static int benchTrigCache(int argc, char* argv[]) {
+    long count = argc > 0 ? atol(argv[0]) : 100000;
+    if (count < 2) count = 2;
+
+    Coordinates* points = (Coordinates*)malloc(count * sizeof(Coordinates));
+    GeoVector* vectors = (GeoVector*)malloc(count * sizeof(GeoVector));
+    if (!points || !vectors) {
+        fprintf(stderr, "Error allocating %ld route points\n", count);
+        free(points);
+        free(vectors);
+        return 1;
+    }
+
+    points[0] = randomCoordinates();
+    for (long i = 1; i < count; i++) {
+        points[i].latitude = fmax(-80.0, fmin(80.0, points[i - 1].latitude + randomUniform(-2.0, 2.0)));
+        points[i].longitude = points[i - 1].longitude + randomUniform(-2.0, 2.0);
+        points[i].altitude = 0.0;
+    }
+
+    long legs = count - 1;
+    double checksum = 0.0;
+
+    // Leg geometry: distance and bearing per leg
+    double startTime = monotonicSeconds();
+    for (long i = 0; i < legs; i++) {
+        checksum += calculateDistance(points[i], points[i + 1]);
+        checksum += calculateBearing(points[i], points[i + 1]);
+    }
+    double legBefore = (monotonicSeconds() - startTime) / legs;
+
+    startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        invalidateGeoVector(&vectors[i]);
+    }
+    for (long i = 0; i < legs; i++) {
+        const GeoVector* from = updateGeoVector(&vectors[i], points[i]);
+        const GeoVector* to = updateGeoVector(&vectors[i + 1], points[i + 1]);
+        checksum += geoVectorDistance(from, to);
+        checksum += geoVectorBearing(from, to);
+    }
+    double legAfter = (monotonicSeconds() - startTime) / legs;
+
+    // Path sampling: 100 points per segment as in generatePathPoints
+    Coordinates sample;
+    startTime = monotonicSeconds();
+    for (long i = 0; i < legs; i++) {
+        for (int s = 0; s < 100; s++) {
+            sample = legacyIntermediatePoint(points[i], points[i + 1], (double)s / 99.0);
+            checksum += sample.latitude;
+        }
+    }
+    double segmentBefore = (monotonicSeconds() - startTime) / legs;
+
+    startTime = monotonicSeconds();
+    for (long i = 0; i < legs; i++) {
+        GeoSegment segment;
+        initGeoSegment(&segment, points[i], points[i + 1]);
+        for (int s = 0; s < 100; s++) {
+            sample = geoSegmentPoint(&segment, (double)s / 99.0);
+            checksum += sample.latitude;
+        }
+    }
+    double segmentAfter = (monotonicSeconds() - startTime) / legs;
+
+    printf("%-18s %14s %14s %10s\n", "operation", "before ns", "after ns", "speedup");
+    printf("%-18s %14.1f %14.1f %9.2fx\n", "leg geometry", legBefore * 1e9, legAfter * 1e9, legBefore / legAfter);
+    printf("%-18s %14.1f %14.1f %9.2fx\n", "segment (100 pts)", segmentBefore * 1e9, segmentAfter * 1e9,
+           segmentBefore / segmentAfter);
+    printf("checksum %.3f\n", checksum);
+
+    free(points);
+    free(vectors);
+    return 0;
+}
+
+static int sameBits(double a, double b) {
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// Whether every result of an incrementally maintained trajectory equals a
+// from-scratch calculation of the same route, bit for bit
+static int sameTrajectoryResults(const TrajectoryData* a, const TrajectoryData* b) {
+    if (a->waypointCount != b->waypointCount || a->dirtyFrom != b->dirtyFrom ||
+        !sameBits(a->totalDistance, b->totalDistance) || !sameBits(a->totalTravelTime, b->totalTravelTime) ||
+        !sameBits(a->initialBearing, b->initialBearing) || !sameBits(a->currentSpeed, b->currentSpeed) ||
+        !sameBits(a->remainingFuel, b->remainingFuel)) {
+        return 0;
+    }
+    for (int i = 0; i < a->waypointCount; i++) {
+        const Waypoint* x = &a->waypoints[i];
+        const Waypoint* y = &b->waypoints[i];
+        if (!sameBits(x->approachSpeed, y->approachSpeed) || !sameBits(x->departureSpeed, y->departureSpeed) ||
+            !sameBits(x->timeToReach, y->timeToReach) ||
+            !sameBits(x->distanceFromPrevious, y->distanceFromPrevious) ||
+            !sameBits(x->bearingFromPrevious, y->bearingFromPrevious) ||
+            !sameBits(x->fuelConsumed, y->fuelConsumed) || !sameBits(x->gForce, y->gForce) ||
+            !sameBits(x->cumulativeDistance, y->cumulativeDistance) ||
+            !sameBits(x->cumulativeTravelTime, y->cumulativeTravelTime) ||
+            !sameBits(x->cumulativeFuel, y->cumulativeFuel)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Calculate the route of trajectory from scratch and compare
+static int matchesFullCalculation(const TrajectoryData* trajectory) {
+    TrajectoryData reference = calculateTrajectory(trajectory->start, trajectory->end, trajectory->missile);
+    beginTrajectoryUpdate(&reference);
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        addWaypoint(&reference, trajectory->waypoints[i].position, trajectory->waypoints[i].turnAngle);
+    }
+    endTrajectoryUpdate(&reference);
+    calculateFullTrajectory(&reference);
+
+    int same = reference.waypointCount == trajectory->waypointCount && sameTrajectoryResults(trajectory, &reference);
+    freeTrajectory(&reference);
+    return same;
+}
+
+// One random edit: append, move, change only the turn angle, or remove a waypoint
+static void randomEdit(TrajectoryData* trajectory) {
+    int count = trajectory->waypointCount;
+    int index = count > 0 ? (int)randomUniform(0.0, count) : 0;
+    if (index >= count) index = count - 1;
+    double choice = randomUniform(0.0, 1.0);
+
+    if (count == 0 || choice < 0.3) {
+        addWaypoint(trajectory, randomCoordinates(), randomUniform(-90.0, 90.0));
+    } else if (choice < 0.55) {
+        updateWaypoint(trajectory, index, randomCoordinates(), randomUniform(-90.0, 90.0));
+    } else if (choice < 0.75) {
+        Waypoint waypoint = trajectory->waypoints[index];
+        double angle = choice < 0.7 ? randomUniform(-90.0, 90.0) : waypoint.turnAngle; // Sometimes unchanged
+        updateWaypoint(trajectory, index, waypoint.position, angle);
+    } else {
+        removeWaypoint(trajectory, index);
+    }
+}
+
+// Replay random edit sequences against calculateFullTrajectory, with and
+// without a leg cache, then time single edits on a long route
+static int benchIncremental(int argc, char* argv[]) {
+    long sequences = argc > 0 ? atol(argv[0]) : 20000;
+    int edits = argc > 1 ? atoi(argv[1]) : 20;
+    int routeWaypoints = argc > 2 ? atoi(argv[2]) : 10000;
+    if (sequences < 1) sequences = 1;
+    if (edits < 1) edits = 1;
+    if (routeWaypoints < 1) routeWaypoints = 1;
+
+    long mismatches = 0;
+    long checks = 0;
+    for (int cached = 0; cached <= 1; cached++) {
+        LegCache* cache = cached ? createLegCache(LEG_CACHE_DEFAULT_ENTRIES) : NULL;
+        setActiveLegCache(cache);
+
+        for (long sequence = 0; sequence < sequences; sequence++) {
+            MissileAttributes missile = defaultMissileAttributes(randomUniform(100.0, 5000.0),
+                                                                 randomUniform(100.0, 3000.0));
+            TrajectoryData trajectory = calculateTrajectory(randomCoordinates(), randomCoordinates(), missile);
+            int initial = (int)randomUniform(0.0, BENCH_MAX_WAYPOINTS + 1.0);
+            for (int w = 0; w < initial; w++) {
+                addWaypoint(&trajectory, randomCoordinates(), randomUniform(-90.0, 90.0));
+            }
+
+            for (int edit = 0; edit < edits; edit++) {
+                if (randomUniform(0.0, 1.0) < 0.2) {
+                    // A batch of edits recalculated once at the end
+                    int batch = 2 + (int)randomUniform(0.0, 4.0);
+                    beginTrajectoryUpdate(&trajectory);
+                    for (int b = 0; b < batch; b++) randomEdit(&trajectory);
+                    endTrajectoryUpdate(&trajectory);
+                } else {
+                    randomEdit(&trajectory);
+                }
+
+                checks++;
+                if (!matchesFullCalculation(&trajectory)) {
+                    if (mismatches == 0) {
+                        fprintf(stderr, "Sequence %ld (%s), edit %d: incremental results differ from a full "
+                                        "calculation\n", sequence, cached ? "leg cache" : "no cache", edit);
+                    }
+                    mismatches++;
+                }
+            }
+            freeTrajectory(&trajectory);
+        }
+
+        setActiveLegCache(NULL);
+        destroyLegCache(cache);
+    }
+
+    // Per-edit cost on a long route: a full recalculation against editing one waypoint
+    TrajectoryData route = calculateTrajectory(randomCoordinates(), randomCoordinates(),
+                                               defaultMissileAttributes(1000.0, 800.0));
+    beginTrajectoryUpdate(&route);
+    for (int w = 0; w < routeWaypoints; w++) {
+        addWaypoint(&route, randomCoordinates(), randomUniform(-30.0, 30.0));
+    }
+    endTrajectoryUpdate(&route);
+
+    int rounds = 1000;
+    double startTime = monotonicSeconds();
+    for (int round = 0; round < rounds / 10; round++) {
+        calculateFullTrajectory(&route);
+    }
+    double fullTime = (monotonicSeconds() - startTime) / (rounds / 10);
+
+    startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        int index = (int)randomUniform(0.0, routeWaypoints);
+        if (index >= routeWaypoints) index = routeWaypoints - 1;
+        updateWaypoint(&route, index, randomCoordinates(), randomUniform(-30.0, 30.0));
+    }
+    double randomTime = (monotonicSeconds() - startTime) / rounds;
+
+    startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        updateWaypoint(&route, routeWaypoints - 1, randomCoordinates(), randomUniform(-30.0, 30.0));
+    }
+    double lastTime = (monotonicSeconds() - startTime) / rounds;
+
+    startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        addWaypoint(&route, randomCoordinates(), randomUniform(-30.0, 30.0));
+        removeWaypoint(&route, route.waypointCount - 1);
+    }
+    double appendTime = (monotonicSeconds() - startTime) / rounds / 2;
+    freeTrajectory(&route);
+
+    printf("%ld random edit sequences x %d edits, with and without a leg cache\n", sequences, edits);
+    printf("results differing from calculateFullTrajectory: %ld of %ld checks\n", mismatches, checks);
+    printf("route of %d waypoints\n", routeWaypoints);
+    printf("%-26s %12s\n", "recalculation", "us");
+    printf("%-26s %12.3f\n", "full", fullTime * 1e6);
+    printf("%-26s %12.3f\n", "edit at random waypoint", randomTime * 1e6);
+    printf("%-26s %12.3f\n", "edit at last waypoint", lastTime * 1e6);
+    printf("%-26s %12.3f\n", "append or remove last", appendTime * 1e6);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Memory footprint and build time of routes with many waypoints
+static int benchMemory(int argc, char* argv[]) {
+    static const int defaultSizes[] = { 10, 1000, 100000 };
+    int sizeCount = argc > 0 ? argc : (int)(sizeof(defaultSizes) / sizeof(defaultSizes[0]));
+
+    printf("sizeof(TrajectoryData) = %zu bytes, sizeof(Waypoint) = %zu bytes\n",
+           sizeof(TrajectoryData), sizeof(Waypoint));
+    printf("%-10s %12s %14s %14s %8s %12s %12s\n", "waypoints", "store bytes", "arena bytes",
+           "bytes/waypoint", "mallocs", "arena ms", "heap ms");
+
+    for (int i = 0; i < sizeCount; i++) {
+        int waypoints = argc > 0 ? atoi(argv[i]) : defaultSizes[i];
+        if (waypoints < 1) continue;
+
+        Coordinates* positions = (Coordinates*)malloc(waypoints * sizeof(Coordinates));
+        double* angles = (double*)malloc(waypoints * sizeof(double));
+        if (!positions || !angles) {
+            fprintf(stderr, "Error allocating %d waypoints\n", waypoints);
+            free(positions);
+            free(angles);
+            return 1;
+        }
+        for (int w = 0; w < waypoints; w++) {
+            positions[w] = randomCoordinates();
+            angles[w] = randomUniform(-90.0, 90.0);
+        }
+
+        Coordinates start = randomCoordinates();
+        Coordinates end = randomCoordinates();
+        MissileAttributes missile = defaultMissileAttributes(1000.0, 800.0);
+
+        // Arena-backed route, waypoints added one at a time
+        Arena arena;
+        initArena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+        double startTime = monotonicSeconds();
+        TrajectoryData trajectory = calculateTrajectoryInArena(start, end, missile, &arena);
+        for (int w = 0; w < waypoints; w++) {
+            addWaypoint(&trajectory, positions[w], angles[w]);
+        }
+        double arenaTime = monotonicSeconds() - startTime;
+        size_t storeBytes = trajectory.waypointCapacity * sizeof(Waypoint);
+        size_t arenaBytes = arena.bytesReserved;
+        long mallocs = arena.blockAllocations;
+        freeArena(&arena);
+
+        // Heap-backed route for comparison
+        startTime = monotonicSeconds();
+        TrajectoryData heapTrajectory = calculateTrajectory(start, end, missile);
+        for (int w = 0; w < waypoints; w++) {
+            addWaypoint(&heapTrajectory, positions[w], angles[w]);
+        }
+        double heapTime = monotonicSeconds() - startTime;
+        freeTrajectory(&heapTrajectory);
+
+        printf("%-10d %12zu %14zu %14.1f %8ld %12.3f %12.3f\n", waypoints, storeBytes, arenaBytes,
+               (double)arenaBytes / waypoints, mallocs, arenaTime * 1e3, heapTime * 1e3);
+
+        free(positions);
+        free(angles);
+    }
+
+    return 0;
+}
+
+// The original stdio implementation of outputTrajectoryJSON, kept as the baseline
+static void legacyTrajectoryJSON(TrajectoryData* trajectory, FILE* file) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"totalDistance\": %.6f,\n", trajectory->totalDistance);
+    fprintf(file, "  \"totalTravelTime\": %.6f,\n", trajectory->totalTravelTime);
+    fprintf(file, "  \"initialBearing\": %.6f,\n", trajectory->initialBearing);
+    fprintf(file, "  \"currentSpeed\": %.6f,\n", trajectory->currentSpeed);
+    fprintf(file, "  \"remainingFuel\": %.6f,\n", trajectory->remainingFuel);
+    fprintf(file, "  \"start\": {\n");
+    fprintf(file, "    \"latitude\": %.6f,\n", trajectory->start.latitude);
+    fprintf(file, "    \"longitude\": %.6f,\n", trajectory->start.longitude);
+    fprintf(file, "    \"altitude\": %.6f\n", trajectory->start.altitude);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"end\": {\n");
+    fprintf(file, "    \"latitude\": %.6f,\n", trajectory->end.latitude);
+    fprintf(file, "    \"longitude\": %.6f,\n", trajectory->end.longitude);
+    fprintf(file, "    \"altitude\": %.6f\n", trajectory->end.altitude);
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"missile\": {\n");
+    fprintf(file, "    \"weight\": %.6f,\n", trajectory->missile.weight);
+    fprintf(file, "    \"speed\": %.6f,\n", trajectory->missile.speed);
+    fprintf(file, "    \"fuel\": %.6f,\n", trajectory->missile.fuel);
+    fprintf(file, "    \"burnRate\": %.6f,\n", trajectory->missile.burnRate);
+    fprintf(file, "    \"thrust\": %.6f,\n", trajectory->missile.thrust);
+    fprintf(file, "    \"maxAcceleration\": %.6f,\n", trajectory->missile.maxAcceleration);
+    fprintf(file, "    \"maxDeceleration\": %.6f,\n", trajectory->missile.maxDeceleration);
+    fprintf(file, "    \"maxTurnRate\": %.6f,\n", trajectory->missile.maxTurnRate);
+    fprintf(file, "    \"dragCoefficient\": %.6f\n", trajectory->missile.dragCoefficient);
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"waypoints\": [\n");
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        Waypoint waypoint = trajectory->waypoints[i];
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"position\": {\n");
+        fprintf(file, "        \"latitude\": %.6f,\n", waypoint.position.latitude);
+        fprintf(file, "        \"longitude\": %.6f,\n", waypoint.position.longitude);
+        fprintf(file, "        \"altitude\": %.6f\n", waypoint.position.altitude);
+        fprintf(file, "      },\n");
+        fprintf(file, "      \"turnAngle\": %.6f,\n", waypoint.turnAngle);
+        fprintf(file, "      \"approachSpeed\": %.6f,\n", waypoint.approachSpeed);
+        fprintf(file, "      \"departureSpeed\": %.6f,\n", waypoint.departureSpeed);
+        fprintf(file, "      \"timeToReach\": %.6f,\n", waypoint.timeToReach);
+        fprintf(file, "      \"distanceFromPrevious\": %.6f,\n", waypoint.distanceFromPrevious);
+        fprintf(file, "      \"bearingFromPrevious\": %.6f,\n", waypoint.bearingFromPrevious);
+        fprintf(file, "      \"fuelConsumed\": %.6f,\n", waypoint.fuelConsumed);
+        fprintf(file, "      \"gForce\": %.6f\n", waypoint.gForce);
+        fprintf(file, "    }%s\n", (i < trajectory->waypointCount - 1) ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"path\": [\n");
+    int pathPointCount = 0;
+    Coordinates* pathPoints = generatePathPoints(trajectory, &pathPointCount);
+    if (pathPoints) {
+        for (int i = 0; i < pathPointCount; i++) {
+            fprintf(file, "    {\n");
+            fprintf(file, "      \"latitude\": %.6f,\n", pathPoints[i].latitude);
+            fprintf(file, "      \"longitude\": %.6f,\n", pathPoints[i].longitude);
+            fprintf(file, "      \"altitude\": %.6f\n", pathPoints[i].altitude);
+            fprintf(file, "    }%s\n", (i < pathPointCount - 1) ? "," : "");
+        }
+        free(pathPoints);
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+// Render one document into memory; the caller frees the text
+static char* renderJSON(TrajectoryData* trajectory, const OutputOptions* options, size_t* length) {
+    char* text = NULL;
+    FILE* stream = open_memstream(&text, length);
+    if (!stream) return NULL;
+
+    if (options) {
+        Writer writer;
+        if (openWriter(&writer, stream, WRITER_DEFAULT_BUFFER) == 0) {
+            writeTrajectoryJSON(&writer, trajectory, options);
+            closeWriter(&writer);
+        }
+    } else {
+        legacyTrajectoryJSON(trajectory, stream);
+    }
+
+    fclose(stream);
+    return text;
+}
+
+// Seconds per document written to sink with the stdio baseline or the streaming writer
+static double timeJSON(TrajectoryData* trajectory, const OutputOptions* options, FILE* sink, int rounds) {
+    double startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        if (options) {
+            Writer writer;
+            if (openWriter(&writer, sink, WRITER_DEFAULT_BUFFER) != 0) return 0.0;
+            writeTrajectoryJSON(&writer, trajectory, options);
+            closeWriter(&writer);
+        } else {
+            legacyTrajectoryJSON(trajectory, sink);
+        }
+    }
+    fflush(sink);
+    return (monotonicSeconds() - startTime) / rounds;
+}
+
+// JSON output throughput for a route with many waypoints
+static int benchJSON(int argc, char* argv[]) {
+    int waypoints = argc > 0 ? atoi(argv[0]) : 1000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    if (waypoints < 0) waypoints = 0;
+    if (rounds < 1) rounds = 1;
+
+    TrajectoryData trajectory = calculateTrajectory(randomCoordinates(), randomCoordinates(),
+                                                    defaultMissileAttributes(1000.0, 800.0));
+    for (int w = 0; w < waypoints; w++) {
+        addWaypoint(&trajectory, randomCoordinates(), randomUniform(-90.0, 90.0));
+    }
+
+    OutputOptions pretty = defaultOutputOptions();
+    OutputOptions compact = defaultOutputOptions();
+    compact.compact = 1;
+
+    // The pretty document must match the stdio baseline byte for byte
+    size_t legacyLength = 0, prettyLength = 0, compactLength = 0;
+    char* legacyText = renderJSON(&trajectory, NULL, &legacyLength);
+    char* prettyText = renderJSON(&trajectory, &pretty, &prettyLength);
+    char* compactText = renderJSON(&trajectory, &compact, &compactLength);
+    int identical = legacyText && prettyText && legacyLength == prettyLength &&
+                    memcmp(legacyText, prettyText, legacyLength) == 0;
+    free(legacyText);
+    free(prettyText);
+    free(compactText);
+
+    FILE* sink = fopen("/dev/null", "w");
+    if (!sink) {
+        fprintf(stderr, "Error opening /dev/null\n");
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+
+    double legacyTime = timeJSON(&trajectory, NULL, sink, rounds);
+    double prettyTime = timeJSON(&trajectory, &pretty, sink, rounds);
+    double compactTime = timeJSON(&trajectory, &compact, sink, rounds);
+    fclose(sink);
+
+    printf("%d waypoints, %d rounds\n", waypoints, rounds);
+    printf("%-16s %12s %12s %10s\n", "writer", "bytes", "ms/doc", "MB/s");
+    printf("%-16s %12zu %12.3f %10.1f\n", "stdio (before)", legacyLength, legacyTime * 1e3,
+           legacyLength / legacyTime / 1e6);
+    printf("%-16s %12zu %12.3f %10.1f\n", "pretty", prettyLength, prettyTime * 1e3,
+           prettyLength / prettyTime / 1e6);
+    printf("%-16s %12zu %12.3f %10.1f\n", "compact", compactLength, compactTime * 1e3,
+           compactLength / compactTime / 1e6);
+    printf("pretty output %s the stdio baseline\n", identical ? "matches" : "DIFFERS FROM");
+
+    freeTrajectory(&trajectory);
+    return identical ? 0 : 1;
+}
+
+// Path points of a JSON document: every number after its "path" key, three per point
+static long decodeJSONPath(const char* text, size_t length, double* values, long capacity) {
+    const char* end = text + length;
+    const char* cursor = strstr(text, "\"path\"");
+    long count = 0;
+
+    while (cursor && count < capacity && (cursor = (const char*)memchr(cursor, ':', end - cursor)) != NULL) {
+        cursor++;
+        while (cursor < end && *cursor == ' ') cursor++;
+        const char* next = parseDouble(cursor, end, &values[count]);
+        if (next) {
+            count++;
+            cursor = next;
+        }
+    }
+    return count / 3;
+}
+
+// Copy the JSON string value of key (unescaped) into buffer; returns its length or -1
+static long jsonStringMember(const char* text, const char* key, char* buffer, long capacity) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    const char* cursor = strstr(text, pattern);
+    if (!cursor) return -1;
+
+    long length = 0;
+    for (cursor += strlen(pattern); *cursor && *cursor != '"' && length < capacity; cursor++) {
+        if (*cursor == '\\') cursor++;
+        buffer[length++] = *cursor;
+    }
+    return length;
+}
+
+// Path points of an encoded document: its two polyline strings, unescaped and decoded
+static long decodeEncodedPath(const char* text, char* scratch, long scratchSize, double* latLngs,
+                              double* altitudes, long capacity) {
+    long length = jsonStringMember(text, "path", scratch, scratchSize);
+    long points = length < 0 ? -1 : decodePolyline(scratch, (size_t)length, 2, POLYLINE_SCALE, latLngs, capacity);
+    length = jsonStringMember(text, "pathAltitudes", scratch, scratchSize);
+    long heights = length < 0 ? -1 : decodePolyline(scratch, (size_t)length, 1, POLYLINE_ALTITUDE_SCALE, altitudes, capacity);
+    return points == heights ? points : -1;
+}
+
+// Size, encode and decode time of the trajectory document with its path as
+// point objects (pretty and compact) and as polyline strings; checks that the
+// encoded path decodes to the sampled points within half a unit of precision
+static int benchPolyline(int argc, char* argv[]) {
+    int waypoints = argc > 0 ? atoi(argv[0]) : 10;
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    if (waypoints < 0) waypoints = 0;
+    if (rounds < 1) rounds = 1;
+
+    TrajectoryData trajectory = calculateTrajectory(randomCoordinates(), randomCoordinates(),
+                                                    defaultMissileAttributes(1000.0, 800.0));
+    for (int w = 0; w < waypoints; w++) {
+        Coordinates position = randomCoordinates();
+        position.altitude = randomUniform(0.0, 12000.0);
+        addWaypoint(&trajectory, position, randomUniform(-90.0, 90.0));
+    }
+
+    OutputOptions variants[3];
+    const char* names[3] = { "pretty", "compact", "encoded" };
+    for (int v = 0; v < 3; v++) {
+        variants[v] = defaultOutputOptions();
+        variants[v].compact = v > 0;
+        variants[v].encodedPath = v == 2;
+    }
+
+    int pointCount = 0;
+    Coordinates* points = samplePathPoints(&trajectory, &variants[0].sampling, &pointCount);
+    long capacity = pointCount + 1;
+    double* values = (double*)malloc(3 * capacity * sizeof(double));
+    double* altitudes = (double*)malloc(capacity * sizeof(double));
+    FILE* sink = fopen("/dev/null", "w");
+    if (!points || !values || !altitudes || !sink) {
+        fprintf(stderr, "Error allocating the path\n");
+        free(points);
+        free(values);
+        free(altitudes);
+        if (sink) fclose(sink);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+
+    printf("%d waypoints, %d path points, %d rounds\n", waypoints, pointCount, rounds);
+    printf("%-10s %12s %10s %14s %14s\n", "path", "bytes", "ratio", "encode_ms/doc", "decode_ms/doc");
+
+    int failures = 0;
+    size_t prettyLength = 0;
+    for (int v = 0; v < 3; v++) {
+        size_t length = 0;
+        char* text = renderJSON(&trajectory, &variants[v], &length);
+        if (!text) {
+            failures++;
+            continue;
+        }
+        if (v == 0) prettyLength = length;
+        double encodeTime = timeJSON(&trajectory, &variants[v], sink, rounds);
+
+        char* scratch = (char*)malloc(length);
+        long decoded = 0;
+        double startTime = monotonicSeconds();
+        for (int round = 0; round < rounds; round++) {
+            decoded = v < 2 ? decodeJSONPath(text, length, values, 3 * capacity)
+                            : scratch ? decodeEncodedPath(text, scratch, (long)length, values, altitudes, capacity) : -1;
+        }
+        double decodeTime = (monotonicSeconds() - startTime) / rounds;
+
+        // Every point within half a unit of the encoded precision
+        double worst = 0.0, worstAltitude = 0.0;
+        for (long i = 0; i < decoded && i < pointCount; i++) {
+            double latitude = v < 2 ? values[3 * i] : values[2 * i];
+            double longitude = v < 2 ? values[3 * i + 1] : values[2 * i + 1];
+            double altitude = v < 2 ? values[3 * i + 2] : altitudes[i];
+            worst = fmax(worst, fmax(fabs(latitude - points[i].latitude), fabs(longitude - points[i].longitude)));
+            worstAltitude = fmax(worstAltitude, fabs(altitude - points[i].altitude));
+        }
+        int ok = decoded == pointCount && worst <= 0.5e-6 * (1.0 + 1e-9) &&
+                 worstAltitude <= (v < 2 ? 0.5e-6 : 0.5e-2) * (1.0 + 1e-9);
+        if (!ok) failures++;
+
+        printf("%-10s %12zu %9.1fx %14.4f %14.4f%s\n", names[v], length, (double)prettyLength / length,
+               encodeTime * 1e3, decodeTime * 1e3, ok ? "" : "  MISMATCH");
+        free(scratch);
+        free(text);
+    }
+
+    fclose(sink);
+    free(points);
+    free(values);
+    free(altitudes);
+    freeTrajectory(&trajectory);
+    printf("Decoded paths %s the sampled points\n", failures == 0 ? "match" : "DO NOT MATCH");
+    return failures == 0 ? 0 : 1;
+}
+
+// Point reached from origin after distanceKm along an initial bearing
+static Coordinates destinationPoint(Coordinates origin, double bearingDegrees, double distanceKm) {
+    double lat1 = origin.latitude * M_PI / 180.0;
+    double lon1 = origin.longitude * M_PI / 180.0;
+    double bearing = bearingDegrees * M_PI / 180.0;
+    double angle = distanceKm / EARTH_RADIUS;
+    double lat2 = asin(sin(lat1) * cos(angle) + cos(lat1) * sin(angle) * cos(bearing));
+    double lon2 = lon1 + atan2(sin(bearing) * sin(angle) * cos(lat1), cos(angle) - sin(lat1) * sin(lat2));
+
+    Coordinates point;
+    point.latitude = lat2 * 180.0 / M_PI;
+    point.longitude = remainder(lon2 * 180.0 / M_PI, 360.0);
+    point.altitude = 0.0;
+    return point;
+}
+
+// Route mixing short hops (0.2-2 km) with long legs (300-2,500 km)
+static TrajectoryData mixedLengthRoute(int waypoints) {
+    Coordinates start = randomCoordinates();
+    Coordinates position = start;
+    Coordinates* positions = (Coordinates*)malloc((waypoints + 1) * sizeof(Coordinates));
+    double* angles = (double*)malloc((waypoints + 1) * sizeof(double));
+
+    for (int w = 0; w <= waypoints && positions && angles; w++) {
+        double distance = randomUniform(0.0, 1.0) < 0.5 ? randomUniform(0.2, 2.0) : randomUniform(300.0, 2500.0);
+        position = destinationPoint(position, randomUniform(0.0, 360.0), distance);
+        if (position.latitude > 75.0 || position.latitude < -75.0) {
+            position.latitude = randomUniform(-60.0, 60.0); // Keep clear of the poles
+        }
+        positions[w] = position;
+        angles[w] = randomUniform(-90.0, 90.0);
+    }
+
+    TrajectoryData trajectory = calculateTrajectory(start, positions ? positions[waypoints] : start,
+                                                    defaultMissileAttributes(1000.0, 800.0));
+    if (positions && angles) {
+        addWaypoints(&trajectory, positions, angles, waypoints);
+    }
+    free(positions);
+    free(angles);
+    return trajectory;
+}
+
+// Fraction of the way along geoSegment at which point lies
+static double segmentFraction(const GeoSegment* geoSegment, Coordinates point) {
+    GeoVector vector;
+    invalidateGeoVector(&vector);
+    updateGeoVector(&vector, point);
+
+    const GeoVector* start = &geoSegment->start;
+    double cx = start->y * vector.z - start->z * vector.y;
+    double cy = start->z * vector.x - start->x * vector.z;
+    double cz = start->x * vector.y - start->y * vector.x;
+    double dot = start->x * vector.x + start->y * vector.y + start->z * vector.z;
+    return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot) / geoSegment->angle;
+}
+
+// Largest deviation of the drawn polyline from the true path, probing each
+// edge at 15 interior points (independent of the points the sampler probed)
+static void measurePathError(TrajectoryData* trajectory, const Coordinates* points, int count,
+                             double* horizontal, double* altitude) {
+    int segments = trajectory->waypointCount + 1;
+    int segment = 0;
+    GeoSegment geoSegment;
+    initTrajectorySegment(trajectory, segment, &geoSegment);
+
+    for (int i = 0; i + 1 < count; i++) {
+        double startFraction = segmentFraction(&geoSegment, points[i]);
+        if (startFraction > 1.0 - 1e-9 && segment < segments - 1) {
+            initTrajectorySegment(trajectory, ++segment, &geoSegment);
+            startFraction = segmentFraction(&geoSegment, points[i]);
+        }
+        double endFraction = segmentFraction(&geoSegment, points[i + 1]);
+        if (!(endFraction > startFraction)) continue; // Repeated vertex
+
+        for (int k = 1; k < 16; k++) {
+            double along = k / 16.0;
+            double altitudeDeviation;
+            Coordinates truth = geoSegmentPoint(&geoSegment, startFraction + (endFraction - startFraction) * along);
+            double deviation = pathDeviation(truth, points[i], points[i + 1], along, &altitudeDeviation);
+            if (deviation > *horizontal) *horizontal = deviation;
+            if (altitudeDeviation > *altitude) *altitude = altitudeDeviation;
+        }
+    }
+}
+
+typedef struct {
+    const char* name;
+    SamplingOptions options;    // tolerance <= 0 runs the fixed sampler
+    long points;
+    long evaluations;
+    double horizontal;
+    double altitude;
+    double seconds;
+} SamplerRun;
+
+// Point counts, great-circle evaluations and error of the fixed and adaptive samplers
+static int benchSampling(int argc, char* argv[]) {
+    int routes = argc > 0 ? atoi(argv[0]) : 200;
+    double tolerance = argc > 1 ? atof(argv[1]) : 0.1;
+    double altitudeTolerance = argc > 2 ? atof(argv[2]) : 10.0;
+    int maxPoints = argc > 3 ? atoi(argv[3]) : 40;
+    int waypoints = 8;
+    if (routes < 1) routes = 1;
+    if (tolerance <= 0.0) tolerance = 0.1;
+
+    SamplerRun runs[4];
+    memset(runs, 0, sizeof(runs));
+    runs[0].name = "fixed 100/segment";
+    runs[0].options = defaultSamplingOptions();
+    runs[1].name = "adaptive";
+    runs[1].options = defaultSamplingOptions();
+    runs[1].options.tolerance = tolerance;
+    runs[2].name = "adaptive + altitude";
+    runs[2].options = runs[1].options;
+    runs[2].options.altitudeTolerance = altitudeTolerance;
+    runs[3].name = "adaptive + budget";
+    runs[3].options = runs[1].options;
+    runs[3].options.maxPoints = maxPoints;
+    int runCount = 2;
+    if (altitudeTolerance > 0.0) runs[runCount++] = runs[2];
+    if (maxPoints > 0) runs[runCount++] = runs[3];
+
+    for (int r = 0; r < routes; r++) {
+        TrajectoryData trajectory = mixedLengthRoute(waypoints);
+
+        for (int run = 0; run < runCount; run++) {
+            SamplingStats stats;
+            int count = 0;
+            double startTime = monotonicSeconds();
+            Coordinates* points;
+            if (runs[run].options.tolerance > 0.0) {
+                points = generateAdaptivePathPoints(&trajectory, &runs[run].options, &count, &stats);
+            } else {
+                points = generatePathPoints(&trajectory, &count);
+                stats.evaluations = count;
+            }
+            runs[run].seconds += monotonicSeconds() - startTime;
+            if (!points) {
+                fprintf(stderr, "Error sampling route %d\n", r);
+                freeTrajectory(&trajectory);
+                return 1;
+            }
+
+            runs[run].points += count;
+            runs[run].evaluations += stats.evaluations;
+            measurePathError(&trajectory, points, count, &runs[run].horizontal, &runs[run].altitude);
+            free(points);
+        }
+
+        freeTrajectory(&trajectory);
+    }
+
+    printf("%d routes of %d mixed-length legs, tolerance %.3f km, altitude tolerance %.1f m, budget %d points\n",
+           routes, waypoints + 1, tolerance, altitudeTolerance, maxPoints);
+    printf("%-20s %12s %12s %14s %14s %10s\n", "sampler", "points", "evaluations", "max error km",
+           "max alt err m", "ms");
+    for (int run = 0; run < runCount; run++) {
+        printf("%-20s %12ld %12ld %14.6f %14.3f %10.3f\n", runs[run].name, runs[run].points,
+               runs[run].evaluations, runs[run].horizontal, runs[run].altitude, runs[run].seconds * 1e3);
+    }
+
+    // The adaptive sampler must honour its tolerance and the default altitude
+    // bound (small slack for probes it didn't see)
+    int status = runs[1].horizontal <= tolerance * 1.05 &&
+                 runs[1].altitude <= tolerance * DEFAULT_ALTITUDE_TOLERANCE_PER_KM * 1.05 ? 0 : 1;
+    if (status != 0) {
+        printf("adaptive sampler exceeded its tolerance\n");
+    }
+    return status;
+}
+
+static int checksumSink(void* context, const Coordinates* points, int count) {
+    double* checksum = (double*)context;
+    for (int i = 0; i < count; i++) {
+        *checksum += points[i].latitude;
+    }
+    return 0;
+}
+
+// Per-scenario cost of path generation: a fresh malloc per call versus a
+// reused caller buffer, a per-thread scratch arena and a streaming sink
+static int benchPaths(int argc, char* argv[]) {
+    long count = argc > 0 ? atol(argv[0]) : 20000;
+    if (count < 1) count = 1;
+
+    Arena scenarioArena;
+    initArena(&scenarioArena, ARENA_DEFAULT_BLOCK_SIZE);
+    Scenario* scenarios = (Scenario*)malloc(count * sizeof(Scenario));
+    TrajectoryData* trajectories = (TrajectoryData*)malloc(count * sizeof(TrajectoryData));
+    if (!scenarios || !trajectories || !generateScenarios(scenarios, count, BENCH_MAX_WAYPOINTS, &scenarioArena)) {
+        fprintf(stderr, "Error allocating %ld scenarios\n", count);
+        free(scenarios);
+        free(trajectories);
+        freeArena(&scenarioArena);
+        return 1;
+    }
+    for (long i = 0; i < count; i++) {
+        trajectories[i] = runScenario(&scenarios[i], NULL);
+    }
+
+    SamplingOptions fixed = defaultSamplingOptions();
+    double checksums[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double seconds[4];
+    long allocations[4];
+    long points = 0;
+
+    // malloc + free per scenario
+    double startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        int pointCount = 0;
+        Coordinates* path = generatePathPoints(&trajectories[i], &pointCount);
+        for (int p = 0; p < pointCount; p++) checksums[0] += path[p].latitude;
+        points += pointCount;
+        free(path);
+    }
+    seconds[0] = monotonicSeconds() - startTime;
+    allocations[0] = count;
+
+    // Caller buffer, grown only when a path needs more room
+    Coordinates* buffer = NULL;
+    int capacity = 0;
+    allocations[1] = 0;
+    startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        int required = generatePathPointsInto(&trajectories[i], NULL, 0);
+        if (required > capacity) {
+            free(buffer);
+            capacity = required;
+            buffer = (Coordinates*)malloc(capacity * sizeof(Coordinates));
+            allocations[1]++;
+            if (!buffer) return 1;
+        }
+        int pointCount = generatePathPointsInto(&trajectories[i], buffer, capacity);
+        for (int p = 0; p < pointCount; p++) checksums[1] += buffer[p].latitude;
+    }
+    seconds[1] = monotonicSeconds() - startTime;
+    free(buffer);
+
+    // Scratch arena reset after every scenario, as the batch workers do
+    Arena scratch;
+    initArena(&scratch, ARENA_DEFAULT_BLOCK_SIZE);
+    startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        int pointCount = 0;
+        Coordinates* path = samplePathPointsInArena(&trajectories[i], &fixed, &scratch, &pointCount);
+        for (int p = 0; path && p < pointCount; p++) checksums[2] += path[p].latitude;
+        resetArena(&scratch);
+    }
+    seconds[2] = monotonicSeconds() - startTime;
+    allocations[2] = scratch.blockAllocations;
+    freeArena(&scratch);
+
+    // Streaming sink, no path array at all
+    startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        streamPathPoints(&trajectories[i], &fixed, checksumSink, &checksums[3], NULL, NULL);
+    }
+    seconds[3] = monotonicSeconds() - startTime;
+    allocations[3] = 0;
+
+    static const char* const names[] = { "malloc per call", "caller buffer", "scratch arena", "streaming sink" };
+    printf("%ld scenarios, %ld path points\n", count, points);
+    printf("%-18s %14s %12s %16s\n", "variant", "us/scenario", "mallocs", "checksum");
+    int status = 0;
+    for (int v = 0; v < 4; v++) {
+        printf("%-18s %14.3f %12ld %16.6f\n", names[v], seconds[v] / count * 1e6, allocations[v], checksums[v]);
+        if (checksums[v] != checksums[0]) status = 1;
+    }
+    if (status != 0) {
+        printf("path variants disagree\n");
+    }
+
+    for (long i = 0; i < count; i++) {
+        freeTrajectory(&trajectories[i]);
+    }
+    free(scenarios);
+    free(trajectories);
+    freeArena(&scenarioArena);
+    return status;
+}
+
+// One load-generating client of the server benchmark
+typedef struct {
+    const char* target;         // Unix socket path, or a localhost port
+    const char* request;        // Complete HTTP request, sent repeatedly
+    size_t requestLength;
+    long requests;
+    long failures;
+    LatencyHistogram* latency;
+    pthread_t thread;
+} ServerClient;
+
+static int connectServer(const char* target) {
+    int fd;
+
+    if (strchr(target, '/')) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", target);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in address;
+        int one = 1;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)atoi(target));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return -1;
+        }
+        if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static char* findText(char* data, size_t length, const char* text) {
+    size_t textLength = strlen(text);
+    for (size_t i = 0; i + textLength <= length; i++) {
+        if (memcmp(data + i, text, textLength) == 0) return data + i;
+    }
+    return NULL;
+}
+
+// Send one request and read its response; returns the HTTP status, -1 on failure
+static int serverRoundTrip(int fd, const ServerClient* client, char** buffer, size_t* capacity) {
+    size_t sent = 0;
+    while (sent < client->requestLength) {
+        ssize_t count = send(fd, client->request + sent, client->requestLength - sent, MSG_NOSIGNAL);
+        if (count <= 0) return -1;
+        sent += count;
+    }
+
+    size_t length = 0;
+    size_t total = 0;
+    for (;;) {
+        if (length == *capacity) {
+            *capacity *= 2;
+            *buffer = (char*)realloc(*buffer, *capacity);
+            if (!*buffer) return -1;
+        }
+        ssize_t count = recv(fd, *buffer + length, *capacity - length, 0);
+        if (count <= 0) return -1;
+        length += count;
+
+        if (total == 0) {
+            // Headers complete once the blank line arrives
+            char* headerEnd = findText(*buffer, length, "\r\n\r\n");
+            if (!headerEnd) continue;
+            char* contentLength = findText(*buffer, headerEnd - *buffer, "Content-Length: ");
+            total = (headerEnd + 4 - *buffer) + (contentLength ? strtoul(contentLength + 16, NULL, 10) : 0);
+        }
+        if (length >= total) break;
+    }
+    return atoi(*buffer + 9);
+}
+
+static void* serverClientMain(void* argument) {
+    ServerClient* client = (ServerClient*)argument;
+    size_t capacity = 256 * 1024;
+    char* buffer = (char*)malloc(capacity);
+    int fd = connectServer(client->target);
+
+    for (long i = 0; i < client->requests; i++) {
+        double startTime = monotonicSeconds();
+        int status = fd >= 0 && buffer ? serverRoundTrip(fd, client, &buffer, &capacity) : -1;
+        recordLatency(client->latency, (uint64_t)((monotonicSeconds() - startTime) * 1e9));
+        if (status != 200) {
+            client->failures++;
+            if (status < 0) break;
+        }
+    }
+
+    if (fd >= 0) close(fd);
+    free(buffer);
+    return NULL;
+}
+
+// Request latency of a running server (missile_calc --serve) under concurrent
+// keep-alive clients, each posting the same trajectory request
+static int benchServer(int argc, char* argv[]) {
+    const char* target = argc > 0 ? argv[0] : "8080";
+    int clientCount = argc > 1 ? atoi(argv[1]) : 4;
+    long requests = argc > 2 ? atol(argv[2]) : 2000;
+    int waypoints = argc > 3 ? atoi(argv[3]) : 3;
+    if (clientCount < 1) clientCount = 1;
+    if (requests < 1) requests = 1;
+
+    // Request body: a fixed route with evenly spaced waypoints
+    char body[4096];
+    int bodyLength = snprintf(body, sizeof(body),
+                              "{\"start\": {\"latitude\": 28.6139, \"longitude\": 77.2090, \"altitude\": 0}, "
+                              "\"end\": {\"latitude\": 19.0760, \"longitude\": 72.8777, \"altitude\": 0}, "
+                              "\"weight\": 1000, \"speed\": 800, \"compact\": true, \"waypoints\": [");
+    for (int w = 0; w < waypoints && bodyLength < (int)sizeof(body) - 128; w++) {
+        double fraction = (w + 1.0) / (waypoints + 1.0);
+        bodyLength += snprintf(body + bodyLength, sizeof(body) - bodyLength,
+                               "%s{\"latitude\": %.4f, \"longitude\": %.4f, \"altitude\": 100, \"turnAngle\": 20}",
+                               w > 0 ? ", " : "", 28.6139 - 9.5379 * fraction, 77.2090 - 4.3313 * fraction + 0.5);
+    }
+    bodyLength += snprintf(body + bodyLength, sizeof(body) - bodyLength, "]}");
+
+    char request[4608];
+    int requestLength = snprintf(request, sizeof(request),
+                                 "POST /trajectory HTTP/1.1\r\nHost: localhost\r\n"
+                                 "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                                 bodyLength, body);
+
+    LatencyHistogram* latency = (LatencyHistogram*)malloc(sizeof(LatencyHistogram));
+    ServerClient* clients = (ServerClient*)calloc(clientCount, sizeof(ServerClient));
+    if (!latency || !clients) {
+        free(latency);
+        free(clients);
+        return 1;
+    }
+    initLatencyHistogram(latency);
+
+    double startTime = monotonicSeconds();
+    for (int c = 0; c < clientCount; c++) {
+        clients[c].target = target;
+        clients[c].request = request;
+        clients[c].requestLength = requestLength;
+        clients[c].requests = requests;
+        clients[c].latency = latency;
+        pthread_create(&clients[c].thread, NULL, serverClientMain, &clients[c]);
+    }
+
+    long failures = 0;
+    for (int c = 0; c < clientCount; c++) {
+        pthread_join(clients[c].thread, NULL);
+        failures += clients[c].failures;
+    }
+    double seconds = monotonicSeconds() - startTime;
+    uint64_t completed = atomic_load(&latency->total);
+
+    printf("%d clients x %ld requests to %s, %d waypoints\n", clientCount, requests, target, waypoints);
+    printf("%-14s %12s\n", "metric", "value");
+    printf("%-14s %12.0f\n", "requests/s", completed / seconds);
+    printf("%-14s %12.1f\n", "p50 us", latencyPercentile(latency, 0.50) / 1000.0);
+    printf("%-14s %12.1f\n", "p90 us", latencyPercentile(latency, 0.90) / 1000.0);
+    printf("%-14s %12.1f\n", "p99 us", latencyPercentile(latency, 0.99) / 1000.0);
+    printf("%-14s %12.1f\n", "max us", atomic_load(&latency->maxNanoseconds) / 1000.0);
+    printf("%-14s %12ld\n", "failures", failures);
+
+    free(latency);
+    free(clients);
+    return failures == 0 ? 0 : 1;
+}
+
+// The original sscanf/strtod record parser, kept as the baseline
+static int legacyParseRecord(const char* record, Scenario* scenario, Arena* arena) {
+    const char* ptr = record;
+    double fields[8];
+
+    while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r') ptr++;
+    if (*ptr == '\0' || *ptr == '#') {
+        return 0;
+    }
+
+    for (int i = 0; i < 8; i++) {
+        char* fieldEnd;
+        fields[i] = strtod(ptr, &fieldEnd);
+        if (fieldEnd == ptr || (*fieldEnd && *fieldEnd != ' ' && *fieldEnd != '\t' && *fieldEnd != '\n')) {
+            return -1;
+        }
+        ptr = fieldEnd;
+        while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r') ptr++;
+    }
+
+    scenario->start.latitude = fields[0];
+    scenario->start.longitude = fields[1];
+    scenario->start.altitude = fields[2];
+    scenario->end.latitude = fields[3];
+    scenario->end.longitude = fields[4];
+    scenario->end.altitude = fields[5];
+    scenario->missile = defaultMissileAttributes(fields[6], fields[7]);
+    scenario->waypointCount = 0;
+
+    if (*ptr) {
+        int capacity = countWaypoints(ptr);
+        scenario->waypoints = (Coordinates*)arenaAlloc(arena, capacity * sizeof(Coordinates));
+        scenario->turnAngles = (double*)arenaAlloc(arena, capacity * sizeof(double));
+        while (*ptr && scenario->waypointCount < capacity) {
+            double lat, lon, alt, angle;
+            if (sscanf(ptr, "%lf,%lf,%lf,%lf", &lat, &lon, &alt, &angle) != 4) break;
+            scenario->waypoints[scenario->waypointCount].latitude = lat;
+            scenario->waypoints[scenario->waypointCount].longitude = lon;
+            scenario->waypoints[scenario->waypointCount].altitude = alt;
+            scenario->turnAngles[scenario->waypointCount] = angle;
+            scenario->waypointCount++;
+            ptr = strchr(ptr, '|');
+            if (!ptr) break;
+            ptr++;
+        }
+    }
+    return 1;
+}
+
+static int sameScenario(const Scenario* a, const Scenario* b) {
+    if (memcmp(&a->start, &b->start, sizeof(Coordinates)) != 0 || memcmp(&a->end, &b->end, sizeof(Coordinates)) != 0 ||
+        a->missile.weight != b->missile.weight || a->missile.speed != b->missile.speed ||
+        a->waypointCount != b->waypointCount) {
+        return 0;
+    }
+    for (int i = 0; i < a->waypointCount; i++) {
+        if (memcmp(&a->waypoints[i], &b->waypoints[i], sizeof(Coordinates)) != 0 ||
+            memcmp(&a->turnAngles[i], &b->turnAngles[i], sizeof(double)) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Values whose parse must match strtod bit for bit, in the shapes inputs take
+static long checkNumberParsing(long count) {
+    static const char* const formats[] = { "%.6f", "%.17g", "%.3f", "%g", "%.10e", "%.0f", "%.1f", "%.15g" };
+    long mismatches = 0;
+    char text[400];
+
+    for (long i = 0; i < count; i++) {
+        double value;
+        if (i % 3 == 0) {
+            uint64_t bits = benchSeed ^ ((uint64_t)i * 0x9e3779b97f4a7c15ULL);
+            memcpy(&value, &bits, sizeof(value));
+            if (value != value) continue;
+        } else if (i % 3 == 1) {
+            value = randomUniform(-400.0, 400.0);
+        } else {
+            value = randomUniform(0.0, 1.0) * 1e-3;
+        }
+        randomUniform(0.0, 1.0);
+
+        snprintf(text, sizeof(text), formats[i % 8], value);
+        size_t length = strlen(text);
+        double expected = strtod(text, NULL);
+        double parsed;
+        const char* end = parseDouble(text, text + length, &parsed);
+        if (end != text + length || memcmp(&expected, &parsed, sizeof(double)) != 0) {
+            if (mismatches < 5) fprintf(stderr, "mismatch on %s\n", text);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+// Scenario record parsing throughput: the span parser against sscanf/strtod
+static int benchParse(int argc, char* argv[]) {
+    long records = argc > 0 ? atol(argv[0]) : 200000;
+    long numbers = argc > 1 ? atol(argv[1]) : 1000000;
+    if (records < 1) records = 1;
+    if (numbers < 0) numbers = 0;
+
+    // Render a corpus in the batch record format
+    size_t capacity = (size_t)records * (8 * 16 + BENCH_MAX_WAYPOINTS * 4 * 16);
+    char* corpus = (char*)malloc(capacity);
+    long* offsets = (long*)malloc((records + 1) * sizeof(long));
+    Scenario* legacy = (Scenario*)malloc(records * sizeof(Scenario));
+    Scenario* parsed = (Scenario*)malloc(records * sizeof(Scenario));
+    Arena generatorArena, legacyArena, parsedArena;
+    initArena(&generatorArena, ARENA_DEFAULT_BLOCK_SIZE);
+    initArena(&legacyArena, ARENA_DEFAULT_BLOCK_SIZE);
+    initArena(&parsedArena, ARENA_DEFAULT_BLOCK_SIZE);
+    Scenario* generated = (Scenario*)malloc(records * sizeof(Scenario));
+    if (!corpus || !offsets || !legacy || !parsed || !generated ||
+        !generateScenarios(generated, records, BENCH_MAX_WAYPOINTS, &generatorArena)) {
+        fprintf(stderr, "Error allocating the parse corpus\n");
+        return 1;
+    }
+
+    size_t used = 0;
+    for (long i = 0; i < records; i++) {
+        const Scenario* scenario = &generated[i];
+        offsets[i] = (long)used;
+        used += snprintf(corpus + used, capacity - used, "%.6f %.6f %.1f %.6f %.6f %.1f %.1f %.1f",
+                         scenario->start.latitude, scenario->start.longitude, scenario->start.altitude,
+                         scenario->end.latitude, scenario->end.longitude, scenario->end.altitude,
+                         scenario->missile.weight, scenario->missile.speed);
+        for (int w = 0; w < scenario->waypointCount; w++) {
+            used += snprintf(corpus + used, capacity - used, "%c%.6f,%.6f,%.1f,%.1f", w == 0 ? ' ' : '|',
+                             scenario->waypoints[w].latitude, scenario->waypoints[w].longitude,
+                             scenario->waypoints[w].altitude, scenario->turnAngles[w]);
+        }
+        corpus[used++] = '\n';
+        corpus[used] = '\0';
+    }
+    offsets[records] = (long)used;
+
+    // The legacy parser needs terminated lines: cut the corpus in place
+    char* lines = (char*)malloc(used + 1);
+    memcpy(lines, corpus, used + 1);
+    for (long i = 0; i < records; i++) lines[offsets[i + 1] - 1] = '\0';
+
+    double startTime = monotonicSeconds();
+    for (long i = 0; i < records; i++) {
+        legacyParseRecord(lines + offsets[i], &legacy[i], &legacyArena);
+    }
+    double legacyTime = monotonicSeconds() - startTime;
+
+    long failures = 0;
+    startTime = monotonicSeconds();
+    for (long i = 0; i < records; i++) {
+        if (parseScenarioSpan(corpus + offsets[i], offsets[i + 1] - offsets[i], &parsed[i], &parsedArena, NULL) != 1) {
+            failures++;
+        }
+    }
+    double parsedTime = monotonicSeconds() - startTime;
+
+    long differences = failures;
+    for (long i = 0; i < records; i++) {
+        if (!sameScenario(&legacy[i], &parsed[i])) differences++;
+    }
+    long mismatches = checkNumberParsing(numbers);
+
+    printf("%ld records, %.1f MB\n", records, used / 1e6);
+    printf("%-18s %12s %10s\n", "parser", "records/s", "MB/s");
+    printf("%-18s %12.0f %10.1f\n", "sscanf (before)", records / legacyTime, used / legacyTime / 1e6);
+    printf("%-18s %12.0f %10.1f\n", "span", records / parsedTime, used / parsedTime / 1e6);
+    printf("speedup: %.2fx\n", legacyTime / parsedTime);
+    printf("records differing from the baseline: %ld\n", differences);
+    printf("numbers differing from strtod: %ld of %ld\n", mismatches, numbers);
+
+    free(lines);
+    free(corpus);
+    free(offsets);
+    free(legacy);
+    free(parsed);
+    free(generated);
+    freeArena(&generatorArena);
+    freeArena(&legacyArena);
+    freeArena(&parsedArena);
+    return differences == 0 && mismatches == 0 ? 0 : 1;
+}
+
+// Evaluate every scenario once on pool; returns the elapsed seconds
+static double timeScenarios(WorkerPool* pool, const Scenario* scenarios, BatchResult* results, long count) {
+    for (long i = 0; i < count; i++) {
+        results[i].status = 1;
+    }
+
+    double startTime = monotonicSeconds();
+    evaluateScenarios(pool, scenarios, results, count, 0);
+    return monotonicSeconds() - startTime;
+}
+
+// Leg physics alone on this thread (no result formatting); returns the elapsed seconds
+static double timePhysics(const Scenario* scenarios, long count) {
+    Arena arena;
+    initArena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+
+    double startTime = monotonicSeconds();
+    for (long i = 0; i < count; i++) {
+        runScenario(&scenarios[i], &arena);
+        resetArena(&arena);
+    }
+    double elapsed = monotonicSeconds() - startTime;
+
+    freeArena(&arena);
+    return elapsed;
+}
+
+// Parameter sweep over shared routes with and without the shared leg cache
+static int benchLegCache(int argc, char* argv[]) {
+    long routes = argc > 0 ? atol(argv[0]) : 500;
+    long variants = argc > 1 ? atol(argv[1]) : 100;
+    int waypoints = argc > 2 ? atoi(argv[2]) : BENCH_MAX_WAYPOINTS;
+    long entries = argc > 3 ? atol(argv[3]) : LEG_CACHE_DEFAULT_ENTRIES;
+    if (routes < 1) routes = 1;
+    if (variants < 1) variants = 1;
+    if (waypoints < 0) waypoints = 0;
+
+    // Every variant flies every route with its own missile, routes interleaved
+    long count = routes * variants;
+    Scenario* scenarios = (Scenario*)malloc(count * sizeof(Scenario));
+    BatchResult* plain = (BatchResult*)malloc(count * sizeof(BatchResult));
+    BatchResult* cached = (BatchResult*)malloc(count * sizeof(BatchResult));
+    Arena arena;
+    initArena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+    WorkerPool* pool = createWorkerPool(0);
+    if (!scenarios || !plain || !cached || !pool) {
+        fprintf(stderr, "Error allocating %ld scenarios\n", count);
+        return 1;
+    }
+
+    for (long r = 0; r < routes; r++) {
+        Scenario* route = &scenarios[r];
+        route->start = randomCoordinates();
+        route->end = randomCoordinates();
+        route->waypointCount = waypoints;
+        route->waypoints = (Coordinates*)arenaAlloc(&arena, waypoints * sizeof(Coordinates));
+        route->turnAngles = (double*)arenaAlloc(&arena, waypoints * sizeof(double));
+        for (int w = 0; w < waypoints; w++) {
+            route->waypoints[w] = randomCoordinates();
+            route->turnAngles[w] = randomUniform(-90.0, 90.0);
+        }
+    }
+    for (long v = 0; v < variants; v++) {
+        for (long r = 0; r < routes; r++) {
+            scenarios[v * routes + r] = scenarios[r];
+            scenarios[v * routes + r].missile = defaultMissileAttributes(randomUniform(100.0, 5000.0),
+                                                                        randomUniform(100.0, 3000.0));
+        }
+    }
+
+    setActiveLegCache(NULL);
+    double plainPhysics = timePhysics(scenarios, count);
+    double plainTime = timeScenarios(pool, scenarios, plain, count);
+
+    // The physics pass fills the cache; the batch pass then runs on a warm cache
+    LegCache* cache = createLegCache(entries);
+    setActiveLegCache(cache);
+    double cachedPhysics = timePhysics(scenarios, count);
+    LegCacheStats coldStats;
+    getLegCacheStats(cache, &coldStats);
+    double cachedTime = timeScenarios(pool, scenarios, cached, count);
+    setActiveLegCache(NULL);
+
+    LegCacheStats stats;
+    getLegCacheStats(cache, &stats);
+    destroyLegCache(cache);
+
+    long differences = 0;
+    for (long i = 0; i < count; i++) {
+        if (plain[i].length != cached[i].length || memcmp(plain[i].text, cached[i].text, plain[i].length) != 0) {
+            differences++;
+        }
+    }
+
+    printf("%ld routes x %ld variants, %d waypoints, %d threads, cache of %ld legs\n",
+           routes, variants, waypoints, workerPoolSize(pool), stats.capacity);
+    printf("%-10s %18s %18s\n", "leg cache", "physics/s", "batch results/s");
+    printf("%-10s %18.0f %18.0f\n", "off", count / plainPhysics, count / plainTime);
+    printf("%-10s %18.0f %18.0f\n", "on", count / cachedPhysics, count / cachedTime);
+    printf("speedup: %.2fx physics, %.2fx batch\n", plainPhysics / cachedPhysics, plainTime / cachedTime);
+    printf("cold pass: hits %llu, misses %llu, hit rate %.1f%%\n",
+           coldStats.hits, coldStats.misses, legCacheHitRate(&coldStats) * 100.0);
+    printf("total: hits %llu, misses %llu, hit rate %.1f%%, evictions %llu, entries %ld\n",
+           stats.hits, stats.misses, legCacheHitRate(&stats) * 100.0, stats.evictions, stats.entries);
+    printf("results differing from the uncached run: %ld\n", differences);
+
+    destroyWorkerPool(pool);
+    free(scenarios);
+    free(plain);
+    free(cached);
+    freeArena(&arena);
+    return differences == 0 ? 0 : 1;
+}
+
+// Position-at-time lookups and telemetry CSV throughput on a long route
+static int benchTelemetry(int argc, char* argv[]) {
+    int waypoints = argc > 0 ? atoi(argv[0]) : 10000;
+    long queries = argc > 1 ? atol(argv[1]) : 1000000;
+    if (waypoints < 0) waypoints = 0;
+    if (queries < 1) queries = 1;
+
+    TrajectoryData trajectory = mixedLengthRoute(waypoints);
+    TelemetryTable table;
+    if (buildTelemetryTable(&table, &trajectory, NULL) != 0) {
+        fprintf(stderr, "Error allocating telemetry tables\n");
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+
+    // Random times: each lookup is two binary searches
+    double checksum = 0.0;
+    double startTime = monotonicSeconds();
+    for (long i = 0; i < queries; i++) {
+        TelemetrySample sample = telemetryAt(&table, randomUniform(0.0, table.totalTime));
+        checksum += sample.position.latitude;
+    }
+    double lookupTime = monotonicSeconds() - startTime;
+
+    // A linear scan of the legs per lookup, as the web logbook did per frame
+    long scanQueries = queries / 100 > 0 ? queries / 100 : 1;
+    startTime = monotonicSeconds();
+    for (long i = 0; i < scanQueries; i++) {
+        double time = randomUniform(0.0, table.totalTime);
+        int leg = 0;
+        while (leg < table.legCount - 1 && table.legEndTime[leg] <= time) leg++;
+        checksum += table.legSpeed[leg];
+    }
+    double scanTime = monotonicSeconds() - startTime;
+
+    // CSV at a step giving about one million rows
+    FILE* sink = fopen("/dev/null", "w");
+    Writer writer;
+    if (!sink || openWriter(&writer, sink, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error opening /dev/null\n");
+        if (sink) fclose(sink);
+        freeTelemetryTable(&table);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+    double step = table.totalTime / 1e6;
+    startTime = monotonicSeconds();
+    long rows = writeTelemetryCSV(&writer, &table, step, 2 * TELEMETRY_MAX_ROWS);
+    closeWriter(&writer);
+    double csvTime = monotonicSeconds() - startTime;
+    size_t bytes = writer.bytesWritten;
+    fclose(sink);
+    if (rows < 0) {
+        fprintf(stderr, "Telemetry CSV was refused at a step of %g s\n", step);
+        freeTelemetryTable(&table);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+
+    printf("%d waypoints, flight time %.3g s, checksum %.3f\n", waypoints, table.totalTime, checksum);
+    printf("%-24s %14.0f lookups/s\n", "binary search", queries / lookupTime);
+    printf("%-24s %14.0f lookups/s\n", "linear leg scan", scanQueries / scanTime);
+    printf("%-24s %14.0f rows/s %8.1f MB/s (%ld rows)\n", "CSV stream", rows / csvTime, bytes / csvTime / 1e6, rows);
+
+    freeTelemetryTable(&table);
+    freeTrajectory(&trajectory);
+    return 0;
+}
+
+// The frontend's catmullRomSpline, transcribed point by point: the reference
+// the batched evaluator has to reproduce exactly
+static int referenceSpline(const Coordinates* points, int count, int segments, Coordinates* out) {
+    int n = 0;
+    if (count < 3) {
+        for (; n < count; n++) out[n] = points[n];
+        return n;
+    }
+    out[n++] = points[0];
+    out[n++] = points[1];
+    for (int i = 1; i < count - 2; i++) {
+        const Coordinates p0 = points[i - 1];
+        const Coordinates p1 = points[i];
+        const Coordinates p2 = points[i + 1];
+        const Coordinates p3 = points[i + 2];
+        for (double t = 0; t <= 1; t += 1.0 / segments) {
+            const double t2 = t * t;
+            const double t3 = t2 * t;
+            out[n].latitude = 0.5 * ((2 * p1.latitude) +
+                (-p0.latitude + p2.latitude) * t +
+                (2*p0.latitude - 5*p1.latitude + 4*p2.latitude - p3.latitude) * t2 +
+                (-p0.latitude + 3*p1.latitude - 3*p2.latitude + p3.latitude) * t3);
+            out[n].longitude = 0.5 * ((2 * p1.longitude) +
+                (-p0.longitude + p2.longitude) * t +
+                (2*p0.longitude - 5*p1.longitude + 4*p2.longitude - p3.longitude) * t2 +
+                (-p0.longitude + 3*p1.longitude - 3*p2.longitude + p3.longitude) * t3);
+            out[n].altitude = 0.5 * ((2 * p1.altitude) +
+                (-p0.altitude + p2.altitude) * t +
+                (2*p0.altitude - 5*p1.altitude + 4*p2.altitude - p3.altitude) * t2 +
+                (-p0.altitude + 3*p1.altitude - 3*p2.altitude + p3.altitude) * t3);
+            n++;
+        }
+    }
+    out[n++] = points[count - 2];
+    out[n++] = points[count - 1];
+    return n;
+}
+
+// Batched spline evaluator against the point-by-point reference: equality and throughput
+static int benchSpline(int argc, char* argv[]) {
+    int waypoints = argc > 0 ? atoi(argv[0]) : 1000;
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    int segments = argc > 2 ? atoi(argv[2]) : SPLINE_DEFAULT_SEGMENTS;
+    if (waypoints < 0) waypoints = 0;
+    if (rounds < 1) rounds = 1;
+    if (segments < 1 || segments > SPLINE_MAX_SEGMENTS) segments = SPLINE_DEFAULT_SEGMENTS;
+
+    TrajectoryData trajectory = mixedLengthRoute(waypoints);
+    int controlCount = waypoints + 2;
+    int count = splinePointCount(controlCount, segments);
+    Coordinates* controls = (Coordinates*)malloc(controlCount * sizeof(Coordinates));
+    Coordinates* reference = (Coordinates*)malloc(count * sizeof(Coordinates));
+    double* values = (double*)malloc(3 * (size_t)count * sizeof(double));
+    if (!controls || !reference || !values) {
+        fprintf(stderr, "Error allocating spline buffers\n");
+        free(controls);
+        free(reference);
+        free(values);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+    double* latitude = values;
+    double* longitude = values + count;
+    double* altitude = values + 2 * (size_t)count;
+
+    controls[0] = trajectory.start;
+    for (int i = 0; i < waypoints; i++) controls[i + 1] = trajectory.waypoints[i].position;
+    controls[controlCount - 1] = trajectory.end;
+
+    double checksum = 0.0;
+    int referenceCount = 0;
+    double startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        referenceCount = referenceSpline(controls, controlCount, segments, reference);
+        checksum += reference[round % referenceCount].latitude;
+    }
+    double referenceTime = monotonicSeconds() - startTime;
+
+    int batchedCount = 0;
+    startTime = monotonicSeconds();
+    for (int round = 0; round < rounds; round++) {
+        batchedCount = evaluateSpline(controls, controlCount, segments, latitude, longitude, altitude);
+        checksum += latitude[round % batchedCount];
+    }
+    double batchedTime = monotonicSeconds() - startTime;
+
+    long mismatches = referenceCount == batchedCount ? 0 : labs((long)referenceCount - batchedCount);
+    for (int i = 0; i < referenceCount && i < batchedCount; i++) {
+        if (memcmp(&reference[i].latitude, &latitude[i], sizeof(double)) != 0 ||
+            memcmp(&reference[i].longitude, &longitude[i], sizeof(double)) != 0 ||
+            memcmp(&reference[i].altitude, &altitude[i], sizeof(double)) != 0) {
+            mismatches++;
+        }
+    }
+
+    SplinePath path;
+    double distance = 0.0;
+    if (buildTrajectorySpline(&trajectory, segments, &path, NULL) == 0) {
+        distance = splinePathDistance(&path);
+        freeSplinePath(&path);
+    }
+
+    printf("%d waypoints, %d samples per leg, %d points, %.1f km, checksum %.3f\n",
+           waypoints, splineSampleCount(segments), batchedCount, distance, checksum);
+    printf("%-24s %14.0f points/s\n", "point by point", (double)referenceCount * rounds / referenceTime);
+    printf("%-24s %14.0f points/s  %.2fx\n", "batched", (double)batchedCount * rounds / batchedTime,
+           referenceTime / batchedTime);
+    printf("Points differing from the reference: %ld\n", mismatches);
+
+    free(controls);
+    free(reference);
+    free(values);
+    freeTrajectory(&trajectory);
+    return mismatches == 0 ? 0 : 1;
+}
+
+static double relativeError(double value, double reference) {
+    double scale = fabs(reference);
+    return scale > 0.0 ? fabs(value - reference) / scale : fabs(value);
+}
+
+// Leg values the kernels produce, in the units Waypoint stores them
+typedef struct {
+    double distance;
+    double bearing;
+    double timeToReach;
+    double departureSpeed;
+    double fuelConsumed;
+    double gForce;
+} BenchLeg;
+
+// Throughput and error of each kernel precision: path points against
+// geoSegmentPoint, and legs against geoVectorDistance, geoVectorBearing and
+// the effects calculateWaypointEffects applied before the kernels, for a
+// missile on the default turn rate and drag and one on its own
+static int benchKernels(int argc, char* argv[]) {
+    int segmentCount = argc > 0 ? atoi(argv[0]) : 20000;
+    int routePoints = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (segmentCount < 1) segmentCount = 1;
+    if (routePoints < 2) routePoints = 2;
+    if (rounds < 1) rounds = 1;
+    int legCount = routePoints - 1;
+
+    GeoSegment* segments = (GeoSegment*)malloc(segmentCount * sizeof(GeoSegment));
+    Coordinates* referencePoints = (Coordinates*)malloc((size_t)segmentCount * KERNEL_SAMPLES_PER_SEGMENT *
+                                                        sizeof(Coordinates));
+    Coordinates* points = (Coordinates*)malloc((size_t)segmentCount * KERNEL_SAMPLES_PER_SEGMENT *
+                                               sizeof(Coordinates));
+    GeoVector* vectors = (GeoVector*)malloc(routePoints * sizeof(GeoVector));
+    double* turnAngles = (double*)malloc(routePoints * sizeof(double));
+    BenchLeg* referenceLegs = (BenchLeg*)malloc(2 * (size_t)legCount * sizeof(BenchLeg));
+    BenchLeg* legs = (BenchLeg*)malloc((size_t)legCount * sizeof(BenchLeg));
+    double* approachSpeeds = (double*)malloc(2 * (size_t)legCount * sizeof(double));
+    if (!segments || !referencePoints || !points || !vectors || !turnAngles || !referenceLegs || !legs ||
+        !approachSpeeds) {
+        fprintf(stderr, "Error allocating kernel corpus\n");
+        free(segments);
+        free(referencePoints);
+        free(points);
+        free(vectors);
+        free(turnAngles);
+        free(referenceLegs);
+        free(legs);
+        free(approachSpeeds);
+        return 1;
+    }
+
+    // Segments mixing continental and short legs
+    for (int s = 0; s < segmentCount; s++) {
+        Coordinates start = { randomUniform(-89.0, 89.0), randomUniform(-180.0, 180.0), 0.0 };
+        double span = (s % 4 == 0) ? 90.0 : 0.5;
+        Coordinates end = { fmax(-89.9, fmin(89.9, start.latitude + randomUniform(-span, span))),
+                            start.longitude + randomUniform(-span, span), 0.0 };
+        initGeoSegment(&segments[s], start, end);
+        for (int i = 0; i < KERNEL_SAMPLES_PER_SEGMENT; i++) {
+            double fraction = (double)i / (KERNEL_SAMPLES_PER_SEGMENT - 1);
+            referencePoints[(size_t)s * KERNEL_SAMPLES_PER_SEGMENT + i] = geoSegmentPoint(&segments[s], fraction);
+        }
+    }
+
+    // One long route with turns; every tenth leg runs along a meridian
+    Coordinates position = randomCoordinates();
+    for (int i = 0; i < routePoints; i++) {
+        invalidateGeoVector(&vectors[i]);
+        updateGeoVector(&vectors[i], position);
+        turnAngles[i] = i > 0 && i < routePoints - 1 ? randomUniform(-20.0, 20.0) : 0.0;
+        position = destinationPoint(position, i % 10 == 9 ? 180.0 : randomUniform(0.0, 360.0),
+                                    randomUniform(0.5, 400.0));
+        if (i % 10 == 9) position.longitude = vectors[i].sourceLongitude;
+        if (position.latitude > 75.0 || position.latitude < -75.0) position.latitude = randomUniform(-60.0, 60.0);
+    }
+
+    // Reference legs. Each is approached at its own speed: chained through
+    // 100k turns the speed would decay towards zero
+    MissileAttributes missiles[2];
+    missiles[0] = defaultMissileAttributes(1000.0, 800.0);
+    missiles[1] = defaultMissileAttributes(1000.0, 800.0);
+    missiles[1].maxTurnRate = 15.0;
+    missiles[1].dragCoefficient = 0.25;
+    const char* missileNames[2] = { "default", "custom" };
+    for (int m = 0; m < 2; m++) {
+        const MissileAttributes* missile = &missiles[m];
+        for (int i = 0; i < legCount; i++) {
+            BenchLeg* reference = &referenceLegs[(size_t)m * legCount + i];
+            double speed = randomUniform(100.0, 3000.0);
+            double turnAngle = turnAngles[i + 1];
+            double turnTime = fabs(turnAngle) / missile->maxTurnRate;
+            approachSpeeds[(size_t)m * legCount + i] = speed;
+            reference->distance = geoVectorDistance(&vectors[i], &vectors[i + 1]);
+            reference->bearing = geoVectorBearing(&vectors[i], &vectors[i + 1]);
+            reference->timeToReach = calculateTravelTime(reference->distance * 1000, speed);
+            reference->departureSpeed = calculateTurnEffect(speed, turnAngle, missile->dragCoefficient);
+            reference->fuelConsumed = reference->timeToReach * missile->fuelConsumptionNormal +
+                                      turnTime * missile->fuelConsumptionTurn;
+            reference->gForce = calculateGForce(speed, speed / (missile->maxTurnRate * M_PI / 180.0));
+        }
+    }
+
+    KernelPrecision defaultPrecision = activeKernelPrecision();
+    long pathPoints = (long)segmentCount * KERNEL_SAMPLES_PER_SEGMENT;
+    int failures = 0;
+
+    printf("%d segments x %d points, route of %d points\n", segmentCount, KERNEL_SAMPLES_PER_SEGMENT, routePoints);
+    printf("%-7s %-8s %14s %12s %12s %12s\n", "kernel", "", "points/s", "max pos m", "mean pos m", "max alt m");
+
+    for (int precision = KERNEL_PRECISION_DOUBLE; precision <= KERNEL_PRECISION_FLOAT; precision++) {
+        selectKernelPrecision((KernelPrecision)precision);
+
+        double startTime = monotonicSeconds();
+        for (int round = 0; round < rounds; round++) {
+            for (int s = 0; s < segmentCount; s++) {
+                kernelSegmentPoints(&segments[s], points + (size_t)s * KERNEL_SAMPLES_PER_SEGMENT);
+            }
+        }
+        double pointRate = (double)pathPoints * rounds / (monotonicSeconds() - startTime);
+
+        double maxPosition = 0.0, sumPosition = 0.0, maxAltitude = 0.0;
+        for (long i = 0; i < pathPoints; i++) {
+            double error = calculateDistance(points[i], referencePoints[i]) * 1000.0;
+            maxPosition = fmax(maxPosition, error);
+            sumPosition += error;
+            maxAltitude = fmax(maxAltitude, fabs(points[i].altitude - referencePoints[i].altitude));
+        }
+
+        // Double must reproduce the reference exactly; float is reported as is
+        int exact = maxPosition == 0.0 && maxAltitude == 0.0;
+        if (precision == KERNEL_PRECISION_DOUBLE && !exact) failures++;
+        printf("%-7s %-8s %14.0f %12.3e %12.3e %12.3e%s\n", kernelPrecisionName((KernelPrecision)precision), "path",
+               pointRate, maxPosition, sumPosition / pathPoints, maxAltitude,
+               precision == KERNEL_PRECISION_DOUBLE && !exact ? "  DIFFERS FROM REFERENCE" : "");
+    }
+
+    printf("%-7s %-8s %14s %12s %12s %12s %12s %12s\n", "kernel", "missile", "legs/s", "max dist m",
+           "max bearing", "max rel time", "max rel fuel", "max rel v/g");
+
+    for (int precision = KERNEL_PRECISION_DOUBLE; precision <= KERNEL_PRECISION_FLOAT; precision++) {
+        selectKernelPrecision((KernelPrecision)precision);
+
+        for (int m = 0; m < 2; m++) {
+            const MissileAttributes* missile = &missiles[m];
+            const BenchLeg* reference = referenceLegs + (size_t)m * legCount;
+            const double* speeds = approachSpeeds + (size_t)m * legCount;
+
+            double startTime = monotonicSeconds();
+            for (int round = 0; round < rounds; round++) {
+                for (int i = 0; i < legCount; i++) {
+                    LegEffects effects;
+                    legs[i].distance = EARTH_RADIUS * kernelLegAngle(&vectors[i], &vectors[i + 1]);
+                    legs[i].bearing = kernelLegBearing(&vectors[i], &vectors[i + 1]);
+                    kernelLegEffects(missile, legs[i].distance, speeds[i], turnAngles[i + 1], &effects);
+                    legs[i].timeToReach = effects.timeToReach;
+                    legs[i].departureSpeed = effects.departureSpeed;
+                    legs[i].fuelConsumed = effects.fuelConsumed;
+                    legs[i].gForce = effects.gForce;
+                }
+            }
+            double legRate = (double)legCount * rounds / (monotonicSeconds() - startTime);
+
+            // Time and fuel follow from the kernel's own distance, as they do in the engine
+            double maxDistance = 0.0, maxBearing = 0.0, maxTime = 0.0, maxFuel = 0.0, maxOther = 0.0;
+            int exact = 1;
+            for (int i = 0; i < legCount; i++) {
+                maxDistance = fmax(maxDistance, fabs(legs[i].distance - reference[i].distance) * 1000.0);
+                maxBearing = fmax(maxBearing, bearingError(legs[i].bearing, reference[i].bearing));
+                maxTime = fmax(maxTime, relativeError(legs[i].timeToReach, reference[i].timeToReach));
+                maxFuel = fmax(maxFuel, relativeError(legs[i].fuelConsumed, reference[i].fuelConsumed));
+                maxOther = fmax(maxOther, relativeError(legs[i].departureSpeed, reference[i].departureSpeed));
+                maxOther = fmax(maxOther, relativeError(legs[i].gForce, reference[i].gForce));
+                exact = exact && memcmp(&legs[i], &reference[i], sizeof(BenchLeg)) == 0;
+            }
+
+            if (precision == KERNEL_PRECISION_DOUBLE && !exact) failures++;
+            printf("%-7s %-8s %14.0f %12.3e %12.3e %12.3e %12.3e %12.3e%s\n",
+                   kernelPrecisionName((KernelPrecision)precision), missileNames[m], legRate, maxDistance,
+                   maxBearing, maxTime, maxFuel, maxOther,
+                   precision == KERNEL_PRECISION_DOUBLE && !exact ? "  DIFFERS FROM REFERENCE" : "");
+        }
+    }
+
+    selectKernelPrecision(defaultPrecision);
+    printf("Runtime selection: %s\n", kernelPrecisionName(defaultPrecision));
+
+    free(segments);
+    free(referencePoints);
+    free(points);
+    free(vectors);
+    free(turnAngles);
+    free(referenceLegs);
+    free(legs);
+    free(approachSpeeds);
+    return failures ? 1 : 0;
+}
+
+// Collects sweep results in row order
+typedef struct {
+    SweepResult* results;
+    long count;
+} SweepCollector;
+
+static int collectSweepResults(void* context, const SweepResult* results, int count) {
+    SweepCollector* collector = (SweepCollector*)context;
+    memcpy(collector->results + collector->count, results, count * sizeof(SweepResult));
+    collector->count += count;
+    return 0;
+}
+
+static int sameValue(double value, double reference) {
+    return value == reference || (isnan(value) && isnan(reference));
+}
+
+// Fill the four axes of grid with values evenly spread over typical ranges
+static int fillSweepGrid(SweepGrid* grid, int valuesPerAxis) {
+    static const double low[SWEEP_AXIS_COUNT] = { 0.05, 200.0, 100.0, 5.0 };
+    static const double high[SWEEP_AXIS_COUNT] = { 0.5, 3000.0, 5000.0, 40.0 };
+    double* values = (double*)malloc(valuesPerAxis * sizeof(double));
+    if (!values) return 0;
+
+    int ok = 1;
+    for (int f = 0; f < SWEEP_AXIS_COUNT; f++) {
+        for (int i = 0; i < valuesPerAxis; i++) {
+            values[i] = valuesPerAxis > 1 ? low[f] + (high[f] - low[f]) * i / (valuesPerAxis - 1) : low[f];
+        }
+        if (setSweepAxis(&grid->axes[f], values, valuesPerAxis) != 0) ok = 0;
+    }
+    free(values);
+    return ok;
+}
+
+// Evaluate every grid point as its own scenario and count the ones whose
+// totals differ from the sweep's results (bit for bit)
+static long sweepMismatches(Scenario* scenario, const SweepResult* results, long count) {
+    long mismatches = 0;
+
+    for (long i = 0; i < count; i++) {
+        const SweepResult* result = &results[i];
+        scenario->missile = defaultMissileAttributes(result->weight, result->speed);
+        scenario->missile.dragCoefficient = result->dragCoefficient;
+        scenario->missile.maxTurnRate = result->maxTurnRate;
+
+        TrajectoryData trajectory = runScenario(scenario, NULL);
+        double maxGForce = 0.0;
+        for (int w = 1; w < trajectory.waypointCount; w++) {
+            maxGForce = fmax(maxGForce, trajectory.waypoints[w].gForce);
+        }
+        if (!sameValue(result->totalDistance, trajectory.totalDistance) ||
+            !sameValue(result->totalTravelTime, trajectory.totalTravelTime) ||
+            !sameValue(result->finalSpeed, trajectory.currentSpeed) ||
+            !sameValue(result->remainingFuel, trajectory.remainingFuel) ||
+            !sameValue(result->maxGForce, maxGForce)) {
+            mismatches++;
+        }
+        freeTrajectory(&trajectory);
+    }
+    return mismatches;
+}
+
+// Attribute sweep over one route against one full scenario per grid point.
+// Also checks routes of zero and one waypoint, which take the engine's special cases
+static int benchSweep(int argc, char* argv[]) {
+    int waypointCount = argc > 0 ? atoi(argv[0]) : 50;
+    int valuesPerAxis = argc > 1 ? atoi(argv[1]) : 12;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (waypointCount < 0) waypointCount = 0;
+    if (valuesPerAxis < 1) valuesPerAxis = 1;
+    if (rounds < 1) rounds = 1;
+
+    SweepGrid grid;
+    memset(&grid, 0, sizeof(grid));
+    long points = fillSweepGrid(&grid, valuesPerAxis) ? sweepPointCount(&grid) : -1;
+    Coordinates* waypoints = (Coordinates*)malloc((waypointCount + 1) * sizeof(Coordinates));
+    double* turnAngles = (double*)malloc((waypointCount + 1) * sizeof(double));
+    SweepResult* results = points > 0 ? (SweepResult*)malloc(points * sizeof(SweepResult)) : NULL;
+    if (!results || !waypoints || !turnAngles) {
+        fprintf(stderr, "Error allocating sweep corpus\n");
+        freeSweepGrid(&grid);
+        free(waypoints);
+        free(turnAngles);
+        free(results);
+        return 1;
+    }
+
+    Coordinates start = randomCoordinates();
+    Coordinates position = start;
+    for (int w = 0; w <= waypointCount; w++) {
+        position = destinationPoint(position, randomUniform(0.0, 360.0), randomUniform(20.0, 400.0));
+        if (position.latitude > 75.0 || position.latitude < -75.0) position.latitude = randomUniform(-60.0, 60.0);
+        waypoints[w] = position;
+        turnAngles[w] = randomUniform(-90.0, 90.0);
+    }
+    Scenario scenario = { start, waypoints[waypointCount], defaultMissileAttributes(1.0, 1.0),
+                          waypointCount, waypoints, turnAngles };
+
+    // Sweep: route geometry once per round, then the grid; best of rounds
+    SweepCollector collector = { results, 0 };
+    SweepRoute route;
+    double sweepTime = INFINITY;
+    long mismatches = 0;
+    for (int round = 0; round < rounds; round++) {
+        collector.count = 0;
+        double startTime = monotonicSeconds();
+        if (prepareSweepRoute(&route, scenario.start, scenario.end, waypoints, turnAngles, waypointCount) != 0) {
+            mismatches++;
+            break;
+        }
+        runSweep(&route, &grid, collectSweepResults, &collector);
+        freeSweepRoute(&route);
+        sweepTime = fmin(sweepTime, monotonicSeconds() - startTime);
+    }
+
+    // Full recalculation: geometry and physics of every leg for every point
+    double startTime = monotonicSeconds();
+    mismatches += sweepMismatches(&scenario, results, collector.count);
+    double fullTime = monotonicSeconds() - startTime;
+
+    // Routes without effect legs: no waypoints, and a single one
+    for (int count = 0; count <= 1; count++) {
+        scenario.waypointCount = count;
+        collector.count = 0;
+        if (prepareSweepRoute(&route, scenario.start, scenario.end, waypoints, turnAngles, count) == 0) {
+            runSweep(&route, &grid, collectSweepResults, &collector);
+            mismatches += sweepMismatches(&scenario, results, collector.count);
+            freeSweepRoute(&route);
+        } else {
+            mismatches++;
+        }
+    }
+
+    printf("%d waypoints, %d values per axis: %ld grid points\n", waypointCount, valuesPerAxis, points);
+    printf("%-20s %12s %16s %16s\n", "method", "seconds", "points/s", "legs/s");
+    printf("%-20s %12.6f %16.0f %16.0f\n", "scenario per point", fullTime, points / fullTime,
+           (double)points * (waypointCount + 1) / fullTime);
+    printf("%-20s %12.6f %16.0f %16.0f\n", "sweep", sweepTime, points / sweepTime,
+           (double)points * (waypointCount + 1) / sweepTime);
+    printf("Speedup: %.1fx, %ld grid points differ from the engine%s\n", fullTime / sweepTime, mismatches,
+           mismatches ? "  DIFFERS FROM REFERENCE" : "");
+
+    freeSweepGrid(&grid);
+    free(waypoints);
+    free(turnAngles);
+    free(results);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Deviation the pyramid ranks points by (pyramid.c's mercatorDeviation)
+static double referenceMercatorDeviation(Coordinates point, Coordinates chordStart, Coordinates chordEnd) {
+    double scale = cos(point.latitude * M_PI / 180.0);
+    if (scale < 0.01) scale = 0.01;
+    return pathDeviation(point, chordStart, chordEnd, 0.0, NULL) / scale;
+}
+
+// Textbook recursive Douglas-Peucker over points[first..last] at tolerance
+static void referenceSimplify(const Coordinates* points, int first, int last, double tolerance, char* keep) {
+    if (last - first < 2) return;
+    int split = first + 1;
+    double worst = -1.0;
+    for (int k = first + 1; k < last; k++) {
+        double deviation = referenceMercatorDeviation(points[k], points[first], points[last]);
+        if (deviation > worst) {
+            worst = deviation;
+            split = k;
+        }
+    }
+    if (!(worst > tolerance)) return;
+    keep[split] = 1;
+    referenceSimplify(points, first, split, tolerance, keep);
+    referenceSimplify(points, split, last, tolerance, keep);
+}
+
+// Levels of pyramid that differ from Douglas-Peucker run at each level's tolerance
+static int pyramidLevelMismatches(const PathPyramid* pyramid, const Coordinates* vertices, int vertexCount,
+                                  char* keep, char* mandatory) {
+    int count = pyramid->count;
+    const Coordinates* points = pyramid->points;
+    for (int i = 0; i < count; i++) {
+        mandatory[i] = i == 0 || i == count - 1;
+        for (int v = 0; v < vertexCount && !mandatory[i]; v++) {
+            mandatory[i] = fabs(points[i].latitude - vertices[v].latitude) <= 1e-9 &&
+                           fabs(points[i].longitude - vertices[v].longitude) <= 1e-9;
+        }
+    }
+
+    int mismatches = 0;
+    for (int level = 0; level < PYRAMID_LEVELS; level++) {
+        memcpy(keep, mandatory, count);
+        for (int first = 0, last = 1; last < count; last++) {
+            if (!mandatory[last]) continue;
+            referenceSimplify(points, first, last, pyramid->levels[level].tolerance, keep);
+            first = last;
+        }
+
+        const PyramidLevel* entry = &pyramid->levels[level];
+        int kept = 0, same = 1;
+        for (int i = 0; i < count; i++) {
+            if (!keep[i]) continue;
+            same = same && kept < entry->count && entry->indices[kept] == i;
+            kept++;
+        }
+        if (!same || kept != entry->count) mismatches++;
+    }
+    return mismatches;
+}
+
+// The level's points inside bounds plus their path neighbours, by scanning every point
+static int scanPyramidLevel(const PathPyramid* pyramid, int level, const GeoBounds* bounds,
+                            char* inside, int* positions) {
+    const PyramidLevel* entry = &pyramid->levels[level];
+    for (int p = 0; p < entry->count; p++) {
+        Coordinates point = pyramid->points[entry->indices[p]];
+        int longitudeInside = bounds->west <= bounds->east
+            ? point.longitude >= bounds->west && point.longitude <= bounds->east
+            : point.longitude >= bounds->west || point.longitude <= bounds->east;
+        inside[p] = longitudeInside && point.latitude >= bounds->south && point.latitude <= bounds->north;
+    }
+
+    int count = 0;
+    for (int p = 0; p < entry->count; p++) {
+        if (inside[p] || (p > 0 && inside[p - 1]) || (p + 1 < entry->count && inside[p + 1])) {
+            positions[count++] = p;
+        }
+    }
+    return count;
+}
+
+// Viewport of a web map at level (a 1024 x 768 pixel window) centred on a path point;
+// the box crosses the antimeridian when the window does
+static GeoBounds pyramidViewport(const PathPyramid* pyramid, int level) {
+    Coordinates centre = pyramid->points[(int)randomUniform(0.0, pyramid->count - 1)];
+    double degreesPerPixel = 360.0 / (256.0 * (double)(1L << level));
+    double halfWidth = fmin(512.0 * degreesPerPixel, 179.0);
+    double halfHeight = fmin(384.0 * degreesPerPixel * cos(centre.latitude * M_PI / 180.0), 89.0);
+
+    GeoBounds bounds;
+    bounds.south = centre.latitude - halfHeight;
+    bounds.north = centre.latitude + halfHeight;
+    bounds.west = centre.longitude - halfWidth;
+    bounds.east = centre.longitude + halfWidth;
+    if (bounds.west < -180.0) bounds.west += 360.0;
+    if (bounds.east > 180.0) bounds.east -= 360.0;
+    return bounds;
+}
+
+// Path pyramid against Douglas-Peucker per level and viewport queries against
+// a scan of the level: equality, build time, query rate and payload size
+static int benchPyramid(int argc, char* argv[]) {
+    int waypoints = argc > 0 ? atoi(argv[0]) : 200;
+    long queries = argc > 1 ? atol(argv[1]) : 20000;
+    if (waypoints < 0) waypoints = 0;
+    if (queries < 1) queries = 1;
+
+    TrajectoryData trajectory = mixedLengthRoute(waypoints);
+    int vertexCount = waypoints + 2;
+    int count = 0;
+    Coordinates* points = samplePathPoints(&trajectory, NULL, &count);
+    Coordinates* vertices = (Coordinates*)malloc(vertexCount * sizeof(Coordinates));
+    char* flags = (char*)malloc(2 * (size_t)count + 2);
+    int* expected = (int*)malloc(((size_t)count + 1) * sizeof(int));
+    int* positions = (int*)malloc(((size_t)count + 1) * sizeof(int));
+    PathPyramid pyramid;
+    memset(&pyramid, 0, sizeof(pyramid));
+    if (!points || !vertices || !flags || !expected || !positions) {
+        fprintf(stderr, "Error allocating pyramid buffers\n");
+        free(points);
+        free(vertices);
+        free(flags);
+        free(expected);
+        free(positions);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+    vertices[0] = trajectory.start;
+    for (int i = 0; i < waypoints; i++) vertices[i + 1] = trajectory.waypoints[i].position;
+    vertices[vertexCount - 1] = trajectory.end;
+
+    // Build: best of a few rounds
+    double buildTime = INFINITY;
+    int status = 0;
+    for (int round = 0; round < 5 && status == 0; round++) {
+        freePathPyramid(&pyramid);
+        double startTime = monotonicSeconds();
+        status = buildPathPyramid(&pyramid, points, count, vertices, vertexCount, NULL);
+        buildTime = fmin(buildTime, monotonicSeconds() - startTime);
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error building the path pyramid\n");
+        free(points);
+        free(vertices);
+        free(flags);
+        free(expected);
+        free(positions);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+
+    double startTime = monotonicSeconds();
+    long mismatches = pyramidLevelMismatches(&pyramid, vertices, vertexCount, flags, flags + count + 1);
+    double referenceTime = monotonicSeconds() - startTime;
+
+    // Viewports per level: the grid query against the scan, answers compared
+    long perLevel = queries / PYRAMID_LEVELS > 0 ? queries / PYRAMID_LEVELS : 1;
+    GeoBounds* viewports = (GeoBounds*)malloc(perLevel * sizeof(GeoBounds));
+    if (!viewports) {
+        fprintf(stderr, "Error allocating pyramid buffers\n");
+        freePathPyramid(&pyramid);
+        free(points);
+        free(vertices);
+        free(flags);
+        free(expected);
+        free(positions);
+        freeTrajectory(&trajectory);
+        return 1;
+    }
+    // Query scratch from an arena reset per query, as the server's workers do
+    Arena scratch;
+    initArena(&scratch, ((size_t)count + 1) * (sizeof(int) + 1) + ARENA_DEFAULT_BLOCK_SIZE);
+    double queryTime[PYRAMID_LEVELS], scanTime[PYRAMID_LEVELS];
+    long checksum = 0, scanChecksum = 0;
+    int slowerLevels = 0;
+    for (int level = 0; level < PYRAMID_LEVELS; level++) {
+        for (long q = 0; q < perLevel; q++) viewports[q] = pyramidViewport(&pyramid, level);
+
+        // Best of a few rounds each, so one preempted round doesn't decide the comparison
+        queryTime[level] = scanTime[level] = INFINITY;
+        for (int round = 0; round < 3; round++) {
+            long found = 0;
+            startTime = monotonicSeconds();
+            for (long q = 0; q < perLevel; q++) {
+                found += queryPathPyramid(&pyramid, level, &viewports[q], positions, &scratch);
+                resetArena(&scratch);
+            }
+            queryTime[level] = fmin(queryTime[level], (monotonicSeconds() - startTime) / perLevel);
+            if (round == 0) checksum += found;
+
+            found = 0;
+            startTime = monotonicSeconds();
+            for (long q = 0; q < perLevel; q++) {
+                found += scanPyramidLevel(&pyramid, level, &viewports[q], flags, expected);
+            }
+            scanTime[level] = fmin(scanTime[level], (monotonicSeconds() - startTime) / perLevel);
+            if (round == 0) scanChecksum += found;
+        }
+        if (queryTime[level] > scanTime[level] * BENCH_PYRAMID_MARGIN + BENCH_PYRAMID_SLACK) slowerLevels++;
+
+        for (long q = 0; q < perLevel; q++) {
+            int found = scanPyramidLevel(&pyramid, level, &viewports[q], flags, expected);
+            int answer = queryPathPyramid(&pyramid, level, &viewports[q], positions, NULL);
+            if (answer != found || memcmp(positions, expected, found * sizeof(int)) != 0) mismatches++;
+        }
+    }
+    freeArena(&scratch);
+    free(viewports);
+
+    // Document sizes: the full path against a view per level
+    OutputOptions options = defaultOutputOptions();
+    options.compact = 1;
+    Writer writer;
+    size_t fullBytes = 0;
+    if (openMemoryWriter(&writer, 1 << 16) == 0) {
+        writeTrajectoryJSON(&writer, &trajectory, &options);
+        fullBytes = writer.bytesWritten;
+        closeWriter(&writer);
+    }
+
+    printf("%d waypoints, %d path points, built in %.3f ms (Douglas-Peucker per level: %.3f ms)\n",
+           waypoints, count, buildTime * 1e3, referenceTime * 1e3);
+    printf("Full path document: %zu bytes\n", fullBytes);
+    printf("%-6s %14s %10s %14s %14s %10s %10s %8s\n", "level", "tolerance_km", "points", "whole_bytes",
+           "viewport_bytes", "grid_us", "scan_us", "speedup");
+    for (int level = 0; level < PYRAMID_LEVELS; level++) {
+        size_t wholeBytes = 0, viewBytes = 0;
+        if (openMemoryWriter(&writer, 1 << 16) == 0) {
+            int found = queryPathPyramid(&pyramid, level, NULL, positions, NULL);
+            writePyramidViewJSON(&writer, &pyramid, level, positions, found);
+            wholeBytes = writer.bytesWritten;
+
+            GeoBounds bounds = pyramidViewport(&pyramid, level);
+            found = queryPathPyramid(&pyramid, level, &bounds, positions, NULL);
+            writePyramidViewJSON(&writer, &pyramid, level, positions, found);
+            viewBytes = writer.bytesWritten - wholeBytes;
+            closeWriter(&writer);
+        }
+        printf("%-6d %14.6f %10d %14zu %14zu %10.2f %10.2f %7.2fx%s\n", level, pyramid.levels[level].tolerance,
+               pyramid.levels[level].count, wholeBytes, viewBytes, queryTime[level] * 1e6, scanTime[level] * 1e6,
+               scanTime[level] / queryTime[level],
+               queryTime[level] > scanTime[level] * BENCH_PYRAMID_MARGIN + BENCH_PYRAMID_SLACK ? "  SLOWER THAN SCAN" : "");
+    }
+    printf("Points returned: %ld (scan %ld), mismatches: %ld%s\n", checksum, scanChecksum, mismatches,
+           mismatches ? "  DIFFERS FROM REFERENCE" : "");
+    printf("Levels where the grid index loses to the scan (by more than %.0f%% + %.1f us): %d\n",
+           (BENCH_PYRAMID_MARGIN - 1.0) * 100.0, BENCH_PYRAMID_SLACK * 1e6, slowerLevels);
+
+    freePathPyramid(&pyramid);
+    free(points);
+    free(vertices);
+    free(flags);
+    free(expected);
+    free(positions);
+    freeTrajectory(&trajectory);
+    return mismatches == 0 && slowerLevels == 0 ? 0 : 1;
+}
+
+// Write a scenario file of about megabytes MB in the batch record format,
+// with a comment, a blank line and a malformed record now and then
+static int writeIngestCorpus(const char* path, long megabytes) {
+    FILE* file = fopen(path, "w");
+    if (!file) return 0;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    long long target = (long long)megabytes * 1000000;
+    long long written = 0;
+    for (long record = 0; written < target; record++) {
+        if (record % 1000 == 999) {
+            written += fprintf(file, "# record %ld\n\n1 2 3 4 5 six 7 8\n", record);
+            continue;
+        }
+        Coordinates start = randomCoordinates();
+        Coordinates end = randomCoordinates();
+        written += fprintf(file, "%.6f %.6f %.1f %.6f %.6f %.1f %.1f %.1f", start.latitude, start.longitude,
+                           start.altitude, end.latitude, end.longitude, end.altitude,
+                           randomUniform(100.0, 5000.0), randomUniform(100.0, 3000.0));
+        int waypoints = (int)randomUniform(0.0, 4.0);
+        for (int w = 0; w < waypoints; w++) {
+            Coordinates position = randomCoordinates();
+            written += fprintf(file, "%c%.6f,%.6f,%.1f,%.1f", w == 0 ? ' ' : '|', position.latitude,
+                               position.longitude, position.altitude, randomUniform(-90.0, 90.0));
+        }
+        written += fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+// Run one batch over input in a child process, so the peak RSS it reports
+// is that run's alone; mapped selects runBatchFile over the stdio reader
+static int runIngestChild(const char* input, const char* output, int mapped, int threads, BatchStats* stats) {
+    int channel[2];
+    if (pipe(channel) != 0) return 0;
+
+    pid_t child = fork();
+    if (child < 0) {
+        close(channel[0]);
+        close(channel[1]);
+        return 0;
+    }
+    if (child == 0) {
+        close(channel[0]);
+        BatchOptions options = defaultBatchOptions();
+        options.threadCount = threads;
+        FILE* results = fopen(output, "w");
+        int status = -1;
+        if (results) {
+            setvbuf(results, NULL, _IOFBF, 1 << 20);
+            if (mapped) {
+                status = runBatchFile(input, results, &options, stats);
+            } else {
+                FILE* records = fopen(input, "r");
+                status = records ? runBatch(records, results, &options, stats) : -1;
+                if (records) fclose(records);
+            }
+            fclose(results);
+        }
+        if (status != 0 || write(channel[1], stats, sizeof(*stats)) != (ssize_t)sizeof(*stats)) _exit(1);
+        _exit(0);
+    }
+
+    close(channel[1]);
+    ssize_t received = read(channel[0], stats, sizeof(*stats));
+    close(channel[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    return received == (ssize_t)sizeof(*stats) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Whether two files hold the same bytes
+static int sameFileContents(const char* first, const char* second) {
+    FILE* a = fopen(first, "r");
+    FILE* b = fopen(second, "r");
+    static char blockA[1 << 16], blockB[1 << 16];
+    int same = a && b;
+    while (same) {
+        size_t lengthA = fread(blockA, 1, sizeof(blockA), a);
+        size_t lengthB = fread(blockB, 1, sizeof(blockB), b);
+        same = lengthA == lengthB && memcmp(blockA, blockB, lengthA) == 0;
+        if (lengthA == 0) break;
+    }
+    if (a) fclose(a);
+    if (b) fclose(b);
+    return same;
+}
+
+// Batch ingestion of a generated scenario file: the stdio line reader against
+// the mapped, chunk-parallel reader. Reports time to first result, total time
+// and peak RSS of each, and checks that both write the same results
+static int benchIngest(int argc, char* argv[]) {
+    long megabytes = argc > 0 ? atol(argv[0]) : 256;
+    int threads = argc > 1 ? atoi(argv[1]) : 0;
+    const char* directory = argc > 2 ? argv[2] : "/tmp";
+    if (megabytes < 1) megabytes = 1;
+
+    char input[4096], streamOutput[4096], mappedOutput[4096];
+    snprintf(input, sizeof(input), "%s/ingest-%d.txt", directory, (int)getpid());
+    snprintf(streamOutput, sizeof(streamOutput), "%s/ingest-%d-stream.ndjson", directory, (int)getpid());
+    snprintf(mappedOutput, sizeof(mappedOutput), "%s/ingest-%d-mapped.ndjson", directory, (int)getpid());
+
+    double startTime = monotonicSeconds();
+    if (!writeIngestCorpus(input, megabytes)) {
+        fprintf(stderr, "Error writing %s\n", input);
+        unlink(input);
+        return 1;
+    }
+    double generateTime = monotonicSeconds() - startTime;
+
+    BatchStats stream, mapped;
+    int ran = runIngestChild(input, streamOutput, 0, threads, &stream) &&
+              runIngestChild(input, mappedOutput, 1, threads, &mapped);
+    int same = ran && sameFileContents(streamOutput, mappedOutput);
+    unlink(input);
+    unlink(streamOutput);
+    unlink(mappedOutput);
+    if (!ran) {
+        fprintf(stderr, "Error running the batch\n");
+        return 1;
+    }
+
+    printf("%ld MB of records (written in %.1f s), %ld scenarios, %ld rejected, %d threads\n",
+           megabytes, generateTime, mapped.scenarios, mapped.rejected, mapped.threadCount);
+    printf("%-20s %14s %12s %12s %12s\n", "reader", "first_result_s", "total_s", "MB/s", "peak_rss_MB");
+    printf("%-20s %14.4f %12.3f %12.1f %12.1f\n", "stdio lines", stream.firstResultSeconds,
+           stream.elapsedSeconds, megabytes / stream.elapsedSeconds, stream.peakResidentBytes / 1e6);
+    printf("%-20s %14.4f %12.3f %12.1f %12.1f\n", "mapped chunks", mapped.firstResultSeconds,
+           mapped.elapsedSeconds, megabytes / mapped.elapsedSeconds, mapped.peakResidentBytes / 1e6);
+    printf("Results %s\n", same ? "identical" : "DIFFER");
+    return same ? 0 : 1;
+}
+
+// Reading end of a pipe drained no faster than bytesPerSecond, standing in for
+// a slow (network mounted) output volume
+typedef struct {
+    int fd;
+    double bytesPerSecond;
+    unsigned long long bytes;
+    uint64_t hash;              // FNV-1a of everything read
+} SlowSink;
+
+static void* drainSlowSink(void* argument) {
+    SlowSink* sink = (SlowSink*)argument;
+    char block[1 << 16];
+    ssize_t length;
+
+    // Every read costs its transfer time, so idle time can't be made up later
+    sink->hash = 0xcbf29ce484222325ULL;
+    while ((length = read(sink->fd, block, sizeof(block))) > 0) {
+        double due = monotonicSeconds() + length / sink->bytesPerSecond;
+        for (ssize_t i = 0; i < length; i++) {
+            sink->hash = (sink->hash ^ (unsigned char)block[i]) * 0x100000001b3ULL;
+        }
+        sink->bytes += (unsigned long long)length;
+        double now = monotonicSeconds();
+        if (due > now) usleep((useconds_t)((due - now) * 1e6));
+    }
+    return NULL;
+}
+
+// Batch over input with its results going to a slow sink; 0 on success
+static int runSlowOutput(const char* input, int buffers, int threads, double bytesPerSecond,
+                         BatchStats* stats, SlowSink* sink) {
+    int channel[2];
+    if (pipe(channel) != 0) return -1;
+    FILE* output = fdopen(channel[1], "w");
+    if (!output) {
+        close(channel[0]);
+        close(channel[1]);
+        return -1;
+    }
+    setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+    memset(sink, 0, sizeof(*sink));
+    sink->fd = channel[0];
+    sink->bytesPerSecond = bytesPerSecond;
+    pthread_t drainer;
+    if (pthread_create(&drainer, NULL, drainSlowSink, sink) != 0) {
+        fclose(output);
+        close(channel[0]);
+        return -1;
+    }
+
+    BatchOptions options = defaultBatchOptions();
+    options.threadCount = threads;
+    options.outputBuffers = buffers;
+    int status = runBatchFile(input, output, &options, stats);
+    if (fclose(output) != 0) status = -1;
+    pthread_join(drainer, NULL);
+    close(channel[0]);
+    return status;
+}
+
+// Batch throughput when the output file is slower than the engine: results
+// written on the compute thread against the output pipeline with 1 to 8 buffers
+static int benchOutput(int argc, char* argv[]) {
+    long megabytes = argc > 0 ? atol(argv[0]) : 20;
+    double sinkMegabytes = argc > 1 ? atof(argv[1]) : 40.0;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+    if (megabytes < 1) megabytes = 1;
+    if (!(sinkMegabytes > 0.0)) sinkMegabytes = 40.0;
+
+    char input[64];
+    snprintf(input, sizeof(input), "/tmp/output-%d.txt", (int)getpid());
+    if (!writeIngestCorpus(input, megabytes)) {
+        fprintf(stderr, "Error writing %s\n", input);
+        unlink(input);
+        return 1;
+    }
+
+    static const int bufferCounts[] = { 0, 1, 2, 4, 8 };
+    int count = (int)(sizeof(bufferCounts) / sizeof(bufferCounts[0]));
+    uint64_t expected = 0;
+    int mismatches = 0;
+
+    printf("%ld MB of records, output drained at %.0f MB/s\n", megabytes, sinkMegabytes);
+    printf("%-10s %12s %14s %10s %10s %12s\n", "buffers", "total_s", "scenarios/s", "output_MB", "stalls", "stalled_s");
+    for (int i = 0; i < count; i++) {
+        BatchStats stats;
+        SlowSink sink;
+        if (runSlowOutput(input, bufferCounts[i], threads, sinkMegabytes * 1e6, &stats, &sink) != 0) {
+            fprintf(stderr, "Error running the batch with %d output buffers\n", bufferCounts[i]);
+            unlink(input);
+            return 1;
+        }
+        if (i == 0) expected = sink.hash;
+        if (sink.hash != expected) mismatches++;
+
+        char label[16];
+        snprintf(label, sizeof(label), bufferCounts[i] == 0 ? "sync" : "%d", bufferCounts[i]);
+        printf("%-10s %12.3f %14.0f %10.1f %10llu %12.3f\n", label, stats.elapsedSeconds,
+               stats.scenarios / stats.elapsedSeconds, sink.bytes / 1e6, stats.output.stalls,
+               stats.output.stallSeconds);
+    }
+    unlink(input);
+
+    printf("Results %s\n", mismatches == 0 ? "identical" : "DIFFER");
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Repeats of each suite case; the median is reported
+#define SUITE_REPEATS 7
+
+// Minimum wall time of one repeat, so short operations aren't lost in timer noise
+#define SUITE_MIN_SECONDS 0.05
+
+// Coordinate pairs in the geodesic corpus
+#define SUITE_PAIRS 4096
+
+typedef void (*SuiteOperation)(void* context, long iterations);
+
+typedef struct {
+    Coordinates* starts;
+    Coordinates* ends;
+    TrajectoryData* trajectory;
+    double sink;                // Keeps results alive past the optimizer
+} SuiteContext;
+
+static void suiteDistance(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        long pair = i & (SUITE_PAIRS - 1);
+        suite->sink += calculateDistance(suite->starts[pair], suite->ends[pair]);
+    }
+}
+
+static void suiteBearing(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        long pair = i & (SUITE_PAIRS - 1);
+        suite->sink += calculateBearing(suite->starts[pair], suite->ends[pair]);
+    }
+}
+
+static void suiteIntermediatePoint(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        long pair = i & (SUITE_PAIRS - 1);
+        suite->sink += calculateIntermediatePoint(suite->starts[pair], suite->ends[pair], (i % 101) / 100.0).latitude;
+    }
+}
+
+static void suiteFullTrajectory(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        calculateFullTrajectory(suite->trajectory);
+        suite->sink += suite->trajectory->totalDistance;
+    }
+}
+
+static void suitePathPoints(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        int pointCount = 0;
+        Coordinates* path = generatePathPoints(suite->trajectory, &pointCount);
+        suite->sink += pointCount > 0 ? path[pointCount - 1].latitude : 0.0;
+        free(path);
+    }
+}
+
+static void suiteOutputJSON(void* context, long iterations) {
+    SuiteContext* suite = (SuiteContext*)context;
+    for (long i = 0; i < iterations; i++) {
+        outputTrajectoryJSON(*suite->trajectory, "/dev/null");
+    }
+}
+
+// Time operation: calibrate the iteration count, then return the median and
+// fastest nanoseconds per operation over SUITE_REPEATS repeats
+static long timeSuiteCase(SuiteOperation operation, void* context, double* median, double* fastest) {
+    long iterations = 1;
+    for (;;) {
+        double startTime = monotonicSeconds();
+        operation(context, iterations);
+        double elapsed = monotonicSeconds() - startTime;
+        if (elapsed >= SUITE_MIN_SECONDS || iterations >= (1L << 40)) break;
+        iterations = elapsed > 0.0 && SUITE_MIN_SECONDS / elapsed < 100.0
+                         ? (long)(iterations * SUITE_MIN_SECONDS / elapsed * 1.2) + 1
+                         : iterations * 100;
+    }
+
+    double samples[SUITE_REPEATS];
+    for (int r = 0; r < SUITE_REPEATS; r++) {
+        double startTime = monotonicSeconds();
+        operation(context, iterations);
+        samples[r] = (monotonicSeconds() - startTime) * 1e9 / iterations;
+    }
+
+    // Insertion sort; the array is tiny
+    for (int a = 1; a < SUITE_REPEATS; a++) {
+        for (int b = a; b > 0 && samples[b] < samples[b - 1]; b--) {
+            double swap = samples[b];
+            samples[b] = samples[b - 1];
+            samples[b - 1] = swap;
+        }
+    }
+    *median = samples[SUITE_REPEATS / 2];
+    *fastest = samples[0];
+    return iterations;
+}
+
+static void reportSuiteCase(FILE* results, int* first, const char* name, SuiteOperation operation, void* context) {
+    double median, fastest;
+    long iterations = timeSuiteCase(operation, context, &median, &fastest);
+
+    printf("%-28s %14.1f %14.1f %12ld\n", name, median, fastest, iterations);
+    fflush(stdout);
+    if (results) {
+        // One result per line keeps the file easy to diff and to read back
+        fprintf(results, "%s    {\"name\": \"%s\", \"unit\": \"ns/op\", \"median\": %.3f, \"min\": %.3f, \"iterations\": %ld}",
+                *first ? "" : ",\n", name, median, fastest, iterations);
+        *first = 0;
+    }
+}
+
+// Benchmark suite over generated corpora: the geodesic primitives, trajectory
+// calculation, path generation and JSON output at several route sizes.
+// Writes machine-readable results to results_file when given
+static int benchSuite(int argc, char* argv[]) {
+    const char* resultsPath = argc > 0 ? argv[0] : NULL;
+    static const int routeSizes[] = { 10, 100, 1000 };
+    SuiteContext suite;
+    char name[64];
+    int first = 1;
+
+    memset(&suite, 0, sizeof(suite));
+    suite.starts = (Coordinates*)malloc(SUITE_PAIRS * sizeof(Coordinates));
+    suite.ends = (Coordinates*)malloc(SUITE_PAIRS * sizeof(Coordinates));
+    if (!suite.starts || !suite.ends) {
+        free(suite.starts);
+        free(suite.ends);
+        return 1;
+    }
+    for (int i = 0; i < SUITE_PAIRS; i++) {
+        suite.starts[i] = randomCoordinates();
+        suite.ends[i] = randomCoordinates();
+    }
+
+    FILE* results = NULL;
+    if (resultsPath) {
+        results = fopen(resultsPath, "w");
+        if (!results) {
+            fprintf(stderr, "Error opening %s\n", resultsPath);
+            free(suite.starts);
+            free(suite.ends);
+            return 1;
+        }
+        fprintf(results, "{\n  \"version\": 1,\n  \"geodesicKernel\": \"%s\",\n  \"processors\": %d,\n  \"results\": [\n",
+                geodesicKernelName(activeGeodesicKernel()), availableProcessors());
+    }
+
+    printf("%-28s %14s %14s %12s\n", "case", "median ns/op", "min ns/op", "iterations");
+    reportSuiteCase(results, &first, "calculateDistance", suiteDistance, &suite);
+    reportSuiteCase(results, &first, "calculateBearing", suiteBearing, &suite);
+    reportSuiteCase(results, &first, "calculateIntermediatePoint", suiteIntermediatePoint, &suite);
+
+    for (size_t r = 0; r < sizeof(routeSizes) / sizeof(routeSizes[0]); r++) {
+        // Random route of the given size from the scenario generator
+        Scenario scenario;
+        Arena arena;
+        initArena(&arena, ARENA_DEFAULT_BLOCK_SIZE);
+        generateScenarios(&scenario, 1, 0, &arena);
+        scenario.waypointCount = routeSizes[r];
+        scenario.waypoints = (Coordinates*)arenaAlloc(&arena, routeSizes[r] * sizeof(Coordinates));
+        scenario.turnAngles = (double*)arenaAlloc(&arena, routeSizes[r] * sizeof(double));
+        if (!scenario.waypoints || !scenario.turnAngles) {
+            freeArena(&arena);
+            break;
+        }
+        for (int w = 0; w < routeSizes[r]; w++) {
+            scenario.waypoints[w] = randomCoordinates();
+            scenario.turnAngles[w] = randomUniform(-90.0, 90.0);
+        }
+
+        TrajectoryData trajectory = runScenario(&scenario, NULL);
+        suite.trajectory = &trajectory;
+
+        snprintf(name, sizeof(name), "calculateFullTrajectory/%d", routeSizes[r]);
+        reportSuiteCase(results, &first, name, suiteFullTrajectory, &suite);
+        snprintf(name, sizeof(name), "generatePathPoints/%d", routeSizes[r]);
+        reportSuiteCase(results, &first, name, suitePathPoints, &suite);
+        snprintf(name, sizeof(name), "outputTrajectoryJSON/%d", routeSizes[r]);
+        reportSuiteCase(results, &first, name, suiteOutputJSON, &suite);
+
+        freeTrajectory(&trajectory);
+        freeArena(&arena);
+    }
+
+    int status = 0;
+    if (results) {
+        fprintf(results, "\n  ]\n}\n");
+        if (fclose(results) != 0) status = 1;
+    }
+    if (suite.sink == 0.12345) printf("\n"); // Never true; keeps the sink observable
+    free(suite.starts);
+    free(suite.ends);
+    return status;
+}
+
+// Suite results read back from a results file
+typedef struct {
+    char name[64];
+    double median;
+} SuiteResult;
+
+// Read the result lines written by benchSuite; returns the count or -1
+static int readSuiteResults(const char* path, SuiteResult* results, int capacity) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening %s\n", path);
+        return -1;
+    }
+
+    char line[512];
+    int count = 0;
+    while (fgets(line, sizeof(line), file) && count < capacity) {
+        char* name = strstr(line, "\"name\": \"");
+        char* median = strstr(line, "\"median\": ");
+        if (!name || !median) continue;
+
+        name += 9;
+        char* nameEnd = strchr(name, '"');
+        if (!nameEnd || nameEnd - name >= (long)sizeof(results[count].name)) continue;
+        memcpy(results[count].name, name, nameEnd - name);
+        results[count].name[nameEnd - name] = '\0';
+        results[count].median = strtod(median + 10, NULL);
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Compare two suite result files; exits non-zero if any case got slower than
+// the baseline by more than threshold_percent
+static int benchCompare(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "compare needs a baseline and a results file\n");
+        return 2;
+    }
+    double threshold = argc > 2 ? atof(argv[2]) : 10.0;
+
+    SuiteResult baseline[128];
+    SuiteResult current[128];
+    int baselineCount = readSuiteResults(argv[0], baseline, 128);
+    int currentCount = readSuiteResults(argv[1], current, 128);
+    if (baselineCount < 0 || currentCount < 0) return 2;
+
+    int regressions = 0;
+    printf("%-28s %14s %14s %9s  %s\n", "case", "baseline ns", "current ns", "change", "status");
+    for (int c = 0; c < currentCount; c++) {
+        const SuiteResult* reference = NULL;
+        for (int b = 0; b < baselineCount && !reference; b++) {
+            if (strcmp(baseline[b].name, current[c].name) == 0) reference = &baseline[b];
+        }
+
+        if (!reference || reference->median <= 0.0) {
+            printf("%-28s %14s %14.1f %9s  new\n", current[c].name, "-", current[c].median, "-");
+            continue;
+        }
+
+        double change = 100.0 * (current[c].median - reference->median) / reference->median;
+        const char* status = "ok";
+        if (change > threshold) {
+            status = "REGRESSION";
+            regressions++;
+        } else if (change < -threshold) {
+            status = "faster";
+        }
+        printf("%-28s %14.1f %14.1f %+8.1f%%  %s\n", current[c].name, reference->median, current[c].median,
+               change, status);
+    }
+
+    // A case that disappeared (it crashed, or was renamed out of the suite) fails too
+    int missing = 0;
+    for (int b = 0; b < baselineCount; b++) {
+        int found = 0;
+        for (int c = 0; c < currentCount && !found; c++) {
+            found = strcmp(baseline[b].name, current[c].name) == 0;
+        }
+        if (!found) {
+            printf("%-28s %14.1f %14s %9s  MISSING\n", baseline[b].name, baseline[b].median, "-", "-");
+            missing++;
+        }
+    }
+
+    if (regressions > 0) {
+        printf("%d case%s regressed by more than %.1f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    }
+    if (missing > 0) {
+        printf("%d baseline case%s missing from the results\n", missing, missing == 1 ? "" : "s");
+    }
+    return regressions > 0 || missing > 0 ? 1 : 0;
+}
+
+typedef struct {
+    const char* name;
+    const char* usage;
+    int (*run)(int argc, char* argv[]);
+} BenchCommand;
+
+static const BenchCommand benchCommands[] = {
+    { "threads", "threads [max_threads] [scenarios]", benchThreads },
+    { "geodesic", "geodesic [pairs] [rounds]", benchGeodesic },
+    { "trig", "trig [route_points]", benchTrigCache },
+    { "incremental", "incremental [sequences] [edits] [route_waypoints]", benchIncremental },
+    { "memory", "memory [waypoints...]", benchMemory },
+    { "json", "json [waypoints] [rounds]", benchJSON },
+    { "polyline", "polyline [waypoints] [rounds]", benchPolyline },
+    { "paths", "paths [scenarios]", benchPaths },
+    { "sampling", "sampling [routes] [tolerance_km] [altitude_tolerance_m] [max_points]", benchSampling },
+    { "legcache", "legcache [routes] [variants] [waypoints] [cache_entries]", benchLegCache },
+    { "telemetry", "telemetry [waypoints] [queries]", benchTelemetry },
+    { "spline", "spline [waypoints] [rounds] [segments]", benchSpline },
+    { "kernels", "kernels [segments] [route_points] [rounds]", benchKernels },
+    { "sweep", "sweep [waypoints] [values_per_axis] [rounds]", benchSweep },
+    { "pyramid", "pyramid [waypoints] [queries]", benchPyramid },
+    { "parse", "parse [records] [numbers]", benchParse },
+    { "ingest", "ingest [megabytes] [threads] [directory]", benchIngest },
+    { "output", "output [megabytes] [sink_MB_per_s] [threads]", benchOutput },
+    { "server", "server [port|socket_path] [clients] [requests_per_client] [waypoints]", benchServer },
+    { "suite", "suite [results_file]", benchSuite },
+    { "compare", "compare <baseline_file> <results_file> [threshold_percent]", benchCompare },
+};
+
+int main(int argc, char* argv[]) {
+    size_t commandCount = sizeof(benchCommands) / sizeof(benchCommands[0]);
+
+    if (argc >= 2) {
+        for (size_t i = 0; i < commandCount; i++) {
+            if (strcmp(argv[1], benchCommands[i].name) == 0) {
+                return benchCommands[i].run(argc - 2, argv + 2);
+            }
+        }
+    }
+
+    printf("Usage: %s <benchmark> [arguments]\n", argv[0]);
+    for (size_t i = 0; i < commandCount; i++) {
+        printf("  %s\n", benchCommands[i].usage);
+    }
+    return 1;
+}
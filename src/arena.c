@@ -0,0 +1,113 @@
+#include "arena.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// Every allocation is aligned for any object type
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t size;      // Usable bytes in data
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+void initArena(Arena* arena, size_t blockSize) {
+    arena->blocks = NULL;
+    arena->blockSize = blockSize > 0 ? blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->bytesReserved = 0;
+    arena->bytesUsed = 0;
+    arena->blockAllocations = 0;
+}
+
+// Allocate size bytes; the memory lives until the arena is reset or freed
+void* arenaAlloc(Arena* arena, size_t size) {
+    size = ARENA_ALIGN(size > 0 ? size : 1);
+
+    ArenaBlock* block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        // Grow geometrically so large routes need few blocks
+        size_t blockSize = arena->blockSize;
+        if (block && block->size * 2 > blockSize) blockSize = block->size * 2;
+        if (size > blockSize) blockSize = size;
+
+        block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + blockSize);
+        if (!block) {
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        arena->blocks = block;
+        arena->bytesReserved += blockSize;
+        arena->blockAllocations++;
+        STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+        STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, sizeof(ArenaBlock) + blockSize);
+    }
+
+    void* memory = block->data + block->used;
+    block->used += size;
+    arena->bytesUsed += size;
+    return memory;
+}
+
+// Grow an allocation; the most recent allocation is extended in place when the
+// block has room, anything else is copied to a new allocation
+void* arenaResize(Arena* arena, void* memory, size_t oldSize, size_t newSize) {
+    ArenaBlock* block = arena->blocks;
+
+    if (memory && block) {
+        size_t oldAligned = ARENA_ALIGN(oldSize > 0 ? oldSize : 1);
+        size_t newAligned = ARENA_ALIGN(newSize > 0 ? newSize : 1);
+        int isLast = (unsigned char*)memory + oldAligned == block->data + block->used;
+
+        if (isLast && newAligned <= block->size - (block->used - oldAligned)) {
+            block->used = block->used - oldAligned + newAligned;
+            arena->bytesUsed = arena->bytesUsed - oldAligned + newAligned;
+            return memory;
+        }
+    }
+
+    void* resized = arenaAlloc(arena, newSize);
+    if (resized && memory) {
+        memcpy(resized, memory, oldSize < newSize ? oldSize : newSize);
+    }
+    return resized;
+}
+
+// Release every allocation, keeping the newest (largest) block for reuse
+void resetArena(Arena* arena) {
+    ArenaBlock* keep = arena->blocks;
+    if (!keep) {
+        return;
+    }
+
+    ArenaBlock* block = keep->next;
+    while (block) {
+        ArenaBlock* next = block->next;
+        arena->bytesReserved -= block->size;
+        free(block);
+        block = next;
+    }
+
+    keep->next = NULL;
+    keep->used = 0;
+    arena->bytesUsed = 0;
+}
+
+// Release every allocation and all memory held by the arena
+void freeArena(Arena* arena) {
+    ArenaBlock* block = arena->blocks;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+    arena->bytesReserved = 0;
+    arena->bytesUsed = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Default size of the blocks an arena requests from malloc
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+
+// Bump allocator: allocations are released together by resetArena or freeArena
+typedef struct {
+    ArenaBlock* blocks;       // Current block first
+    size_t blockSize;         // Minimum size of new blocks
+    size_t bytesReserved;     // Bytes obtained from malloc and still held
+    size_t bytesUsed;         // Bytes handed out since the last reset
+    long blockAllocations;    // Number of malloc calls made by this arena
+} Arena;
+
+// Function declarations
+void initArena(Arena* arena, size_t blockSize);
+void* arenaAlloc(Arena* arena, size_t size);
+void* arenaResize(Arena* arena, void* memory, size_t oldSize, size_t newSize);
+void resetArena(Arena* arena);
+void freeArena(Arena* arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,518 @@
+#include "batch.h"
+#include "ingest.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// Shared state for one parallel evaluation round
+typedef struct {
+    const Scenario* scenarios;
+    BatchResult* results;
+    long firstIndex;    // Record index of scenarios[0] within the whole run
+    Arena* arenas;      // One scratch arena per worker, reset after every scenario
+} EvaluationRound;
+
+// Current value of the monotonic clock in seconds
+double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+// Peak resident set size of the process so far, in bytes
+static size_t peakResidentBytes(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t)usage.ru_maxrss * 1024;  // Kilobytes on Linux
+}
+
+BatchOptions defaultBatchOptions(void) {
+    BatchOptions options;
+    options.threadCount = 0;
+    options.blockSize = BATCH_BLOCK_SIZE;
+    options.legCacheEntries = 0;
+    options.outputBuffers = PIPELINE_DEFAULT_BUFFERS;
+    return options;
+}
+
+// Where a run's result lines go: a writer on the output file, feeding an
+// output pipeline unless the options ask for synchronous writes
+typedef struct {
+    FILE* file;
+    OutputPipeline* pipeline;
+    Writer writer;
+} BatchOutput;
+
+// Falls back to synchronous writes if the pipeline can't be started
+static int openBatchOutput(BatchOutput* output, FILE* file, const BatchOptions* options) {
+    output->file = file;
+    output->pipeline = options->outputBuffers > 0
+                           ? createOutputPipeline(file, options->outputBuffers, WRITER_DEFAULT_BUFFER)
+                           : NULL;
+    if (output->pipeline) {
+        if (openPipelineWriter(&output->writer, output->pipeline) == 0) {
+            return 0;
+        }
+        destroyOutputPipeline(output->pipeline, NULL);
+        output->pipeline = NULL;
+    }
+    return openWriter(&output->writer, file, WRITER_DEFAULT_BUFFER);
+}
+
+// Make everything written so far reach the file
+static void flushBatchOutput(BatchOutput* output) {
+    flushWriter(&output->writer);
+    if (output->pipeline) {
+        syncOutputPipeline(output->pipeline);
+    } else {
+        fflush(output->file);
+    }
+}
+
+// Write what's left and stop the pipeline; returns -1 if any write failed
+static int closeBatchOutput(BatchOutput* output, BatchStats* stats) {
+    int status = closeWriter(&output->writer);
+    if (output->pipeline) {
+        stats->outputPipelined = 1;
+        if (destroyOutputPipeline(output->pipeline, &stats->output) != 0) status = -1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "Error writing batch output\n");
+    }
+    return status;
+}
+
+// Format one result record as a single line of JSON
+static int formatBatchResult(char* buffer, size_t size, long index, const BatchResult* result) {
+    if (result->status < 0) {
+        if (!result->error) {
+            return snprintf(buffer, size, "{\"index\": %ld, \"error\": \"malformed record\"}\n", index);
+        }
+        return snprintf(buffer, size, "{\"index\": %ld, \"error\": \"malformed record\", \"reason\": \"%s\", \"column\": %ld}\n",
+                        index, result->error, result->errorColumn);
+    }
+
+    return snprintf(buffer, size,
+                    "{\"index\": %ld, \"totalDistance\": %.6f, \"totalTravelTime\": %.6f, "
+                    "\"initialBearing\": %.6f, \"currentSpeed\": %.6f, \"remainingFuel\": %.6f, "
+                    "\"waypointCount\": %d}\n",
+                    index,
+                    result->totalDistance,
+                    result->totalTravelTime,
+                    result->initialBearing,
+                    result->currentSpeed,
+                    result->remainingFuel,
+                    result->waypointCount);
+}
+
+// Evaluate one scenario (when result->status says it parsed) and format
+// record index's result line into its slot
+static void evaluateResult(const Scenario* scenario, BatchResult* result, long index, Arena* arena) {
+    if (result->status > 0) {
+        TrajectoryData trajectory = runScenario(scenario, arena);
+        result->totalDistance = trajectory.totalDistance;
+        result->totalTravelTime = trajectory.totalTravelTime;
+        result->initialBearing = trajectory.initialBearing;
+        result->currentSpeed = trajectory.currentSpeed;
+        result->remainingFuel = trajectory.remainingFuel;
+        result->waypointCount = trajectory.waypointCount;
+        resetArena(arena);
+    }
+
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    int length = formatBatchResult(result->text, sizeof(result->text), index, result);
+    result->length = length < (int)sizeof(result->text) ? length : -1;
+    STATS_END();
+}
+
+// Worker task: evaluate one scenario and format its result line into the record's slot
+static void evaluateScenarioTask(void* context, long index, int worker) {
+    EvaluationRound* round = (EvaluationRound*)context;
+    evaluateResult(&round->scenarios[index], &round->results[index], round->firstIndex + index,
+                   &round->arenas[worker]);
+}
+
+// Evaluate count scenarios on the pool; results[i].status must be set by the caller
+void evaluateScenarios(WorkerPool* pool, const Scenario* scenarios, BatchResult* results, long count, long firstIndex) {
+    int workers = workerPoolSize(pool);
+    EvaluationRound round;
+    round.scenarios = scenarios;
+    round.results = results;
+    round.firstIndex = firstIndex;
+    round.arenas = (Arena*)malloc(workers * sizeof(Arena));
+    if (!round.arenas) {
+        for (long i = 0; i < count; i++) {
+            results[i].status = -1;
+            results[i].length = -1;
+            results[i].error = NULL;
+        }
+        return;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        initArena(&round.arenas[i], ARENA_DEFAULT_BLOCK_SIZE);
+    }
+
+    runParallel(pool, count, evaluateScenarioTask, &round);
+
+    for (int i = 0; i < workers; i++) {
+        freeArena(&round.arenas[i]);
+    }
+    free(round.arenas);
+}
+
+// Write evaluated results in input order
+void writeBatchResults(Writer* writer, const BatchResult* results, long count, long firstIndex) {
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    for (long i = 0; i < count; i++) {
+        if (results[i].length >= 0) {
+            writerPut(writer, results[i].text, results[i].length);
+            continue;
+        }
+
+        // Extreme values overflowed the slot; format this line on the heap instead
+        int length = formatBatchResult(NULL, 0, firstIndex + i, &results[i]);
+        char* line = (char*)malloc(length + 1);
+        if (line) {
+            formatBatchResult(line, length + 1, firstIndex + i, &results[i]);
+            writerPut(writer, line, length);
+            free(line);
+        }
+    }
+    STATS_END();
+}
+
+// Evaluate every scenario record read from input, streaming one result line per record
+int runBatch(FILE* input, FILE* output, const BatchOptions* options, BatchStats* stats) {
+    long blockSize = options->blockSize > 0 ? options->blockSize : BATCH_BLOCK_SIZE;
+    Scenario* scenarios = (Scenario*)malloc(blockSize * sizeof(Scenario));
+    BatchResult* results = (BatchResult*)malloc(blockSize * sizeof(BatchResult));
+    Arena recordArena;
+    WorkerPool* pool = createWorkerPool(options->threadCount);
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    long index = 0;
+    int status = 0;
+    double startTime = monotonicSeconds();
+
+    memset(stats, 0, sizeof(*stats));
+    initArena(&recordArena, ARENA_DEFAULT_BLOCK_SIZE);
+
+    if (!scenarios || !results || !pool) {
+        fprintf(stderr, "Error allocating batch buffers\n");
+        free(scenarios);
+        free(results);
+        freeArena(&recordArena);
+        destroyWorkerPool(pool);
+        return -1;
+    }
+    stats->threadCount = workerPoolSize(pool);
+
+    // Results are written by the output pipeline's thread while the next block is evaluated
+    BatchOutput batchOutput;
+    if (openBatchOutput(&batchOutput, output, options) != 0) {
+        fprintf(stderr, "Error allocating batch buffers\n");
+        free(scenarios);
+        free(results);
+        freeArena(&recordArena);
+        destroyWorkerPool(pool);
+        return -1;
+    }
+
+    // Records that share a route reuse its leg geometry across the whole run
+    LegCache* legCache = createLegCache(options->legCacheEntries);
+    setActiveLegCache(legCache);
+
+    for (;;) {
+        // Read the next block of records; their waypoints live in recordArena
+        long count = 0;
+        resetArena(&recordArena);
+        ssize_t lineLength;
+        while (count < blockSize && (lineLength = getline(&line, &lineCapacity, input)) != -1) {
+            ParseError error;
+            int parsed = parseScenarioSpan(line, (size_t)lineLength, &scenarios[count], &recordArena, &error);
+            if (parsed == 0) {
+                continue; // Blank line or comment
+            }
+
+            results[count].status = parsed;
+            results[count].error = parsed < 0 ? error.message : NULL;
+            results[count].errorColumn = parsed < 0 ? (long)error.offset + 1 : 0;
+            if (parsed > 0) {
+                stats->scenarios++;
+            } else {
+                stats->rejected++;
+            }
+            count++;
+        }
+
+        if (count == 0) {
+            break;
+        }
+
+        evaluateScenarios(pool, scenarios, results, count, index);
+        writeBatchResults(&batchOutput.writer, results, count, index);
+        if (index == 0) {
+            flushBatchOutput(&batchOutput);
+            stats->firstResultSeconds = monotonicSeconds() - startTime;
+        }
+        index += count;
+    }
+
+    if (ferror(input)) {
+        fprintf(stderr, "Error reading batch input\n");
+        status = -1;
+    }
+
+    if (closeBatchOutput(&batchOutput, stats) != 0) {
+        status = -1;
+    }
+
+    free(line);
+    free(scenarios);
+    free(results);
+    freeArena(&recordArena);
+    destroyWorkerPool(pool);
+    stats->elapsedSeconds = monotonicSeconds() - startTime;
+    stats->peakResidentBytes = peakResidentBytes();
+
+    if (legCache) {
+        stats->legCacheEnabled = 1;
+        getLegCacheStats(legCache, &stats->legCache);
+        destroyLegCache(legCache);
+    }
+
+    return status;
+}
+
+// One round of the mapped-file pipeline: the records of one window of chunks
+// are evaluated while the chunks of the next window are parsed. Parse tasks
+// sit stride apart in the index range, so the pool's even split hands each
+// to a different worker first
+typedef struct {
+    ScenarioFile* file;
+    int parseFirst;             // Chunks parsed this round
+    int parseCount;
+    long stride;
+    int windowFirst;            // Chunks evaluated this round
+    int windowCount;
+    const long* windowStart;    // First result slot of each window chunk, windowCount + 1 entries
+    BatchResult* results;
+    long firstIndex;            // Record index of results[0] within the whole run
+    Arena* arenas;              // One scratch arena per worker
+} PipelineRound;
+
+static void pipelineTask(void* context, long index, int worker) {
+    PipelineRound* round = (PipelineRound*)context;
+    long parsesBefore = index / round->stride;
+    if (index % round->stride == 0 && parsesBefore < round->parseCount) {
+        parseScenarioChunk(round->file, round->parseFirst + (int)parsesBefore);
+        return;
+    }
+
+    // Result slot: the index less the parse tasks in front of it
+    long parses = parsesBefore + 1 < round->parseCount ? parsesBefore + 1 : round->parseCount;
+    long slot = index - parses;
+
+    // Window chunk holding the slot
+    int low = 0, high = round->windowCount - 1;
+    while (low < high) {
+        int middle = (low + high + 1) / 2;
+        if (round->windowStart[middle] <= slot) low = middle; else high = middle - 1;
+    }
+    const ScenarioChunk* chunk = &round->file->chunks[round->windowFirst + low];
+
+    Scenario scenario;
+    scenarioFromRecord(&chunk->records[slot - round->windowStart[low]], &scenario);
+    evaluateResult(&scenario, &round->results[slot], round->firstIndex + slot, &round->arenas[worker]);
+}
+
+// Set the status of each window record's result slot from its chunk
+static void prepareWindowResults(const ScenarioFile* file, int windowFirst, int windowCount,
+                                 const long* windowStart, BatchResult* results, BatchStats* stats) {
+    for (int c = 0; c < windowCount; c++) {
+        const ScenarioChunk* chunk = &file->chunks[windowFirst + c];
+        BatchResult* slots = results + windowStart[c];
+        long reject = 0;
+        for (long k = 0; k < chunk->count; k++) {
+            if (chunk->records[k].waypointCount >= 0) {
+                slots[k].status = 1;
+                slots[k].error = NULL;
+                slots[k].errorColumn = 0;
+                stats->scenarios++;
+            } else {
+                slots[k].status = -1;
+                slots[k].error = chunk->rejects[reject].message;
+                slots[k].errorColumn = chunk->rejects[reject].column;
+                reject++;
+                stats->rejected++;
+            }
+        }
+    }
+}
+
+// Evaluate every record of the scenario file at path, streaming one result
+// line per record exactly as runBatch does. A regular file is mapped and
+// parsed in chunks on the worker pool, one window of chunks per round while
+// the window before it is evaluated, and each window is released once its
+// results are written. Anything else (a pipe, a terminal) is read by runBatch
+int runBatchFile(const char* path, FILE* output, const BatchOptions* options, BatchStats* stats) {
+    struct stat info;
+    if (stat(path, &info) == 0 && !S_ISREG(info.st_mode)) {
+        FILE* input = fopen(path, "r");
+        if (!input) {
+            fprintf(stderr, "Error opening batch input file\n");
+            memset(stats, 0, sizeof(*stats));
+            return -1;
+        }
+        int status = runBatch(input, output, options, stats);
+        fclose(input);
+        return status;
+    }
+
+    double startTime = monotonicSeconds();
+    memset(stats, 0, sizeof(*stats));
+
+    ScenarioFile file;
+    char error[256];
+    if (openScenarioFile(path, &file, error, sizeof(error)) != 0) {
+        fprintf(stderr, "Error opening batch input file: %s\n", error);
+        return -1;
+    }
+
+    WorkerPool* pool = createWorkerPool(options->threadCount);
+    int workers = pool ? workerPoolSize(pool) : 1;
+    Arena* arenas = (Arena*)malloc(workers * sizeof(Arena));
+    long* windowStart = (long*)malloc((workers + 1) * sizeof(long));
+    BatchOutput batchOutput;
+    if (!pool || !arenas || !windowStart || openBatchOutput(&batchOutput, output, options) != 0) {
+        fprintf(stderr, "Error allocating batch buffers\n");
+        free(arenas);
+        free(windowStart);
+        destroyWorkerPool(pool);
+        closeScenarioFile(&file);
+        return -1;
+    }
+    for (int i = 0; i < workers; i++) {
+        initArena(&arenas[i], ARENA_DEFAULT_BLOCK_SIZE);
+    }
+    stats->threadCount = workers;
+
+    // Records that share a route reuse its leg geometry across the whole run
+    LegCache* legCache = createLegCache(options->legCacheEntries);
+    setActiveLegCache(legCache);
+
+    BatchResult* results = NULL;
+    long resultCapacity = 0;
+    long index = 0;
+    int status = 0;
+    int windowFirst = 0, windowCount = 0;
+    for (;;) {
+        // The window was parsed last round; the next one is parsed alongside it
+        long records = 0;
+        for (int c = 0; c < windowCount; c++) {
+            windowStart[c] = records;
+            records += file.chunks[windowFirst + c].count;
+        }
+        windowStart[windowCount] = records;
+        int parseFirst = windowFirst + windowCount;
+        int parseCount = planScenarioChunks(&file, workers);
+        if (records == 0 && parseCount == 0) {
+            break;
+        }
+
+        if (records > resultCapacity) {
+            BatchResult* grown = (BatchResult*)realloc(results, records * sizeof(BatchResult));
+            if (!grown) {
+                fprintf(stderr, "Error allocating batch buffers\n");
+                status = -1;
+                break;
+            }
+            results = grown;
+            resultCapacity = records;
+        }
+        prepareWindowResults(&file, windowFirst, windowCount, windowStart, results, stats);
+
+        PipelineRound round;
+        round.file = &file;
+        round.parseFirst = parseFirst;
+        round.parseCount = parseCount;
+        round.stride = parseCount > 0 ? (records + parseCount) / parseCount : records + 1;
+        round.windowFirst = windowFirst;
+        round.windowCount = windowCount;
+        round.windowStart = windowStart;
+        round.results = results;
+        round.firstIndex = index;
+        round.arenas = arenas;
+        runParallel(pool, records + parseCount, pipelineTask, &round);
+
+        writeBatchResults(&batchOutput.writer, results, records, index);
+        if (records > 0 && index == 0) {
+            flushBatchOutput(&batchOutput);
+            stats->firstResultSeconds = monotonicSeconds() - startTime;
+        }
+        index += records;
+
+        for (int c = parseFirst; c < parseFirst + parseCount; c++) {
+            if (file.chunks[c].parsed < 0) {
+                fprintf(stderr, "Error allocating the scenario table\n");
+                status = -1;
+            }
+        }
+        if (status != 0) {
+            break;
+        }
+        releaseScenarioChunks(&file, parseFirst);
+        windowFirst = parseFirst;
+        windowCount = parseCount;
+    }
+
+    if (closeBatchOutput(&batchOutput, stats) != 0) {
+        status = -1;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        freeArena(&arenas[i]);
+    }
+    free(arenas);
+    free(windowStart);
+    free(results);
+    destroyWorkerPool(pool);
+    closeScenarioFile(&file);
+    stats->elapsedSeconds = monotonicSeconds() - startTime;
+    stats->peakResidentBytes = peakResidentBytes();
+
+    if (legCache) {
+        stats->legCacheEnabled = 1;
+        getLegCacheStats(legCache, &stats->legCache);
+        destroyLegCache(legCache);
+    }
+
+    return status;
+}
+
+// Print the batch summary including throughput
+void printBatchSummary(FILE* stream, const BatchStats* stats) {
+    double throughput = stats->elapsedSeconds > 0.0 ? stats->scenarios / stats->elapsedSeconds : 0.0;
+
+    fprintf(stream, "Batch scenarios: %ld\n", stats->scenarios);
+    fprintf(stream, "Rejected records: %ld\n", stats->rejected);
+    fprintf(stream, "Worker threads: %d\n", stats->threadCount);
+    fprintf(stream, "Elapsed time: %.3f seconds\n", stats->elapsedSeconds);
+    fprintf(stream, "Throughput: %.0f scenarios/second\n", throughput);
+    fprintf(stream, "Time to first result: %.3f seconds\n", stats->firstResultSeconds);
+    fprintf(stream, "Peak RSS: %.1f MB\n", stats->peakResidentBytes / 1e6);
+    if (stats->legCacheEnabled) {
+        fprintf(stream, "Leg cache: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %ld of %ld entries\n",
+                stats->legCache.hits, stats->legCache.misses, legCacheHitRate(&stats->legCache) * 100.0,
+                stats->legCache.evictions, stats->legCache.entries, stats->legCache.capacity);
+    }
+    if (stats->outputPipelined) {
+        fprintf(stream, "Output pipeline: %llu buffers, %.1f MB written in %.3f seconds, %llu stalls (%.3f seconds waiting)\n",
+                stats->output.buffersWritten, stats->output.bytesWritten / 1e6, stats->output.writeSeconds,
+                stats->output.stalls, stats->output.stallSeconds);
+    }
+}
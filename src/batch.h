@@ -0,0 +1,64 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "trajectory.h"
+#include "scenario.h"
+#include "parallel.h"
+#include "legcache.h"
+#include "writer.h"
+#include "pipeline.h"
+
+// Size of the per-record text slot a worker formats its result line into
+#define BATCH_RESULT_TEXT 384
+
+// Default number of records read and evaluated together
+#define BATCH_BLOCK_SIZE 8192
+
+// Structure to hold batch mode settings
+typedef struct {
+    int threadCount;    // Worker threads, 0 selects one per processor
+    long blockSize;     // Records evaluated per parallel round
+    long legCacheEntries;   // Size of the shared leg cache, 0 to compute every leg
+    int outputBuffers;      // Buffers of the output pipeline, 0 to write on the calling thread
+} BatchOptions;
+
+// Structure to hold the result of one batch record
+typedef struct {
+    int status;                 // 1 evaluated, -1 malformed record
+    int length;                 // Length of text, -1 if the line did not fit
+    double totalDistance;
+    double totalTravelTime;
+    double initialBearing;
+    double currentSpeed;
+    double remainingFuel;
+    int waypointCount;
+    const char* error;          // Why a malformed record was rejected
+    long errorColumn;           // 1-based column of the first invalid byte
+    char text[BATCH_RESULT_TEXT];
+} BatchResult;
+
+// Structure to hold the outcome of a batch run
+typedef struct {
+    long scenarios;         // Records evaluated
+    long rejected;          // Malformed records
+    int threadCount;        // Worker threads used
+    double elapsedSeconds;  // Wall clock time for the whole run
+    double firstResultSeconds;  // Wall clock time until the first results were written
+    size_t peakResidentBytes;   // Peak resident set size of the process
+    int legCacheEnabled;
+    LegCacheStats legCache; // Leg cache effectiveness when enabled
+    int outputPipelined;
+    OutputPipelineStats output; // Output pipeline behaviour when used
+} BatchStats;
+
+// Function declarations
+BatchOptions defaultBatchOptions(void);
+int runBatch(FILE* input, FILE* output, const BatchOptions* options, BatchStats* stats);
+int runBatchFile(const char* path, FILE* output, const BatchOptions* options, BatchStats* stats);
+void evaluateScenarios(WorkerPool* pool, const Scenario* scenarios, BatchResult* results, long count, long firstIndex);
+void writeBatchResults(Writer* writer, const BatchResult* results, long count, long firstIndex);
+void printBatchSummary(FILE* stream, const BatchStats* stats);
+double monotonicSeconds(void);
+
+#endif /* BATCH_H */
@@ -0,0 +1,415 @@
+#include "columnar.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Doubles staged per write when gathering a column out of an array of structs
+#define COLUMNAR_CHUNK 512
+
+_Static_assert(sizeof(ColumnarHeader) == 256, "ColumnarHeader must be 256 bytes");
+_Static_assert(sizeof(ColumnarColumn) == 64, "ColumnarColumn must be 64 bytes");
+_Static_assert(sizeof(Coordinates) == 3 * sizeof(double), "Coordinates must be three packed doubles");
+
+static const char* const columnNames[COLUMNAR_COLUMN_COUNT] = {
+    "path.latitude",
+    "path.longitude",
+    "path.altitude",
+    "waypoint.latitude",
+    "waypoint.longitude",
+    "waypoint.altitude",
+    "waypoint.turnAngle",
+    "waypoint.approachSpeed",
+    "waypoint.departureSpeed",
+    "waypoint.timeToReach",
+    "waypoint.distanceFromPrevious",
+    "waypoint.bearingFromPrevious",
+    "waypoint.fuelConsumed",
+    "waypoint.gForce",
+};
+
+static const uint8_t zeroPadding[COLUMNAR_ALIGNMENT];
+
+const char* columnarColumnName(ColumnarColumnId column) {
+    return column >= 0 && column < COLUMNAR_COLUMN_COUNT ? columnNames[column] : "unknown";
+}
+
+static int hostIsBigEndian(void) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static uint64_t swapBytes64(uint64_t value) {
+    return __builtin_bswap64(value);
+}
+
+// Reverse the byte order of count 4- or 8-byte words in place
+static void swapWords(void* data, size_t count, size_t width) {
+    if (width == 8) {
+        uint64_t* words = (uint64_t*)data;
+        for (size_t i = 0; i < count; i++) words[i] = swapBytes64(words[i]);
+    } else {
+        uint32_t* words = (uint32_t*)data;
+        for (size_t i = 0; i < count; i++) words[i] = __builtin_bswap32(words[i]);
+    }
+}
+
+static size_t alignOffset(size_t offset) {
+    return (offset + COLUMNAR_ALIGNMENT - 1) & ~(size_t)(COLUMNAR_ALIGNMENT - 1);
+}
+
+// Write count doubles found every stride bytes starting at base, little-endian
+static void writeColumn(Writer* writer, const void* base, size_t stride, size_t count) {
+    double chunk[COLUMNAR_CHUNK];
+    const char* source = (const char*)base;
+
+    for (size_t i = 0; i < count; i += COLUMNAR_CHUNK) {
+        size_t length = count - i < COLUMNAR_CHUNK ? count - i : COLUMNAR_CHUNK;
+        for (size_t j = 0; j < length; j++) {
+            memcpy(&chunk[j], source + (i + j) * stride, sizeof(double));
+        }
+        if (hostIsBigEndian()) swapWords(chunk, length, sizeof(double));
+        writerPut(writer, (const char*)chunk, length * sizeof(double));
+    }
+}
+
+// Stream a columnar file for trajectory and its path points to writer
+int writeTrajectoryColumnar(Writer* writer, const TrajectoryData* trajectory,
+                            const Coordinates* pathPoints, int pathPointCount) {
+    ColumnarHeader header;
+    ColumnarColumn directory[COLUMNAR_COLUMN_COUNT];
+    size_t waypointCount = trajectory->waypointCount;
+    size_t pathCount = pathPoints && pathPointCount > 0 ? (size_t)pathPointCount : 0;
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+    header.version = COLUMNAR_VERSION;
+    header.columnCount = COLUMNAR_COLUMN_COUNT;
+    header.directoryOffset = sizeof(ColumnarHeader);
+    header.pathPointCount = pathCount;
+    header.waypointCount = waypointCount;
+    header.totalDistance = trajectory->totalDistance;
+    header.totalTravelTime = trajectory->totalTravelTime;
+    header.initialBearing = trajectory->initialBearing;
+    header.currentSpeed = trajectory->currentSpeed;
+    header.remainingFuel = trajectory->remainingFuel;
+    header.start = trajectory->start;
+    header.end = trajectory->end;
+    header.weight = trajectory->missile.weight;
+    header.speed = trajectory->missile.speed;
+    header.fuel = trajectory->missile.fuel;
+    header.burnRate = trajectory->missile.burnRate;
+    header.thrust = trajectory->missile.thrust;
+    header.maxAcceleration = trajectory->missile.maxAcceleration;
+    header.maxDeceleration = trajectory->missile.maxDeceleration;
+    header.maxTurnRate = trajectory->missile.maxTurnRate;
+    header.dragCoefficient = trajectory->missile.dragCoefficient;
+
+    // Lay the columns out back to back, each on an aligned boundary
+    size_t offset = alignOffset(header.directoryOffset + sizeof(directory));
+    memset(directory, 0, sizeof(directory));
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        size_t count = column <= COLUMN_PATH_ALTITUDE ? pathCount : waypointCount;
+        strncpy(directory[column].name, columnNames[column], COLUMNAR_NAME_LENGTH - 1);
+        directory[column].type = COLUMNAR_TYPE_FLOAT64;
+        directory[column].width = sizeof(double);
+        directory[column].offset = offset;
+        directory[column].count = count;
+        offset = alignOffset(offset + count * sizeof(double));
+    }
+    header.fileSize = offset;
+
+    if (hostIsBigEndian()) {
+        swapWords(&header.version, 2, sizeof(uint32_t));
+        swapWords(&header.fileSize, (sizeof(header) - offsetof(ColumnarHeader, fileSize) - sizeof(header.padding)) / 8, 8);
+        for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+            swapWords(&directory[column].type, 2, sizeof(uint32_t));
+            swapWords(&directory[column].offset, 2, sizeof(uint64_t));
+        }
+    }
+
+    writerPut(writer, (const char*)&header, sizeof(header));
+    writerPut(writer, (const char*)directory, sizeof(directory));
+    size_t written = sizeof(header) + sizeof(directory);
+
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        size_t start = hostIsBigEndian() ? swapBytes64(directory[column].offset) : directory[column].offset;
+        writerPut(writer, (const char*)zeroPadding, start - written);
+        written = start;
+
+        // An empty column has no data, and its source array may be NULL
+        size_t count = column <= COLUMN_PATH_ALTITUDE ? pathCount : waypointCount;
+        if (count == 0) continue;
+
+        const Waypoint* waypoints = trajectory->waypoints;
+        switch (column) {
+            case COLUMN_PATH_LATITUDE:
+                writeColumn(writer, &pathPoints[0].latitude, sizeof(Coordinates), pathCount);
+                break;
+            case COLUMN_PATH_LONGITUDE:
+                writeColumn(writer, &pathPoints[0].longitude, sizeof(Coordinates), pathCount);
+                break;
+            case COLUMN_PATH_ALTITUDE:
+                writeColumn(writer, &pathPoints[0].altitude, sizeof(Coordinates), pathCount);
+                break;
+            case COLUMN_WAYPOINT_LATITUDE:
+                writeColumn(writer, &waypoints[0].position.latitude, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_LONGITUDE:
+                writeColumn(writer, &waypoints[0].position.longitude, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_ALTITUDE:
+                writeColumn(writer, &waypoints[0].position.altitude, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_TURN_ANGLE:
+                writeColumn(writer, &waypoints[0].turnAngle, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_APPROACH_SPEED:
+                writeColumn(writer, &waypoints[0].approachSpeed, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_DEPARTURE_SPEED:
+                writeColumn(writer, &waypoints[0].departureSpeed, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_TIME_TO_REACH:
+                writeColumn(writer, &waypoints[0].timeToReach, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_DISTANCE_FROM_PREVIOUS:
+                writeColumn(writer, &waypoints[0].distanceFromPrevious, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_BEARING_FROM_PREVIOUS:
+                writeColumn(writer, &waypoints[0].bearingFromPrevious, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_FUEL_CONSUMED:
+                writeColumn(writer, &waypoints[0].fuelConsumed, sizeof(Waypoint), waypointCount);
+                break;
+            case COLUMN_WAYPOINT_G_FORCE:
+                writeColumn(writer, &waypoints[0].gForce, sizeof(Waypoint), waypointCount);
+                break;
+        }
+        written += count * sizeof(double);
+    }
+
+    size_t fileSize = hostIsBigEndian() ? swapBytes64(header.fileSize) : header.fileSize;
+    writerPut(writer, (const char*)zeroPadding, fileSize - written);
+    STATS_END();
+    return writer->error ? -1 : 0;
+}
+
+// Write trajectory and its sampled path to outputFile; returns 0 on success
+int saveTrajectoryColumnar(TrajectoryData* trajectory, const char* outputFile, const SamplingOptions* sampling) {
+    FILE* file = fopen(outputFile, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening output file\n");
+        return -1;
+    }
+
+    Writer writer;
+    if (openWriter(&writer, file, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error allocating output buffer\n");
+        fclose(file);
+        return -1;
+    }
+
+    int pathPointCount = 0;
+    Coordinates* pathPoints = samplePathPoints(trajectory, sampling, &pathPointCount);
+    writeTrajectoryColumnar(&writer, trajectory, pathPoints, pathPointCount);
+    free(pathPoints);
+
+    int status = closeWriter(&writer);
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) {
+        fprintf(stderr, "Error writing output file\n");
+    }
+    return status;
+}
+
+// Check the header and directory of a mapped file and point the columns at its data
+static int bindColumnarFile(ColumnarFile* file, const ColumnarHeader* header, const ColumnarColumn* directory,
+                            const char* base, size_t size, char* error, size_t errorSize) {
+    if (header->version == 0 || header->version > COLUMNAR_VERSION) {
+        snprintf(error, errorSize, "unsupported schema version %u", header->version);
+        return -1;
+    }
+    if (header->fileSize != size) {
+        snprintf(error, errorSize, "file is %zu bytes, header says %llu", size,
+                 (unsigned long long)header->fileSize);
+        return -1;
+    }
+    if (header->columnCount < COLUMNAR_COLUMN_COUNT || header->directoryOffset > size ||
+        header->directoryOffset % sizeof(uint64_t) != 0 ||
+        header->columnCount > (size - header->directoryOffset) / sizeof(ColumnarColumn)) {
+        snprintf(error, errorSize, "column directory is truncated");
+        return -1;
+    }
+
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        const ColumnarColumn* entry = &directory[column];
+        uint64_t expected = column <= COLUMN_PATH_ALTITUDE ? header->pathPointCount : header->waypointCount;
+
+        if (strncmp(entry->name, columnNames[column], COLUMNAR_NAME_LENGTH) != 0 ||
+            entry->type != COLUMNAR_TYPE_FLOAT64 || entry->width != sizeof(double) || entry->count != expected) {
+            snprintf(error, errorSize, "column %d is not %s", column, columnNames[column]);
+            return -1;
+        }
+        if (entry->offset % sizeof(double) != 0 || entry->offset > size ||
+            entry->count > (size - entry->offset) / sizeof(double)) {
+            snprintf(error, errorSize, "column %s lies outside the file", columnNames[column]);
+            return -1;
+        }
+        file->columns[column] = (const double*)(base + entry->offset);
+    }
+
+    file->pathPointCount = header->pathPointCount;
+    file->waypointCount = header->waypointCount;
+    return 0;
+}
+
+// Map a columnar file for reading. Returns 0 on success; otherwise -1 with
+// a message in error
+int openColumnarFile(const char* path, ColumnarFile* file, char* error, size_t errorSize) {
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(error, errorSize, "cannot open %s", path);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(ColumnarHeader)) {
+        snprintf(error, errorSize, "%s is too small to be a trajectory file", path);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = (size_t)info.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        snprintf(error, errorSize, "cannot map %s", path);
+        return -1;
+    }
+    file->mapping = mapping;
+    file->mappingSize = size;
+
+    if (memcmp(mapping, COLUMNAR_MAGIC, 8) != 0) {
+        snprintf(error, errorSize, "%s is not a trajectory file", path);
+        closeColumnarFile(file);
+        return -1;
+    }
+
+    const char* base = (const char*)mapping;
+    if (!hostIsBigEndian()) {
+        // Read in place
+        const ColumnarHeader* header = (const ColumnarHeader*)base;
+        file->header = header;
+        file->directory = (const ColumnarColumn*)(base + (header->directoryOffset <= size ? header->directoryOffset : 0));
+        if (bindColumnarFile(file, header, file->directory, base, size, error, errorSize) != 0) {
+            closeColumnarFile(file);
+            return -1;
+        }
+        return 0;
+    }
+
+    // Big-endian host: decode a private copy of the whole file
+    file->swapped = (double*)malloc(alignOffset(size));
+    if (!file->swapped) {
+        snprintf(error, errorSize, "out of memory");
+        closeColumnarFile(file);
+        return -1;
+    }
+    memcpy(file->swapped, base, size);
+    ColumnarHeader* header = (ColumnarHeader*)file->swapped;
+    swapWords(&header->version, 2, sizeof(uint32_t));
+    swapWords(&header->fileSize, (sizeof(*header) - offsetof(ColumnarHeader, fileSize) - sizeof(header->padding)) / 8, 8);
+    if (header->directoryOffset > size ||
+        (size - header->directoryOffset) / sizeof(ColumnarColumn) < COLUMNAR_COLUMN_COUNT) {
+        snprintf(error, errorSize, "column directory is truncated");
+        closeColumnarFile(file);
+        return -1;
+    }
+
+    ColumnarColumn* directory = (ColumnarColumn*)((char*)file->swapped + header->directoryOffset);
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        swapWords(&directory[column].type, 2, sizeof(uint32_t));
+        swapWords(&directory[column].offset, 2, sizeof(uint64_t));
+    }
+    file->header = header;
+    file->directory = directory;
+    if (bindColumnarFile(file, header, directory, (const char*)file->swapped, size, error, errorSize) != 0) {
+        closeColumnarFile(file);
+        return -1;
+    }
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        swapWords((void*)file->columns[column], directory[column].count, sizeof(double));
+    }
+    return 0;
+}
+
+void closeColumnarFile(ColumnarFile* file) {
+    if (file->mapping) {
+        munmap(file->mapping, file->mappingSize);
+    }
+    free(file->swapped);
+    memset(file, 0, sizeof(*file));
+}
+
+// Rebuild the trajectory summary and waypoints (file->waypointCount entries) from a file
+void columnarTrajectory(const ColumnarFile* file, TrajectoryData* trajectory, Waypoint* waypoints) {
+    const ColumnarHeader* header = file->header;
+
+    memset(trajectory, 0, sizeof(*trajectory));
+    trajectory->start = header->start;
+    trajectory->end = header->end;
+    trajectory->missile.weight = header->weight;
+    trajectory->missile.speed = header->speed;
+    trajectory->missile.fuel = header->fuel;
+    trajectory->missile.burnRate = header->burnRate;
+    trajectory->missile.thrust = header->thrust;
+    trajectory->missile.maxAcceleration = header->maxAcceleration;
+    trajectory->missile.maxDeceleration = header->maxDeceleration;
+    trajectory->missile.maxTurnRate = header->maxTurnRate;
+    trajectory->missile.dragCoefficient = header->dragCoefficient;
+    trajectory->totalDistance = header->totalDistance;
+    trajectory->totalTravelTime = header->totalTravelTime;
+    trajectory->initialBearing = header->initialBearing;
+    trajectory->currentSpeed = header->currentSpeed;
+    trajectory->remainingFuel = header->remainingFuel;
+    trajectory->waypointCount = (int)file->waypointCount;
+    trajectory->waypointCapacity = (int)file->waypointCount;
+    trajectory->waypoints = waypoints;
+    trajectory->dirtyFrom = TRAJECTORY_CLEAN;
+
+    for (size_t i = 0; i < file->waypointCount; i++) {
+        Waypoint* waypoint = &waypoints[i];
+        memset(waypoint, 0, sizeof(*waypoint));
+        waypoint->position.latitude = file->columns[COLUMN_WAYPOINT_LATITUDE][i];
+        waypoint->position.longitude = file->columns[COLUMN_WAYPOINT_LONGITUDE][i];
+        waypoint->position.altitude = file->columns[COLUMN_WAYPOINT_ALTITUDE][i];
+        waypoint->turnAngle = file->columns[COLUMN_WAYPOINT_TURN_ANGLE][i];
+        waypoint->approachSpeed = file->columns[COLUMN_WAYPOINT_APPROACH_SPEED][i];
+        waypoint->departureSpeed = file->columns[COLUMN_WAYPOINT_DEPARTURE_SPEED][i];
+        waypoint->timeToReach = file->columns[COLUMN_WAYPOINT_TIME_TO_REACH][i];
+        waypoint->distanceFromPrevious = file->columns[COLUMN_WAYPOINT_DISTANCE_FROM_PREVIOUS][i];
+        waypoint->bearingFromPrevious = file->columns[COLUMN_WAYPOINT_BEARING_FROM_PREVIOUS][i];
+        waypoint->fuelConsumed = file->columns[COLUMN_WAYPOINT_FUEL_CONSUMED][i];
+        waypoint->gForce = file->columns[COLUMN_WAYPOINT_G_FORCE][i];
+    }
+}
+
+// Gather the path columns back into file->pathPointCount coordinates
+void columnarPathPoints(const ColumnarFile* file, Coordinates* pathPoints) {
+    for (size_t i = 0; i < file->pathPointCount; i++) {
+        pathPoints[i].latitude = file->columns[COLUMN_PATH_LATITUDE][i];
+        pathPoints[i].longitude = file->columns[COLUMN_PATH_LONGITUDE][i];
+        pathPoints[i].altitude = file->columns[COLUMN_PATH_ALTITUDE][i];
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "trajectory.h"
+#include "writer.h"
+#include "sampling.h"
+
+// Binary columnar trajectory file (.trjc)
+//
+// Layout, all integers and doubles little-endian:
+//   ColumnarHeader       256 bytes: magic, schema version, counts and the
+//                        trajectory scalars (totals, start, end, missile)
+//   ColumnarColumn[n]    column directory, 64 bytes per column
+//   column data          one float64 array per column, each starting on a
+//                        COLUMNAR_ALIGNMENT boundary
+// Columns are listed in ColumnarColumnId order: the sampled path point
+// coordinates, then the per-waypoint position and metrics.
+// On little-endian hosts a mapped file can be read in place.
+
+#define COLUMNAR_MAGIC "TRJCOL\r\n"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_ALIGNMENT 64
+#define COLUMNAR_NAME_LENGTH 40
+
+// Element types
+#define COLUMNAR_TYPE_FLOAT64 1
+
+typedef enum {
+    COLUMN_PATH_LATITUDE = 0,
+    COLUMN_PATH_LONGITUDE,
+    COLUMN_PATH_ALTITUDE,
+    COLUMN_WAYPOINT_LATITUDE,
+    COLUMN_WAYPOINT_LONGITUDE,
+    COLUMN_WAYPOINT_ALTITUDE,
+    COLUMN_WAYPOINT_TURN_ANGLE,
+    COLUMN_WAYPOINT_APPROACH_SPEED,
+    COLUMN_WAYPOINT_DEPARTURE_SPEED,
+    COLUMN_WAYPOINT_TIME_TO_REACH,
+    COLUMN_WAYPOINT_DISTANCE_FROM_PREVIOUS,
+    COLUMN_WAYPOINT_BEARING_FROM_PREVIOUS,
+    COLUMN_WAYPOINT_FUEL_CONSUMED,
+    COLUMN_WAYPOINT_G_FORCE,
+    COLUMNAR_COLUMN_COUNT
+} ColumnarColumnId;
+
+// File header (fixed 256 bytes)
+typedef struct {
+    char magic[8];              // COLUMNAR_MAGIC
+    uint32_t version;           // COLUMNAR_VERSION; readers reject newer files
+    uint32_t columnCount;       // Entries in the column directory
+    uint64_t fileSize;          // Total bytes, for truncation checks
+    uint64_t directoryOffset;   // Offset of the first ColumnarColumn
+    uint64_t pathPointCount;
+    uint64_t waypointCount;
+    uint64_t reserved;
+    double totalDistance;
+    double totalTravelTime;
+    double initialBearing;
+    double currentSpeed;
+    double remainingFuel;
+    Coordinates start;
+    Coordinates end;
+    double weight;
+    double speed;
+    double fuel;
+    double burnRate;
+    double thrust;
+    double maxAcceleration;
+    double maxDeceleration;
+    double maxTurnRate;
+    double dragCoefficient;
+    uint8_t padding[40];
+} ColumnarHeader;
+
+// Column directory entry (fixed 64 bytes)
+typedef struct {
+    char name[COLUMNAR_NAME_LENGTH];    // e.g. "path.latitude", NUL padded
+    uint32_t type;                      // COLUMNAR_TYPE_FLOAT64
+    uint32_t width;                     // Bytes per element
+    uint64_t offset;                    // From the start of the file
+    uint64_t count;                     // Elements
+} ColumnarColumn;
+
+// A mapped columnar file
+typedef struct {
+    const ColumnarHeader* header;
+    const ColumnarColumn* directory;
+    const double* columns[COLUMNAR_COLUMN_COUNT];
+    size_t pathPointCount;
+    size_t waypointCount;
+    void* mapping;
+    size_t mappingSize;
+    double* swapped;            // Byte-swapped copy on big-endian hosts
+} ColumnarFile;
+
+// Function declarations
+const char* columnarColumnName(ColumnarColumnId column);
+int writeTrajectoryColumnar(Writer* writer, const TrajectoryData* trajectory,
+                            const Coordinates* pathPoints, int pathPointCount);
+int saveTrajectoryColumnar(TrajectoryData* trajectory, const char* outputFile, const SamplingOptions* sampling);
+int openColumnarFile(const char* path, ColumnarFile* file, char* error, size_t errorSize);
+void closeColumnarFile(ColumnarFile* file);
+void columnarTrajectory(const ColumnarFile* file, TrajectoryData* trajectory, Waypoint* waypoints);
+void columnarPathPoints(const ColumnarFile* file, Coordinates* pathPoints);
+
+#endif /* COLUMNAR_H */
@@ -0,0 +1,252 @@
+#include "geodesic.h"
+#include "trajectory.h"
+#include <stdatomic.h>
+
+// Reduction and polynomial constants shared by the vector kernels (Cephes)
+#define TWO_OVER_PI 6.36619772367581382433E-1
+#define PIO2_PART1 1.57079625129699707031E0
+#define PIO2_PART2 7.54978941586159635335E-8
+#define PIO2_PART3 5.39030285815811905290E-15
+#define PI_OVER_2 1.57079632679489661923
+#define PI_OVER_4 7.85398163397448309616E-1
+#define PI_LOW 6.123233995736765886130E-17
+
+#define SIN_COEF0 1.58962301576546568060E-10
+#define SIN_COEF1 -2.50507477628578072866E-8
+#define SIN_COEF2 2.75573136213857245213E-6
+#define SIN_COEF3 -1.98412698295895385996E-4
+#define SIN_COEF4 8.33333333332211858878E-3
+#define SIN_COEF5 -1.66666666666666307295E-1
+
+#define COS_COEF0 -1.13585365213876817300E-11
+#define COS_COEF1 2.08757008419747316778E-9
+#define COS_COEF2 -2.75573141792967388112E-7
+#define COS_COEF3 2.48015872888517045348E-5
+#define COS_COEF4 -1.38888888888730564116E-3
+#define COS_COEF5 4.16666666666665929218E-2
+
+#define ATAN_P0 -8.750608600031904122785E-1
+#define ATAN_P1 -1.615753718733365076637E1
+#define ATAN_P2 -7.500855792314704667340E1
+#define ATAN_P3 -1.228866684490136173410E2
+#define ATAN_P4 -6.485021904942025371773E1
+#define ATAN_Q0 2.485846490142306297962E1
+#define ATAN_Q1 1.650270098316988542046E2
+#define ATAN_Q2 4.328810604912902668951E2
+#define ATAN_Q3 4.853903996359136964868E2
+#define ATAN_Q4 1.945506571482613964425E2
+
+typedef void (*GeodesicLegKernel)(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                                  double* distances, double* bearings, size_t count);
+
+// Scalar fallback: the reference functions from trajectory.c
+static void geodesicLegsScalar(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                               double* distances, double* bearings, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        Coordinates start = { lat1[i], lon1[i], 0.0 };
+        Coordinates end = { lat2[i], lon2[i], 0.0 };
+        if (distances) distances[i] = calculateDistance(start, end);
+        if (bearings) bearings[i] = calculateBearing(start, end);
+    }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define GEODESIC_HAVE_X86 1
+#include <immintrin.h>
+
+// AVX2: four doubles per vector, masks are full-width vectors
+#define VD __m256d
+#define VM __m256d
+#define VWIDTH 4
+#define V_SUFFIX Avx2
+#define V_TARGET __attribute__((target("avx2,fma")))
+#define VLOAD(p) _mm256_loadu_pd(p)
+#define VSTORE(p, v) _mm256_storeu_pd((p), (v))
+#define VSET1(x) _mm256_set1_pd(x)
+#define VADD(a, b) _mm256_add_pd((a), (b))
+#define VSUB(a, b) _mm256_sub_pd((a), (b))
+#define VMUL(a, b) _mm256_mul_pd((a), (b))
+#define VDIV(a, b) _mm256_div_pd((a), (b))
+#define VSQRT(a) _mm256_sqrt_pd(a)
+#define VMIN(a, b) _mm256_min_pd((a), (b))
+#define VMAX(a, b) _mm256_max_pd((a), (b))
+#define VABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), (a))
+#define VROUND(a) _mm256_round_pd((a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VFLOOR(a) _mm256_floor_pd(a)
+#define VXOR(a, b) _mm256_xor_pd((a), (b))
+#define VSIGN(a) _mm256_and_pd((a), _mm256_set1_pd(-0.0))
+#define VSELECT(m, a, b) _mm256_blendv_pd((b), (a), (m))
+#define VCMPLT(a, b) _mm256_cmp_pd((a), (b), _CMP_LT_OQ)
+#define VCMPGT(a, b) _mm256_cmp_pd((a), (b), _CMP_GT_OQ)
+#define VCMPGE(a, b) _mm256_cmp_pd((a), (b), _CMP_GE_OQ)
+#define VCMPEQ(a, b) _mm256_cmp_pd((a), (b), _CMP_EQ_OQ)
+#define VOR_MASK(a, b) _mm256_or_pd((a), (b))
+#define VSIGNBIT(a) _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_setzero_si256(), _mm256_castpd_si256(a)))
+#include "geodesic_simd.h"
+#undef VD
+#undef VM
+#undef VWIDTH
+#undef V_SUFFIX
+#undef V_TARGET
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VROUND
+#undef VFLOOR
+#undef VXOR
+#undef VSIGN
+#undef VSELECT
+#undef VCMPLT
+#undef VCMPGT
+#undef VCMPGE
+#undef VCMPEQ
+#undef VOR_MASK
+#undef VSIGNBIT
+
+// AVX-512F: eight doubles per vector, masks are k-registers
+#define VD __m512d
+#define VM __mmask8
+#define VWIDTH 8
+#define V_SUFFIX Avx512
+#define V_TARGET __attribute__((target("avx512f")))
+#define VLOAD(p) _mm512_loadu_pd(p)
+#define VSTORE(p, v) _mm512_storeu_pd((p), (v))
+#define VSET1(x) _mm512_set1_pd(x)
+#define VADD(a, b) _mm512_add_pd((a), (b))
+#define VSUB(a, b) _mm512_sub_pd((a), (b))
+#define VMUL(a, b) _mm512_mul_pd((a), (b))
+#define VDIV(a, b) _mm512_div_pd((a), (b))
+#define VSQRT(a) _mm512_sqrt_pd(a)
+#define VMIN(a, b) _mm512_min_pd((a), (b))
+#define VMAX(a, b) _mm512_max_pd((a), (b))
+#define VABS(a) _mm512_abs_pd(a)
+#define VROUND(a) _mm512_roundscale_pd((a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VFLOOR(a) _mm512_roundscale_pd((a), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+#define VXOR(a, b) _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(b)))
+#define VSIGN(a) _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_castpd_si512(_mm512_set1_pd(-0.0))))
+#define VSELECT(m, a, b) _mm512_mask_blend_pd((m), (b), (a))
+#define VCMPLT(a, b) _mm512_cmp_pd_mask((a), (b), _CMP_LT_OQ)
+#define VCMPGT(a, b) _mm512_cmp_pd_mask((a), (b), _CMP_GT_OQ)
+#define VCMPGE(a, b) _mm512_cmp_pd_mask((a), (b), _CMP_GE_OQ)
+#define VCMPEQ(a, b) _mm512_cmp_pd_mask((a), (b), _CMP_EQ_OQ)
+#define VOR_MASK(a, b) ((VM)((a) | (b)))
+#define VSIGNBIT(a) _mm512_cmplt_epi64_mask(_mm512_castpd_si512(a), _mm512_setzero_si512())
+#include "geodesic_simd.h"
+#undef VD
+#undef VM
+#undef VWIDTH
+#undef V_SUFFIX
+#undef V_TARGET
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VROUND
+#undef VFLOOR
+#undef VXOR
+#undef VSIGN
+#undef VSELECT
+#undef VCMPLT
+#undef VCMPGT
+#undef VCMPGE
+#undef VCMPEQ
+#undef VOR_MASK
+#undef VSIGNBIT
+#endif
+
+// Kernel in use; -1 until the first call picks one from the CPU features
+static _Atomic int selectedKernel = -1;
+
+int geodesicKernelSupported(GeodesicKernel kernel) {
+    switch (kernel) {
+        case GEODESIC_KERNEL_SCALAR:
+            return 1;
+#ifdef GEODESIC_HAVE_X86
+        case GEODESIC_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case GEODESIC_KERNEL_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return 0;
+    }
+}
+
+GeodesicKernel activeGeodesicKernel(void) {
+    int kernel = atomic_load_explicit(&selectedKernel, memory_order_relaxed);
+
+    if (kernel < 0) {
+        // Prefer the widest vectors the CPU supports
+        if (geodesicKernelSupported(GEODESIC_KERNEL_AVX512)) {
+            kernel = GEODESIC_KERNEL_AVX512;
+        } else if (geodesicKernelSupported(GEODESIC_KERNEL_AVX2)) {
+            kernel = GEODESIC_KERNEL_AVX2;
+        } else {
+            kernel = GEODESIC_KERNEL_SCALAR;
+        }
+        atomic_store_explicit(&selectedKernel, kernel, memory_order_relaxed);
+    }
+
+    return (GeodesicKernel)kernel;
+}
+
+// Force a specific kernel; returns 0 if the CPU can't run it
+int selectGeodesicKernel(GeodesicKernel kernel) {
+    if (!geodesicKernelSupported(kernel)) {
+        return 0;
+    }
+    atomic_store_explicit(&selectedKernel, kernel, memory_order_relaxed);
+    return 1;
+}
+
+const char* geodesicKernelName(GeodesicKernel kernel) {
+    switch (kernel) {
+        case GEODESIC_KERNEL_SCALAR: return "scalar";
+        case GEODESIC_KERNEL_AVX2: return "avx2";
+        case GEODESIC_KERNEL_AVX512: return "avx512";
+        default: return "unknown";
+    }
+}
+
+static GeodesicLegKernel geodesicLegKernel(void) {
+    switch (activeGeodesicKernel()) {
+#ifdef GEODESIC_HAVE_X86
+        case GEODESIC_KERNEL_AVX2: return geodesicLegsAvx2;
+        case GEODESIC_KERNEL_AVX512: return geodesicLegsAvx512;
+#endif
+        default: return geodesicLegsScalar;
+    }
+}
+
+// Great-circle distances in kilometers for count coordinate pairs
+void calculateDistances(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                        double* distances, size_t count) {
+    geodesicLegKernel()(lat1, lon1, lat2, lon2, distances, NULL, count);
+}
+
+// Initial bearings in degrees for count coordinate pairs
+void calculateBearings(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                       double* bearings, size_t count) {
+    geodesicLegKernel()(lat1, lon1, lat2, lon2, NULL, bearings, count);
+}
+
+// Distances and bearings together, sharing the endpoint trigonometry
+void calculateDistancesAndBearings(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                                   double* distances, double* bearings, size_t count) {
+    geodesicLegKernel()(lat1, lon1, lat2, lon2, distances, bearings, count);
+}
@@ -0,0 +1,31 @@
+#ifndef GEODESIC_H
+#define GEODESIC_H
+
+#include <stddef.h>
+
+// Batched great-circle kernels over coordinates stored as separate
+// latitude/longitude arrays (structure of arrays). Pair i runs from
+// (lat1[i], lon1[i]) to (lat2[i], lon2[i]); for consecutive route legs pass
+// the same arrays offset by one element.
+
+// Kernel implementations, selected at runtime from the CPU features
+typedef enum {
+    GEODESIC_KERNEL_SCALAR = 0,
+    GEODESIC_KERNEL_AVX2,
+    GEODESIC_KERNEL_AVX512
+} GeodesicKernel;
+
+// Function declarations
+void calculateDistances(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                        double* distances, size_t count);
+void calculateBearings(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                       double* bearings, size_t count);
+void calculateDistancesAndBearings(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                                   double* distances, double* bearings, size_t count);
+
+GeodesicKernel activeGeodesicKernel(void);
+int geodesicKernelSupported(GeodesicKernel kernel);
+int selectGeodesicKernel(GeodesicKernel kernel);
+const char* geodesicKernelName(GeodesicKernel kernel);
+
+#endif /* GEODESIC_H */
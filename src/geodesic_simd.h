@@ -0,0 +1,161 @@
+// Vector body of the geodesic kernels. geodesic.c includes this file once per
+// instruction set after defining the V* macros below for that set:
+//   VD, VM          vector of doubles and comparison mask types
+//   VWIDTH          doubles per vector
+//   V_SUFFIX        suffix appended to the generated function names
+//   V_TARGET        function attribute enabling the instruction set
+//   VLOAD, VSTORE, VSET1, VADD, VSUB, VMUL, VDIV, VSQRT, VMIN, VMAX,
+//   VABS, VROUND, VFLOOR, VXOR, VSIGN, VSELECT, VCMPLT, VCMPGT, VCMPGE,
+//   VCMPEQ, VOR_MASK, VSIGNBIT
+// No include guard: the file is meant to be included repeatedly.
+
+#define V_PASTE_(name, suffix) name##suffix
+#define V_PASTE(name, suffix) V_PASTE_(name, suffix)
+#define V_FN(name) V_PASTE(name, V_SUFFIX)
+
+// Sine and cosine of x in radians, reduced by pi/2 (Cody-Waite) onto [-pi/4, pi/4]
+static V_TARGET inline void V_FN(vectorSinCos)(VD x, VD* sinOut, VD* cosOut) {
+    VD k = VROUND(VMUL(x, VSET1(TWO_OVER_PI)));
+    VD r = VSUB(VSUB(VSUB(x, VMUL(k, VSET1(PIO2_PART1))), VMUL(k, VSET1(PIO2_PART2))), VMUL(k, VSET1(PIO2_PART3)));
+    VD z = VMUL(r, r);
+
+    VD sinPoly = VSET1(SIN_COEF0);
+    sinPoly = VADD(VMUL(sinPoly, z), VSET1(SIN_COEF1));
+    sinPoly = VADD(VMUL(sinPoly, z), VSET1(SIN_COEF2));
+    sinPoly = VADD(VMUL(sinPoly, z), VSET1(SIN_COEF3));
+    sinPoly = VADD(VMUL(sinPoly, z), VSET1(SIN_COEF4));
+    sinPoly = VADD(VMUL(sinPoly, z), VSET1(SIN_COEF5));
+    VD s = VADD(r, VMUL(VMUL(r, z), sinPoly));
+
+    VD cosPoly = VSET1(COS_COEF0);
+    cosPoly = VADD(VMUL(cosPoly, z), VSET1(COS_COEF1));
+    cosPoly = VADD(VMUL(cosPoly, z), VSET1(COS_COEF2));
+    cosPoly = VADD(VMUL(cosPoly, z), VSET1(COS_COEF3));
+    cosPoly = VADD(VMUL(cosPoly, z), VSET1(COS_COEF4));
+    cosPoly = VADD(VMUL(cosPoly, z), VSET1(COS_COEF5));
+    VD c = VADD(VSUB(VSET1(1.0), VMUL(VSET1(0.5), z)), VMUL(VMUL(z, z), cosPoly));
+
+    // Quadrant q = k mod 4 picks which polynomial and sign each result takes
+    VD q = VSUB(k, VMUL(VSET1(4.0), VFLOOR(VMUL(k, VSET1(0.25)))));
+    VM odd = VOR_MASK(VCMPEQ(q, VSET1(1.0)), VCMPEQ(q, VSET1(3.0)));
+    VM sinNegative = VCMPGE(q, VSET1(2.0));
+    VM cosNegative = VOR_MASK(VCMPEQ(q, VSET1(1.0)), VCMPEQ(q, VSET1(2.0)));
+
+    VD sinBase = VSELECT(odd, c, s);
+    VD cosBase = VSELECT(odd, s, c);
+    VD negativeZero = VSET1(-0.0);
+    *sinOut = VSELECT(sinNegative, VXOR(sinBase, negativeZero), sinBase);
+    *cosOut = VSELECT(cosNegative, VXOR(cosBase, negativeZero), cosBase);
+}
+
+// Arctangent of t in [0, 1] (Cephes rational approximation)
+static V_TARGET inline VD V_FN(vectorAtanUnit)(VD t) {
+    VM reduced = VCMPGT(t, VSET1(0.66));
+    VD u = VSELECT(reduced, VDIV(VSUB(t, VSET1(1.0)), VADD(t, VSET1(1.0))), t);
+    VD z = VMUL(u, u);
+
+    VD p = VSET1(ATAN_P0);
+    p = VADD(VMUL(p, z), VSET1(ATAN_P1));
+    p = VADD(VMUL(p, z), VSET1(ATAN_P2));
+    p = VADD(VMUL(p, z), VSET1(ATAN_P3));
+    p = VADD(VMUL(p, z), VSET1(ATAN_P4));
+
+    VD q = VADD(z, VSET1(ATAN_Q0));
+    q = VADD(VMUL(q, z), VSET1(ATAN_Q1));
+    q = VADD(VMUL(q, z), VSET1(ATAN_Q2));
+    q = VADD(VMUL(q, z), VSET1(ATAN_Q3));
+    q = VADD(VMUL(q, z), VSET1(ATAN_Q4));
+
+    VD r = VADD(VMUL(u, VDIV(VMUL(z, p), q)), u);
+    r = VADD(r, VSELECT(reduced, VSET1(0.5 * PI_LOW), VSET1(0.0)));
+    return VADD(VSELECT(reduced, VSET1(PI_OVER_4), VSET1(0.0)), r);
+}
+
+// Four-quadrant arctangent of y/x
+static V_TARGET inline VD V_FN(vectorAtan2)(VD y, VD x) {
+    VD ax = VABS(x);
+    VD ay = VABS(y);
+    VD den = VMAX(ax, ay);
+    VD t = VDIV(VMIN(ax, ay), den);
+    t = VSELECT(VCMPEQ(den, VSET1(0.0)), VSET1(0.0), t);
+
+    VD r = V_FN(vectorAtanUnit)(t);
+    r = VSELECT(VCMPGT(ay, ax), VADD(VSUB(VSET1(PI_OVER_2), r), VSET1(PI_LOW)), r);
+    r = VSELECT(VSIGNBIT(x), VADD(VSUB(VSET1(M_PI), r), VSET1(2.0 * PI_LOW)), r);
+    return VXOR(r, VSIGN(y));
+}
+
+// Distance (km) and initial bearing (degrees) for VWIDTH coordinate pairs
+static V_TARGET inline void V_FN(vectorLegs)(VD lat1Deg, VD lon1Deg, VD lat2Deg, VD lon2Deg,
+                                             VD* distance, VD* bearing) {
+    VD degToRad = VSET1(M_PI);
+    VD halfCircle = VSET1(180.0);
+    VD lat1 = VDIV(VMUL(lat1Deg, degToRad), halfCircle);
+    VD lon1 = VDIV(VMUL(lon1Deg, degToRad), halfCircle);
+    VD lat2 = VDIV(VMUL(lat2Deg, degToRad), halfCircle);
+    VD lon2 = VDIV(VMUL(lon2Deg, degToRad), halfCircle);
+
+    VD dlat = VSUB(lat2, lat1);
+    VD dlon = VSUB(lon2, lon1);
+
+    VD sinLat1, cosLat1, sinLat2, cosLat2, sinDlon, cosDlon, sinHalfDlat, sinHalfDlon, unused;
+    V_FN(vectorSinCos)(lat1, &sinLat1, &cosLat1);
+    V_FN(vectorSinCos)(lat2, &sinLat2, &cosLat2);
+    V_FN(vectorSinCos)(dlon, &sinDlon, &cosDlon);
+    V_FN(vectorSinCos)(VMUL(dlat, VSET1(0.5)), &sinHalfDlat, &unused);
+    V_FN(vectorSinCos)(VMUL(dlon, VSET1(0.5)), &sinHalfDlon, &unused);
+
+    // Haversine, evaluated in the same order as calculateDistance
+    VD a = VADD(VMUL(sinHalfDlat, sinHalfDlat),
+                VMUL(VMUL(VMUL(cosLat1, cosLat2), sinHalfDlon), sinHalfDlon));
+    VD c = VMUL(VSET1(2.0), V_FN(vectorAtan2)(VSQRT(a), VSQRT(VSUB(VSET1(1.0), a))));
+    *distance = VMUL(VSET1(EARTH_RADIUS), c);
+
+    // Initial bearing, evaluated in the same order as calculateBearing
+    VD y = VMUL(sinDlon, cosLat2);
+    VD x = VSUB(VMUL(cosLat1, sinLat2), VMUL(VMUL(sinLat1, cosLat2), cosDlon));
+    VD degrees = VADD(VDIV(VMUL(V_FN(vectorAtan2)(y, x), halfCircle), degToRad), VSET1(360.0));
+    *bearing = VSELECT(VCMPGE(degrees, VSET1(360.0)), VSUB(degrees, VSET1(360.0)), degrees);
+}
+
+// Kernel entry point: any output pointer may be NULL
+static V_TARGET void V_FN(geodesicLegs)(const double* lat1, const double* lon1, const double* lat2, const double* lon2,
+                                        double* distances, double* bearings, size_t count) {
+    size_t i = 0;
+    VD distance, bearing;
+
+    for (; i + VWIDTH <= count; i += VWIDTH) {
+        V_FN(vectorLegs)(VLOAD(lat1 + i), VLOAD(lon1 + i), VLOAD(lat2 + i), VLOAD(lon2 + i), &distance, &bearing);
+        if (distances) VSTORE(distances + i, distance);
+        if (bearings) VSTORE(bearings + i, bearing);
+    }
+
+    if (i < count) {
+        // Pad the tail so it goes through the same vector code as the body
+        double tail[4][VWIDTH];
+        double tailDistances[VWIDTH];
+        double tailBearings[VWIDTH];
+        size_t remaining = count - i;
+
+        for (size_t lane = 0; lane < VWIDTH; lane++) {
+            size_t source = lane < remaining ? i + lane : i;
+            tail[0][lane] = lat1[source];
+            tail[1][lane] = lon1[source];
+            tail[2][lane] = lat2[source];
+            tail[3][lane] = lon2[source];
+        }
+
+        V_FN(vectorLegs)(VLOAD(tail[0]), VLOAD(tail[1]), VLOAD(tail[2]), VLOAD(tail[3]), &distance, &bearing);
+        VSTORE(tailDistances, distance);
+        VSTORE(tailBearings, bearing);
+
+        for (size_t lane = 0; lane < remaining; lane++) {
+            if (distances) distances[i + lane] = tailDistances[lane];
+            if (bearings) bearings[i + lane] = tailBearings[lane];
+        }
+    }
+}
+
+#undef V_FN
+#undef V_PASTE
+#undef V_PASTE_
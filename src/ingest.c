@@ -0,0 +1,201 @@
+#include "ingest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Map a scenario file for reading; chunks are planned as they're needed
+// (planScenarioChunks). Returns 0 on success; otherwise -1 with a message in error
+int openScenarioFile(const char* path, ScenarioFile* file, char* error, size_t errorSize) {
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(error, errorSize, "cannot open %s", path);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        snprintf(error, errorSize, "%s is not a regular file", path);
+        close(fd);
+        return -1;
+    }
+
+    file->size = (size_t)info.st_size;
+    if (file->size > 0) {
+        void* mapping = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            snprintf(error, errorSize, "cannot map %s", path);
+            close(fd);
+            return -1;
+        }
+        // Read once, front to back: ask for aggressive readahead
+        madvise(mapping, file->size, MADV_SEQUENTIAL);
+        file->data = (const char*)mapping;
+    }
+    close(fd);
+
+    // Chunks are at least SCENARIO_CHUNK_BYTES after the first few doublings
+    int capacity = (int)(file->size / SCENARIO_CHUNK_BYTES) + 8;
+    file->chunks = (ScenarioChunk*)calloc(capacity, sizeof(ScenarioChunk));
+    if (!file->chunks) {
+        snprintf(error, errorSize, "out of memory");
+        closeScenarioFile(file);
+        return -1;
+    }
+    return 0;
+}
+
+// Plan up to count more chunks, each ending on a line boundary. Chunk sizes
+// double from SCENARIO_FIRST_CHUNK_BYTES to SCENARIO_CHUNK_BYTES; a chunk runs
+// on to the end of the line its target size lands in. Planning only reads
+// the pages the chunks end in, just ahead of parsing them, so nothing beyond
+// the chunks in flight is read early. Returns the number of chunks planned
+int planScenarioChunks(ScenarioFile* file, int count) {
+    int planned = 0;
+    while (planned < count && file->plannedBytes < file->size) {
+        size_t offset = file->plannedBytes;
+        size_t target = (size_t)SCENARIO_FIRST_CHUNK_BYTES << (file->chunkCount < 8 ? file->chunkCount : 8);
+        if (target > SCENARIO_CHUNK_BYTES) target = SCENARIO_CHUNK_BYTES;
+
+        size_t end = file->size;
+        if (file->size - offset > target) {
+            const char* newline = (const char*)memchr(file->data + offset + target, '\n',
+                                                      file->size - offset - target);
+            if (newline) end = (size_t)(newline - file->data) + 1;
+        }
+
+        ScenarioChunk* chunk = &file->chunks[file->chunkCount++];
+        chunk->offset = offset;
+        chunk->length = end - offset;
+        file->plannedBytes = end;
+        planned++;
+    }
+    return planned;
+}
+
+// Parse every record of one chunk into its table. Chunks are independent, so
+// different chunks may be parsed on different threads at once.
+// Returns 0, or -1 if the table couldn't be allocated
+int parseScenarioChunk(ScenarioFile* file, int index) {
+    ScenarioChunk* chunk = &file->chunks[index];
+    const char* begin = file->data + chunk->offset;
+    const char* end = begin + chunk->length;
+
+    // Every line may be a record; one block holds the table and, typically,
+    // every waypoint array
+    long lines = 1;
+    for (const char* p = begin; (p = (const char*)memchr(p, '\n', end - p)) != NULL; p++) {
+        lines++;
+    }
+    initArena(&chunk->arena, lines * sizeof(ScenarioRecord) + 2 * chunk->length);
+    chunk->records = (ScenarioRecord*)arenaAlloc(&chunk->arena, lines * sizeof(ScenarioRecord));
+    chunk->count = 0;
+    chunk->rejectCount = 0;
+    chunk->rejects = NULL;
+    if (!chunk->records) {
+        chunk->parsed = -1;
+        return -1;
+    }
+
+    long rejectCapacity = 0;
+    for (const char* line = begin; line < end;) {
+        const char* newline = (const char*)memchr(line, '\n', end - line);
+        const char* next = newline ? newline + 1 : end;
+        Scenario scenario;
+        ParseError error;
+        int parsed = parseScenarioSpan(line, (size_t)(next - line), &scenario, &chunk->arena, &error);
+        line = next;
+        if (parsed == 0) {
+            continue; // Blank line or comment
+        }
+
+        ScenarioRecord* record = &chunk->records[chunk->count];
+        if (parsed > 0) {
+            record->start = scenario.start;
+            record->end = scenario.end;
+            record->weight = scenario.missile.weight;
+            record->speed = scenario.missile.speed;
+            record->waypointCount = scenario.waypointCount;
+            record->waypoints = scenario.waypoints;
+            record->turnAngles = scenario.turnAngles;
+        } else {
+            memset(record, 0, sizeof(*record));
+            record->waypointCount = -1;
+
+            if (chunk->rejectCount == rejectCapacity) {
+                long capacity = rejectCapacity > 0 ? 2 * rejectCapacity : 16;
+                ScenarioReject* rejects = (ScenarioReject*)arenaResize(&chunk->arena, chunk->rejects,
+                                                                       rejectCapacity * sizeof(ScenarioReject),
+                                                                       capacity * sizeof(ScenarioReject));
+                if (!rejects) {
+                    chunk->parsed = -1;
+                    return -1;
+                }
+                chunk->rejects = rejects;
+                rejectCapacity = capacity;
+            }
+            ScenarioReject* reject = &chunk->rejects[chunk->rejectCount++];
+            reject->record = chunk->count;
+            reject->message = error.message;
+            reject->column = (long)error.offset + 1;
+        }
+        chunk->count++;
+    }
+
+    chunk->parsed = 1;
+    return 0;
+}
+
+// The scenario a parsed (not malformed) record describes; its waypoint
+// arrays stay in the chunk
+void scenarioFromRecord(const ScenarioRecord* record, Scenario* scenario) {
+    scenario->start = record->start;
+    scenario->end = record->end;
+    scenario->missile = defaultMissileAttributes(record->weight, record->speed);
+    scenario->waypointCount = record->waypointCount;
+    scenario->waypoints = record->waypoints;
+    scenario->turnAngles = record->turnAngles;
+}
+
+// Free the tables of every chunk before endChunk and hand their mapped pages
+// back, so resident memory stays bounded however large the file is
+void releaseScenarioChunks(ScenarioFile* file, int endChunk) {
+    if (endChunk > file->chunkCount) endChunk = file->chunkCount;
+    if (endChunk <= file->releasedChunks) return;
+
+    for (int i = file->releasedChunks; i < endChunk; i++) {
+        freeArena(&file->chunks[i].arena);
+        file->chunks[i].records = NULL;
+        file->chunks[i].rejects = NULL;
+    }
+    file->releasedChunks = endChunk;
+
+    // Whole pages only; the page shared with the next chunk goes next time
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const ScenarioChunk* last = &file->chunks[endChunk - 1];
+    size_t end = last->offset + last->length;
+    if (end < file->size) end = end / page * page;
+    if (end > file->releasedBytes) {
+        size_t start = file->releasedBytes / page * page;
+        madvise((void*)(file->data + start), end - start, MADV_DONTNEED);
+        file->releasedBytes = end;
+    }
+}
+
+void closeScenarioFile(ScenarioFile* file) {
+    if (file->chunks) {
+        for (int i = file->releasedChunks; i < file->chunkCount; i++) {
+            freeArena(&file->chunks[i].arena);
+        }
+        free(file->chunks);
+    }
+    if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    memset(file, 0, sizeof(*file));
+}
@@ -0,0 +1,68 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+#include "scenario.h"
+#include "arena.h"
+
+// Memory-mapped batch input. The file is split into chunks that end on a
+// line boundary, planned a few at a time as parsing reaches them. Each chunk
+// parses on its own into a table of records in its own arena, so chunks can
+// be parsed on different threads while earlier ones are evaluated, and
+// released in order once their results are written.
+// Chunks start at SCENARIO_FIRST_CHUNK_BYTES and double up to
+// SCENARIO_CHUNK_BYTES, so the first records are ready almost at once.
+
+#define SCENARIO_FIRST_CHUNK_BYTES (16 * 1024)
+#define SCENARIO_CHUNK_BYTES (256 * 1024)
+
+// One parsed record. The missile is defaultMissileAttributes(weight, speed),
+// as parseScenarioSpan builds it
+typedef struct {
+    Coordinates start;
+    Coordinates end;
+    double weight;
+    double speed;
+    int waypointCount;          // -1 for a malformed record
+    Coordinates* waypoints;     // In the chunk's arena
+    double* turnAngles;
+} ScenarioRecord;
+
+// Why a record of a chunk was rejected
+typedef struct {
+    long record;                // Index of the record within its chunk
+    const char* message;
+    long column;                // 1-based column of the first invalid byte
+} ScenarioReject;
+
+typedef struct {
+    size_t offset;              // Bytes of the file covered by the chunk
+    size_t length;
+    int parsed;                 // 1 parsed, -1 out of memory, 0 not yet
+    long count;                 // Records, without blank lines and comments
+    ScenarioRecord* records;
+    long rejectCount;           // Malformed records, in record order
+    ScenarioReject* rejects;
+    Arena arena;                // Backs records, rejects and waypoint arrays
+} ScenarioChunk;
+
+// A mapped scenario file and its chunks
+typedef struct {
+    const char* data;
+    size_t size;
+    int chunkCount;             // Chunks planned so far
+    ScenarioChunk* chunks;
+    size_t plannedBytes;        // Bytes covered by the planned chunks
+    int releasedChunks;         // Chunks before this one are released
+    size_t releasedBytes;       // Mapped pages before this offset are handed back
+} ScenarioFile;
+
+// Function declarations
+int openScenarioFile(const char* path, ScenarioFile* file, char* error, size_t errorSize);
+int planScenarioChunks(ScenarioFile* file, int count);
+int parseScenarioChunk(ScenarioFile* file, int chunk);
+void scenarioFromRecord(const ScenarioRecord* record, Scenario* scenario);
+void releaseScenarioChunks(ScenarioFile* file, int endChunk);
+void closeScenarioFile(ScenarioFile* file);
+
+#endif /* INGEST_H */
@@ -0,0 +1,122 @@
+// Body of the path and leg kernels. kernels.c includes this file once per
+// precision after defining the K_* macros below for it:
+//   K_REAL          floating-point type the kernels compute in
+//   K_SUFFIX        suffix appended to the generated function names
+//   K_ATAN2, K_SQRT math functions for K_REAL
+//   K_COS, K_FABS,  math functions for K_REAL
+//   K_FMAX
+//   K_SIN_ARC       sine for arguments in [0, pi]
+//   K_SAMPLES       points per segment of the fixed path sampler
+// Expressions follow geoSegmentPoint, geoVectorAngle, geoVectorBearing and
+// the helpers calculateWaypointEffects used term for term, so the double
+// variant returns exactly what the engine's reference functions do.
+// No include guard: the file is meant to be included repeatedly.
+
+#define K_PASTE_(name, suffix) name##suffix
+#define K_PASTE(name, suffix) K_PASTE_(name, suffix)
+#define K_FN(name) K_PASTE(name, K_SUFFIX)
+
+static inline K_REAL K_FN(toDegrees)(K_REAL radians) {
+    return radians * (K_REAL)180.0 / (K_REAL)M_PI;
+}
+
+static inline K_REAL K_FN(toRadians)(K_REAL degrees) {
+    return degrees * (K_REAL)M_PI / (K_REAL)180.0;
+}
+
+// Central angle in radians between two unit vectors (geoVectorAngle)
+static double K_FN(legAngle)(const GeoVector* start, const GeoVector* end) {
+    K_REAL dx = (K_REAL)start->x - (K_REAL)end->x;
+    K_REAL dy = (K_REAL)start->y - (K_REAL)end->y;
+    K_REAL dz = (K_REAL)start->z - (K_REAL)end->z;
+
+    K_REAL a = (dx * dx + dy * dy + dz * dz) / (K_REAL)4.0;
+    return (K_REAL)2 * K_ATAN2(K_SQRT(a), K_SQRT(1-a));
+}
+
+// Initial bearing in degrees between two unit vectors (geoVectorBearing)
+static double K_FN(legBearing)(const GeoVector* start, const GeoVector* end) {
+    K_REAL sinDlon = (K_REAL)0.0;
+    K_REAL cosDlon = (K_REAL)1.0;
+
+    if (start->sourceLongitude != end->sourceLongitude) {
+        sinDlon = (K_REAL)end->sinLon * (K_REAL)start->cosLon - (K_REAL)end->cosLon * (K_REAL)start->sinLon;
+        cosDlon = (K_REAL)end->cosLon * (K_REAL)start->cosLon + (K_REAL)end->sinLon * (K_REAL)start->sinLon;
+    }
+
+    K_REAL y = sinDlon * (K_REAL)end->cosLat;
+    K_REAL x = (K_REAL)start->cosLat * (K_REAL)end->sinLat -
+               (K_REAL)start->sinLat * (K_REAL)end->cosLat * cosDlon;
+    K_REAL degrees = K_FN(toDegrees)(K_ATAN2(y, x)) + (K_REAL)360.0;
+    return degrees >= (K_REAL)360.0 ? degrees - (K_REAL)360.0 : degrees;
+}
+
+// Arrival effects of a leg: calculateTravelTime of the distance in meters,
+// calculateTurnEffect, the turn fuel and calculateGForce. The turn rate and
+// drag are parameters so the callers below can pass compile-time constants
+static inline void K_FN(legEffectsWith)(const MissileAttributes* missile, K_REAL maxTurnRate,
+                                        K_REAL dragCoefficient, double distance, double approachSpeed,
+                                        double turnAngle, LegEffects* effects) {
+    K_REAL speed = (K_REAL)approachSpeed;
+    K_REAL turn = (K_REAL)turnAngle;
+
+    K_REAL timeToReach = (K_REAL)distance * (K_REAL)1000 * (K_REAL)1000.0 / speed;
+
+    K_REAL turnRadians = K_FABS(K_FN(toRadians)(turn));
+    K_REAL departureSpeed = K_FMAX(speed * K_COS(turnRadians * dragCoefficient), (K_REAL)0.1 * speed);
+
+    K_REAL turnTime = K_FABS(turn) / maxTurnRate;
+    K_REAL fuelConsumed = timeToReach * (K_REAL)missile->fuelConsumptionNormal +
+                          turnTime * (K_REAL)missile->fuelConsumptionTurn;
+
+    K_REAL turnRadius = speed / K_FN(toRadians)(maxTurnRate);
+    if (turnRadius < (K_REAL)0.1) turnRadius = (K_REAL)0.1;
+    K_REAL gForce = (speed * speed) / (turnRadius * (K_REAL)GRAVITY);
+
+    effects->timeToReach = timeToReach;
+    effects->departureSpeed = departureSpeed;
+    effects->fuelConsumed = fuelConsumed;
+    effects->gForce = gForce;
+}
+
+// Arrival effects with the missile's own turn rate and drag
+static void K_FN(legEffects)(const MissileAttributes* missile, double distance, double approachSpeed,
+                             double turnAngle, LegEffects* effects) {
+    K_FN(legEffectsWith)(missile, (K_REAL)missile->maxTurnRate, (K_REAL)missile->dragCoefficient,
+                         distance, approachSpeed, turnAngle, effects);
+}
+
+// Arrival effects for a missile on the default turn rate and drag, which
+// fold into the arithmetic as constants
+static void K_FN(legEffectsDefaults)(const MissileAttributes* missile, double distance, double approachSpeed,
+                                     double turnAngle, LegEffects* effects) {
+    K_FN(legEffectsWith)(missile, (K_REAL)MISSILE_DEFAULT_MAX_TURN_RATE,
+                         (K_REAL)MISSILE_DEFAULT_DRAG_COEFFICIENT, distance, approachSpeed, turnAngle, effects);
+}
+
+// K_SAMPLES points of a prepared segment (geoSegmentPoint at i / (K_SAMPLES - 1)).
+// The sample count is a constant, so the fractions fold at compile time
+static void K_FN(segmentPoints)(const GeoSegment* segment, Coordinates* points) {
+    K_REAL d = (K_REAL)segment->angle;
+    K_REAL sinAngle = (K_REAL)segment->sinAngle;
+    K_REAL x1 = (K_REAL)segment->start.x, y1 = (K_REAL)segment->start.y, z1 = (K_REAL)segment->start.z;
+    K_REAL x2 = (K_REAL)segment->end.x, y2 = (K_REAL)segment->end.y, z2 = (K_REAL)segment->end.z;
+
+    for (int i = 0; i < K_SAMPLES; i++) {
+        K_REAL fraction = (K_REAL)i / (K_SAMPLES - 1);
+        K_REAL a = K_SIN_ARC((1-fraction) * d) / sinAngle;
+        K_REAL b = K_SIN_ARC(fraction * d) / sinAngle;
+
+        K_REAL x = a * x1 + b * x2;
+        K_REAL y = a * y1 + b * y2;
+        K_REAL z = a * z1 + b * z2;
+
+        points[i].latitude = K_FN(toDegrees)(K_ATAN2(z, K_SQRT(x*x + y*y)));
+        points[i].longitude = K_FN(toDegrees)(K_ATAN2(y, x));
+        points[i].altitude = (K_REAL)10000.0 * K_SIN_ARC(fraction * (K_REAL)M_PI);
+    }
+}
+
+#undef K_FN
+#undef K_PASTE
+#undef K_PASTE_
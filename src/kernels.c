@@ -0,0 +1,165 @@
+#include "kernels.h"
+#include <stdatomic.h>
+#include <string.h>
+
+// Single-precision polynomial constants (Cephes sinf, cosf, atanf)
+#define SINF_COEF0 -1.9515295891E-4f
+#define SINF_COEF1 8.3321608736E-3f
+#define SINF_COEF2 -1.6666654611E-1f
+#define COSF_COEF0 2.443315711809948E-5f
+#define COSF_COEF1 -1.388731625493765E-3f
+#define COSF_COEF2 4.166664568298827E-2f
+#define ATANF_COEF0 8.05374449538E-2f
+#define ATANF_COEF1 -1.38776856032E-1f
+#define ATANF_COEF2 1.99777106478E-1f
+#define ATANF_COEF3 -3.33329491539E-1f
+#define TAN_PI_OVER_8 0.4142135623730950f
+#define FLOAT_PI ((float)M_PI)
+#define FLOAT_PI_OVER_2 ((float)M_PI_2)
+#define FLOAT_PI_OVER_4 ((float)M_PI_4)
+
+typedef void (*SegmentPointsKernel)(const GeoSegment* segment, Coordinates* points);
+typedef double (*LegVectorKernel)(const GeoVector* start, const GeoVector* end);
+typedef void (*LegEffectsKernel)(const MissileAttributes* missile, double distance, double approachSpeed,
+                                 double turnAngle, LegEffects* effects);
+
+// Double: analysis grade, identical to geoSegmentPoint
+#define K_REAL double
+#define K_SUFFIX Double
+#define K_SIN_ARC sin
+#define K_ATAN2 atan2
+#define K_SQRT sqrt
+#define K_COS cos
+#define K_FABS fabs
+#define K_FMAX fmax
+#define K_SAMPLES KERNEL_SAMPLES_PER_SEGMENT
+#include "kernel_variant.h"
+#undef K_REAL
+#undef K_SUFFIX
+#undef K_SIN_ARC
+#undef K_ATAN2
+#undef K_SQRT
+#undef K_COS
+#undef K_FABS
+#undef K_FMAX
+#undef K_SAMPLES
+
+// Sine of an arc in [0, pi], the only arguments the path kernel passes.
+// Inline and branch-free, so the fixed-count float loop needs no libm calls
+static inline float sinArcFloat(float x) {
+    float r = x > FLOAT_PI_OVER_2 ? FLOAT_PI - x : x;
+    float c = FLOAT_PI_OVER_2 - r;
+    float rr = r * r;
+    float cc = c * c;
+    float s = ((SINF_COEF0 * rr + SINF_COEF1) * rr + SINF_COEF2) * rr * r + r;
+    float co = ((COSF_COEF0 * cc + COSF_COEF1) * cc + COSF_COEF2) * cc * cc - 0.5f * cc + 1.0f;
+    return r > FLOAT_PI_OVER_4 ? co : s;
+}
+
+// Four-quadrant arctangent of y/x; glibc's atan2f costs as much as atan2
+static inline float atan2Float(float y, float x) {
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float high = ax > ay ? ax : ay;
+    float low = ax > ay ? ay : ax;
+    float ratio = low / high;
+    float t = high > 0.0f ? ratio : 0.0f;
+
+    // Both sides are computed so the selects need no branches
+    int reduced = t > TAN_PI_OVER_8;
+    float shifted = (t - 1.0f) / (t + 1.0f);
+    float u = reduced ? shifted : t;
+    float z = u * u;
+    float r = (((ATANF_COEF0 * z + ATANF_COEF1) * z + ATANF_COEF2) * z + ATANF_COEF3) * z * u + u;
+    r = reduced ? r + FLOAT_PI_OVER_4 : r;
+
+    r = ay > ax ? FLOAT_PI_OVER_2 - r : r;
+    r = signbit(x) ? FLOAT_PI - r : r;
+    return copysignf(r, y);
+}
+
+// Float: visualisation grade
+#define K_REAL float
+#define K_SUFFIX Float
+#define K_SIN_ARC sinArcFloat
+#define K_ATAN2 atan2Float
+#define K_SQRT sqrtf
+#define K_COS cosf
+#define K_FABS fabsf
+#define K_FMAX fmaxf
+#define K_SAMPLES KERNEL_SAMPLES_PER_SEGMENT
+#include "kernel_variant.h"
+#undef K_REAL
+#undef K_SUFFIX
+#undef K_SIN_ARC
+#undef K_ATAN2
+#undef K_SQRT
+#undef K_COS
+#undef K_FABS
+#undef K_FMAX
+#undef K_SAMPLES
+
+static _Atomic int selectedPrecision = KERNEL_PRECISION_DOUBLE;
+
+KernelPrecision activeKernelPrecision(void) {
+    return (KernelPrecision)atomic_load_explicit(&selectedPrecision, memory_order_relaxed);
+}
+
+void selectKernelPrecision(KernelPrecision precision) {
+    atomic_store_explicit(&selectedPrecision, precision, memory_order_relaxed);
+}
+
+const char* kernelPrecisionName(KernelPrecision precision) {
+    switch (precision) {
+        case KERNEL_PRECISION_DOUBLE: return "double";
+        case KERNEL_PRECISION_FLOAT: return "float";
+        default: return "unknown";
+    }
+}
+
+// Precision from its name; returns 0 for an unknown name
+int parseKernelPrecision(const char* name, KernelPrecision* precision) {
+    if (strcmp(name, "double") == 0) {
+        *precision = KERNEL_PRECISION_DOUBLE;
+    } else if (strcmp(name, "float") == 0) {
+        *precision = KERNEL_PRECISION_FLOAT;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// KERNEL_SAMPLES_PER_SEGMENT evenly spaced points of a prepared segment
+void kernelSegmentPoints(const GeoSegment* segment, Coordinates* points) {
+    SegmentPointsKernel kernel = activeKernelPrecision() == KERNEL_PRECISION_FLOAT ? segmentPointsFloat
+                                                                                   : segmentPointsDouble;
+    kernel(segment, points);
+}
+
+// Central angle in radians of the leg between two current vectors
+double kernelLegAngle(const GeoVector* start, const GeoVector* end) {
+    LegVectorKernel kernel = activeKernelPrecision() == KERNEL_PRECISION_FLOAT ? legAngleFloat : legAngleDouble;
+    return kernel(start, end);
+}
+
+// Initial bearing in degrees of the leg between two current vectors
+double kernelLegBearing(const GeoVector* start, const GeoVector* end) {
+    LegVectorKernel kernel = activeKernelPrecision() == KERNEL_PRECISION_FLOAT ? legBearingFloat
+                                                                               : legBearingDouble;
+    return kernel(start, end);
+}
+
+// Effects of flying distance km at approachSpeed and turning by turnAngle
+// degrees on arrival. Missiles on the default turn rate and drag take the
+// variant with those folded in
+void kernelLegEffects(const MissileAttributes* missile, double distance, double approachSpeed,
+                      double turnAngle, LegEffects* effects) {
+    static const LegEffectsKernel kernels[2][2] = {
+        { legEffectsDouble, legEffectsDefaultsDouble },
+        { legEffectsFloat, legEffectsDefaultsFloat }
+    };
+    int defaults = missile->maxTurnRate == MISSILE_DEFAULT_MAX_TURN_RATE &&
+                   missile->dragCoefficient == MISSILE_DEFAULT_DRAG_COEFFICIENT;
+    int precision = activeKernelPrecision() == KERNEL_PRECISION_FLOAT;
+    kernels[precision][defaults](missile, distance, approachSpeed, turnAngle, effects);
+}
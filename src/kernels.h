@@ -0,0 +1,44 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "trajectory.h"
+
+// Path sampling and leg physics kernels specialised at compile time: each
+// precision is generated from the same body (kernel_variant.h), the points
+// per segment is a constant of the variant, and leg effects have a further
+// variant with the default turn rate and drag folded in. Double matches
+// geoSegmentPoint, geoVectorAngle, geoVectorBearing and the effects
+// calculateWaypointEffects applied before bit for bit and is for analysis;
+// float runs the same steps in single precision for visualisation-grade
+// results. The active variant is picked at runtime and can be changed with
+// selectKernelPrecision; trajectory.c computes every leg through it.
+
+// Points per segment the fixed path kernels produce
+#define KERNEL_SAMPLES_PER_SEGMENT PATH_POINTS_PER_SEGMENT
+
+typedef enum {
+    KERNEL_PRECISION_DOUBLE = 0,
+    KERNEL_PRECISION_FLOAT
+} KernelPrecision;
+
+// What arriving at a waypoint costs (fields as in Waypoint)
+typedef struct {
+    double timeToReach;       // in seconds
+    double departureSpeed;    // in m/s after the turn
+    double fuelConsumed;      // in kg
+    double gForce;            // during the turn
+} LegEffects;
+
+// Function declarations
+void kernelSegmentPoints(const GeoSegment* segment, Coordinates* points);
+double kernelLegAngle(const GeoVector* start, const GeoVector* end);
+double kernelLegBearing(const GeoVector* start, const GeoVector* end);
+void kernelLegEffects(const MissileAttributes* missile, double distance, double approachSpeed,
+                      double turnAngle, LegEffects* effects);
+
+KernelPrecision activeKernelPrecision(void);
+void selectKernelPrecision(KernelPrecision precision);
+const char* kernelPrecisionName(KernelPrecision precision);
+int parseKernelPrecision(const char* name, KernelPrecision* precision);
+
+#endif /* KERNELS_H */
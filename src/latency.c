@@ -0,0 +1,73 @@
+#include "latency.h"
+
+static int latencyBucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + (int)((value >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+// Midpoint of the values that fall into bucket
+static double latencyBucketValue(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lower + 0.5 * (double)((uint64_t)1 << shift);
+}
+
+void initLatencyHistogram(LatencyHistogram* histogram) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        atomic_init(&histogram->counts[i], 0);
+    }
+    atomic_init(&histogram->total, 0);
+    atomic_init(&histogram->sumNanoseconds, 0);
+    atomic_init(&histogram->maxNanoseconds, 0);
+}
+
+void recordLatency(LatencyHistogram* histogram, uint64_t nanoseconds) {
+    atomic_fetch_add_explicit(&histogram->counts[latencyBucket(nanoseconds)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sumNanoseconds, nanoseconds, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&histogram->maxNanoseconds, memory_order_relaxed);
+    while (nanoseconds > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->maxNanoseconds, &max, nanoseconds,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Value in nanoseconds below which quantile (0..1) of the recorded values fall
+double latencyPercentile(const LatencyHistogram* histogram, double quantile) {
+    uint64_t total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    if (total == 0) {
+        return 0.0;
+    }
+
+    // Rank of the requested value, 1-based
+    uint64_t rank = (uint64_t)(quantile * total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            double value = latencyBucketValue(i);
+            double max = (double)atomic_load_explicit(&histogram->maxNanoseconds, memory_order_relaxed);
+            return value < max ? value : max;
+        }
+    }
+    return (double)atomic_load_explicit(&histogram->maxNanoseconds, memory_order_relaxed);
+}
+
+double latencyMean(const LatencyHistogram* histogram) {
+    uint64_t total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&histogram->sumNanoseconds, memory_order_relaxed);
+    return total ? (double)sum / total : 0.0;
+}
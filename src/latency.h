@@ -0,0 +1,27 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Log-linear latency histogram: values are nanoseconds, each power of two is
+// split into 2^LATENCY_SUB_BITS buckets, so percentiles are within ~3% of the
+// true value. Recording is lock-free and safe from any thread.
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)
+
+typedef struct {
+    _Atomic uint64_t counts[LATENCY_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t sumNanoseconds;
+    _Atomic uint64_t maxNanoseconds;
+} LatencyHistogram;
+
+// Function declarations
+void initLatencyHistogram(LatencyHistogram* histogram);
+void recordLatency(LatencyHistogram* histogram, uint64_t nanoseconds);
+double latencyPercentile(const LatencyHistogram* histogram, double quantile);
+double latencyMean(const LatencyHistogram* histogram);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,205 @@
+#include "legcache.h"
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Largest quantised coordinate that still fits the integer key
+#define LEG_CACHE_KEY_LIMIT 9.0e18
+
+typedef struct {
+    int64_t key[4];         // Quantised from latitude, from longitude, to latitude, to longitude
+    LegGeometry geometry;
+    uint64_t lastUse;       // Shard clock at the last hit or insert, 0 for an empty way
+} LegCacheEntry;
+
+// Counters and lock for the sets whose index is congruent modulo LEG_CACHE_SHARDS.
+// Aligned so threads working on different shards don't share cache lines
+typedef struct {
+    _Alignas(64) pthread_mutex_t lock;
+    uint64_t clock;         // Counts from 1 and can't wrap in a process lifetime
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    long entries;
+} LegCacheShard;
+
+struct LegCache {
+    LegCacheShard shards[LEG_CACHE_SHARDS];
+    LegCacheEntry* entries;     // setCount sets of LEG_CACHE_WAYS entries
+    size_t setMask;
+    long capacity;
+};
+
+static _Atomic(LegCache*) activeCache = NULL;
+
+// Quantise the endpoints into a key; returns 0 for coordinates that can't be cached
+static int legKey(Coordinates from, Coordinates to, int64_t key[4]) {
+    double values[4] = { from.latitude, from.longitude, to.latitude, to.longitude };
+
+    for (int i = 0; i < 4; i++) {
+        double scaled = values[i] * LEG_CACHE_STEPS_PER_DEGREE;
+        if (!(scaled > -LEG_CACHE_KEY_LIMIT && scaled < LEG_CACHE_KEY_LIMIT)) {
+            return 0; // Non-finite or out of range
+        }
+        key[i] = (int64_t)(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5); // Round half away from zero
+    }
+    return 1;
+}
+
+static uint64_t hashKey(const int64_t key[4]) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ (uint64_t)key[i]) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+static int sameKey(const int64_t a[4], const int64_t b[4]) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+}
+
+static uint64_t tick(LegCacheShard* shard) {
+    return ++shard->clock; // Starts at 1: 0 marks an empty way
+}
+
+// Create a cache holding at least capacity legs; NULL if capacity <= 0 or out of memory
+LegCache* createLegCache(long capacity) {
+    if (capacity <= 0) {
+        return NULL;
+    }
+
+    size_t setCount = LEG_CACHE_SHARDS;
+    while (setCount * LEG_CACHE_WAYS < (size_t)capacity) {
+        setCount *= 2;
+    }
+
+    LegCache* cache = (LegCache*)aligned_alloc(_Alignof(LegCache), sizeof(LegCache));
+    LegCacheEntry* entries = (LegCacheEntry*)calloc(setCount * LEG_CACHE_WAYS, sizeof(LegCacheEntry));
+    if (!cache || !entries) {
+        free(cache);
+        free(entries);
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    for (int i = 0; i < LEG_CACHE_SHARDS; i++) {
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+    }
+    cache->entries = entries;
+    cache->setMask = setCount - 1;
+    cache->capacity = (long)(setCount * LEG_CACHE_WAYS);
+    return cache;
+}
+
+void destroyLegCache(LegCache* cache) {
+    if (!cache) {
+        return;
+    }
+
+    LegCache* expected = cache;
+    atomic_compare_exchange_strong(&activeCache, &expected, NULL);
+    for (int i = 0; i < LEG_CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&cache->shards[i].lock);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+// Copy the cached geometry of the leg into geometry; returns 0 on a miss
+int legCacheLookup(LegCache* cache, Coordinates from, Coordinates to, LegGeometry* geometry) {
+    int64_t key[4];
+    if (!legKey(from, to, key)) {
+        return 0;
+    }
+
+    size_t set = hashKey(key) & cache->setMask;
+    LegCacheShard* shard = &cache->shards[set % LEG_CACHE_SHARDS];
+    LegCacheEntry* ways = &cache->entries[set * LEG_CACHE_WAYS];
+    int found = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    for (int i = 0; i < LEG_CACHE_WAYS; i++) {
+        if (ways[i].lastUse != 0 && sameKey(ways[i].key, key)) {
+            ways[i].lastUse = tick(shard);
+            *geometry = ways[i].geometry;
+            found = 1;
+            break;
+        }
+    }
+    if (found) {
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return found;
+}
+
+// Store the geometry of a leg, evicting the least recently used entry of a full set
+void legCacheInsert(LegCache* cache, Coordinates from, Coordinates to, const LegGeometry* geometry) {
+    int64_t key[4];
+    if (!legKey(from, to, key)) {
+        return;
+    }
+
+    size_t set = hashKey(key) & cache->setMask;
+    LegCacheShard* shard = &cache->shards[set % LEG_CACHE_SHARDS];
+    LegCacheEntry* ways = &cache->entries[set * LEG_CACHE_WAYS];
+
+    pthread_mutex_lock(&shard->lock);
+    LegCacheEntry* slot = &ways[0];
+    for (int i = 0; i < LEG_CACHE_WAYS; i++) {
+        if (ways[i].lastUse != 0 && sameKey(ways[i].key, key)) {
+            slot = &ways[i]; // Another thread computed it meanwhile
+            break;
+        }
+        if (ways[i].lastUse < slot->lastUse) {
+            slot = &ways[i]; // Empty ways sort first
+        }
+    }
+
+    if (slot->lastUse == 0) {
+        shard->entries++;
+    } else if (!sameKey(slot->key, key)) {
+        shard->evictions++;
+    }
+    memcpy(slot->key, key, sizeof(key));
+    slot->geometry = *geometry;
+    slot->lastUse = tick(shard);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Totals over every shard
+void getLegCacheStats(LegCache* cache, LegCacheStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!cache) {
+        return;
+    }
+
+    for (int i = 0; i < LEG_CACHE_SHARDS; i++) {
+        LegCacheShard* shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->entries;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    stats->capacity = cache->capacity;
+}
+
+double legCacheHitRate(const LegCacheStats* stats) {
+    unsigned long long lookups = stats->hits + stats->misses;
+    return lookups > 0 ? (double)stats->hits / lookups : 0.0;
+}
+
+void setActiveLegCache(LegCache* cache) {
+    atomic_store_explicit(&activeCache, cache, memory_order_release);
+}
+
+LegCache* activeLegCache(void) {
+    return atomic_load_explicit(&activeCache, memory_order_acquire);
+}
@@ -0,0 +1,53 @@
+#ifndef LEGCACHE_H
+#define LEGCACHE_H
+
+#include "trajectory.h"
+
+// Bounded, thread-safe memo of great-circle leg geometry shared by every
+// trajectory in the process. Scenarios that differ only in their missile reuse
+// the distance, bearing and arc trigonometry of legs another scenario computed.
+// Keys are the endpoint latitudes and longitudes quantised to steps of
+// 1/LEG_CACHE_STEPS_PER_DEGREE (altitude doesn't affect the geometry).
+
+// Key resolution: inputs with up to 9 decimals map to distinct keys
+#define LEG_CACHE_STEPS_PER_DEGREE 1e9
+
+// Entries per set; a full set evicts its least recently used entry
+#define LEG_CACHE_WAYS 4
+
+// Independently locked shards
+#define LEG_CACHE_SHARDS 64
+
+// Suggested size: 64k legs in 4 MB
+#define LEG_CACHE_DEFAULT_ENTRIES 65536
+
+// Geometry of one leg
+typedef struct {
+    double angle;       // Central angle in radians (distance is EARTH_RADIUS * angle)
+    double sinAngle;
+    double bearing;     // Initial bearing in degrees
+} LegGeometry;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    long entries;       // Entries in use
+    long capacity;
+} LegCacheStats;
+
+typedef struct LegCache LegCache;
+
+// Function declarations
+LegCache* createLegCache(long capacity);
+void destroyLegCache(LegCache* cache);
+int legCacheLookup(LegCache* cache, Coordinates from, Coordinates to, LegGeometry* geometry);
+void legCacheInsert(LegCache* cache, Coordinates from, Coordinates to, const LegGeometry* geometry);
+void getLegCacheStats(LegCache* cache, LegCacheStats* stats);
+double legCacheHitRate(const LegCacheStats* stats);
+
+// The cache trajectory calculations consult, NULL (the default) to compute every leg
+void setActiveLegCache(LegCache* cache);
+LegCache* activeLegCache(void);
+
+#endif /* LEGCACHE_H */
@@ -2,173 +2,457 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <limits.h>
 #include "trajectory.h"
+#include "scenario.h"
+#include "batch.h"
+#include "output.h"
+#include "columnar.h"
+#include "server.h"
+#include "stats.h"
+#include "number.h"
+#include "telemetry.h"
+#include "spline.h"
+#include "kernels.h"
+#include "sweep.h"
 
-// Function to parse waypoints from a string
-int parseWaypoints(const char* waypointStr, Coordinates waypoints[], double angles[], int maxWaypoints) {
-    if (!waypointStr || strlen(waypointStr) == 0) {
-        return 0; // No waypoints
+// Largest --threads (0 is one per processor) and --block-size accepted
+#define MAX_THREADS_ARGUMENT 4096
+#define MAX_BLOCK_SIZE_ARGUMENT 1000000
+
+// Largest --leg-cache accepted, in legs
+#define MAX_LEG_CACHE_ARGUMENT (1L << 30)
+
+// Parse a whole argument as a number, reporting the offending position if it isn't one
+static int parseNumberArgument(const char* text, const char* name, double* value) {
+    const char* end = text + strlen(text);
+    const char* next = parseDouble(text, end, value);
+
+    if (next != end) {
+        size_t position = next ? (size_t)(next - text) : 0;
+        fprintf(stderr, "Invalid %s '%s': expected a number at position %zu\n", name, text, position + 1);
+        return 0;
     }
-    
-    int count = 0;
-    const char* ptr = waypointStr;
-    
-    while (*ptr && count < maxWaypoints) {
-        // Format: lat,lon,alt,angle|lat,lon,alt,angle|...
-        double lat, lon, alt, angle;
-        int parsed = sscanf(ptr, "%lf,%lf,%lf,%lf", &lat, &lon, &alt, &angle);
-        
-        if (parsed != 4) {
-            break; // Invalid format
+    return 1;
+}
+
+// Parse a whole argument as a whole number from minimum to maximum
+static int parseCountArgument(const char* text, const char* name, long minimum, long maximum, long* value) {
+    double number;
+    if (!parseNumberArgument(text, name, &number)) {
+        return 0;
+    }
+    if (!(number >= (double)minimum && number <= (double)maximum) || number != floor(number)) {
+        fprintf(stderr, "Invalid %s '%s': expected a whole number from %ld to %ld\n", name, text, minimum, maximum);
+        return 0;
+    }
+    *value = (long)number;
+    return 1;
+}
+
+// Run batch mode: missile_calc --batch [--threads N] [--leg-cache N] [--output-buffers N] [--stats FORMAT] [input_file|-] [output_file]
+static int runBatchMode(int argc, char* argv[]) {
+    BatchOptions options = defaultBatchOptions();
+    const char* inputPath = "-";
+    const char* outputPath = NULL;
+    int positional = 0;
+    int reportFormat = -1;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            StatsFormat format;
+            if (!parseStatsFormat(argv[++i], &format)) {
+                fprintf(stderr, "Unknown stats format: %s\n", argv[i]);
+                return 1;
+            }
+            reportFormat = format;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            long threads;
+            if (!parseCountArgument(argv[++i], "thread count", 0, MAX_THREADS_ARGUMENT, &threads)) return 1;
+            options.threadCount = (int)threads;
+        } else if (strcmp(argv[i], "--block-size") == 0 && i + 1 < argc) {
+            if (!parseCountArgument(argv[++i], "block size", 1, MAX_BLOCK_SIZE_ARGUMENT, &options.blockSize)) return 1;
+        } else if (strcmp(argv[i], "--leg-cache") == 0 && i + 1 < argc) {
+            if (!parseCountArgument(argv[++i], "leg cache size", 0, MAX_LEG_CACHE_ARGUMENT, &options.legCacheEntries)) return 1;
+        } else if (strcmp(argv[i], "--output-buffers") == 0 && i + 1 < argc) {
+            long buffers;
+            if (!parseCountArgument(argv[++i], "output buffer count", 0, PIPELINE_MAX_BUFFERS, &buffers)) return 1;
+            options.outputBuffers = (int)buffers;
+        } else if (positional == 0) {
+            inputPath = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            outputPath = argv[i];
+            positional++;
+        } else {
+            fprintf(stderr, "Unexpected batch argument: %s\n", argv[i]);
+            return 1;
         }
-        
-        waypoints[count].latitude = lat;
-        waypoints[count].longitude = lon;
-        waypoints[count].altitude = alt;
-        angles[count] = angle;
-        count++;
-        
-        // Find the next waypoint separator
-        ptr = strchr(ptr, '|');
-        if (!ptr) break;
-        ptr++; // Skip the separator
     }
-    
-    return count;
+
+    FILE* output = outputPath ? fopen(outputPath, "w") : stdout;
+    if (!output) {
+        fprintf(stderr, "Error opening batch output file\n");
+        return 1;
+    }
+
+    // Results are small lines; a large buffer keeps writes sequential
+    setvbuf(output, NULL, _IOFBF, 1 << 20);
+
+    // Input files are mapped and parsed in parallel; stdin is read as a stream
+    BatchStats stats;
+    int status = strcmp(inputPath, "-") == 0 ? runBatch(stdin, output, &options, &stats)
+                                             : runBatchFile(inputPath, output, &options, &stats);
+
+    if (output != stdout) {
+        fclose(output);
+    } else {
+        fflush(output);
+    }
+
+    printBatchSummary(stderr, &stats);
+    if (reportFormat >= 0) reportStats(stderr, (StatsFormat)reportFormat);
+    return status == 0 ? 0 : 1;
 }
 
-// Function to output trajectory data to a JSON file for the web frontend
-void outputTrajectoryJSON(TrajectoryData trajectory, const char* outputFile) {
-    FILE* file = fopen(outputFile, "w");
-    if (!file) {
-        fprintf(stderr, "Error opening output file\n");
-        return;
+// Select the kernel precision named on the command line; returns 0 if unknown
+static int selectPrecisionArgument(const char* name) {
+    KernelPrecision precision;
+    if (!parseKernelPrecision(name, &precision)) {
+        fprintf(stderr, "Unknown precision: %s (expected double or float)\n", name);
+        return 0;
     }
-    
-    // Write trajectory data as JSON
-    fprintf(file, "{\n");
-    fprintf(file, "  \"totalDistance\": %.6f,\n", trajectory.totalDistance);
-    fprintf(file, "  \"totalTravelTime\": %.6f,\n", trajectory.totalTravelTime);
-    fprintf(file, "  \"initialBearing\": %.6f,\n", trajectory.initialBearing);
-    fprintf(file, "  \"currentSpeed\": %.6f,\n", trajectory.currentSpeed);
-    fprintf(file, "  \"remainingFuel\": %.6f,\n", trajectory.remainingFuel);
-    fprintf(file, "  \"start\": {\n");
-    fprintf(file, "    \"latitude\": %.6f,\n", trajectory.start.latitude);
-    fprintf(file, "    \"longitude\": %.6f,\n", trajectory.start.longitude);
-    fprintf(file, "    \"altitude\": %.6f\n", trajectory.start.altitude);
-    fprintf(file, "  },\n");
-    fprintf(file, "  \"end\": {\n");
-    fprintf(file, "    \"latitude\": %.6f,\n", trajectory.end.latitude);
-    fprintf(file, "    \"longitude\": %.6f,\n", trajectory.end.longitude);
-    fprintf(file, "    \"altitude\": %.6f\n", trajectory.end.altitude);
-    fprintf(file, "  },\n");
-    fprintf(file, "  \"missile\": {\n");
-    fprintf(file, "    \"weight\": %.6f,\n", trajectory.missile.weight);
-    fprintf(file, "    \"speed\": %.6f,\n", trajectory.missile.speed);
-    fprintf(file, "    \"fuel\": %.6f,\n", trajectory.missile.fuel);
-    fprintf(file, "    \"burnRate\": %.6f,\n", trajectory.missile.burnRate);
-    fprintf(file, "    \"thrust\": %.6f,\n", trajectory.missile.thrust);
-    fprintf(file, "    \"maxAcceleration\": %.6f,\n", trajectory.missile.maxAcceleration);
-    fprintf(file, "    \"maxDeceleration\": %.6f,\n", trajectory.missile.maxDeceleration);
-    fprintf(file, "    \"maxTurnRate\": %.6f,\n", trajectory.missile.maxTurnRate);
-    fprintf(file, "    \"dragCoefficient\": %.6f\n", trajectory.missile.dragCoefficient);
-    fprintf(file, "  },\n");
-    
-    // Write waypoints
-    fprintf(file, "  \"waypoints\": [\n");
-    for (int i = 0; i < trajectory.waypointCount; i++) {
-        Waypoint waypoint = trajectory.waypoints[i];
-        fprintf(file, "    {\n");
-        fprintf(file, "      \"position\": {\n");
-        fprintf(file, "        \"latitude\": %.6f,\n", waypoint.position.latitude);
-        fprintf(file, "        \"longitude\": %.6f,\n", waypoint.position.longitude);
-        fprintf(file, "        \"altitude\": %.6f\n", waypoint.position.altitude);
-        fprintf(file, "      },\n");
-        fprintf(file, "      \"turnAngle\": %.6f,\n", waypoint.turnAngle);
-        fprintf(file, "      \"approachSpeed\": %.6f,\n", waypoint.approachSpeed);
-        fprintf(file, "      \"departureSpeed\": %.6f,\n", waypoint.departureSpeed);
-        fprintf(file, "      \"timeToReach\": %.6f,\n", waypoint.timeToReach);
-        fprintf(file, "      \"distanceFromPrevious\": %.6f,\n", waypoint.distanceFromPrevious);
-        fprintf(file, "      \"bearingFromPrevious\": %.6f,\n", waypoint.bearingFromPrevious);
-        fprintf(file, "      \"fuelConsumed\": %.6f,\n", waypoint.fuelConsumed);
-        fprintf(file, "      \"gForce\": %.6f\n", waypoint.gForce);
-        fprintf(file, "    }%s\n", (i < trajectory.waypointCount - 1) ? "," : "");
-    }
-    fprintf(file, "  ],\n");
-    
-    // Calculate and write path points
-    fprintf(file, "  \"path\": [\n");
-    
-    int pathPointCount = 0;
-    Coordinates* pathPoints = generatePathPoints(&trajectory, &pathPointCount);
-    
-    if (pathPoints) {
-        for (int i = 0; i < pathPointCount; i++) {
-            fprintf(file, "    {\n");
-            fprintf(file, "      \"latitude\": %.6f,\n", pathPoints[i].latitude);
-            fprintf(file, "      \"longitude\": %.6f,\n", pathPoints[i].longitude);
-            fprintf(file, "      \"altitude\": %.6f\n", pathPoints[i].altitude);
-            fprintf(file, "    }%s\n", (i < pathPointCount - 1) ? "," : "");
+    selectKernelPrecision(precision);
+    return 1;
+}
+
+// Run server mode: missile_calc --serve [--listen HOST:PORT | --socket PATH] [--threads N] [--leg-cache N]
+static int runServeMode(int argc, char* argv[]) {
+    ServerOptions options = defaultServerOptions();
+    char host[256];
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            long threads;
+            if (!parseCountArgument(argv[++i], "thread count", 0, MAX_THREADS_ARGUMENT, &threads)) return 1;
+            options.threadCount = (int)threads;
+        } else if (strcmp(argv[i], "--leg-cache") == 0 && i + 1 < argc) {
+            if (!parseCountArgument(argv[++i], "leg cache size", 0, MAX_LEG_CACHE_ARGUMENT, &options.legCacheEntries)) return 1;
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            if (!selectPrecisionArgument(argv[++i])) return 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            // HOST:PORT, or just PORT
+            const char* address = argv[++i];
+            const char* colon = strrchr(address, ':');
+            long port;
+            if (colon) {
+                size_t length = colon - address;
+                if (length >= sizeof(host)) length = sizeof(host) - 1;
+                memcpy(host, address, length);
+                host[length] = '\0';
+                options.host = host;
+            }
+            if (!parseCountArgument(colon ? colon + 1 : address, "port", 1, 65535, &port)) return 1;
+            options.port = (int)port;
+        } else {
+            fprintf(stderr, "Unexpected server argument: %s\n", argv[i]);
+            return 1;
         }
-        
-        free(pathPoints);
     }
-    
-    fprintf(file, "  ]\n");
-    fprintf(file, "}\n");
-    
-    fclose(file);
+
+    return runServer(&options);
+}
+
+// Evaluate a parsed sweep grid over the route in the positional arguments:
+// start_lat start_lon start_alt end_lat end_lon end_alt output_file|- [waypoints]
+static int runSweepRoute(const SweepGrid* grid, const char* positional[], int positionalCount) {
+    static const char* const argumentNames[6] = {
+        "start_lat", "start_lon", "start_alt", "end_lat", "end_lon", "end_alt"
+    };
+    double arguments[6];
+    for (int i = 0; i < 6; i++) {
+        if (!parseNumberArgument(positional[i], argumentNames[i], &arguments[i])) {
+            return 1;
+        }
+    }
+
+    Coordinates start = { arguments[0], arguments[1], arguments[2] };
+    Coordinates end = { arguments[3], arguments[4], arguments[5] };
+
+    Coordinates* waypoints = NULL;
+    double* turnAngles = NULL;
+    int waypointCount = 0;
+    if (positionalCount > 7) {
+        const char* text = positional[7];
+        int capacity = countWaypoints(text);
+        waypoints = (Coordinates*)malloc(capacity * sizeof(Coordinates));
+        turnAngles = (double*)malloc(capacity * sizeof(double));
+        if (!waypoints || !turnAngles) {
+            fprintf(stderr, "Error allocating waypoints\n");
+            free(waypoints);
+            free(turnAngles);
+            return 1;
+        }
+
+        ParseError error;
+        waypointCount = parseWaypointSpan(text, strlen(text), waypoints, turnAngles, capacity, &error);
+        if (waypointCount < 0) {
+            fprintf(stderr, "Invalid waypoints: %s at position %zu\n  %s\n  %*s^\n",
+                    error.message, error.offset + 1, text, (int)error.offset, "");
+            free(waypoints);
+            free(turnAngles);
+            return 1;
+        }
+    }
+
+    SweepRoute route;
+    int prepared = prepareSweepRoute(&route, start, end, waypoints, turnAngles, waypointCount);
+    free(waypoints);
+    free(turnAngles);
+    if (prepared != 0) {
+        fprintf(stderr, "Error allocating sweep route\n");
+        return 1;
+    }
+
+    int status = saveSweepCSV(&route, grid, positional[6]);
+    freeSweepRoute(&route);
+    return status == 0 ? 0 : 1;
+}
+
+// Parse the sweep axes and positional arguments into grid; returns the
+// number of positional arguments, or -1 after reporting an error
+static int parseSweepArguments(int argc, char* argv[], SweepGrid* grid, const char* positional[8]) {
+    static const char* const axisOptions[SWEEP_AXIS_COUNT] = { "--drag", "--speed", "--weight", "--turn-rate" };
+    // Drag and turn rate default to the simulator's single values
+    static const double axisDefaults[SWEEP_AXIS_COUNT] = { 0.1, 0.0, 0.0, 20.0 };
+    int positionalCount = 0;
+
+    for (int i = 2; i < argc; i++) {
+        int field = -1;
+        for (int f = 0; f < SWEEP_AXIS_COUNT; f++) {
+            if (strcmp(argv[i], axisOptions[f]) == 0) field = f;
+        }
+
+        if (field >= 0 && i + 1 < argc) {
+            const char* text = argv[++i];
+            ParseError error;
+            freeSweepAxis(&grid->axes[field]);
+            if (parseSweepAxis(text, strlen(text), &grid->axes[field], &error) != 0) {
+                fprintf(stderr, "Invalid %s '%s': %s at position %zu\n",
+                        sweepAxisName((SweepAxisField)field), text, error.message, error.offset + 1);
+                return -1;
+            }
+        } else if (positionalCount < 8) {
+            positional[positionalCount++] = argv[i];
+        } else {
+            fprintf(stderr, "Unexpected sweep argument: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (positionalCount < 7 || !grid->axes[SWEEP_SPEED].count || !grid->axes[SWEEP_WEIGHT].count) {
+        fprintf(stderr, "Usage: %s --sweep --speed LIST --weight LIST [--drag LIST] [--turn-rate LIST] "
+                        "<start_lat> <start_lon> <start_alt> <end_lat> <end_lon> <end_alt> <output_file|-> [waypoints]\n",
+                argv[0]);
+        fprintf(stderr, "LIST is v1,v2,... or first:last:step\n");
+        return -1;
+    }
+
+    for (int f = 0; f < SWEEP_AXIS_COUNT; f++) {
+        if (!grid->axes[f].count && setSweepAxis(&grid->axes[f], &axisDefaults[f], 1) != 0) {
+            fprintf(stderr, "Error allocating sweep axes\n");
+            return -1;
+        }
+    }
+    if (sweepPointCount(grid) < 0) {
+        fprintf(stderr, "Sweep grid exceeds %ld points\n", SWEEP_MAX_POINTS);
+        return -1;
+    }
+    return positionalCount;
+}
+
+// Run sweep mode: missile_calc --sweep --speed LIST --weight LIST [--drag LIST] [--turn-rate LIST]
+//                 <start_lat> <start_lon> <start_alt> <end_lat> <end_lon> <end_alt> <output_file|-> [waypoints]
+static int runSweepMode(int argc, char* argv[]) {
+    SweepGrid grid;
+    const char* positional[8];
+
+    memset(&grid, 0, sizeof(grid));
+    int positionalCount = parseSweepArguments(argc, argv, &grid, positional);
+    int status = positionalCount < 0 ? 1 : runSweepRoute(&grid, positional, positionalCount);
+
+    freeSweepGrid(&grid);
+    return status;
 }
 
 // Main function
 int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+        return runBatchMode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+        return runServeMode(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) {
+        return runSweepMode(argc, argv);
+    }
+
+    // Pull options out so the remaining arguments keep their positions
+    OutputOptions outputOptions = defaultOutputOptions();
+    int columnar = 0;
+    int reportFormat = -1;
+    const char* telemetryFile = NULL;
+    double telemetryStep = TELEMETRY_DEFAULT_STEP;
+    long telemetryMaxRows = TELEMETRY_MAX_ROWS;
+    int positionalCount = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            StatsFormat format;
+            if (!parseStatsFormat(argv[++i], &format)) {
+                fprintf(stderr, "Unknown stats format: %s\n", argv[i]);
+                return 1;
+            }
+            reportFormat = format;
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            outputOptions.compact = 1;
+        } else if (strcmp(argv[i], "--encoded-path") == 0) {
+            outputOptions.encodedPath = 1;
+        } else if (strcmp(argv[i], "--output-buffers") == 0 && i + 1 < argc) {
+            long buffers;
+            if (!parseCountArgument(argv[++i], "output buffer count", 0, PIPELINE_MAX_BUFFERS, &buffers)) return 1;
+            outputOptions.outputBuffers = (int)buffers;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            double* tolerance = &outputOptions.sampling.tolerance;
+            if (!parseNumberArgument(argv[++i], "tolerance", tolerance)) return 1;
+            if (!(*tolerance > 0.0) || isinf(*tolerance)) {
+                fprintf(stderr, "Invalid tolerance '%s': must be a positive number\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--altitude-tolerance") == 0 && i + 1 < argc) {
+            double* tolerance = &outputOptions.sampling.altitudeTolerance;
+            if (!parseNumberArgument(argv[++i], "altitude tolerance", tolerance)) return 1;
+            if (!(*tolerance >= 0.0) || isinf(*tolerance)) {
+                fprintf(stderr, "Invalid altitude tolerance '%s': must be a non-negative number\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetryFile = argv[++i];
+        } else if (strcmp(argv[i], "--telemetry-step") == 0 && i + 1 < argc) {
+            if (!parseNumberArgument(argv[++i], "telemetry step", &telemetryStep)) return 1;
+            if (!(telemetryStep > 0.0)) {
+                fprintf(stderr, "Invalid telemetry step '%s': must be positive\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--telemetry-max-rows") == 0 && i + 1 < argc) {
+            if (!parseCountArgument(argv[++i], "telemetry max rows", 1, TELEMETRY_ROW_LIMIT, &telemetryMaxRows)) return 1;
+        } else if (strcmp(argv[i], "--max-points") == 0 && i + 1 < argc) {
+            long maxPoints;
+            if (!parseCountArgument(argv[++i], "max points", 0, INT_MAX, &maxPoints)) return 1;
+            outputOptions.sampling.maxPoints = (int)maxPoints;
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            if (!selectPrecisionArgument(argv[++i])) return 1;
+        } else if (strcmp(argv[i], "--smooth") == 0) {
+            outputOptions.sampling.smoothSegments = SPLINE_DEFAULT_SEGMENTS;
+        } else if (strcmp(argv[i], "--smooth-segments") == 0 && i + 1 < argc) {
+            long segments;
+            if (!parseCountArgument(argv[++i], "smooth segments", 1, SPLINE_MAX_SEGMENTS, &segments)) return 1;
+            outputOptions.sampling.smoothSegments = (int)segments;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "columnar") == 0) {
+                columnar = 1;
+            } else if (strcmp(argv[i], "json") != 0) {
+                fprintf(stderr, "Unknown output format: %s\n", argv[i]);
+                return 1;
+            }
+        } else {
+            argv[positionalCount++] = argv[i];
+        }
+    }
+    argc = positionalCount;
+
     if (argc < 10) {
-        printf("Usage: %s <start_lat> <start_lon> <start_alt> <end_lat> <end_lon> <end_alt> <weight> <speed> <output_file> [waypoints]\n", argv[0]);
+        printf("Usage: %s [options] <start_lat> <start_lon> <start_alt> <end_lat> <end_lon> <end_alt> <weight> <speed> <output_file> [waypoints]\n", argv[0]);
+        printf("       %s --batch [--threads N] [--block-size N] [--leg-cache N] [--output-buffers N] [--stats FORMAT] [input_file|-] [output_file]\n", argv[0]);
+        printf("       %s --serve [--listen HOST:PORT | --socket PATH] [--threads N] [--leg-cache N] [--precision P]\n", argv[0]);
+        printf("       %s --sweep --speed LIST --weight LIST [--drag LIST] [--turn-rate LIST] <start_lat> <start_lon> <start_alt> <end_lat> <end_lon> <end_alt> <output_file|-> [waypoints]\n", argv[0]);
+        printf("Options: --compact               JSON without indentation\n");
+        printf("         --encoded-path          path as delta-encoded polyline strings\n");
+        printf("         --format json|columnar  output file format\n");
+        printf("         --output-buffers N      write JSON through N buffers on an output thread (0 for none)\n");
+        printf("         --tolerance KM          sample the path adaptively to this horizontal deviation\n");
+        printf("         --altitude-tolerance M  bound the altitude profile deviation (default 1000 m per km)\n");
+        printf("         --max-points N          cap the number of adaptive path points\n");
+        printf("         --precision double|float path points and leg physics in double (default) or faster float\n");
+        printf("         --smooth                output the web frontend's Catmull-Rom smoothed path\n");
+        printf("         --smooth-segments N     smooth with N samples per leg (default 20)\n");
+        printf("         --stats json|prometheus report phase timers and counters on stderr at exit\n");
+        printf("         --telemetry FILE        also write time,lat,lng,alt,speed,eta,dist samples as CSV\n");
+        printf("         --telemetry-step S      seconds between telemetry samples (default 1)\n");
+        printf("         --telemetry-max-rows N  refuse a telemetry log longer than N rows (default 1000000)\n");
         printf("Waypoints format: lat,lon,alt,angle|lat,lon,alt,angle|...\n");
+        printf("Batch record format: start_lat start_lon start_alt end_lat end_lon end_alt weight speed [waypoints]\n");
         return 1;
     }
     
     // Parse command line arguments
+    static const char* const argumentNames[8] = {
+        "start_lat", "start_lon", "start_alt", "end_lat", "end_lon", "end_alt", "weight", "speed"
+    };
+    double arguments[8];
+    for (int i = 0; i < 8; i++) {
+        if (!parseNumberArgument(argv[i + 1], argumentNames[i], &arguments[i])) {
+            return 1;
+        }
+    }
+
     Coordinates start, end;
-    MissileAttributes missile;
-    
-    start.latitude = atof(argv[1]);
-    start.longitude = atof(argv[2]);
-    start.altitude = atof(argv[3]);
-    
-    end.latitude = atof(argv[4]);
-    end.longitude = atof(argv[5]);
-    end.altitude = atof(argv[6]);
     
-    missile.weight = atof(argv[7]);
-    missile.speed = atof(argv[8]);
-    missile.fuel = missile.weight * 0.7; // Assume 70% of weight is fuel
-    missile.burnRate = missile.fuel / 60.0; // Burn all fuel in 60 seconds
-    missile.thrust = missile.weight * 30.0; // Simple thrust calculation
+    start.latitude = arguments[0];
+    start.longitude = arguments[1];
+    start.altitude = arguments[2];
     
-    // Set advanced physics parameters
-    missile.maxAcceleration = 30.0; // m/s²
-    missile.maxDeceleration = 50.0; // m/s²
-    missile.maxTurnRate = 20.0;     // degrees/second
-    missile.dragCoefficient = 0.1;  // dimensionless
-    missile.fuelConsumptionNormal = missile.burnRate;
-    missile.fuelConsumptionTurn = missile.burnRate * 2.0;
+    end.latitude = arguments[3];
+    end.longitude = arguments[4];
+    end.altitude = arguments[5];
     
+    MissileAttributes missile = defaultMissileAttributes(arguments[6], arguments[7]);
+
     const char* outputFile = argv[9];
     
     // Calculate initial trajectory
     TrajectoryData trajectory = calculateTrajectory(start, end, missile);
     
     // Parse and add waypoints if provided
-    if (argc > 10) {
-        Coordinates waypointCoords[MAX_WAYPOINTS];
-        double turnAngles[MAX_WAYPOINTS];
+    int capacity = argc > 10 ? countWaypoints(argv[10]) : 0;
+    if (capacity > 0) {
+        Coordinates* waypointCoords = (Coordinates*)malloc(capacity * sizeof(Coordinates));
+        double* turnAngles = (double*)malloc(capacity * sizeof(double));
         
-        int waypointCount = parseWaypoints(argv[10], waypointCoords, turnAngles, MAX_WAYPOINTS);
+        if (!waypointCoords || !turnAngles) {
+            fprintf(stderr, "Error allocating waypoints\n");
+            free(waypointCoords);
+            free(turnAngles);
+            return 1;
+        }
         
-        for (int i = 0; i < waypointCount; i++) {
-            addWaypoint(&trajectory, waypointCoords[i], turnAngles[i]);
+        ParseError error;
+        int waypointCount = parseWaypointSpan(argv[10], strlen(argv[10]), waypointCoords, turnAngles, capacity, &error);
+        if (waypointCount < 0) {
+            fprintf(stderr, "Invalid waypoints: %s at position %zu\n  %s\n  %*s^\n",
+                    error.message, error.offset + 1, argv[10], (int)error.offset, "");
+            free(waypointCoords);
+            free(turnAngles);
+            freeTrajectory(&trajectory);
+            return 1;
         }
+
+        addWaypoints(&trajectory, waypointCoords, turnAngles, waypointCount);
+        free(waypointCoords);
+        free(turnAngles);
     }
     
     // Print trajectory information
@@ -193,8 +477,15 @@ int main(int argc, char* argv[]) {
         printf("  Fuel consumed: %.2f kg\n", wp.fuelConsumed);
     }
     
-    // Output JSON for web frontend
-    outputTrajectoryJSON(trajectory, outputFile);
+    // Output JSON for web frontend, or the columnar file for analysis
+    int status = columnar ? saveTrajectoryColumnar(&trajectory, outputFile, &outputOptions.sampling)
+                          : saveTrajectoryJSON(&trajectory, outputFile, &outputOptions);
+    
+    if (telemetryFile && saveTelemetryCSV(&trajectory, telemetryFile, telemetryStep, telemetryMaxRows) != 0) {
+        status = -1;
+    }
     
-    return 0;
+    freeTrajectory(&trajectory);
+    if (reportFormat >= 0) reportStats(stderr, (StatsFormat)reportFormat);
+    return status == 0 ? 0 : 1;
 }
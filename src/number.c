@@ -0,0 +1,146 @@
+#include "number.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <pthread.h>
+
+// Significant digits that always fit in a uint64_t mantissa
+#define NUMBER_MAX_DIGITS 19
+
+// Largest power of ten that is exact in a double
+#define NUMBER_MAX_EXACT_POWER 22
+
+// Longest token the strtod fallback copies onto the stack
+#define NUMBER_FALLBACK_BUFFER 128
+
+static const double exactPowersOfTen[NUMBER_MAX_EXACT_POWER + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static pthread_once_t cLocaleOnce = PTHREAD_ONCE_INIT;
+static locale_t cLocale;
+
+static void createCLocale(void) {
+    cLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+}
+
+static int isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// strtod on [start, end) in the C locale. Returns the end of what it parsed
+static const char* parseDoubleSlow(const char* start, const char* end, double* value) {
+    char stackBuffer[NUMBER_FALLBACK_BUFFER];
+    size_t length = end - start;
+    char* buffer = length < sizeof(stackBuffer) ? stackBuffer : (char*)malloc(length + 1);
+    if (!buffer) {
+        return NULL;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    pthread_once(&cLocaleOnce, createCLocale);
+    locale_t previous = cLocale ? uselocale(cLocale) : (locale_t)0;
+    char* parsedEnd;
+    *value = strtod(buffer, &parsedEnd);
+    if (cLocale) uselocale(previous);
+
+    const char* next = parsedEnd == buffer ? NULL : start + (parsedEnd - buffer);
+    if (buffer != stackBuffer) free(buffer);
+    return next;
+}
+
+// Parse a decimal number ([+-]digits[.digits][(e|E)[+-]digits]) at the start
+// of [start, end). Returns the first byte after it, or NULL if there is no number.
+// Clinger's fast path handles mantissas up to 2^53 with exponents whose power
+// of ten is exact: one correctly rounded multiply or divide gives the exact
+// result. Anything else (long mantissas, large exponents, inf/nan) goes to strtod
+const char* parseDouble(const char* start, const char* end, double* value) {
+    const char* p = start;
+    int negative = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+    int sawDigit = 0;
+    int inexact = 0;        // Non-zero digits beyond NUMBER_MAX_DIGITS were dropped
+
+    for (; p < end && isDigit(*p); p++) {
+        sawDigit = 1;
+        if (significantDigits < NUMBER_MAX_DIGITS) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa) significantDigits++;
+        } else {
+            exponent++;
+            inexact |= *p != '0';
+        }
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && isDigit(*p); p++) {
+            sawDigit = 1;
+            if (significantDigits < NUMBER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa) significantDigits++;
+                exponent--;
+            } else {
+                inexact |= *p != '0';
+            }
+        }
+    }
+
+    if (!sawDigit) {
+        // Possibly inf or nan: let strtod decide over the alphabetic run
+        const char* tokenEnd = p;
+        while (tokenEnd < end && ((*tokenEnd >= 'a' && *tokenEnd <= 'z') || (*tokenEnd >= 'A' && *tokenEnd <= 'Z'))) {
+            tokenEnd++;
+        }
+        return tokenEnd > p ? parseDoubleSlow(start, tokenEnd, value) : NULL;
+    }
+
+    // An exponent only counts when digits follow the marker
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int exponentNegative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exponentNegative = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q)) {
+            int explicitExponent = 0;
+            for (; q < end && isDigit(*q); q++) {
+                if (explicitExponent < 100000) explicitExponent = explicitExponent * 10 + (*q - '0');
+            }
+            exponent += exponentNegative ? -explicitExponent : explicitExponent;
+            p = q;
+        }
+    }
+
+    if (mantissa == 0 && !inexact) {
+        *value = negative ? -0.0 : 0.0;
+        return p;
+    }
+
+    if (!inexact && mantissa <= (UINT64_C(1) << 53)) {
+        double result = (double)mantissa;
+        if (exponent >= 0 && exponent <= NUMBER_MAX_EXACT_POWER) {
+            *value = negative ? -(result * exactPowersOfTen[exponent]) : result * exactPowersOfTen[exponent];
+            return p;
+        }
+        if (exponent < 0 && exponent >= -NUMBER_MAX_EXACT_POWER) {
+            *value = negative ? -(result / exactPowersOfTen[-exponent]) : result / exactPowersOfTen[-exponent];
+            return p;
+        }
+    }
+
+    const char* parsedEnd = parseDoubleSlow(start, p, value);
+    return parsedEnd == p ? p : NULL;
+}
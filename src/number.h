@@ -0,0 +1,11 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+// Locale-independent decimal parsing straight from a byte span (no NUL
+// terminator needed). Results are correctly rounded, like strtod in the C
+// locale: short inputs take an exact fast path, the rest fall back to strtod.
+
+// Function declarations
+const char* parseDouble(const char* start, const char* end, double* value);
+
+#endif /* NUMBER_H */
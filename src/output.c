@@ -0,0 +1,333 @@
+#include "output.h"
+#include "spline.h"
+#include "polyline.h"
+#include "stats.h"
+#include <string.h>
+
+// Deepest nesting the trajectory document uses
+#define JSON_MAX_DEPTH 8
+
+// Decimals written for every number in the document
+#define JSON_DECIMALS 6
+
+// Streaming JSON emitter; tracks only what it needs to place commas and indentation
+typedef struct {
+    Writer* writer;
+    int compact;
+    int depth;
+    int hasMembers[JSON_MAX_DEPTH];
+
+    // Encoded path: the last quantised point, and the altitude string, which
+    // follows the path string and so is collected on the side
+    int encodedPath;
+    long long previous[3];
+    Writer altitudes;
+} JsonEmitter;
+
+static const char jsonIndent[] = "                                ";
+
+// Separator, line break and key before a value at the current depth
+static void jsonPrefix(JsonEmitter* json, const char* key) {
+    Writer* writer = json->writer;
+
+    if (json->hasMembers[json->depth]) {
+        writerPutChar(writer, ',');
+    }
+    json->hasMembers[json->depth] = 1;
+
+    if (!json->compact) {
+        writerPutChar(writer, '\n');
+        writerPut(writer, jsonIndent, 2 * json->depth);
+    }
+
+    if (key) {
+        writerPutChar(writer, '"');
+        writerPutString(writer, key);
+        writerPut(writer, json->compact ? "\":" : "\": ", json->compact ? 2 : 3);
+    }
+}
+
+static void jsonOpen(JsonEmitter* json, const char* key, char bracket) {
+    if (json->depth > 0 || json->hasMembers[0]) {
+        jsonPrefix(json, key);
+    }
+    writerPutChar(json->writer, bracket);
+    json->depth++;
+    json->hasMembers[json->depth] = 0;
+}
+
+static void jsonClose(JsonEmitter* json, char bracket) {
+    json->depth--;
+    if (!json->compact) {
+        writerPutChar(json->writer, '\n');
+        writerPut(json->writer, jsonIndent, 2 * json->depth);
+    }
+    writerPutChar(json->writer, bracket);
+}
+
+static void jsonNumber(JsonEmitter* json, const char* key, double value) {
+    jsonPrefix(json, key);
+    writerPutFixed(json->writer, value, JSON_DECIMALS);
+}
+
+static void jsonCoordinates(JsonEmitter* json, const char* key, Coordinates coordinates) {
+    jsonOpen(json, key, '{');
+    jsonNumber(json, "latitude", coordinates.latitude);
+    jsonNumber(json, "longitude", coordinates.longitude);
+    jsonNumber(json, "altitude", coordinates.altitude);
+    jsonClose(json, '}');
+}
+
+// Append one polyline difference as JSON string content. Polyline
+// characters need no escaping except the backslash
+static void putPolylineValue(Writer* writer, long long delta) {
+    char text[POLYLINE_MAX_VALUE_CHARS];
+    int length = encodePolylineValue(delta, text);
+
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '\\') writerPutChar(writer, '\\');
+        writerPutChar(writer, text[i]);
+    }
+}
+
+// Open the document's path: an array of point objects, or for an encoded
+// path its precisions and the opening quote of the latitude/longitude string
+static void beginPath(JsonEmitter* json) {
+    if (!json->encodedPath) {
+        jsonOpen(json, "path", '[');
+        return;
+    }
+
+    jsonPrefix(json, "pathEncoding");
+    writerPutString(json->writer, "\"polyline\"");
+    jsonPrefix(json, "pathPrecision");
+    writerPutInt(json->writer, POLYLINE_PRECISION);
+    jsonPrefix(json, "altitudePrecision");
+    writerPutInt(json->writer, POLYLINE_ALTITUDE_PRECISION);
+    jsonPrefix(json, "path");
+    writerPutChar(json->writer, '"');
+
+    memset(json->previous, 0, sizeof(json->previous));
+    if (openMemoryWriter(&json->altitudes, 4096) != 0) {
+        json->writer->error = 1;
+    }
+}
+
+static void pathPoint(JsonEmitter* json, Coordinates point) {
+    if (!json->encodedPath) {
+        jsonCoordinates(json, NULL, point);
+        return;
+    }
+
+    long long latitude = polylineQuantize(point.latitude, POLYLINE_SCALE);
+    long long longitude = polylineQuantize(point.longitude, POLYLINE_SCALE);
+    long long altitude = polylineQuantize(point.altitude, POLYLINE_ALTITUDE_SCALE);
+
+    putPolylineValue(json->writer, latitude - json->previous[0]);
+    putPolylineValue(json->writer, longitude - json->previous[1]);
+    putPolylineValue(&json->altitudes, altitude - json->previous[2]);
+    json->previous[0] = latitude;
+    json->previous[1] = longitude;
+    json->previous[2] = altitude;
+}
+
+// Close the path; an encoded path's altitude string follows as "pathAltitudes"
+static void endPath(JsonEmitter* json) {
+    if (!json->encodedPath) {
+        jsonClose(json, ']');
+        return;
+    }
+
+    writerPutChar(json->writer, '"');
+    jsonPrefix(json, "pathAltitudes");
+    writerPutChar(json->writer, '"');
+    if (json->altitudes.error) json->writer->error = 1;
+    writerPut(json->writer, json->altitudes.buffer, json->altitudes.length);
+    writerPutChar(json->writer, '"');
+    closeWriter(&json->altitudes);
+}
+
+OutputOptions defaultOutputOptions(void) {
+    OutputOptions options;
+    options.compact = 0;
+    options.encodedPath = 0;
+    options.sampling = defaultSamplingOptions();
+    options.outputBuffers = -1;
+    return options;
+}
+
+// Everything up to and including the opening of the "path" array
+static void beginTrajectoryJSON(JsonEmitter* json, Writer* writer, const TrajectoryData* trajectory,
+                                const OutputOptions* options) {
+    memset(json, 0, sizeof(*json));
+    json->writer = writer;
+    json->compact = options->compact;
+    json->encodedPath = options->encodedPath;
+
+    jsonOpen(json, NULL, '{');
+    jsonNumber(json, "totalDistance", trajectory->totalDistance);
+    jsonNumber(json, "totalTravelTime", trajectory->totalTravelTime);
+    jsonNumber(json, "initialBearing", trajectory->initialBearing);
+    jsonNumber(json, "currentSpeed", trajectory->currentSpeed);
+    jsonNumber(json, "remainingFuel", trajectory->remainingFuel);
+    jsonCoordinates(json, "start", trajectory->start);
+    jsonCoordinates(json, "end", trajectory->end);
+
+    jsonOpen(json, "missile", '{');
+    jsonNumber(json, "weight", trajectory->missile.weight);
+    jsonNumber(json, "speed", trajectory->missile.speed);
+    jsonNumber(json, "fuel", trajectory->missile.fuel);
+    jsonNumber(json, "burnRate", trajectory->missile.burnRate);
+    jsonNumber(json, "thrust", trajectory->missile.thrust);
+    jsonNumber(json, "maxAcceleration", trajectory->missile.maxAcceleration);
+    jsonNumber(json, "maxDeceleration", trajectory->missile.maxDeceleration);
+    jsonNumber(json, "maxTurnRate", trajectory->missile.maxTurnRate);
+    jsonNumber(json, "dragCoefficient", trajectory->missile.dragCoefficient);
+    jsonClose(json, '}');
+
+    // Write waypoints
+    jsonOpen(json, "waypoints", '[');
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        const Waypoint* waypoint = &trajectory->waypoints[i];
+        jsonOpen(json, NULL, '{');
+        jsonCoordinates(json, "position", waypoint->position);
+        jsonNumber(json, "turnAngle", waypoint->turnAngle);
+        jsonNumber(json, "approachSpeed", waypoint->approachSpeed);
+        jsonNumber(json, "departureSpeed", waypoint->departureSpeed);
+        jsonNumber(json, "timeToReach", waypoint->timeToReach);
+        jsonNumber(json, "distanceFromPrevious", waypoint->distanceFromPrevious);
+        jsonNumber(json, "bearingFromPrevious", waypoint->bearingFromPrevious);
+        jsonNumber(json, "fuelConsumed", waypoint->fuelConsumed);
+        jsonNumber(json, "gForce", waypoint->gForce);
+        jsonClose(json, '}');
+    }
+    jsonClose(json, ']');
+
+    // Path points follow
+    beginPath(json);
+}
+
+static void endTrajectoryJSON(JsonEmitter* json) {
+    endPath(json);
+    jsonClose(json, '}');
+    writerPutChar(json->writer, '\n');
+}
+
+static int jsonPathSink(void* context, const Coordinates* points, int count) {
+    JsonEmitter* json = (JsonEmitter*)context;
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    for (int i = 0; i < count; i++) {
+        pathPoint(json, points[i]);
+    }
+    STATS_END();
+    return json->writer->error;
+}
+
+// Smoothed path points, then the length and flight time of the smoothed path
+// (km and s, as the frontend reports them) after the path array
+static void writeSmoothedPathJSON(JsonEmitter* json, const TrajectoryData* trajectory, int segments) {
+    SplinePath path;
+
+    if (buildTrajectorySpline(trajectory, segments, &path, NULL) != 0) {
+        json->writer->error = 1;
+        endPath(json);
+        return;
+    }
+    STATS_ADD(STATS_COUNTER_PATH_POINTS, path.count);
+
+    for (int i = 0; i < path.count; i++) {
+        Coordinates point = { path.latitude[i], path.longitude[i], path.altitude[i] };
+        pathPoint(json, point);
+    }
+    endPath(json);
+
+    double distance = splinePathDistance(&path);
+    double speed = trajectory->missile.speed;
+    jsonNumber(json, "smoothedDistance", distance);
+    jsonNumber(json, "smoothedTravelTime", speed > 0.0 ? distance * 1000.0 / speed : 0.0);
+    freeSplinePath(&path);
+}
+
+// Stream the trajectory document consumed by the web frontend to writer.
+// Path points go straight from the sampler to the writer without a buffer
+void writeTrajectoryJSON(Writer* writer, TrajectoryData* trajectory, const OutputOptions* options) {
+    JsonEmitter json;
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+
+    beginTrajectoryJSON(&json, writer, trajectory, options);
+    if (options->sampling.smoothSegments > 0) {
+        writeSmoothedPathJSON(&json, trajectory, options->sampling.smoothSegments);
+        jsonClose(&json, '}');
+        writerPutChar(writer, '\n');
+    } else {
+        streamPathPoints(trajectory, &options->sampling, jsonPathSink, &json, NULL, NULL);
+        endTrajectoryJSON(&json);
+    }
+    STATS_END();
+}
+
+// Same document, with path points supplied by the caller instead of sampled
+void writeTrajectoryJSONWithPath(Writer* writer, const TrajectoryData* trajectory,
+                                 const Coordinates* pathPoints, int pathPointCount, const OutputOptions* options) {
+    JsonEmitter json;
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+
+    beginTrajectoryJSON(&json, writer, trajectory, options);
+    for (int i = 0; pathPoints && i < pathPointCount; i++) {
+        pathPoint(&json, pathPoints[i]);
+    }
+    endTrajectoryJSON(&json);
+    STATS_END();
+}
+
+// Rough size of the document in bytes: the path points plus a few hundred
+// bytes per waypoint. Adaptive sampling is taken to need no more points than
+// the fixed sampler
+static size_t estimateDocumentSize(const TrajectoryData* trajectory, const OutputOptions* options) {
+    size_t segments = (size_t)trajectory->waypointCount + 1;
+    size_t points = segments * (options->sampling.smoothSegments > 0 ? (size_t)options->sampling.smoothSegments
+                                                                      : PATH_POINTS_PER_SEGMENT);
+    size_t pointSize = options->encodedPath ? 12 : options->compact ? 70 : 100;
+    return points * pointSize + segments * 400;
+}
+
+// Write the trajectory document to outputFile; returns 0 on success. With an
+// output pipeline, full buffers are written by its thread while the path is
+// still being sampled into the next one
+int saveTrajectoryJSON(TrajectoryData* trajectory, const char* outputFile, const OutputOptions* options) {
+    FILE* file = fopen(outputFile, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening output file\n");
+        return -1;
+    }
+
+    int bufferCount = options->outputBuffers;
+    if (bufferCount < 0) {
+        bufferCount = estimateDocumentSize(trajectory, options) > OUTPUT_PIPELINE_MIN_SIZE ? PIPELINE_DEFAULT_BUFFERS : 0;
+    }
+
+    Writer writer;
+    OutputPipeline* pipeline = bufferCount > 0 ? createOutputPipeline(file, bufferCount, WRITER_DEFAULT_BUFFER) : NULL;
+    if (pipeline ? openPipelineWriter(&writer, pipeline) != 0 : openWriter(&writer, file, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error allocating output buffer\n");
+        destroyOutputPipeline(pipeline, NULL);
+        fclose(file);
+        return -1;
+    }
+
+    writeTrajectoryJSON(&writer, trajectory, options);
+
+    int status = closeWriter(&writer);
+    if (destroyOutputPipeline(pipeline, NULL) != 0) status = -1;
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) {
+        fprintf(stderr, "Error writing output file\n");
+    }
+    return status;
+}
+
+// Function to output trajectory data to a JSON file for the web frontend
+void outputTrajectoryJSON(TrajectoryData trajectory, const char* outputFile) {
+    OutputOptions options = defaultOutputOptions();
+    saveTrajectoryJSON(&trajectory, outputFile, &options);
+}
@@ -0,0 +1,29 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "trajectory.h"
+#include "writer.h"
+#include "sampling.h"
+
+// Options controlling the trajectory JSON document
+typedef struct {
+    int compact;                // Omit indentation and line breaks
+    int encodedPath;            // Path as polyline strings instead of point objects (src/polyline.h)
+    SamplingOptions sampling;   // How the path is sampled
+    int outputBuffers;          // Buffers of the output pipeline saveTrajectoryJSON writes through, 0 to
+                                // write on the calling thread, < 0 for a pipeline on large documents only
+} OutputOptions;
+
+// Estimated document size above which saveTrajectoryJSON writes through an
+// output pipeline by default; smaller documents go out in one or two writes
+#define OUTPUT_PIPELINE_MIN_SIZE (2 * WRITER_DEFAULT_BUFFER)
+
+// Function declarations
+OutputOptions defaultOutputOptions(void);
+void writeTrajectoryJSON(Writer* writer, TrajectoryData* trajectory, const OutputOptions* options);
+void writeTrajectoryJSONWithPath(Writer* writer, const TrajectoryData* trajectory,
+                                 const Coordinates* pathPoints, int pathPointCount, const OutputOptions* options);
+int saveTrajectoryJSON(TrajectoryData* trajectory, const char* outputFile, const OutputOptions* options);
+void outputTrajectoryJSON(TrajectoryData trajectory, const char* outputFile);
+
+#endif /* OUTPUT_H */
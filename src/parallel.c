@@ -0,0 +1,236 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Each queue holds a contiguous index range packed as (tail << 32) | head.
+// The owner pops from the head, thieves take the upper half from the tail.
+#define QUEUE_HEAD(range) ((uint32_t)((range) & 0xffffffffu))
+#define QUEUE_TAIL(range) ((uint32_t)((range) >> 32))
+#define QUEUE_PACK(head, tail) (((uint64_t)(tail) << 32) | (uint64_t)(head))
+
+// Largest index range handed to the queues in one round
+#define MAX_ROUND_SIZE 0x7fffffffL
+
+// Range queue padded to a cache line so workers don't share lines
+typedef struct {
+    _Atomic uint64_t range;
+    char padding[64 - sizeof(uint64_t)];
+} RangeQueue;
+
+typedef struct {
+    WorkerPool* pool;
+    int index;
+} WorkerSlot;
+
+struct WorkerPool {
+    int threadCount;
+    pthread_t* threads;
+    WorkerSlot* slots;
+    RangeQueue* queues;
+
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    unsigned long generation;   // Incremented for every round of work
+    int pendingWorkers;         // Helpers still running the current round
+    int shuttingDown;
+
+    // Current round
+    long base;
+    ParallelTask task;
+    void* context;
+};
+
+// Number of online processors, at least 1
+int availableProcessors(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+// Take the next index from the worker's own queue
+static int popLocal(RangeQueue* queue, uint32_t* index) {
+    uint64_t range = atomic_load_explicit(&queue->range, memory_order_acquire);
+
+    for (;;) {
+        uint32_t head = QUEUE_HEAD(range);
+        uint32_t tail = QUEUE_TAIL(range);
+        if (head >= tail) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(&queue->range, &range, QUEUE_PACK(head + 1, tail),
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            *index = head;
+            return 1;
+        }
+    }
+}
+
+// Move the upper half of another worker's range into this worker's empty queue
+static int stealWork(WorkerPool* pool, int worker) {
+    for (int offset = 1; offset < pool->threadCount; offset++) {
+        RangeQueue* victim = &pool->queues[(worker + offset) % pool->threadCount];
+        uint64_t range = atomic_load_explicit(&victim->range, memory_order_acquire);
+
+        for (;;) {
+            uint32_t head = QUEUE_HEAD(range);
+            uint32_t tail = QUEUE_TAIL(range);
+            if (head >= tail) {
+                break; // Nothing left to steal here
+            }
+
+            uint32_t split = tail - (tail - head + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, QUEUE_PACK(head, split),
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+                atomic_store_explicit(&pool->queues[worker].range, QUEUE_PACK(split, tail),
+                                      memory_order_release);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Process indices until every queue is empty
+static void drainQueues(WorkerPool* pool, int worker) {
+    uint32_t index;
+
+    do {
+        while (popLocal(&pool->queues[worker], &index)) {
+            pool->task(pool->context, pool->base + index, worker);
+        }
+    } while (stealWork(pool, worker));
+}
+
+static void* workerMain(void* argument) {
+    WorkerSlot* slot = (WorkerSlot*)argument;
+    WorkerPool* pool = slot->pool;
+    unsigned long seenGeneration = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shuttingDown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->workReady, &pool->lock);
+        }
+        if (pool->shuttingDown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seenGeneration = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        drainQueues(pool, slot->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pendingWorkers == 0) {
+            pthread_cond_signal(&pool->workDone);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// Create a pool of threadCount workers; the calling thread acts as worker 0
+WorkerPool* createWorkerPool(int threadCount) {
+    if (threadCount < 1) {
+        threadCount = availableProcessors();
+    }
+
+    WorkerPool* pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->threadCount = threadCount;
+    pool->threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+    pool->slots = (WorkerSlot*)calloc(threadCount, sizeof(WorkerSlot));
+    pool->queues = (RangeQueue*)aligned_alloc(64, threadCount * sizeof(RangeQueue));
+    if (!pool->threads || !pool->slots || !pool->queues) {
+        free(pool->threads);
+        free(pool->slots);
+        free(pool->queues);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+
+    for (int i = 0; i < threadCount; i++) {
+        atomic_init(&pool->queues[i].range, 0);
+        pool->slots[i].pool = pool;
+        pool->slots[i].index = i;
+    }
+
+    for (int i = 1; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerMain, &pool->slots[i]) != 0) {
+            // Run with the helpers that did start
+            pool->threadCount = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+// Stop the helper threads and release the pool
+void destroyWorkerPool(WorkerPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = 1;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_cond_destroy(&pool->workDone);
+    free(pool->threads);
+    free(pool->slots);
+    free(pool->queues);
+    free(pool);
+}
+
+int workerPoolSize(const WorkerPool* pool) {
+    return pool->threadCount;
+}
+
+// Run task for every index in [0, count) and return once all calls have finished
+void runParallel(WorkerPool* pool, long count, ParallelTask task, void* context) {
+    for (long base = 0; base < count; base += MAX_ROUND_SIZE) {
+        long roundSize = count - base < MAX_ROUND_SIZE ? count - base : MAX_ROUND_SIZE;
+
+        // Give every worker an equal contiguous share to start from
+        for (int i = 0; i < pool->threadCount; i++) {
+            uint32_t head = (uint32_t)(roundSize * i / pool->threadCount);
+            uint32_t tail = (uint32_t)(roundSize * (i + 1) / pool->threadCount);
+            atomic_store_explicit(&pool->queues[i].range, QUEUE_PACK(head, tail), memory_order_relaxed);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->base = base;
+        pool->task = task;
+        pool->context = context;
+        pool->pendingWorkers = pool->threadCount - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->workReady);
+        pthread_mutex_unlock(&pool->lock);
+
+        drainQueues(pool, 0);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pendingWorkers > 0) {
+            pthread_cond_wait(&pool->workDone, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Task invoked once per index; worker identifies the calling thread (0..threadCount-1)
+typedef void (*ParallelTask)(void* context, long index, int worker);
+
+// Pool of worker threads that share index ranges through work stealing
+typedef struct WorkerPool WorkerPool;
+
+// Function declarations
+int availableProcessors(void);
+WorkerPool* createWorkerPool(int threadCount);
+void destroyWorkerPool(WorkerPool* pool);
+int workerPoolSize(const WorkerPool* pool);
+void runParallel(WorkerPool* pool, long count, ParallelTask task, void* context);
+
+#endif /* PARALLEL_H */
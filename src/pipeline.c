@@ -0,0 +1,281 @@
+#include "pipeline.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Attempts on a ring before a side parks on its condition variable
+#define PIPELINE_SPINS 64
+
+// What a ring entry carries
+typedef enum {
+    ENTRY_BUFFER = 0,   // A buffer and the bytes it holds
+    ENTRY_SYNC,         // Flush the file and report back
+    ENTRY_CLOSE         // Flush the file and stop
+} EntryKind;
+
+typedef struct {
+    char* data;
+    size_t length;
+    EntryKind kind;
+} PipelineEntry;
+
+// Bounded single-producer, single-consumer ring. head is only written by the
+// consumer and tail by the producer, each on its own cache line; both only grow.
+// Every buffer is in at most one ring, so with room for all of them and one
+// marker a push never finds the ring full
+typedef struct {
+    _Alignas(64) _Atomic size_t head;
+    _Alignas(64) _Atomic size_t tail;
+    _Alignas(64) atomic_int sleeping;   // The consumer is parked on ready
+    pthread_cond_t ready;
+    size_t capacity;
+    PipelineEntry entries[PIPELINE_MAX_BUFFERS + 1];
+} EntryRing;
+
+struct OutputPipeline {
+    EntryRing filled;           // Producer to writer thread
+    EntryRing empty;            // Writer thread back to producer
+    pthread_mutex_t lock;       // Only taken to park or wake a side
+    pthread_cond_t synced;
+    unsigned long syncsCompleted;   // Guarded by lock
+    unsigned long syncsRequested;   // Producer only
+    atomic_int error;           // Non-zero once a write or flush failed
+
+    FILE* file;
+    char* memory;               // bufferCount buffers of bufferSize bytes
+    size_t bufferSize;
+    int bufferCount;
+    pthread_t thread;
+
+    // Producer side
+    unsigned long long stalls;
+    double stallSeconds;
+
+    // Writer thread side
+    unsigned long long buffersWritten;
+    unsigned long long bytesWritten;
+    double writeSeconds;
+};
+
+static double pipelineSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void initRing(EntryRing* ring, size_t capacity) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->sleeping, 0);
+    pthread_cond_init(&ring->ready, NULL);
+    ring->capacity = capacity;
+}
+
+// Append an entry and wake the consumer if it's parked. The fence pairs with
+// the one in popEntry: either the consumer sees the entry or we see it asleep
+static void pushEntry(OutputPipeline* pipeline, EntryRing* ring, const PipelineEntry* entry) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    ring->entries[tail % ring->capacity] = *entry;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->sleeping, memory_order_relaxed)) {
+        pthread_mutex_lock(&pipeline->lock);
+        pthread_cond_signal(&ring->ready);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+
+static int tryPopEntry(EntryRing* ring, PipelineEntry* entry) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+        return 0;
+    }
+    *entry = ring->entries[head % ring->capacity];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Take the next entry, spinning briefly and then sleeping until one arrives
+static void popEntry(OutputPipeline* pipeline, EntryRing* ring, PipelineEntry* entry) {
+    for (int i = 0; i < PIPELINE_SPINS; i++) {
+        if (tryPopEntry(ring, entry)) return;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    atomic_store_explicit(&ring->sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!tryPopEntry(ring, entry)) {
+        pthread_cond_wait(&ring->ready, &pipeline->lock);
+    }
+    atomic_store_explicit(&ring->sleeping, 0, memory_order_relaxed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Write each filled buffer in order and hand it back. After a failed write the
+// buffers keep cycling unwritten, so the producer never blocks on an error
+static void* outputWriterThread(void* argument) {
+    OutputPipeline* pipeline = (OutputPipeline*)argument;
+
+    for (;;) {
+        PipelineEntry entry;
+        popEntry(pipeline, &pipeline->filled, &entry);
+
+        if (entry.kind == ENTRY_BUFFER) {
+            if (entry.length > 0 && !atomic_load_explicit(&pipeline->error, memory_order_relaxed)) {
+                double start = pipelineSeconds();
+                if (fwrite(entry.data, 1, entry.length, pipeline->file) != entry.length) {
+                    atomic_store(&pipeline->error, 1);
+                }
+                pipeline->writeSeconds += pipelineSeconds() - start;
+                pipeline->buffersWritten++;
+                pipeline->bytesWritten += entry.length;
+                STATS_ADD(STATS_COUNTER_BYTES_WRITTEN, entry.length);
+            }
+            pushEntry(pipeline, &pipeline->empty, &entry);
+            continue;
+        }
+
+        double start = pipelineSeconds();
+        if (fflush(pipeline->file) != 0) {
+            atomic_store(&pipeline->error, 1);
+        }
+        pipeline->writeSeconds += pipelineSeconds() - start;
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->syncsCompleted++;
+        pthread_cond_broadcast(&pipeline->synced);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        if (entry.kind == ENTRY_CLOSE) {
+            return NULL;
+        }
+    }
+}
+
+// Start a writer thread for file with bufferCount buffers of bufferSize bytes
+// (0 for the defaults). Until the pipeline is destroyed only its thread may
+// touch file. Returns NULL if the buffers or the thread can't be had
+OutputPipeline* createOutputPipeline(FILE* file, int bufferCount, size_t bufferSize) {
+    if (bufferCount < 1) bufferCount = PIPELINE_DEFAULT_BUFFERS;
+    if (bufferCount > PIPELINE_MAX_BUFFERS) bufferCount = PIPELINE_MAX_BUFFERS;
+    if (bufferSize == 0) bufferSize = 1 << 20;
+
+    void* block = NULL;
+    if (posix_memalign(&block, 64, sizeof(OutputPipeline)) != 0) {
+        return NULL;
+    }
+    OutputPipeline* pipeline = (OutputPipeline*)block;
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->memory = (char*)malloc((size_t)bufferCount * bufferSize);
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 2);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, sizeof(OutputPipeline) + (size_t)bufferCount * bufferSize);
+    if (!pipeline->memory) {
+        free(pipeline);
+        return NULL;
+    }
+
+    pipeline->file = file;
+    pipeline->bufferSize = bufferSize;
+    pipeline->bufferCount = bufferCount;
+    atomic_init(&pipeline->error, 0);
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->synced, NULL);
+    initRing(&pipeline->filled, (size_t)bufferCount + 1);
+    initRing(&pipeline->empty, (size_t)bufferCount + 1);
+
+    for (int i = 0; i < bufferCount; i++) {
+        PipelineEntry entry = { pipeline->memory + (size_t)i * bufferSize, 0, ENTRY_BUFFER };
+        pushEntry(pipeline, &pipeline->empty, &entry);
+    }
+
+    if (pthread_create(&pipeline->thread, NULL, outputWriterThread, pipeline) != 0) {
+        pthread_cond_destroy(&pipeline->filled.ready);
+        pthread_cond_destroy(&pipeline->empty.ready);
+        pthread_cond_destroy(&pipeline->synced);
+        pthread_mutex_destroy(&pipeline->lock);
+        free(pipeline->memory);
+        free(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+// Write everything submitted, flush the file and stop the writer thread. The
+// file stays open. Fills stats if given; returns 0, or -1 if any write failed
+int destroyOutputPipeline(OutputPipeline* pipeline, OutputPipelineStats* stats) {
+    if (!pipeline) {
+        if (stats) memset(stats, 0, sizeof(*stats));
+        return 0;
+    }
+
+    PipelineEntry close = { NULL, 0, ENTRY_CLOSE };
+    pushEntry(pipeline, &pipeline->filled, &close);
+    pthread_join(pipeline->thread, NULL);
+
+    if (stats) {
+        stats->buffersWritten = pipeline->buffersWritten;
+        stats->bytesWritten = pipeline->bytesWritten;
+        stats->stalls = pipeline->stalls;
+        stats->stallSeconds = pipeline->stallSeconds;
+        stats->writeSeconds = pipeline->writeSeconds;
+    }
+
+    int status = atomic_load(&pipeline->error) ? -1 : 0;
+    pthread_cond_destroy(&pipeline->filled.ready);
+    pthread_cond_destroy(&pipeline->empty.ready);
+    pthread_cond_destroy(&pipeline->synced);
+    pthread_mutex_destroy(&pipeline->lock);
+    free(pipeline->memory);
+    free(pipeline);
+    return status;
+}
+
+size_t outputPipelineBufferSize(const OutputPipeline* pipeline) {
+    return pipeline->bufferSize;
+}
+
+// An empty buffer of outputPipelineBufferSize bytes to fill. Blocks while
+// every buffer is queued for writing; this is the pipeline's back-pressure
+char* acquireOutputBuffer(OutputPipeline* pipeline) {
+    PipelineEntry entry;
+    if (tryPopEntry(&pipeline->empty, &entry)) {
+        return entry.data;
+    }
+
+    double start = pipelineSeconds();
+    popEntry(pipeline, &pipeline->empty, &entry);
+    pipeline->stalls++;
+    pipeline->stallSeconds += pipelineSeconds() - start;
+    return entry.data;
+}
+
+// Queue the first length bytes of an acquired buffer for writing; the buffer
+// belongs to the pipeline again. A length of 0 just returns it
+void submitOutputBuffer(OutputPipeline* pipeline, char* buffer, size_t length) {
+    PipelineEntry entry = { buffer, length, ENTRY_BUFFER };
+    pushEntry(pipeline, &pipeline->filled, &entry);
+}
+
+// Wait until everything submitted so far is written and the file flushed.
+// Returns 0, or -1 if any write failed
+int syncOutputPipeline(OutputPipeline* pipeline) {
+    unsigned long target = ++pipeline->syncsRequested;
+    PipelineEntry sync = { NULL, 0, ENTRY_SYNC };
+    pushEntry(pipeline, &pipeline->filled, &sync);
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->syncsCompleted < target) {
+        pthread_cond_wait(&pipeline->synced, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return outputPipelineError(pipeline);
+}
+
+// -1 once a write or flush has failed, else 0
+int outputPipelineError(OutputPipeline* pipeline) {
+    return atomic_load_explicit(&pipeline->error, memory_order_relaxed) ? -1 : 0;
+}
@@ -0,0 +1,42 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Asynchronous output stage. A dedicated thread owns the file and writes the
+// buffers the producer hands it, in order, one large fwrite each. The producer
+// fills one buffer while the thread writes the others (two buffers is classic
+// double buffering). Full buffers travel to the writer and empty ones back
+// through two bounded single-producer, single-consumer rings; a side only
+// sleeps when its ring is empty. When every buffer is waiting to be written
+// the producer blocks, so memory stays at bufferCount * bufferSize however slow
+// the file is.
+
+// Buffers in flight by default
+#define PIPELINE_DEFAULT_BUFFERS 2
+
+// Most buffers a pipeline may have
+#define PIPELINE_MAX_BUFFERS 64
+
+// How well the writer kept up
+typedef struct {
+    unsigned long long buffersWritten;
+    unsigned long long bytesWritten;
+    unsigned long long stalls;  // Times the producer waited for an empty buffer
+    double stallSeconds;        // Time the producer spent waiting
+    double writeSeconds;        // Time the writer thread spent in fwrite and fflush
+} OutputPipelineStats;
+
+typedef struct OutputPipeline OutputPipeline;
+
+// Function declarations
+OutputPipeline* createOutputPipeline(FILE* file, int bufferCount, size_t bufferSize);
+int destroyOutputPipeline(OutputPipeline* pipeline, OutputPipelineStats* stats);
+size_t outputPipelineBufferSize(const OutputPipeline* pipeline);
+char* acquireOutputBuffer(OutputPipeline* pipeline);
+void submitOutputBuffer(OutputPipeline* pipeline, char* buffer, size_t length);
+int syncOutputPipeline(OutputPipeline* pipeline);
+int outputPipelineError(OutputPipeline* pipeline);
+
+#endif /* PIPELINE_H */
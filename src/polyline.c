@@ -0,0 +1,71 @@
+#include "polyline.h"
+#include <math.h>
+#include <stdint.h>
+
+// Quantised values stay well inside 64 bits so differences can't overflow
+#define POLYLINE_VALUE_LIMIT 4.0e18
+
+// value * scale rounded half away from zero (as %.*f rounds all but exact
+// ties); non-finite and out of range values encode as 0
+long long polylineQuantize(double value, double scale) {
+    double scaled = value * scale;
+    if (!(scaled > -POLYLINE_VALUE_LIMIT && scaled < POLYLINE_VALUE_LIMIT)) {
+        return 0;
+    }
+    return (long long)(scaled < 0.0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+// Write the characters of one difference to text (at least
+// POLYLINE_MAX_VALUE_CHARS bytes); returns how many
+int encodePolylineValue(long long delta, char* text) {
+    uint64_t bits = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63); // Zigzag
+    int length = 0;
+
+    while (bits >= 0x20) {
+        text[length++] = (char)((0x20 | (bits & 0x1f)) + 63);
+        bits >>= 5;
+    }
+    text[length++] = (char)(bits + 63);
+    return length;
+}
+
+// Read one difference starting at text; returns the character after it, or
+// NULL if the text ends inside it or holds a character outside the format
+const char* decodePolylineValue(const char* text, const char* end, long long* delta) {
+    uint64_t bits = 0;
+    int shift = 0;
+
+    for (;;) {
+        if (text == end || shift > 60) return NULL;
+        int group = (unsigned char)*text++ - 63;
+        if (group < 0 || group > 0x3f) return NULL;
+        bits |= (uint64_t)(group & 0x1f) << shift;
+        shift += 5;
+        if (group < 0x20) break;
+    }
+
+    *delta = (long long)(bits >> 1) ^ -(long long)(bits & 1);
+    return text;
+}
+
+// Decode a polyline of dimensions interleaved values per point into values
+// (divided by scale), at most capacity points. Returns the points decoded, or
+// -1 if the text is malformed or ends inside a point
+long decodePolyline(const char* text, size_t length, int dimensions, double scale, double* values, long capacity) {
+    const char* end = text + length;
+    long long current[4] = { 0, 0, 0, 0 };
+    long points = 0;
+
+    if (dimensions < 1 || dimensions > 4) return -1;
+    while (text < end && points < capacity) {
+        for (int d = 0; d < dimensions; d++) {
+            long long delta;
+            text = decodePolylineValue(text, end, &delta);
+            if (!text) return -1;
+            current[d] += delta;
+            values[points * dimensions + d] = (double)current[d] / scale;
+        }
+        points++;
+    }
+    return points;
+}
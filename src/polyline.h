@@ -0,0 +1,32 @@
+#ifndef POLYLINE_H
+#define POLYLINE_H
+
+#include <stddef.h>
+
+// Encoded polyline format, as Google's and OSRM's polyline6. Each value is
+// rounded to an integer at a fixed precision and stored as the difference to
+// the previous value of its dimension, zigzag encoded (sign in the low bit)
+// and split into 5-bit groups, least significant first. Each group is written
+// as one character, group + 63, with 0x20 added while more groups follow, so
+// every character lies in '?'..'~'. Small steps between neighbouring path
+// points take one or two characters per value instead of a dozen digits.
+
+// Decimal places of encoded latitudes and longitudes (polyline6), and the
+// matching scale
+#define POLYLINE_PRECISION 6
+#define POLYLINE_SCALE 1e6
+
+// Decimal places of encoded altitudes (centimetres), and the matching scale
+#define POLYLINE_ALTITUDE_PRECISION 2
+#define POLYLINE_ALTITUDE_SCALE 1e2
+
+// Longest encoding of one 64-bit difference
+#define POLYLINE_MAX_VALUE_CHARS 13
+
+// Function declarations
+long long polylineQuantize(double value, double scale);
+int encodePolylineValue(long long delta, char* text);
+const char* decodePolylineValue(const char* text, const char* end, long long* delta);
+long decodePolyline(const char* text, size_t length, int dimensions, double scale, double* values, long capacity);
+
+#endif /* POLYLINE_H */
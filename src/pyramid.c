@@ -0,0 +1,838 @@
+#include "pyramid.h"
+#include "stats.h"
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Route vertices match path points within this many degrees (sampled
+// vertices go through a unit vector and back)
+#define PYRAMID_VERTEX_EPSILON 1e-9
+
+// Smallest cos(latitude) used when scaling deviations to Mercator units
+#define PYRAMID_MIN_COS 0.01
+
+// A query scans the whole level instead of the grid when the level's points
+// expected in view, plus the cells in view at PYRAMID_CELLS_PER_POINT cells
+// to a point's cost, outnumber the level's points over PYRAMID_SCAN_COST
+// (what a point found through the grid costs against a point scanned)
+#define PYRAMID_CELLS_PER_POINT 4.0
+#define PYRAMID_SCAN_COST 3.0
+
+// Decimals of the coordinates in a view document
+#define PYRAMID_DECIMALS 6
+
+static void* tableAlloc(Arena* arena, size_t size) {
+    return arena ? arenaAlloc(arena, size) : malloc(size);
+}
+
+static void tableFree(Arena* arena, void* memory) {
+    if (!arena) free(memory);
+}
+
+static double levelTolerance(int level) {
+    return PYRAMID_TOP_TOLERANCE / (double)(1L << level);
+}
+
+static int nearVertex(Coordinates point, Coordinates vertex) {
+    return fabs(point.latitude - vertex.latitude) <= PYRAMID_VERTEX_EPSILON &&
+           fabs(point.longitude - vertex.longitude) <= PYRAMID_VERTEX_EPSILON;
+}
+
+// Deviation of point from the chord in km at the equator's scale (Mercator units)
+static double mercatorDeviation(Coordinates point, Coordinates chordStart, Coordinates chordEnd) {
+    double scale = cos(point.latitude * M_PI / 180.0);
+    if (scale < PYRAMID_MIN_COS) scale = PYRAMID_MIN_COS;
+    return pathDeviation(point, chordStart, chordEnd, 0.0, NULL) / scale;
+}
+
+// Douglas-Peucker over the points between consecutive route vertices, with
+// an explicit stack. The point split off a range is the same at every
+// tolerance, so recording its deviation, capped by the deviation of the split
+// that produced the range, gives the largest tolerance at which it's kept
+static int rankPoints(const Coordinates* points, int count, const Coordinates* vertices, int vertexCount,
+                      double* importance) {
+    int* stack = (int*)malloc(2 * (size_t)(count > 0 ? count : 1) * sizeof(int));
+    double* caps = (double*)malloc((size_t)(count > 0 ? count : 1) * sizeof(double));
+    if (!stack || !caps) {
+        free(stack);
+        free(caps);
+        return -1;
+    }
+
+    // Route vertices in path order, then the first and last point
+    int vertex = 0;
+    for (int i = 0; i < count; i++) {
+        importance[i] = 0.0;
+        if (vertex + 1 < vertexCount && !nearVertex(points[i], vertices[vertex]) &&
+            nearVertex(points[i], vertices[vertex + 1])) {
+            vertex++;
+        }
+        if (vertex < vertexCount && nearVertex(points[i], vertices[vertex])) {
+            importance[i] = INFINITY;
+        }
+    }
+    if (count > 0) {
+        importance[0] = INFINITY;
+        importance[count - 1] = INFINITY;
+    }
+
+    int first = 0;
+    for (int last = 1; last < count; last++) {
+        if (importance[last] != INFINITY) continue;
+
+        stack[0] = first;
+        stack[1] = last;
+        caps[0] = INFINITY;
+        int depth = 1;
+        while (depth > 0) {
+            depth--;
+            int a = stack[2 * depth], b = stack[2 * depth + 1];
+            double cap = caps[depth];
+            if (b - a < 2) continue;
+
+            int split = a + 1;
+            double worst = -1.0;
+            for (int k = a + 1; k < b; k++) {
+                double deviation = mercatorDeviation(points[k], points[a], points[b]);
+                if (deviation > worst) {
+                    worst = deviation;
+                    split = k;
+                }
+            }
+            importance[split] = worst < cap ? worst : cap;
+
+            stack[2 * depth] = a;
+            stack[2 * depth + 1] = split;
+            caps[depth] = importance[split];
+            depth++;
+            stack[2 * depth] = split;
+            stack[2 * depth + 1] = b;
+            caps[depth] = importance[split];
+            depth++;
+        }
+        first = last;
+    }
+
+    free(stack);
+    free(caps);
+    return 0;
+}
+
+// Bucket the kept points into the grid, coarsest level first within each cell.
+// scratch holds keptCount + cells ints
+static void buildGrid(PathPyramid* pyramid, const int* levelOrder, int keptCount, int* scratch) {
+    int cells = pyramid->gridRows * pyramid->gridColumns;
+    int* cellOf = scratch;
+    int* fill = scratch + keptCount;
+    memset(pyramid->cellStart, 0, (cells + 1) * sizeof(int));
+
+    for (int k = 0; k < keptCount; k++) {
+        Coordinates point = pyramid->points[levelOrder[k]];
+        int row = (int)((point.latitude - pyramid->gridSouth) / pyramid->cellHeight);
+        int column = (int)((point.longitude - pyramid->gridWest) / pyramid->cellWidth);
+        if (row >= pyramid->gridRows) row = pyramid->gridRows - 1;
+        if (column >= pyramid->gridColumns) column = pyramid->gridColumns - 1;
+        if (row < 0) row = 0;
+        if (column < 0) column = 0;
+        cellOf[k] = row * pyramid->gridColumns + column;
+        pyramid->cellStart[cellOf[k] + 1]++;
+    }
+    for (int c = 0; c < cells; c++) {
+        pyramid->cellStart[c + 1] += pyramid->cellStart[c];
+    }
+
+    // levelOrder is sorted by level, so each cell's list comes out sorted too
+    memcpy(fill, pyramid->cellStart, cells * sizeof(int));
+    for (int c = 0; c < cells; c++) pyramid->cellLevel[c] = PYRAMID_LEVELS;
+    for (int k = 0; k < keptCount; k++) {
+        if (fill[cellOf[k]] == pyramid->cellStart[cellOf[k]]) {
+            pyramid->cellLevel[cellOf[k]] = pyramid->firstLevel[levelOrder[k]];   // Its first, so its coarsest
+        }
+        PyramidCellPoint* entry = &pyramid->cellPoints[fill[cellOf[k]]++];
+        entry->latitude = pyramid->points[levelOrder[k]].latitude;
+        entry->longitude = pyramid->points[levelOrder[k]].longitude;
+        entry->rank = k;
+    }
+}
+
+static void chooseGrid(PathPyramid* pyramid, const int* kept, int keptCount) {
+    double south = INFINITY, north = -INFINITY, west = INFINITY, east = -INFINITY;
+    for (int k = 0; k < keptCount; k++) {
+        Coordinates point = pyramid->points[kept[k]];
+        if (point.latitude < south) south = point.latitude;
+        if (point.latitude > north) north = point.latitude;
+        if (point.longitude < west) west = point.longitude;
+        if (point.longitude > east) east = point.longitude;
+    }
+    if (keptCount == 0) {
+        south = north = west = east = 0.0;
+    }
+
+    double height = north - south > 0.0 ? north - south : 1e-9;
+    double width = east - west > 0.0 ? east - west : 1e-9;
+    double cells = (double)keptCount / PYRAMID_POINTS_PER_CELL;
+    if (cells < 1.0) cells = 1.0;
+
+    int columns = (int)ceil(sqrt(cells * width / height));
+    if (columns < 1) columns = 1;
+    if (columns > PYRAMID_MAX_GRID_SIDE) columns = PYRAMID_MAX_GRID_SIDE;
+    int rows = (int)ceil(cells / columns);
+    if (rows < 1) rows = 1;
+    if (rows > PYRAMID_MAX_GRID_SIDE) rows = PYRAMID_MAX_GRID_SIDE;
+
+    pyramid->gridRows = rows;
+    pyramid->gridColumns = columns;
+    pyramid->gridSouth = south;
+    pyramid->gridWest = west;
+    pyramid->cellHeight = height / rows;
+    pyramid->cellWidth = width / columns;
+}
+
+// Build the pyramid and index of count path points; vertices are the route's
+// start, waypoints and end in order. The points must outlive the pyramid.
+// Tables come from arena (heap if NULL; release with freePathPyramid).
+// Returns 0, or -1 if out of memory
+int buildPathPyramid(PathPyramid* pyramid, const Coordinates* points, int count,
+                     const Coordinates* vertices, int vertexCount, Arena* arena) {
+    memset(pyramid, 0, sizeof(*pyramid));
+    pyramid->count = count;
+    pyramid->points = points;
+    pyramid->arena = arena;
+
+    STATS_BEGIN(STATS_PHASE_SAMPLING);
+    pyramid->importance = (double*)tableAlloc(arena, (count + 1) * sizeof(double));
+    pyramid->firstLevel = (unsigned char*)tableAlloc(arena, count + 1);
+    int* levelOrder = (int*)malloc((count + 1) * sizeof(int));
+    if (!pyramid->importance || !pyramid->firstLevel || !levelOrder ||
+        rankPoints(points, count, vertices, vertexCount, pyramid->importance) != 0) {
+        free(levelOrder);
+        freePathPyramid(pyramid);
+        STATS_END();
+        return -1;
+    }
+
+    // Level sizes, and the kept points ordered by their coarsest level
+    int levelStart[PYRAMID_LEVELS + 1] = { 0 };
+    for (int i = 0; i < count; i++) {
+        int level = 0;
+        while (level < PYRAMID_LEVELS && !(pyramid->importance[i] > levelTolerance(level))) level++;
+        pyramid->firstLevel[i] = (unsigned char)level;
+        if (level < PYRAMID_LEVELS) levelStart[level + 1]++;
+    }
+    size_t levelTotal = 0;
+    for (int level = 0; level < PYRAMID_LEVELS; level++) {
+        levelStart[level + 1] += levelStart[level];
+        levelTotal += levelStart[level + 1];   // Level z holds every point first kept at 0..z
+    }
+    int keptCount = levelStart[PYRAMID_LEVELS];
+
+    int fill[PYRAMID_LEVELS];
+    memcpy(fill, levelStart, sizeof(fill));
+    for (int i = 0; i < count; i++) {
+        if (pyramid->firstLevel[i] < PYRAMID_LEVELS) levelOrder[fill[pyramid->firstLevel[i]]++] = i;
+    }
+
+    chooseGrid(pyramid, levelOrder, keptCount);
+    int cells = pyramid->gridRows * pyramid->gridColumns;
+    int* levelIndices = (int*)tableAlloc(arena, (levelTotal + 1) * sizeof(int));
+    pyramid->cellStart = (int*)tableAlloc(arena, (cells + 1) * sizeof(int));
+    pyramid->cellPoints = (PyramidCellPoint*)tableAlloc(arena, (keptCount + 1) * sizeof(PyramidCellPoint));
+    pyramid->cellLevel = (unsigned char*)tableAlloc(arena, cells + 1);
+    int* levelPositions = (int*)tableAlloc(arena, (levelTotal + 1) * sizeof(int));
+    int* rankOf = (int*)malloc(((size_t)count + 1) * sizeof(int));
+    int* gridScratch = (int*)malloc(((size_t)keptCount + cells + 1) * sizeof(int));
+    if (!levelIndices || !pyramid->cellStart || !pyramid->cellPoints || !pyramid->cellLevel || !levelPositions ||
+        !rankOf || !gridScratch) {
+        tableFree(arena, levelIndices);
+        tableFree(arena, levelPositions);
+        free(rankOf);
+        free(gridScratch);
+        free(levelOrder);
+        freePathPyramid(pyramid);
+        STATS_END();
+        return -1;
+    }
+
+    // Each level in path order, and the position of each of its points by rank
+    for (int k = 0; k < keptCount; k++) rankOf[levelOrder[k]] = k;
+    size_t offset = 0;
+    for (int level = 0; level < PYRAMID_LEVELS; level++) {
+        PyramidLevel* entry = &pyramid->levels[level];
+        entry->tolerance = levelTolerance(level);
+        entry->indices = levelIndices + offset;
+        entry->positions = levelPositions + offset;
+        entry->count = 0;
+        for (int i = 0; i < count; i++) {
+            if (pyramid->firstLevel[i] <= level) {
+                entry->positions[rankOf[i]] = entry->count;
+                entry->indices[entry->count++] = i;
+            }
+        }
+        offset += entry->count;
+    }
+
+    buildGrid(pyramid, levelOrder, keptCount, gridScratch);
+    free(rankOf);
+    free(gridScratch);
+    free(levelOrder);
+    STATS_END();
+    return 0;
+}
+
+void freePathPyramid(PathPyramid* pyramid) {
+    if (!pyramid->arena) {
+        free(pyramid->importance);
+        free(pyramid->firstLevel);
+        free(pyramid->levels[0].indices);
+        free(pyramid->cellStart);
+        free(pyramid->cellPoints);
+        free(pyramid->cellLevel);
+        free(pyramid->levels[0].positions);
+    }
+    memset(pyramid, 0, sizeof(*pyramid));
+}
+
+// Pyramid level for a map zoom: its integer part, clamped to the levels built
+int pyramidLevelForZoom(double zoom) {
+    if (!(zoom > 0.0)) return 0;
+    if (zoom >= PYRAMID_LEVELS - 1) return PYRAMID_LEVELS - 1;
+    return (int)zoom;
+}
+
+// Cell holding offset along one grid axis: -1 before the grid, cells past it
+static int cellIndex(double offset, double size, int cells) {
+    double index = floor(offset / size);
+    if (!(index >= 0.0)) return -1;
+    return index < cells ? (int)index : cells;
+}
+
+// Cells overlapping [west, east] x [south, north] as first/last row and
+// column in cells; 0 if the box misses the grid
+static int cellRange(const PathPyramid* pyramid, double south, double north, double west, double east, int* cells) {
+    int firstRow = cellIndex(south - pyramid->gridSouth, pyramid->cellHeight, pyramid->gridRows);
+    int lastRow = cellIndex(north - pyramid->gridSouth, pyramid->cellHeight, pyramid->gridRows);
+    int firstColumn = cellIndex(west - pyramid->gridWest, pyramid->cellWidth, pyramid->gridColumns);
+    int lastColumn = cellIndex(east - pyramid->gridWest, pyramid->cellWidth, pyramid->gridColumns);
+    if (lastRow < 0 || lastColumn < 0 || firstRow >= pyramid->gridRows || firstColumn >= pyramid->gridColumns) {
+        return 0;
+    }
+    cells[0] = firstRow < 0 ? 0 : firstRow;
+    cells[1] = lastRow >= pyramid->gridRows ? pyramid->gridRows - 1 : lastRow;
+    cells[2] = firstColumn < 0 ? 0 : firstColumn;
+    cells[3] = lastColumn >= pyramid->gridColumns ? pyramid->gridColumns - 1 : lastColumn;
+    return 1;
+}
+
+// Kept points (of every level) listed in a cell range; a row's cells are contiguous
+static long cellRangePoints(const PathPyramid* pyramid, const int* cells) {
+    long points = 0;
+    for (int row = cells[0]; row <= cells[1]; row++) {
+        int first = row * pyramid->gridColumns;
+        points += pyramid->cellStart[first + cells[3] + 1] - pyramid->cellStart[first + cells[2]];
+    }
+    return points;
+}
+
+// Whether cell along one grid axis (cells size apart from origin) lies inside
+// [low, high] with PYRAMID_VERTEX_EPSILON to spare, so a point bucketed into
+// it is inside without testing it
+static int cellInside(double origin, double size, int cell, double low, double high) {
+    return origin + cell * size - PYRAMID_VERTEX_EPSILON >= low &&
+           origin + (cell + 1) * size + PYRAMID_VERTEX_EPSILON <= high;
+}
+
+// Collect the positions of the level's points inside [west, east] x
+// [south, north] from a cell range; cells wholly inside the box are taken
+// without testing their points
+static int collectCells(const PathPyramid* pyramid, int level, const int* cells, double south, double north,
+                        double west, double east, int* positions, int found) {
+    const PyramidLevel* entry = &pyramid->levels[level];
+    for (int row = cells[0]; row <= cells[1]; row++) {
+        int rowInside = cellInside(pyramid->gridSouth, pyramid->cellHeight, row, south, north);
+        for (int column = cells[2]; column <= cells[3]; column++) {
+            int cell = row * pyramid->gridColumns + column;
+            if (pyramid->cellLevel[cell] > level) continue;   // Nothing this coarse
+
+            const PyramidCellPoint* point = &pyramid->cellPoints[pyramid->cellStart[cell]];
+            const PyramidCellPoint* end = &pyramid->cellPoints[pyramid->cellStart[cell + 1]];
+
+            // Points are ranked coarsest first: the first one past the level ends the cell
+            if (rowInside && cellInside(pyramid->gridWest, pyramid->cellWidth, column, west, east)) {
+                for (; point < end && point->rank < entry->count; point++) {
+                    positions[found++] = entry->positions[point->rank];
+                }
+                continue;
+            }
+            for (; point < end && point->rank < entry->count; point++) {
+                if (point->latitude >= south && point->latitude <= north &&
+                    point->longitude >= west && point->longitude <= east) {
+                    positions[found++] = entry->positions[point->rank];
+                }
+            }
+        }
+    }
+    return found;
+}
+
+// Mark the level's points inside any of the longitude ranges by a pass over the level
+static void scanLevel(const PathPyramid* pyramid, int level, double south, double north,
+                      const double* west, const double* east, int ranges, unsigned char* inside) {
+    const PyramidLevel* entry = &pyramid->levels[level];
+    for (int p = 0; p < entry->count; p++) {
+        Coordinates point = pyramid->points[entry->indices[p]];
+        int longitudeInside = point.longitude >= west[0] && point.longitude <= east[0];
+        if (ranges > 1) longitudeInside |= point.longitude >= west[1] && point.longitude <= east[1];
+        inside[p] = (unsigned char)(longitudeInside && point.latitude >= south && point.latitude <= north);
+    }
+}
+
+// Longitude of a wrapped map (Leaflet bounds may pass +-180) in [-180, 180]
+static double wrapLongitude(double degrees) {
+    if (degrees >= -180.0 && degrees <= 180.0) return degrees;
+    degrees = fmod(degrees + 180.0, 360.0);
+    if (degrees < 0.0) degrees += 360.0;
+    return degrees - 180.0;
+}
+
+// Whether bounds hold every point of the grid (and so of every level)
+static int boundsCoverGrid(const PathPyramid* pyramid, const GeoBounds* bounds) {
+    double north = pyramid->gridSouth + pyramid->gridRows * pyramid->cellHeight;
+    double east = pyramid->gridWest + pyramid->gridColumns * pyramid->cellWidth;
+    if (bounds->south > pyramid->gridSouth || bounds->north < north) return 0;
+    if (bounds->east - bounds->west >= 360.0) return 1;
+
+    // A box across the antimeridian covers [west, 180] and [-180, east]
+    double west = wrapLongitude(bounds->west);
+    double boundsEast = wrapLongitude(bounds->east);
+    if (west > boundsEast) {
+        return west <= pyramid->gridWest || boundsEast >= east;
+    }
+    return west <= pyramid->gridWest && boundsEast >= east;
+}
+
+static int compareInts(const void* a, const void* b) {
+    int left = *(const int*)a;
+    int right = *(const int*)b;
+    return (left > right) - (left < right);
+}
+
+// Runs of count ascending positions below levelCount, each widened by one
+// point on either side, written to positions
+static int widenSorted(const int* found, int count, int levelCount, int* positions) {
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        int position = found[i];
+        int runStart = i == 0 || found[i - 1] != position - 1;
+        int runEnd = i + 1 == count || found[i + 1] != position + 1;
+
+        if (runStart && position > 0 && (written == 0 || positions[written - 1] < position - 1)) {
+            positions[written++] = position - 1;
+        }
+        if (written == 0 || positions[written - 1] < position) {
+            positions[written++] = position;
+        }
+        if (runEnd && position + 1 < levelCount) {
+            positions[written++] = position + 1;
+        }
+    }
+    return written;
+}
+
+// Runs of the points marked in inside, each widened by one point on either side
+static int widenMarked(const unsigned char* inside, int levelCount, int* positions) {
+    int written = 0;
+    for (int p = 0; p < levelCount; p++) {
+        if (inside[p] || (p > 0 && inside[p - 1]) || (p + 1 < levelCount && inside[p + 1])) {
+            positions[written++] = p;
+        }
+    }
+    return written;
+}
+
+// Positions (into levels[level].indices, ascending) of the level's points
+// inside bounds (everything if NULL), plus the neighbours just outside each
+// run so the drawn lines reach the viewport edge. positions needs room for
+// the level's point count; scratch (heap if NULL) holds the candidates.
+// Returns the number of positions, or -1 if out of memory
+int queryPathPyramid(const PathPyramid* pyramid, int level, const GeoBounds* bounds, int* positions, Arena* scratch) {
+    const PyramidLevel* entry = &pyramid->levels[level];
+
+    if (!bounds || (bounds->east - bounds->west >= 360.0 && bounds->south <= -90.0 && bounds->north >= 90.0)) {
+        for (int i = 0; i < entry->count; i++) positions[i] = i;
+        return entry->count;
+    }
+    if (bounds->north < bounds->south || entry->count == 0) {
+        return 0;
+    }
+    if (boundsCoverGrid(pyramid, bounds)) {
+        for (int i = 0; i < entry->count; i++) positions[i] = i;
+        return entry->count;
+    }
+
+    // One longitude range, or two when the box crosses the antimeridian
+    double west[2] = { -INFINITY, 0.0 }, east[2] = { INFINITY, 0.0 };
+    int ranges = 1;
+    if (bounds->east - bounds->west < 360.0) {
+        west[0] = wrapLongitude(bounds->west);
+        east[0] = wrapLongitude(bounds->east);
+        if (west[0] > east[0]) {
+            west[1] = -180.0;
+            east[1] = east[0];
+            east[0] = 180.0;
+            ranges = 2;
+        }
+    }
+
+    // Candidate positions, then a byte per level point for large answers
+    int* found = (int*)tableAlloc(scratch, (entry->count + 1) * (sizeof(int) + 1));
+    if (!found) return -1;
+    unsigned char* inside = (unsigned char*)(found + entry->count + 1);
+
+    // The grid's work: the cells in view, and the level's share of the points
+    // they list (the cells hold every level's points)
+    int cells[2][4];
+    int overlaps[2] = { 0, 0 };
+    double listed = 0.0, visited = 0.0;
+    for (int r = 0; r < ranges; r++) {
+        overlaps[r] = cellRange(pyramid, bounds->south, bounds->north, west[r], east[r], cells[r]);
+        if (overlaps[r]) {
+            listed += cellRangePoints(pyramid, cells[r]);
+            visited += (double)(cells[r][1] - cells[r][0] + 1) * (cells[r][3] - cells[r][2] + 1) /
+                       PYRAMID_CELLS_PER_POINT;
+        }
+    }
+    visited += listed * entry->count / pyramid->cellStart[pyramid->gridRows * pyramid->gridColumns];
+
+    int written = 0;
+    if (visited * PYRAMID_SCAN_COST > entry->count) {
+        // A pass over the level is cheaper than visiting its points through
+        // the cells: the view holds much of it, or many cells with few of its points
+        scanLevel(pyramid, level, bounds->south, bounds->north, west, east, ranges, inside);
+        written = widenMarked(inside, entry->count, positions);
+    } else {
+        int count = 0;
+        for (int r = 0; r < ranges; r++) {
+            if (overlaps[r]) {
+                count = collectCells(pyramid, level, cells[r], bounds->south, bounds->north, west[r], east[r],
+                                     found, count);
+            }
+        }
+        if ((double)count * log2((double)count + 1.0) < entry->count) {
+            qsort(found, count, sizeof(int), compareInts);
+            written = widenSorted(found, count, entry->count, positions);
+        } else {
+            // Ordering by a sweep of the level is linear, and cheaper than sorting here
+            memset(inside, 0, entry->count);
+            for (int i = 0; i < count; i++) inside[found[i]] = 1;
+            written = widenMarked(inside, entry->count, positions);
+        }
+    }
+
+    tableFree(scratch, found);
+    return written;
+}
+
+// {"level": z, "tolerance": km, "pathPoints": n, "points": k, "paths": [[[lat, lon, alt], ...], ...]}
+// written compactly; consecutive positions form one path
+void writePyramidViewJSON(Writer* writer, const PathPyramid* pyramid, int level, const int* positions, int count) {
+    const PyramidLevel* entry = &pyramid->levels[level];
+
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    writerPutString(writer, "{\"level\":");
+    writerPutInt(writer, level);
+    writerPutString(writer, ",\"tolerance\":");
+    writerPutFixed(writer, entry->tolerance, PYRAMID_DECIMALS);
+    writerPutString(writer, ",\"pathPoints\":");
+    writerPutInt(writer, pyramid->count);
+    writerPutString(writer, ",\"points\":");
+    writerPutInt(writer, count);
+    writerPutString(writer, ",\"paths\":[");
+    for (int i = 0; i < count; i++) {
+        int pathStart = i == 0 || positions[i - 1] != positions[i] - 1;
+        if (pathStart) writerPutString(writer, i == 0 ? "[" : "],[");
+        else writerPutChar(writer, ',');
+
+        Coordinates point = pyramid->points[entry->indices[positions[i]]];
+        writerPutChar(writer, '[');
+        writerPutFixed(writer, point.latitude, PYRAMID_DECIMALS);
+        writerPutChar(writer, ',');
+        writerPutFixed(writer, point.longitude, PYRAMID_DECIMALS);
+        writerPutChar(writer, ',');
+        writerPutFixed(writer, point.altitude, PYRAMID_DECIMALS);
+        writerPutChar(writer, ']');
+    }
+    writerPutString(writer, count > 0 ? "]]}\n" : "]}\n");
+    STATS_END();
+}
+
+// Sample the trajectory's path as options say and build its pyramid, the
+// points and tables both from arena (heap if NULL; release the points with the
+// pyramid). Returns 0, or -1 if out of memory
+static int buildTrajectoryPyramid(PathPyramid* pyramid, TrajectoryData* trajectory, const SamplingOptions* options,
+                                  Arena* arena) {
+    int pointCount = 0;
+    Coordinates* points = arena ? samplePathPointsInArena(trajectory, options, arena, &pointCount)
+                                : samplePathPoints(trajectory, options, &pointCount);
+    int vertexCount = trajectory->waypointCount + 2;
+    Coordinates* vertices = (Coordinates*)tableAlloc(arena, vertexCount * sizeof(Coordinates));
+    if (!points || !vertices) {
+        tableFree(arena, points);
+        tableFree(arena, vertices);
+        return -1;
+    }
+    vertices[0] = trajectory->start;
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        vertices[i + 1] = trajectory->waypoints[i].position;
+    }
+    vertices[vertexCount - 1] = trajectory->end;
+
+    int status = buildPathPyramid(pyramid, points, pointCount, vertices, vertexCount, arena);
+    if (status != 0) tableFree(arena, points);
+    tableFree(arena, vertices);
+    return status;
+}
+
+// Query the pyramid level for zoom within bounds and write the view
+static int writePyramidView(Writer* writer, const PathPyramid* pyramid, double zoom, const GeoBounds* bounds,
+                            Arena* arena) {
+    int level = pyramidLevelForZoom(zoom);
+    int* positions = (int*)tableAlloc(arena, (pyramid->levels[level].count + 1) * sizeof(int));
+    int count = positions ? queryPathPyramid(pyramid, level, bounds, positions, arena) : -1;
+    if (count >= 0) {
+        writePyramidViewJSON(writer, pyramid, level, positions, count);
+    }
+    tableFree(arena, positions);
+    return count >= 0 ? 0 : -1;
+}
+
+// Sample the trajectory's path as options say, build its pyramid and write
+// the view of bounds (NULL for everything) at zoom. Memory comes from arena
+// (heap if NULL). Returns 0, or -1 if out of memory
+int writeTrajectoryViewJSON(Writer* writer, TrajectoryData* trajectory, const SamplingOptions* options,
+                            double zoom, const GeoBounds* bounds, Arena* arena) {
+    PathPyramid pyramid;
+    if (buildTrajectoryPyramid(&pyramid, trajectory, options, arena) != 0) {
+        return -1;
+    }
+
+    int status = writePyramidView(writer, &pyramid, zoom, bounds, arena);
+    const Coordinates* points = pyramid.points;
+    freePathPyramid(&pyramid);
+    tableFree(arena, (void*)points);
+    return status;
+}
+
+// A cached pyramid. The cache holds one reference while the entry is in its
+// table and every query in progress holds another; the last release frees it
+typedef struct {
+    PathPyramid pyramid;        // Built on the heap, owning its points
+    double* key;
+    int keyLength;
+    uint64_t hash;
+    uint64_t lastUse;
+    int references;
+} PyramidCacheEntry;
+
+struct PyramidCache {
+    pthread_mutex_t lock;
+    PyramidCacheEntry** entries;    // capacity slots, NULL when empty
+    int capacity;
+    uint64_t clock;
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+// Create a cache of up to capacity pyramids; NULL if capacity <= 0 or out of memory
+PyramidCache* createPyramidCache(int capacity) {
+    if (capacity <= 0) {
+        return NULL;
+    }
+
+    PyramidCache* cache = (PyramidCache*)calloc(1, sizeof(PyramidCache));
+    PyramidCacheEntry** entries = (PyramidCacheEntry**)calloc(capacity, sizeof(PyramidCacheEntry*));
+    if (!cache || !entries) {
+        free(cache);
+        free(entries);
+        return NULL;
+    }
+
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return cache;
+}
+
+static void releaseEntry(PyramidCacheEntry* entry) {
+    if (--entry->references > 0) {
+        return;
+    }
+    free((void*)entry->pyramid.points);
+    freePathPyramid(&entry->pyramid);
+    free(entry->key);
+    free(entry);
+}
+
+// Free the cache; no query may be in progress
+void destroyPyramidCache(PyramidCache* cache) {
+    if (!cache) {
+        return;
+    }
+    for (int i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i]) releaseEntry(cache->entries[i]);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache);
+}
+
+void getPyramidCacheStats(PyramidCache* cache, unsigned long long* hits, unsigned long long* misses) {
+    pthread_mutex_lock(&cache->lock);
+    *hits = cache->hits;
+    *misses = cache->misses;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Everything the drawn path depends on: the route's positions and the sampling
+// options (the missile and turn angles only change the physics). Returns the
+// number of values, or -1 if out of memory
+static int pyramidKey(const Scenario* scenario, const SamplingOptions* options, Arena* arena, double** key) {
+    int length = 3 * (scenario->waypointCount + 2) + 4;
+    double* values = (double*)tableAlloc(arena, length * sizeof(double));
+    if (!values) {
+        return -1;
+    }
+
+    int n = 0;
+    for (int i = -1; i <= scenario->waypointCount; i++) {
+        Coordinates position = i < 0 ? scenario->start
+                             : i == scenario->waypointCount ? scenario->end : scenario->waypoints[i];
+        values[n++] = position.latitude;
+        values[n++] = position.longitude;
+        values[n++] = position.altitude;
+    }
+    values[n++] = options ? options->tolerance : 0.0;
+    values[n++] = options ? options->altitudeTolerance : 0.0;
+    values[n++] = options ? options->maxPoints : 0.0;
+    values[n++] = options ? options->smoothSegments : 0.0;
+    *key = values;
+    return length;
+}
+
+static uint64_t hashPyramidKey(const double* key, int length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < length; i++) {
+        uint64_t bits;
+        memcpy(&bits, &key[i], sizeof(bits));
+        hash = (hash ^ bits) * 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+// Slot of the entry with key, -1 if none; the cache must be locked
+static int findEntry(PyramidCache* cache, const double* key, int length, uint64_t hash) {
+    for (int i = 0; i < cache->capacity; i++) {
+        PyramidCacheEntry* entry = cache->entries[i];
+        if (entry && entry->hash == hash && entry->keyLength == length &&
+            memcmp(entry->key, key, length * sizeof(double)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Look up the pyramid of key, taking a reference; NULL on a miss
+static PyramidCacheEntry* acquireEntry(PyramidCache* cache, const double* key, int length, uint64_t hash) {
+    pthread_mutex_lock(&cache->lock);
+    int slot = findEntry(cache, key, length, hash);
+    PyramidCacheEntry* entry = slot >= 0 ? cache->entries[slot] : NULL;
+    if (entry) {
+        entry->references++;
+        entry->lastUse = ++cache->clock;
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+// Add a built entry holding the caller's reference, evicting the least
+// recently used entry if the cache is full, and return the entry to query with
+// the caller's reference. Another thread may have cached the same key
+// meanwhile; then that entry is returned and the built one freed
+static PyramidCacheEntry* insertEntry(PyramidCache* cache, PyramidCacheEntry* built) {
+    PyramidCacheEntry* entry = built;
+
+    pthread_mutex_lock(&cache->lock);
+    int slot = findEntry(cache, built->key, built->keyLength, built->hash);
+    if (slot >= 0) {
+        entry = cache->entries[slot];
+        releaseEntry(built);
+    } else {
+        slot = 0;
+        for (int i = 0; i < cache->capacity; i++) {
+            if (!cache->entries[i]) {
+                slot = i;
+                break;
+            }
+            if (cache->entries[i]->lastUse < cache->entries[slot]->lastUse) slot = i;
+        }
+        if (cache->entries[slot]) releaseEntry(cache->entries[slot]);
+        cache->entries[slot] = built;
+    }
+    entry->references++;
+    entry->lastUse = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+static void releaseCachedEntry(PyramidCache* cache, PyramidCacheEntry* entry) {
+    pthread_mutex_lock(&cache->lock);
+    releaseEntry(entry);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// Write the view of a scenario like writeTrajectoryViewJSON, reusing the
+// pyramid cached for its route and sampling options. On a miss the trajectory
+// is calculated and its pyramid built and cached, unless its path exceeds
+// PYRAMID_CACHE_MAX_POINTS. Request memory comes from arena. Returns 0, or -1
+// if out of memory
+int writeCachedViewJSON(Writer* writer, PyramidCache* cache, const Scenario* scenario,
+                        const SamplingOptions* options, double zoom, const GeoBounds* bounds, Arena* arena) {
+    double* key;
+    int keyLength = pyramidKey(scenario, options, arena, &key);
+    if (keyLength < 0) {
+        return -1;
+    }
+    uint64_t hash = hashPyramidKey(key, keyLength);
+
+    PyramidCacheEntry* entry = acquireEntry(cache, key, keyLength, hash);
+    if (!entry) {
+        PyramidCacheEntry* built = (PyramidCacheEntry*)calloc(1, sizeof(PyramidCacheEntry));
+        TrajectoryData trajectory = runScenario(scenario, arena);
+        int status = built ? buildTrajectoryPyramid(&built->pyramid, &trajectory, options, NULL) : -1;
+        freeTrajectory(&trajectory);
+        if (status != 0) {
+            free(built);
+            return -1;
+        }
+
+        built->references = 1;
+        built->key = (double*)malloc(keyLength * sizeof(double));
+        if (!built->key || built->pyramid.count > PYRAMID_CACHE_MAX_POINTS) {
+            // Too large to keep: answer from it once
+            status = writePyramidView(writer, &built->pyramid, zoom, bounds, arena);
+            releaseEntry(built);
+            return status;
+        }
+        memcpy(built->key, key, keyLength * sizeof(double));
+        built->keyLength = keyLength;
+        built->hash = hash;
+        entry = insertEntry(cache, built);
+    }
+
+    int status = writePyramidView(writer, &entry->pyramid, zoom, bounds, arena);
+    releaseCachedEntry(cache, entry);
+    return status;
+}
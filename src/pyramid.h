@@ -0,0 +1,101 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "trajectory.h"
+#include "scenario.h"
+#include "sampling.h"
+#include "writer.h"
+#include "arena.h"
+
+// Level-of-detail pyramid of a drawn path for the map frontend. One
+// Douglas-Peucker pass over the path records, for every point, the largest
+// tolerance at which the simplifier still keeps it; level z then holds the
+// points kept at one pixel of Web Mercator zoom z, which is exactly what
+// Douglas-Peucker at that tolerance returns. Deviations are measured like
+// the adaptive sampler's (pathDeviation), scaled to Mercator units by
+// 1/cos(latitude), so a tolerance is one pixel at any latitude. Route
+// vertices (start, waypoints, end) are kept at every level.
+//
+// A uniform grid over the path's bounding box indexes the kept points, each
+// cell listing its points coarsest level first, so a viewport query touches
+// only the cells it overlaps and stops in each at the first point finer than
+// the requested level. Kept points are ranked coarsest level first, so level z
+// holds exactly the first levels[z].count ranks and maps each rank to its
+// position in the level without a search.
+
+// Levels, one per zoom 0..PYRAMID_LEVELS - 1
+#define PYRAMID_LEVELS 19
+
+// Size of a 256-pixel tile pixel at zoom 0 on the equator, in km
+#define PYRAMID_TOP_TOLERANCE (40075.016686 / 256.0)
+
+// Average number of kept points per grid cell, and the grid's size limit per side
+#define PYRAMID_POINTS_PER_CELL 16
+#define PYRAMID_MAX_GRID_SIDE 1024
+
+// Pyramids the server keeps, so panning and zooming over one route query its
+// pyramid instead of sampling the path and building it again per request.
+// Paths longer than PYRAMID_CACHE_MAX_POINTS are built per request and not kept
+#define PYRAMID_CACHE_DEFAULT_ENTRIES 16
+#define PYRAMID_CACHE_MAX_POINTS (1 << 20)
+
+// Latitude/longitude box in degrees; west > east crosses the antimeridian
+typedef struct {
+    double south;
+    double west;
+    double north;
+    double east;
+} GeoBounds;
+
+typedef struct {
+    double tolerance;           // km at the equator (one pixel at this zoom)
+    int count;
+    int* indices;               // Path points kept at this level, in path order
+    int* positions;             // Position in indices of each point held, by rank
+} PyramidLevel;
+
+// A kept point as the grid lists it: what a query reads, stored in cell order
+typedef struct {
+    double latitude;
+    double longitude;
+    int rank;                   // Among the kept points ordered coarsest level first
+} PyramidCellPoint;
+
+typedef struct {
+    int count;                  // Points of the full-resolution path
+    const Coordinates* points;
+    double* importance;         // Largest tolerance keeping each point, INFINITY for route vertices
+    unsigned char* firstLevel;  // Coarsest level holding each point, PYRAMID_LEVELS if none
+    PyramidLevel levels[PYRAMID_LEVELS];
+
+    int gridRows;               // Spatial index over the kept points
+    int gridColumns;
+    double gridSouth;
+    double gridWest;
+    double cellHeight;          // Degrees
+    double cellWidth;
+    int* cellStart;             // gridRows * gridColumns + 1 offsets into cellPoints
+    PyramidCellPoint* cellPoints; // Points per cell, coarsest level first
+    unsigned char* cellLevel;   // Coarsest level of each cell's points, PYRAMID_LEVELS if empty
+
+    Arena* arena;               // Arena backing the tables, NULL for the heap
+} PathPyramid;
+
+typedef struct PyramidCache PyramidCache;
+
+// Function declarations
+int buildPathPyramid(PathPyramid* pyramid, const Coordinates* points, int count,
+                     const Coordinates* vertices, int vertexCount, Arena* arena);
+void freePathPyramid(PathPyramid* pyramid);
+int pyramidLevelForZoom(double zoom);
+int queryPathPyramid(const PathPyramid* pyramid, int level, const GeoBounds* bounds, int* positions, Arena* scratch);
+void writePyramidViewJSON(Writer* writer, const PathPyramid* pyramid, int level, const int* positions, int count);
+int writeTrajectoryViewJSON(Writer* writer, TrajectoryData* trajectory, const SamplingOptions* options,
+                            double zoom, const GeoBounds* bounds, Arena* arena);
+PyramidCache* createPyramidCache(int capacity);
+void destroyPyramidCache(PyramidCache* cache);
+void getPyramidCacheStats(PyramidCache* cache, unsigned long long* hits, unsigned long long* misses);
+int writeCachedViewJSON(Writer* writer, PyramidCache* cache, const Scenario* scenario,
+                        const SamplingOptions* options, double zoom, const GeoBounds* bounds, Arena* arena);
+
+#endif /* PYRAMID_H */
@@ -0,0 +1,478 @@
+#include "request.h"
+#include "stats.h"
+#include "number.h"
+#include "telemetry.h"
+#include "spline.h"
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+// Longest object key the parser keeps; longer keys can't match a field anyway
+#define REQUEST_KEY_LENGTH 32
+
+// Nesting limit for values the parser skips
+#define REQUEST_MAX_DEPTH 64
+
+typedef struct {
+    const char* text;
+    const char* end;
+    const char* position;
+    const char* failure;        // Error message once parsing failed
+    Arena* arena;
+} JsonReader;
+
+static int fail(JsonReader* reader, const char* message) {
+    if (!reader->failure) reader->failure = message;
+    return 0;
+}
+
+static void skipSpace(JsonReader* reader) {
+    while (reader->position < reader->end &&
+           (*reader->position == ' ' || *reader->position == '\t' ||
+            *reader->position == '\n' || *reader->position == '\r')) {
+        reader->position++;
+    }
+}
+
+// Consume c (after whitespace) if it is next
+static int acceptChar(JsonReader* reader, char c) {
+    skipSpace(reader);
+    if (reader->position < reader->end && *reader->position == c) {
+        reader->position++;
+        return 1;
+    }
+    return 0;
+}
+
+static int expectChar(JsonReader* reader, char c) {
+    if (acceptChar(reader, c)) return 1;
+    return fail(reader, c == '{' ? "expected '{'" : c == '}' ? "expected '}'" : c == ':' ? "expected ':'" :
+                        c == ']' ? "expected ']'" : "unexpected character");
+}
+
+// Read a string into output (truncated to size - 1). Escapes are decoded;
+// \u escapes outside ASCII become '?'
+static int readString(JsonReader* reader, char* output, size_t size, size_t* length) {
+    size_t used = 0;
+
+    if (!acceptChar(reader, '"')) return fail(reader, "expected a string");
+
+    while (reader->position < reader->end && *reader->position != '"') {
+        char c = *reader->position++;
+        if ((unsigned char)c < 0x20) return fail(reader, "control character in string");
+
+        if (c == '\\') {
+            if (reader->position >= reader->end) break;
+            char escape = *reader->position++;
+            switch (escape) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case '"': case '\\': case '/': c = escape; break;
+                case 'u': {
+                    unsigned code = 0;
+                    for (int i = 0; i < 4; i++) {
+                        char h = reader->position < reader->end ? *reader->position++ : 0;
+                        code <<= 4;
+                        if (h >= '0' && h <= '9') code |= h - '0';
+                        else if (h >= 'a' && h <= 'f') code |= h - 'a' + 10;
+                        else if (h >= 'A' && h <= 'F') code |= h - 'A' + 10;
+                        else return fail(reader, "bad \\u escape");
+                    }
+                    c = code < 0x80 ? (char)code : '?';
+                    break;
+                }
+                default:
+                    return fail(reader, "bad escape in string");
+            }
+        }
+
+        if (output && used + 1 < size) output[used] = c;
+        used++;
+    }
+
+    if (!acceptChar(reader, '"')) return fail(reader, "unterminated string");
+    if (output && size > 0) output[used < size ? used : size - 1] = '\0';
+    if (length) *length = used;
+    return 1;
+}
+
+static int readNumber(JsonReader* reader, double* value) {
+    skipSpace(reader);
+
+    // Parsed in place: JSON numbers start with '-' or a digit (no inf or nan)
+    const char* numberEnd = NULL;
+    if (reader->position < reader->end &&
+        (*reader->position == '-' || (*reader->position >= '0' && *reader->position <= '9'))) {
+        numberEnd = parseDouble(reader->position, reader->end, value);
+    }
+    if (!numberEnd) return fail(reader, "expected a number");
+    if (!isfinite(*value)) return fail(reader, "expected a finite number"); // -nan, -inf or overflow
+    reader->position = numberEnd;
+    return 1;
+}
+
+static int readBool(JsonReader* reader, int* value) {
+    skipSpace(reader);
+    size_t remaining = reader->end - reader->position;
+
+    if (remaining >= 4 && memcmp(reader->position, "true", 4) == 0) {
+        reader->position += 4;
+        *value = 1;
+        return 1;
+    }
+    if (remaining >= 5 && memcmp(reader->position, "false", 5) == 0) {
+        reader->position += 5;
+        *value = 0;
+        return 1;
+    }
+    return fail(reader, "expected true or false");
+}
+
+// Skip any value, for fields the request doesn't use
+static int skipValue(JsonReader* reader, int depth) {
+    if (depth > REQUEST_MAX_DEPTH) return fail(reader, "nested too deeply");
+    skipSpace(reader);
+    if (reader->position >= reader->end) return fail(reader, "unexpected end of input");
+
+    char c = *reader->position;
+    if (c == '"') return readString(reader, NULL, 0, NULL);
+    if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        reader->position++;
+        if (acceptChar(reader, close)) return 1;
+        do {
+            if (c == '{' && !(readString(reader, NULL, 0, NULL) && expectChar(reader, ':'))) return 0;
+            if (!skipValue(reader, depth + 1)) return 0;
+        } while (acceptChar(reader, ','));
+        return expectChar(reader, close);
+    }
+    if (c == 't' || c == 'f') {
+        int ignored;
+        return readBool(reader, &ignored);
+    }
+    if (c == 'n') {
+        if (reader->end - reader->position >= 4 && memcmp(reader->position, "null", 4) == 0) {
+            reader->position += 4;
+            return 1;
+        }
+        return fail(reader, "unexpected character");
+    }
+    double ignored;
+    return readNumber(reader, &ignored);
+}
+
+// Iterate the members of an object: call with *first set to 1, then repeatedly
+// while it returns 1; each call leaves the reader at the member's value
+static int nextMember(JsonReader* reader, int* first, char* key) {
+    if (*first) {
+        *first = 0;
+        if (!expectChar(reader, '{')) return -1;
+        if (acceptChar(reader, '}')) return 0;
+    } else if (!acceptChar(reader, ',')) {
+        return expectChar(reader, '}') ? 0 : -1;
+    }
+
+    if (!readString(reader, key, REQUEST_KEY_LENGTH, NULL) || !expectChar(reader, ':')) return -1;
+    return 1;
+}
+
+// {"latitude": .., "longitude": .., "altitude": ..}; turnAngle is read too when asked for
+static int readCoordinates(JsonReader* reader, Coordinates* coordinates, double* turnAngle) {
+    char key[REQUEST_KEY_LENGTH];
+    int first = 1;
+    int found = 0;
+    int member;
+
+    coordinates->altitude = 0.0;
+    while ((member = nextMember(reader, &first, key)) == 1) {
+        int ok;
+        if (strcmp(key, "latitude") == 0) {
+            ok = readNumber(reader, &coordinates->latitude);
+            found |= 1;
+        } else if (strcmp(key, "longitude") == 0) {
+            ok = readNumber(reader, &coordinates->longitude);
+            found |= 2;
+        } else if (strcmp(key, "altitude") == 0) {
+            ok = readNumber(reader, &coordinates->altitude);
+        } else if (turnAngle && strcmp(key, "turnAngle") == 0) {
+            ok = readNumber(reader, turnAngle);
+        } else if (turnAngle && strcmp(key, "position") == 0) {
+            ok = readCoordinates(reader, coordinates, NULL);
+            found |= 3;
+        } else {
+            ok = skipValue(reader, 0);
+        }
+        if (!ok) return 0;
+    }
+
+    if (member < 0) return 0;
+    if (found != 3) return fail(reader, "coordinates need latitude and longitude");
+    return 1;
+}
+
+static int appendWaypoint(JsonReader* reader, Scenario* scenario, int* capacity, Coordinates position, double angle) {
+    if (scenario->waypointCount == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 16;
+        Coordinates* waypoints = (Coordinates*)arenaResize(reader->arena, scenario->waypoints,
+                                                           *capacity * sizeof(Coordinates), grown * sizeof(Coordinates));
+        double* angles = waypoints ? (double*)arenaResize(reader->arena, scenario->turnAngles,
+                                                          *capacity * sizeof(double), grown * sizeof(double)) : NULL;
+        if (!waypoints || !angles) return fail(reader, "out of memory");
+        scenario->waypoints = waypoints;
+        scenario->turnAngles = angles;
+        *capacity = grown;
+    }
+
+    scenario->waypoints[scenario->waypointCount] = position;
+    scenario->turnAngles[scenario->waypointCount] = angle;
+    scenario->waypointCount++;
+    return 1;
+}
+
+// true for the frontend's spline, false or 0 for none, or the samples per smoothed leg
+static int readSmooth(JsonReader* reader, int* segments) {
+    skipSpace(reader);
+    if (reader->position < reader->end && (*reader->position == 't' || *reader->position == 'f')) {
+        int smooth;
+        if (!readBool(reader, &smooth)) return 0;
+        *segments = smooth ? SPLINE_DEFAULT_SEGMENTS : 0;
+        return 1;
+    }
+
+    double value;
+    if (!readNumber(reader, &value)) return 0;
+    if (!(value >= 0.0 && value <= SPLINE_MAX_SEGMENTS) || value != (int)value) {
+        return fail(reader, "smooth must be true, false or a whole number of samples up to 1000");
+    }
+    *segments = (int)value;
+    return 1;
+}
+
+// {"south": .., "west": .., "north": .., "east": ..}, all four required
+static int readBounds(JsonReader* reader, GeoBounds* bounds) {
+    char key[REQUEST_KEY_LENGTH];
+    int first = 1;
+    int found = 0;
+    int member;
+
+    while ((member = nextMember(reader, &first, key)) == 1) {
+        int ok;
+        if (strcmp(key, "south") == 0) {
+            ok = readNumber(reader, &bounds->south);
+            found |= 1;
+        } else if (strcmp(key, "west") == 0) {
+            ok = readNumber(reader, &bounds->west);
+            found |= 2;
+        } else if (strcmp(key, "north") == 0) {
+            ok = readNumber(reader, &bounds->north);
+            found |= 4;
+        } else if (strcmp(key, "east") == 0) {
+            ok = readNumber(reader, &bounds->east);
+            found |= 8;
+        } else {
+            ok = skipValue(reader, 0);
+        }
+        if (!ok) return 0;
+    }
+
+    if (member < 0) return 0;
+    if (found != 15) return fail(reader, "bounds need south, west, north and east");
+    return 1;
+}
+
+// A number or an array of numbers, stored in an array from the arena
+static int readTimes(JsonReader* reader, TrajectoryRequest* request) {
+    int capacity = 0;
+    request->timeCount = 0;
+    request->times = NULL;
+
+    if (!acceptChar(reader, '[')) {
+        request->times = (double*)arenaAlloc(reader->arena, sizeof(double));
+        if (!request->times) return fail(reader, "out of memory");
+        request->timeCount = 1;
+        return readNumber(reader, &request->times[0]);
+    }
+
+    if (acceptChar(reader, ']')) return 1;
+    do {
+        if (request->timeCount == capacity) {
+            int grown = capacity ? capacity * 2 : 16;
+            double* times = (double*)arenaResize(reader->arena, request->times,
+                                                 capacity * sizeof(double), grown * sizeof(double));
+            if (!times) return fail(reader, "out of memory");
+            request->times = times;
+            capacity = grown;
+        }
+        if (!readNumber(reader, &request->times[request->timeCount])) return 0;
+        request->timeCount++;
+    } while (acceptChar(reader, ','));
+    return expectChar(reader, ']');
+}
+
+// Array of waypoint objects, or a "lat,lon,alt,angle|..." string
+static int readWaypoints(JsonReader* reader, Scenario* scenario) {
+    int capacity = 0;
+    scenario->waypointCount = 0;
+    scenario->waypoints = NULL;
+    scenario->turnAngles = NULL;
+
+    skipSpace(reader);
+    if (reader->position < reader->end && *reader->position == '"') {
+        const char* start = reader->position;
+        size_t length;
+        if (!readString(reader, NULL, 0, &length)) return 0;
+
+        char* text = (char*)arenaAlloc(reader->arena, length + 1);
+        if (!text) return fail(reader, "out of memory");
+        reader->position = start;
+        readString(reader, text, length + 1, NULL);
+
+        capacity = countWaypointSpan(text, length);
+        scenario->waypoints = (Coordinates*)arenaAlloc(reader->arena, (capacity + 1) * sizeof(Coordinates));
+        scenario->turnAngles = (double*)arenaAlloc(reader->arena, (capacity + 1) * sizeof(double));
+        if (!scenario->waypoints || !scenario->turnAngles) return fail(reader, "out of memory");
+
+        ParseError error;
+        int count = parseWaypointSpan(text, length, scenario->waypoints, scenario->turnAngles, capacity, &error);
+        if (count < 0) {
+            // Point at the invalid byte inside the string (exact unless it holds escapes)
+            if (start + 1 + error.offset < reader->position) reader->position = start + 1 + error.offset;
+            return fail(reader, error.message);
+        }
+        scenario->waypointCount = count;
+        return 1;
+    }
+
+    if (!expectChar(reader, '[')) return 0;
+    if (acceptChar(reader, ']')) return 1;
+    do {
+        Coordinates position;
+        double angle = 0.0;
+        if (!readCoordinates(reader, &position, &angle)) return 0;
+        if (!appendWaypoint(reader, scenario, &capacity, position, angle)) return 0;
+    } while (acceptChar(reader, ','));
+    return expectChar(reader, ']');
+}
+
+// {"weight": .., "speed": ..}
+static int readMissile(JsonReader* reader, double* weight, double* speed, int* found) {
+    char key[REQUEST_KEY_LENGTH];
+    int first = 1;
+    int member;
+
+    while ((member = nextMember(reader, &first, key)) == 1) {
+        int ok;
+        if (strcmp(key, "weight") == 0) {
+            ok = readNumber(reader, weight);
+            *found |= 4;
+        } else if (strcmp(key, "speed") == 0) {
+            ok = readNumber(reader, speed);
+            *found |= 8;
+        } else {
+            ok = skipValue(reader, 0);
+        }
+        if (!ok) return 0;
+    }
+    return member == 0;
+}
+
+// Parse a request body. Waypoint arrays come from arena. Returns 0 on success,
+// otherwise -1 with a message and byte offset in error
+int parseTrajectoryRequest(const char* body, size_t length, TrajectoryRequest* request, Arena* arena,
+                           char* error, size_t errorSize) {
+    STATS_BEGIN(STATS_PHASE_PARSE);
+    JsonReader reader = { body, body + length, body, NULL, arena };
+    char key[REQUEST_KEY_LENGTH];
+    double weight = 0.0;
+    double speed = 0.0;
+    int found = 0;
+    int first = 1;
+    int member;
+
+    memset(request, 0, sizeof(*request));
+    request->output = defaultOutputOptions();
+    request->telemetryStep = TELEMETRY_DEFAULT_STEP;
+    request->zoom = PYRAMID_LEVELS - 1;
+
+    while ((member = nextMember(&reader, &first, key)) == 1) {
+        int ok;
+        if (strcmp(key, "start") == 0) {
+            ok = readCoordinates(&reader, &request->scenario.start, NULL);
+            found |= 1;
+        } else if (strcmp(key, "end") == 0) {
+            ok = readCoordinates(&reader, &request->scenario.end, NULL);
+            found |= 2;
+        } else if (strcmp(key, "weight") == 0) {
+            ok = readNumber(&reader, &weight);
+            found |= 4;
+        } else if (strcmp(key, "speed") == 0) {
+            ok = readNumber(&reader, &speed);
+            found |= 8;
+        } else if (strcmp(key, "missile") == 0) {
+            ok = readMissile(&reader, &weight, &speed, &found);
+        } else if (strcmp(key, "waypoints") == 0) {
+            ok = readWaypoints(&reader, &request->scenario);
+        } else if (strcmp(key, "compact") == 0) {
+            ok = readBool(&reader, &request->output.compact);
+        } else if (strcmp(key, "encodedPath") == 0) {
+            ok = readBool(&reader, &request->output.encodedPath);
+        } else if (strcmp(key, "tolerance") == 0) {
+            ok = readNumber(&reader, &request->output.sampling.tolerance);
+            if (ok && !(request->output.sampling.tolerance > 0.0)) ok = fail(&reader, "tolerance must be positive");
+        } else if (strcmp(key, "altitudeTolerance") == 0) {
+            ok = readNumber(&reader, &request->output.sampling.altitudeTolerance);
+            if (ok && request->output.sampling.altitudeTolerance < 0.0) {
+                ok = fail(&reader, "altitudeTolerance must not be negative");
+            }
+        } else if (strcmp(key, "maxPoints") == 0) {
+            double maxPoints;
+            ok = readNumber(&reader, &maxPoints);
+            if (ok && (!(maxPoints >= 0.0 && maxPoints <= REQUEST_MAX_POINTS) || maxPoints != (int)maxPoints)) {
+                ok = fail(&reader, "maxPoints must be a whole number up to 262144");
+            }
+            if (ok) request->output.sampling.maxPoints = (int)maxPoints;
+        } else if (strcmp(key, "smooth") == 0) {
+            ok = readSmooth(&reader, &request->output.sampling.smoothSegments);
+        } else if (strcmp(key, "step") == 0) {
+            ok = readNumber(&reader, &request->telemetryStep);
+            if (ok && !(request->telemetryStep > 0.0)) ok = fail(&reader, "step must be positive");
+        } else if (strcmp(key, "time") == 0) {
+            ok = readTimes(&reader, request);
+        } else if (strcmp(key, "zoom") == 0) {
+            ok = readNumber(&reader, &request->zoom);
+        } else if (strcmp(key, "bounds") == 0) {
+            ok = readBounds(&reader, &request->bounds);
+            request->hasBounds = 1;
+        } else {
+            ok = skipValue(&reader, 0);
+        }
+        if (!ok) {
+            member = -1;
+            break;
+        }
+    }
+
+    if (member == 0) {
+        skipSpace(&reader);
+        if (reader.position != reader.end) {
+            fail(&reader, "unexpected data after the request object");
+        } else if ((found & 15) != 15) {
+            fail(&reader, "request needs start, end, weight and speed");
+        }
+    }
+
+    if (!reader.failure) {
+        request->scenario.missile = defaultMissileAttributes(weight, speed);
+        // Without a budget a tiny tolerance could refine each segment into 2^24 pieces
+        if (request->output.sampling.maxPoints == 0) request->output.sampling.maxPoints = REQUEST_MAX_POINTS;
+    } else {
+        snprintf(error, errorSize, "%s at offset %ld", reader.failure, (long)(reader.position - reader.text));
+    }
+
+    STATS_END();
+    return reader.failure ? -1 : 0;
+}
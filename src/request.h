@@ -0,0 +1,47 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <stddef.h>
+#include "scenario.h"
+#include "output.h"
+#include "pyramid.h"
+
+// Largest adaptive path a request may ask for, and its budget when it gives none
+#define REQUEST_MAX_POINTS 262144
+
+// A trajectory calculation requested as JSON:
+// {
+//   "start": {"latitude": 28.6, "longitude": 77.2, "altitude": 0},
+//   "end": {"latitude": 19.07, "longitude": 72.87, "altitude": 0},
+//   "weight": 1000, "speed": 800,
+//   "waypoints": [{"latitude": 26, "longitude": 75, "altitude": 100, "turnAngle": 30}],
+//   "compact": true, "encodedPath": true, "tolerance": 0.1, "altitudeTolerance": 0, "maxPoints": 0,
+//   "smooth": true, "step": 1, "time": [0, 30.5],
+//   "zoom": 6, "bounds": {"south": 18, "west": 70, "north": 30, "east": 80}
+// }
+// weight and speed may also sit in a "missile" object, waypoints may give
+// their position as a "position" object or use the command line string
+// format, and altitudes default to 0. "smooth" (true or samples per leg)
+// returns the frontend's Catmull-Rom path, "encodedPath" sends the path as
+// polyline strings (src/polyline.h). "step" is the telemetry interval in
+// seconds and "time" one or more flight times to look up positions at.
+// "zoom" and "bounds" pick the level and viewport of a path view (src/pyramid.h).
+// Unknown fields are ignored. "tolerance" must be positive, and an adaptive
+// path is capped at "maxPoints", which defaults to and may not exceed
+// REQUEST_MAX_POINTS so one request can't make the server sample millions of points.
+typedef struct {
+    Scenario scenario;
+    OutputOptions output;
+    double telemetryStep;   // Seconds between telemetry samples
+    int timeCount;          // Flight times requested for position lookups
+    double* times;
+    double zoom;            // Map zoom of a path view, finest level if absent
+    int hasBounds;          // bounds holds the viewport of a path view
+    GeoBounds bounds;
+} TrajectoryRequest;
+
+// Function declarations
+int parseTrajectoryRequest(const char* body, size_t length, TrajectoryRequest* request, Arena* arena,
+                           char* error, size_t errorSize);
+
+#endif /* REQUEST_H */
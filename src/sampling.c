@@ -0,0 +1,535 @@
+#include "sampling.h"
+#include "spline.h"
+#include "kernels.h"
+#include "stats.h"
+#include <string.h>
+
+// Kilometers per degree of latitude
+#define KM_PER_DEGREE (EARTH_RADIUS * M_PI / 180.0)
+
+// Probes per piece: both ends plus the quarter, half and three-quarter points.
+// Probing the quarters as well as the middle catches S-shaped pieces whose
+// midpoint happens to sit on the chord.
+#define PIECE_PROBES 5
+
+// The peak deviation of a long piece can fall between probes, up to ~10%
+// above the largest probe; pieces must fit the tolerance with this margin
+#define PROBE_MARGIN 1.125
+
+// Part of a segment, with the path evaluated at its probe fractions
+typedef struct {
+    double priority;            // Worst probe deviation relative to the tolerance
+    double startFraction;
+    double endFraction;
+    int segment;
+    int depth;
+    Coordinates probes[PIECE_PROBES];
+} PathPiece;
+
+SamplingOptions defaultSamplingOptions(void) {
+    SamplingOptions options;
+    options.tolerance = 0.0;
+    options.altitudeTolerance = 0.0;
+    options.maxPoints = 0;
+    options.smoothSegments = 0;
+    return options;
+}
+
+static double wrapLongitude(double degrees) {
+    if (degrees > 180.0) return degrees - 360.0;
+    if (degrees < -180.0) return degrees + 360.0;
+    return degrees;
+}
+
+// Horizontal distance in km from point to the straight line drawn between
+// chordStart and chordEnd on the map (local equirectangular projection).
+// along is the point's position between the chord ends (0..1); the altitude
+// deviation in meters from the linearly interpolated profile goes to
+// altitudeDeviation when it isn't NULL
+double pathDeviation(Coordinates point, Coordinates chordStart, Coordinates chordEnd, double along,
+                     double* altitudeDeviation) {
+    double scaleX = KM_PER_DEGREE * cos(point.latitude * M_PI / 180.0);
+    double ax = wrapLongitude(chordStart.longitude - point.longitude) * scaleX;
+    double ay = (chordStart.latitude - point.latitude) * KM_PER_DEGREE;
+    double bx = wrapLongitude(chordEnd.longitude - point.longitude) * scaleX;
+    double by = (chordEnd.latitude - point.latitude) * KM_PER_DEGREE;
+
+    // Closest point of the chord to the origin (the probe)
+    double dx = bx - ax;
+    double dy = by - ay;
+    double lengthSquared = dx * dx + dy * dy;
+    double t = lengthSquared > 0.0 ? -(ax * dx + ay * dy) / lengthSquared : 0.0;
+    if (t < 0.0) t = 0.0;
+    if (t > 1.0) t = 1.0;
+
+    if (altitudeDeviation) {
+        double chordAltitude = chordStart.altitude + (chordEnd.altitude - chordStart.altitude) * along;
+        *altitudeDeviation = fabs(point.altitude - chordAltitude);
+    }
+
+    double ex = ax + t * dx;
+    double ey = ay + t * dy;
+    return sqrt(ex * ex + ey * ey);
+}
+
+// Altitude deviation in meters the adaptive sampler allows
+static double effectiveAltitudeTolerance(const SamplingOptions* options) {
+    if (options->altitudeTolerance > 0.0) {
+        return options->altitudeTolerance;
+    }
+    return options->tolerance * DEFAULT_ALTITUDE_TOLERANCE_PER_KM;
+}
+
+// Worst deviation of the inner probes from the piece's chord, relative to the tolerances
+static double piecePriority(const PathPiece* piece, const SamplingOptions* options) {
+    double altitudeLimit = effectiveAltitudeTolerance(options);
+    double worst = 0.0;
+
+    for (int i = 1; i < PIECE_PROBES - 1; i++) {
+        double altitudeDeviation;
+        double along = (double)i / (PIECE_PROBES - 1);
+        double deviation = pathDeviation(piece->probes[i], piece->probes[0], piece->probes[PIECE_PROBES - 1],
+                                         along, &altitudeDeviation) / options->tolerance;
+        if (altitudeDeviation / altitudeLimit > deviation) {
+            deviation = altitudeDeviation / altitudeLimit;
+        }
+        if (!(deviation <= worst)) worst = deviation; // NaN probes sort first
+    }
+
+    return worst * PROBE_MARGIN;
+}
+
+// Working memory from the caller's arena when there is one, else the heap
+static void* scratchResize(Arena* scratch, void* memory, size_t oldSize, size_t newSize) {
+    if (scratch) {
+        return arenaResize(scratch, memory, oldSize, newSize);
+    }
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, newSize);
+    return realloc(memory, newSize);
+}
+
+static void scratchFree(Arena* scratch, void* memory) {
+    if (!scratch) free(memory);
+}
+
+// Max-heap of pieces ordered by priority
+typedef struct {
+    PathPiece* pieces;
+    int count;
+    int capacity;
+    Arena* scratch;
+} PieceHeap;
+
+static int pushPiece(PieceHeap* heap, const PathPiece* piece) {
+    if (heap->count == heap->capacity) {
+        int capacity = heap->capacity ? heap->capacity * 2 : 64;
+        PathPiece* pieces = (PathPiece*)scratchResize(heap->scratch, heap->pieces,
+                                                      heap->capacity * sizeof(PathPiece), capacity * sizeof(PathPiece));
+        if (!pieces) return 0;
+        heap->pieces = pieces;
+        heap->capacity = capacity;
+    }
+
+    int index = heap->count++;
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!(heap->pieces[parent].priority < piece->priority)) break;
+        heap->pieces[index] = heap->pieces[parent];
+        index = parent;
+    }
+    heap->pieces[index] = *piece;
+    return 1;
+}
+
+static PathPiece popPiece(PieceHeap* heap) {
+    PathPiece top = heap->pieces[0];
+    PathPiece last = heap->pieces[--heap->count];
+    int index = 0;
+
+    for (;;) {
+        int child = 2 * index + 1;
+        if (child >= heap->count) break;
+        if (child + 1 < heap->count && heap->pieces[child + 1].priority > heap->pieces[child].priority) child++;
+        if (!(heap->pieces[child].priority > last.priority)) break;
+        heap->pieces[index] = heap->pieces[child];
+        index = child;
+    }
+    if (heap->count > 0) heap->pieces[index] = last;
+    return top;
+}
+
+// Evaluate the probes of piece that aren't inherited from its parent
+static void evaluateProbes(PathPiece* piece, const GeoSegment* geoSegment, int firstProbe, int step, long* evaluations) {
+    double width = piece->endFraction - piece->startFraction;
+
+    for (int i = firstProbe; i < PIECE_PROBES; i += step) {
+        double fraction = piece->startFraction + width * i / (PIECE_PROBES - 1);
+        if (i == PIECE_PROBES - 1) fraction = piece->endFraction;
+        piece->probes[i] = geoSegmentPoint(geoSegment, fraction);
+        (*evaluations)++;
+    }
+}
+
+// Whole segment as a single piece
+static void initPiece(PathPiece* piece, const GeoSegment* geoSegment, int segment,
+                      const SamplingOptions* options, long* evaluations) {
+    piece->startFraction = 0.0;
+    piece->endFraction = 1.0;
+    piece->segment = segment;
+    piece->depth = 0;
+    evaluateProbes(piece, geoSegment, 0, 1, evaluations);
+    piece->priority = piecePriority(piece, options);
+}
+
+static int needsSplit(const PathPiece* piece) {
+    return piece->priority > 1.0 && piece->depth < SAMPLING_MAX_DEPTH;
+}
+
+// Split piece in half; each half inherits three probes and evaluates two
+static void splitPiece(const PathPiece* piece, PathPiece* left, PathPiece* right, const GeoSegment* geoSegment,
+                       const SamplingOptions* options, long* evaluations) {
+    double middle = 0.5 * (piece->startFraction + piece->endFraction);
+
+    left->startFraction = piece->startFraction;
+    left->endFraction = middle;
+    left->segment = piece->segment;
+    left->depth = piece->depth + 1;
+    left->probes[0] = piece->probes[0];
+    left->probes[2] = piece->probes[1];
+    left->probes[4] = piece->probes[2];
+    evaluateProbes(left, geoSegment, 1, 2, evaluations);
+    left->priority = piecePriority(left, options);
+
+    right->startFraction = middle;
+    right->endFraction = piece->endFraction;
+    right->segment = piece->segment;
+    right->depth = piece->depth + 1;
+    right->probes[0] = piece->probes[2];
+    right->probes[2] = piece->probes[3];
+    right->probes[4] = piece->probes[4];
+    evaluateProbes(right, geoSegment, 1, 2, evaluations);
+    right->priority = piecePriority(right, options);
+}
+
+// Batches points on the stack and hands them to a PathSink a chunk at a time
+typedef struct {
+    PathSink sink;
+    void* context;
+    int count;
+    int stopped;                // The sink asked to stop
+    long delivered;
+    Coordinates chunk[PATH_SINK_CHUNK];
+} PathEmitter;
+
+static int flushEmitter(PathEmitter* emitter) {
+    if (emitter->count > 0 && !emitter->stopped) {
+        if (emitter->sink(emitter->context, emitter->chunk, emitter->count) != 0) {
+            emitter->stopped = 1;
+        } else {
+            emitter->delivered += emitter->count;
+        }
+    }
+    emitter->count = 0;
+    return !emitter->stopped;
+}
+
+static int emitPoint(PathEmitter* emitter, Coordinates point) {
+    emitter->chunk[emitter->count++] = point;
+    return emitter->count < PATH_SINK_CHUNK || flushEmitter(emitter);
+}
+
+// No budget: refine each segment depth-first, which emits vertices in path order
+static int refineDepthFirst(TrajectoryData* trajectory, const SamplingOptions* options, PathEmitter* emitter,
+                            SamplingStats* stats) {
+    int segments = trajectory->waypointCount + 1;
+    PathPiece stack[SAMPLING_MAX_DEPTH + 2];
+    GeoSegment geoSegment;
+
+    for (int segment = 0; segment < segments; segment++) {
+        int depth = 0;
+        initTrajectorySegment(trajectory, segment, &geoSegment);
+        initPiece(&stack[depth++], &geoSegment, segment, options, &stats->evaluations);
+
+        while (depth > 0) {
+            PathPiece piece = stack[--depth];
+
+            if (needsSplit(&piece)) {
+                // Left half on top so it is emitted first
+                splitPiece(&piece, &stack[depth + 1], &stack[depth], &geoSegment, options, &stats->evaluations);
+                depth += 2;
+                continue;
+            }
+
+            if (piece.priority > stats->maxError) stats->maxError = piece.priority;
+            if (!emitPoint(emitter, piece.probes[0])) return 0;
+            if (segment == segments - 1 && piece.endFraction == 1.0) {
+                if (!emitPoint(emitter, piece.probes[PIECE_PROBES - 1])) return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// A finished vertex of the sampled path
+typedef struct {
+    int segment;
+    double fraction;
+    Coordinates position;
+} PathVertex;
+
+static int compareVertices(const void* a, const void* b) {
+    const PathVertex* left = (const PathVertex*)a;
+    const PathVertex* right = (const PathVertex*)b;
+
+    if (left->segment != right->segment) return left->segment < right->segment ? -1 : 1;
+    if (left->fraction != right->fraction) return left->fraction < right->fraction ? -1 : 1;
+    return 0;
+}
+
+// With a budget: always split the worst piece of the whole route next, then
+// put the vertices back in path order. maxPoints must allow one piece per segment
+static int refineWorstFirst(TrajectoryData* trajectory, const SamplingOptions* options, PathEmitter* emitter,
+                            SamplingStats* stats, Arena* scratch) {
+    int segments = trajectory->waypointCount + 1;
+    GeoSegment* geoSegments = (GeoSegment*)scratchResize(scratch, NULL, 0, segments * sizeof(GeoSegment));
+    PathVertex* vertices = (PathVertex*)scratchResize(scratch, NULL, 0, options->maxPoints * sizeof(PathVertex));
+    PieceHeap heap = { NULL, 0, 0, scratch };
+    Coordinates pathEnd = trajectory->end;
+    int pieceCount = segments;
+    int vertexCount = 0;
+    int status = 0;
+
+    if (!geoSegments || !vertices) goto done;
+
+    for (int segment = 0; segment < segments; segment++) {
+        PathPiece piece;
+        initTrajectorySegment(trajectory, segment, &geoSegments[segment]);
+        initPiece(&piece, &geoSegments[segment], segment, options, &stats->evaluations);
+        if (!pushPiece(&heap, &piece)) goto done;
+        if (segment == segments - 1) pathEnd = piece.probes[PIECE_PROBES - 1];
+    }
+
+    // Every piece contributes its start vertex and the path end adds one more,
+    // so splitting stops at maxPoints - 1 pieces
+    while (heap.count > 0) {
+        PathPiece piece = popPiece(&heap);
+
+        if (needsSplit(&piece) && pieceCount < options->maxPoints - 1) {
+            PathPiece left, right;
+            splitPiece(&piece, &left, &right, &geoSegments[piece.segment], options, &stats->evaluations);
+            if (!pushPiece(&heap, &left) || !pushPiece(&heap, &right)) goto done;
+            pieceCount++;
+            continue;
+        }
+
+        if (piece.priority > stats->maxError) stats->maxError = piece.priority;
+        vertices[vertexCount].segment = piece.segment;
+        vertices[vertexCount].fraction = piece.startFraction;
+        vertices[vertexCount].position = piece.probes[0];
+        vertexCount++;
+    }
+
+    qsort(vertices, vertexCount, sizeof(PathVertex), compareVertices);
+
+    status = 1;
+    for (int i = 0; i < vertexCount && status; i++) {
+        status = emitPoint(emitter, vertices[i].position);
+    }
+    status = status && emitPoint(emitter, pathEnd);
+
+done:
+    scratchFree(scratch, geoSegments);
+    scratchFree(scratch, vertices);
+    scratchFree(scratch, heap.pieces);
+    return status;
+}
+
+// Emit the Catmull-Rom smoothed route, evaluated in one batch
+static int emitSpline(TrajectoryData* trajectory, int segments, PathEmitter* emitter, SamplingStats* stats,
+                      Arena* scratch) {
+    SplinePath path;
+    if (buildTrajectorySpline(trajectory, segments, &path, scratch) != 0) {
+        return 0;
+    }
+
+    int status = 1;
+    for (int i = 0; status && i < path.count; i++) {
+        Coordinates point = { path.latitude[i], path.longitude[i], path.altitude[i] };
+        status = emitPoint(emitter, point);
+    }
+    stats->evaluations = path.count;
+    freeSplinePath(&path);
+    return status && flushEmitter(emitter);
+}
+
+// Run the sampler selected by options through emitter
+static int runSampler(TrajectoryData* trajectory, const SamplingOptions* options, PathEmitter* emitter,
+                      SamplingStats* stats, Arena* scratch) {
+    int segments = trajectory->waypointCount + 1;
+
+    stats->evaluations = 0;
+    stats->maxError = 0.0;
+
+    if (options && options->smoothSegments > 0) {
+        return emitSpline(trajectory, options->smoothSegments, emitter, stats, scratch);
+    }
+
+    if (!options || !(options->tolerance > 0.0)) {
+        // Fixed sampler, one segment at a time
+        for (int segment = 0; segment < segments; segment++) {
+            GeoSegment geoSegment;
+            Coordinates points[KERNEL_SAMPLES_PER_SEGMENT];
+            initTrajectorySegment(trajectory, segment, &geoSegment);
+            kernelSegmentPoints(&geoSegment, points);
+            for (int i = 0; i < KERNEL_SAMPLES_PER_SEGMENT; i++) {
+                if (!emitPoint(emitter, points[i])) return 0;
+            }
+        }
+        stats->evaluations = (long)segments * PATH_POINTS_PER_SEGMENT;
+        return flushEmitter(emitter);
+    }
+
+    if (options->maxPoints > 0) {
+        // Pieces hold one vertex each, so a budget can't go below one piece per segment
+        SamplingOptions budgeted = *options;
+        if (budgeted.maxPoints < segments + 1) budgeted.maxPoints = segments + 1;
+        return refineWorstFirst(trajectory, &budgeted, emitter, stats, scratch) && flushEmitter(emitter);
+    }
+
+    return refineDepthFirst(trajectory, options, emitter, stats) && flushEmitter(emitter);
+}
+
+// Stream the sampled path to sink in order, PATH_SINK_CHUNK points at a time.
+// Only the budgeted adaptive sampler needs working memory, taken from scratch
+// (heap if NULL). Returns the number of points delivered, or -1 if the sink
+// stopped early or memory ran out
+int streamPathPoints(TrajectoryData* trajectory, const SamplingOptions* options, PathSink sink, void* context,
+                     Arena* scratch, SamplingStats* stats) {
+    SamplingStats localStats;
+    PathEmitter emitter;
+    STATS_BEGIN(STATS_PHASE_SAMPLING);
+
+    emitter.sink = sink;
+    emitter.context = context;
+    emitter.count = 0;
+    emitter.stopped = 0;
+    emitter.delivered = 0;
+
+    int status = runSampler(trajectory, options, &emitter, stats ? stats : &localStats, scratch);
+    STATS_ADD(STATS_COUNTER_PATH_POINTS, emitter.delivered);
+    STATS_END();
+    return status ? (int)emitter.delivered : -1;
+}
+
+// Destination of samplePathPointsInto and the arena/heap collectors
+typedef struct {
+    Coordinates* points;
+    int count;
+    int capacity;
+    Arena* arena;               // Grow points in this arena; NULL for a fixed buffer or the heap
+    int growable;
+} PointCollector;
+
+static int collectPoints(void* context, const Coordinates* points, int count) {
+    PointCollector* collector = (PointCollector*)context;
+
+    if (collector->growable && collector->count + count > collector->capacity) {
+        int capacity = collector->capacity * 2;
+        if (capacity < collector->count + count) capacity = collector->count + count;
+        Coordinates* grown = (Coordinates*)scratchResize(collector->arena, collector->points,
+                                                         collector->capacity * sizeof(Coordinates),
+                                                         capacity * sizeof(Coordinates));
+        if (!grown) return 1;
+        collector->points = grown;
+        collector->capacity = capacity;
+    }
+
+    // A fixed buffer takes what fits and keeps counting the rest
+    int room = collector->capacity - collector->count;
+    int copied = count < room ? count : room;
+    if (copied > 0) {
+        memcpy(collector->points + collector->count, points, copied * sizeof(Coordinates));
+    }
+    collector->count += count;
+    return 0;
+}
+
+// Write up to capacity path points into buffer. Returns the number of points
+// the whole path has (-1 on failure); when that exceeds capacity the output was
+// truncated. The fixed sampler's size is known up front: call with a NULL
+// buffer and zero capacity to get it without sampling
+int samplePathPointsInto(TrajectoryData* trajectory, const SamplingOptions* options,
+                         Coordinates* buffer, int capacity, Arena* scratch) {
+    if (!options || (!(options->tolerance > 0.0) && options->smoothSegments <= 0)) {
+        return generatePathPointsInto(trajectory, buffer, capacity);
+    }
+
+    PointCollector collector = { buffer, 0, capacity, NULL, 0 };
+    if (streamPathPoints(trajectory, options, collectPoints, &collector, scratch, NULL) < 0) {
+        return -1;
+    }
+    return collector.count;
+}
+
+// Sample the path into memory from arena, which a caller reuses across
+// trajectories (e.g. one per worker thread, reset between scenarios)
+Coordinates* samplePathPointsInArena(TrajectoryData* trajectory, const SamplingOptions* options,
+                                     Arena* arena, int* pointCount) {
+    *pointCount = 0;
+
+    if (!options || (!(options->tolerance > 0.0) && options->smoothSegments <= 0)) {
+        int required = generatePathPointsInto(trajectory, NULL, 0);
+        Coordinates* points = (Coordinates*)arenaAlloc(arena, required * sizeof(Coordinates));
+        if (!points) return NULL;
+        *pointCount = generatePathPointsInto(trajectory, points, required);
+        return points;
+    }
+
+    // A budget bounds the point count, so the points never have to move
+    PointCollector collector = { NULL, 0, 0, arena, 1 };
+    collector.capacity = 4 * (trajectory->waypointCount + 2);
+    if (options->maxPoints > collector.capacity) collector.capacity = options->maxPoints;
+    collector.points = (Coordinates*)arenaAlloc(arena, collector.capacity * sizeof(Coordinates));
+    if (!collector.points) return NULL;
+    if (streamPathPoints(trajectory, options, collectPoints, &collector, arena, NULL) < 0) {
+        return NULL;
+    }
+
+    *pointCount = collector.count;
+    return collector.points;
+}
+
+// Sample the path adaptively (fixed sampler if options has no tolerance).
+// Consecutive segments share their waypoint vertex, so a path needing no
+// refinement has waypointCount + 2 points. Returns a malloc'd array (NULL on
+// failure) and its length in pointCount
+Coordinates* generateAdaptivePathPoints(TrajectoryData* trajectory, const SamplingOptions* options,
+                                        int* pointCount, SamplingStats* stats) {
+    PointCollector collector = { NULL, 0, 0, NULL, 1 };
+
+    *pointCount = 0;
+    collector.capacity = 4 * (trajectory->waypointCount + 2);
+    collector.points = (Coordinates*)malloc(collector.capacity * sizeof(Coordinates));
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, collector.capacity * sizeof(Coordinates));
+    if (!collector.points) return NULL;
+
+    if (streamPathPoints(trajectory, options, collectPoints, &collector, NULL, stats) < 0) {
+        free(collector.points);
+        return NULL;
+    }
+
+    *pointCount = collector.count;
+    return collector.points;
+}
+
+// Path points for output: smoothed or adaptive when options ask for it, otherwise
+// the fixed PATH_POINTS_PER_SEGMENT per segment of generatePathPoints
+Coordinates* samplePathPoints(TrajectoryData* trajectory, const SamplingOptions* options, int* pointCount) {
+    if (options && (options->tolerance > 0.0 || options->smoothSegments > 0)) {
+        return generateAdaptivePathPoints(trajectory, options, pointCount, NULL);
+    }
+    return generatePathPoints(trajectory, pointCount);
+}
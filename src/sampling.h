@@ -0,0 +1,54 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include "trajectory.h"
+#include "arena.h"
+
+// Adaptive path sampling: instead of a fixed 100 points per segment, each
+// segment starts as one straight line and the worst-fitting piece of the
+// whole route is split in half until every piece is within tolerance or the
+// point budget is spent. Points end up where the drawn path bends.
+
+// Subdivision depth limit per segment (pieces of 2^-depth of a segment)
+#define SAMPLING_MAX_DEPTH 24
+
+// Points per PathSink call
+#define PATH_SINK_CHUNK 128
+
+// Altitude deviation in meters allowed per km of horizontal tolerance when no
+// altitude tolerance is given, so the default output keeps the climb and descent
+#define DEFAULT_ALTITUDE_TOLERANCE_PER_KM 1000.0
+
+typedef struct {
+    double tolerance;           // Max horizontal deviation in km; <= 0 selects the fixed sampler
+    double altitudeTolerance;   // Max altitude deviation in meters; <= 0 uses tolerance *
+                                // DEFAULT_ALTITUDE_TOLERANCE_PER_KM
+    int maxPoints;              // Point budget for the whole path; <= 0 for no budget
+    int smoothSegments;         // > 0 draws the frontend's Catmull-Rom spline instead, this many
+                                // samples per smoothed leg (src/spline.h); overrides the above
+} SamplingOptions;
+
+typedef struct {
+    long evaluations;           // Points evaluated on the great circle
+    double maxError;            // Largest remaining deviation relative to the tolerance
+} SamplingStats;
+
+// Receives the path in order, up to PATH_SINK_CHUNK points per call; return
+// non-zero to stop sampling
+typedef int (*PathSink)(void* context, const Coordinates* points, int count);
+
+// Function declarations
+SamplingOptions defaultSamplingOptions(void);
+double pathDeviation(Coordinates point, Coordinates chordStart, Coordinates chordEnd, double along,
+                     double* altitudeDeviation);
+Coordinates* generateAdaptivePathPoints(TrajectoryData* trajectory, const SamplingOptions* options,
+                                        int* pointCount, SamplingStats* stats);
+Coordinates* samplePathPoints(TrajectoryData* trajectory, const SamplingOptions* options, int* pointCount);
+int streamPathPoints(TrajectoryData* trajectory, const SamplingOptions* options, PathSink sink, void* context,
+                     Arena* scratch, SamplingStats* stats);
+int samplePathPointsInto(TrajectoryData* trajectory, const SamplingOptions* options,
+                         Coordinates* buffer, int capacity, Arena* scratch);
+Coordinates* samplePathPointsInArena(TrajectoryData* trajectory, const SamplingOptions* options,
+                                     Arena* arena, int* pointCount);
+
+#endif /* SAMPLING_H */
@@ -0,0 +1,229 @@
+#include "scenario.h"
+#include "stats.h"
+#include "number.h"
+#include <string.h>
+
+// Number of numeric fields in a scenario record before the optional waypoints
+#define SCENARIO_NUMERIC_FIELDS 8
+
+// Build missile attributes from weight and speed using the simulator defaults
+MissileAttributes defaultMissileAttributes(double weight, double speed) {
+    MissileAttributes missile;
+
+    missile.weight = weight;
+    missile.speed = speed;
+    missile.fuel = missile.weight * 0.7; // Assume 70% of weight is fuel
+    missile.burnRate = missile.fuel / 60.0; // Burn all fuel in 60 seconds
+    missile.thrust = missile.weight * 30.0; // Simple thrust calculation
+
+    // Set advanced physics parameters
+    missile.maxAcceleration = MISSILE_DEFAULT_MAX_ACCELERATION;
+    missile.maxDeceleration = MISSILE_DEFAULT_MAX_DECELERATION;
+    missile.maxTurnRate = MISSILE_DEFAULT_MAX_TURN_RATE;
+    missile.dragCoefficient = MISSILE_DEFAULT_DRAG_COEFFICIENT;
+    missile.fuelConsumptionNormal = missile.burnRate;
+    missile.fuelConsumptionTurn = missile.burnRate * 2.0;
+
+    return missile;
+}
+
+static int isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static const char* skipBlanks(const char* ptr, const char* end) {
+    while (ptr < end && isBlank(*ptr)) ptr++;
+    return ptr;
+}
+
+static void setParseError(ParseError* error, const char* message, const char* start, const char* at) {
+    if (error) {
+        error->message = message;
+        error->offset = (size_t)(at - start);
+    }
+}
+
+// Upper bound on the number of waypoints in a waypoint span
+int countWaypointSpan(const char* text, size_t length) {
+    if (!text || length == 0) {
+        return 0;
+    }
+
+    int count = 1;
+    const char* end = text + length;
+    for (const char* ptr = text; (ptr = memchr(ptr, '|', end - ptr)) != NULL; ptr++) {
+        count++;
+    }
+    return count;
+}
+
+// Upper bound on the number of waypoints in a waypoint string
+int countWaypoints(const char* waypointStr) {
+    return waypointStr ? countWaypointSpan(waypointStr, strlen(waypointStr)) : 0;
+}
+
+static int parseWaypointFields(const char* text, size_t length, Coordinates waypoints[], double angles[],
+                               int capacity, ParseError* error) {
+    const char* ptr = skipBlanks(text, text + length);
+    const char* end = text + length;
+    int count = 0;
+
+    while (ptr < end) {
+        double fields[4];
+
+        for (int i = 0; i < 4; i++) {
+            const char* next = parseDouble(ptr, end, &fields[i]);
+            if (!next) {
+                setParseError(error, "expected a number", text, ptr);
+                return -1;
+            }
+            ptr = skipBlanks(next, end);
+            if (i < 3) {
+                if (ptr == end || *ptr != ',') {
+                    setParseError(error, "expected ',' between waypoint fields", text, ptr);
+                    return -1;
+                }
+                ptr = skipBlanks(ptr + 1, end);
+            }
+        }
+
+        if (count == capacity) {
+            setParseError(error, "too many waypoints", text, ptr);
+            return -1;
+        }
+        waypoints[count].latitude = fields[0];
+        waypoints[count].longitude = fields[1];
+        waypoints[count].altitude = fields[2];
+        angles[count] = fields[3];
+        count++;
+
+        if (ptr < end) {
+            if (*ptr != '|') {
+                setParseError(error, "expected '|' between waypoints", text, ptr);
+                return -1;
+            }
+            ptr = skipBlanks(ptr + 1, end);
+        }
+    }
+
+    return count;
+}
+
+// Parse a waypoint span of length bytes (no terminator needed):
+// lat,lon,alt,angle|lat,lon,alt,angle|... Blanks around the numbers and a
+// trailing '|' are accepted. Returns the number of waypoints stored, or -1
+// with error set at the first invalid byte; the waypoints ahead of it are stored
+int parseWaypointSpan(const char* text, size_t length, Coordinates waypoints[], double angles[],
+                      int capacity, ParseError* error) {
+    STATS_BEGIN(STATS_PHASE_PARSE);
+    int count = parseWaypointFields(text, length, waypoints, angles, capacity, error);
+    STATS_END();
+    return count;
+}
+
+// Function to parse waypoints from a string.
+// Stops at the first invalid waypoint and returns how many were stored
+int parseWaypoints(const char* waypointStr, Coordinates waypoints[], double angles[], int maxWaypoints) {
+    if (!waypointStr || *waypointStr == '\0' || maxWaypoints <= 0) {
+        return 0; // No waypoints
+    }
+
+    ParseError error;
+    int count = parseWaypointSpan(waypointStr, strlen(waypointStr), waypoints, angles, maxWaypoints, &error);
+    if (count < 0) {
+        // Every '|' ahead of the error closes a waypoint that was stored
+        count = countWaypointSpan(waypointStr, error.offset) - 1;
+        if (count < 0) count = 0;
+        if (count > maxWaypoints) count = maxWaypoints;
+    }
+    return count;
+}
+
+static int parseRecordFields(const char* record, size_t length, Scenario* scenario, Arena* arena, ParseError* error) {
+    const char* end = record + length;
+    const char* ptr = skipBlanks(record, end);
+    double fields[SCENARIO_NUMERIC_FIELDS];
+
+    if (ptr == end || *ptr == '#') {
+        return 0; // Nothing to evaluate
+    }
+
+    for (int i = 0; i < SCENARIO_NUMERIC_FIELDS; i++) {
+        const char* fieldEnd = ptr < end ? parseDouble(ptr, end, &fields[i]) : NULL;
+        if (!fieldEnd) {
+            setParseError(error, ptr < end ? "expected a number" : "missing field", record, ptr);
+            return -1;
+        }
+        if (fieldEnd < end && !isBlank(*fieldEnd)) {
+            setParseError(error, "unexpected character after number", record, fieldEnd);
+            return -1;
+        }
+        ptr = skipBlanks(fieldEnd, end);
+    }
+
+    scenario->start.latitude = fields[0];
+    scenario->start.longitude = fields[1];
+    scenario->start.altitude = fields[2];
+    scenario->end.latitude = fields[3];
+    scenario->end.longitude = fields[4];
+    scenario->end.altitude = fields[5];
+    scenario->missile = defaultMissileAttributes(fields[6], fields[7]);
+    scenario->waypointCount = 0;
+    scenario->waypoints = NULL;
+    scenario->turnAngles = NULL;
+
+    if (ptr < end) {
+        // The waypoint list must be the last token on the line
+        const char* tokenEnd = ptr;
+        while (tokenEnd < end && !isBlank(*tokenEnd)) tokenEnd++;
+        const char* rest = skipBlanks(tokenEnd, end);
+        if (rest < end) {
+            setParseError(error, "unexpected field after waypoints", record, rest);
+            return -1;
+        }
+
+        int capacity = countWaypointSpan(ptr, tokenEnd - ptr);
+        scenario->waypoints = (Coordinates*)arenaAlloc(arena, capacity * sizeof(Coordinates));
+        scenario->turnAngles = (double*)arenaAlloc(arena, capacity * sizeof(double));
+        if (!scenario->waypoints || !scenario->turnAngles) {
+            setParseError(error, "out of memory", record, ptr);
+            return -1;
+        }
+
+        ParseError waypointError;
+        int count = parseWaypointFields(ptr, tokenEnd - ptr, scenario->waypoints, scenario->turnAngles,
+                                        capacity, &waypointError);
+        if (count < 0) {
+            setParseError(error, waypointError.message, record, ptr + waypointError.offset);
+            return -1;
+        }
+        scenario->waypointCount = count;
+    }
+
+    return 1;
+}
+
+// Parse one batch record of length bytes (no terminator needed):
+// start_lat start_lon start_alt end_lat end_lon end_alt weight speed [waypoints]
+// Waypoint arrays are allocated from arena.
+// Returns 1 when a scenario was parsed, 0 for blank or comment lines, -1 if
+// malformed with error (may be NULL) describing the first invalid byte
+int parseScenarioSpan(const char* record, size_t length, Scenario* scenario, Arena* arena, ParseError* error) {
+    STATS_BEGIN(STATS_PHASE_PARSE);
+    int status = parseRecordFields(record, length, scenario, arena, error);
+    STATS_END();
+    return status;
+}
+
+// parseScenarioSpan over a NUL-terminated record
+int parseScenarioRecord(const char* record, Scenario* scenario, Arena* arena) {
+    return parseScenarioSpan(record, strlen(record), scenario, arena, NULL);
+}
+
+// Calculate the trajectory for a scenario, adding its waypoints in order.
+// The waypoint store comes from arena (heap if NULL; release with freeTrajectory)
+TrajectoryData runScenario(const Scenario* scenario, Arena* arena) {
+    TrajectoryData trajectory = calculateTrajectoryInArena(scenario->start, scenario->end, scenario->missile, arena);
+    addWaypoints(&trajectory, scenario->waypoints, scenario->turnAngles, scenario->waypointCount);
+    return trajectory;
+}
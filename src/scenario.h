@@ -0,0 +1,34 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "trajectory.h"
+#include "arena.h"
+
+// Structure to hold the inputs of a single trajectory calculation
+typedef struct {
+    Coordinates start;
+    Coordinates end;
+    MissileAttributes missile;
+    int waypointCount;          // Number of waypoints
+    Coordinates* waypoints;     // Waypoint positions
+    double* turnAngles;         // Turn angle at each waypoint in degrees
+} Scenario;
+
+// Where and why a span failed to parse
+typedef struct {
+    const char* message;        // Static description of what was expected
+    size_t offset;              // Byte offset of the first invalid byte in the span
+} ParseError;
+
+// Function declarations
+MissileAttributes defaultMissileAttributes(double weight, double speed);
+int countWaypoints(const char* waypointStr);
+int countWaypointSpan(const char* text, size_t length);
+int parseWaypoints(const char* waypointStr, Coordinates waypoints[], double angles[], int maxWaypoints);
+int parseWaypointSpan(const char* text, size_t length, Coordinates waypoints[], double angles[],
+                      int capacity, ParseError* error);
+int parseScenarioRecord(const char* record, Scenario* scenario, Arena* arena);
+int parseScenarioSpan(const char* record, size_t length, Scenario* scenario, Arena* arena, ParseError* error);
+TrajectoryData runScenario(const Scenario* scenario, Arena* arena);
+
+#endif /* SCENARIO_H */
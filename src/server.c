@@ -0,0 +1,836 @@
+#include "server.h"
+#include "request.h"
+#include "latency.h"
+#include "parallel.h"
+#include "batch.h"
+#include "writer.h"
+#include "stats.h"
+#include "legcache.h"
+#include "telemetry.h"
+#include "pyramid.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Initial size of a connection's receive buffer
+#define SERVER_RECEIVE_BUFFER (16 * 1024)
+
+// Milliseconds a response may wait for a client to drain its socket
+#define SERVER_SEND_TIMEOUT 10000
+
+// Events handled per epoll_wait call
+#define SERVER_EVENTS 64
+
+// Initial capacity of a worker's response body
+#define SERVER_RESPONSE_BUFFER (256 * 1024)
+
+// Counters shared by all workers
+typedef struct {
+    _Atomic long requests;
+    _Atomic long errors;            // Responses with a 4xx or 5xx status
+    _Atomic long connections;
+    LatencyHistogram latency;       // Time from a complete request to its response
+    double startTime;
+} ServerStats;
+
+typedef struct {
+    int listener;
+    _Atomic int stopping;
+    ServerStats stats;
+    PyramidCache* viewCache;    // Pyramids of recent /view routes, NULL to build one per request
+} Server;
+
+// Client connection, owned by the worker that accepted it
+typedef struct Connection {
+    int fd;
+    char* receive;              // Bytes received but not yet handled
+    size_t length;
+    size_t capacity;
+    double lastActive;
+    struct Connection* previous;
+    struct Connection* next;
+} Connection;
+
+// State a worker reuses across connections and requests. Each worker runs its
+// own epoll loop, so one thread multiplexes any number of keep-alive clients
+typedef struct {
+    Server* server;
+    pthread_t thread;
+    int poller;                 // epoll instance
+    Connection* connections;    // Open connections, for idle sweeps and shutdown
+    Arena arena;                // Request scenario and trajectory, reset per request
+    Writer body;                // Response body
+} ServerWorker;
+
+// Parsed request line and the headers the server acts on
+typedef struct {
+    const char* method;
+    size_t methodLength;
+    const char* path;
+    size_t pathLength;
+    size_t headerLength;        // Bytes up to and including the blank line
+    size_t contentLength;
+    int keepAlive;
+} HttpRequest;
+
+ServerOptions defaultServerOptions(void) {
+    ServerOptions options;
+    options.host = SERVER_DEFAULT_HOST;
+    options.port = SERVER_DEFAULT_PORT;
+    options.socketPath = NULL;
+    options.threadCount = 0;
+    options.legCacheEntries = 0;
+    return options;
+}
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Entity";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        default: return "Unknown";
+    }
+}
+
+static int matches(const char* text, size_t length, const char* literal) {
+    return length == strlen(literal) && memcmp(text, literal, length) == 0;
+}
+
+// Parse the header block in data; returns 1 when complete, 0 if more data is
+// needed, otherwise the HTTP status to fail with
+static int parseHttpRequest(const char* data, size_t length, HttpRequest* request) {
+    const char* end = NULL;
+    for (size_t i = 3; i < length; i++) {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            end = data + i + 1;
+            break;
+        }
+    }
+    if (!end) {
+        return length > SERVER_MAX_HEADER ? 431 : 0;
+    }
+
+    memset(request, 0, sizeof(*request));
+    request->headerLength = end - data;
+
+    // Request line: METHOD SP PATH SP VERSION CRLF
+    const char* lineEnd = memchr(data, '\r', end - data);
+    const char* space = memchr(data, ' ', lineEnd - data);
+    const char* pathEnd = space ? memchr(space + 1, ' ', lineEnd - space - 1) : NULL;
+    if (!space || !pathEnd) return 400;
+
+    request->method = data;
+    request->methodLength = space - data;
+    request->path = space + 1;
+    request->pathLength = pathEnd - space - 1;
+    request->keepAlive = matches(pathEnd + 1, lineEnd - pathEnd - 1, "HTTP/1.1");
+
+    // Drop any query string
+    const char* query = memchr(request->path, '?', request->pathLength);
+    if (query) request->pathLength = query - request->path;
+
+    for (const char* line = lineEnd + 2; line < end - 2;) {
+        const char* next = memchr(line, '\r', end - line);
+        const char* colon = memchr(line, ':', next - line);
+        if (colon) {
+            const char* value = colon + 1;
+            while (value < next && (*value == ' ' || *value == '\t')) value++;
+            size_t nameLength = colon - line;
+            size_t valueLength = next - value;
+
+            if (nameLength == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                char* numberEnd;
+                unsigned long long contentLength = strtoull(value, &numberEnd, 10);
+                if (numberEnd == value) return 400;
+                if (contentLength > SERVER_MAX_BODY) return 413;
+                request->contentLength = (size_t)contentLength;
+            } else if (nameLength == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                if (valueLength >= 5 && strncasecmp(value, "close", 5) == 0) request->keepAlive = 0;
+                if (valueLength >= 10 && strncasecmp(value, "keep-alive", 10) == 0) request->keepAlive = 1;
+            } else if (nameLength == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                return 400; // Chunked bodies aren't supported; clients send Content-Length
+            }
+        }
+        line = next + 2;
+    }
+
+    return 1;
+}
+
+// Write all of header and body; returns 0 on success
+static int sendResponse(int client, const char* header, size_t headerLength, const char* body, size_t bodyLength) {
+    STATS_ADD(STATS_COUNTER_BYTES_WRITTEN, headerLength + bodyLength);
+    struct iovec parts[2] = {
+        { (void*)header, headerLength },
+        { (void*)body, bodyLength }
+    };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = bodyLength > 0 ? 2 : 1;
+
+    while (message.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(client, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+
+            // The socket is non-blocking: wait for the client to drain it
+            struct pollfd writable = { client, POLLOUT, 0 };
+            if (poll(&writable, 1, SERVER_SEND_TIMEOUT) <= 0) return -1;
+            continue;
+        }
+
+        // Advance past what was sent
+        while (message.msg_iovlen > 0 && (size_t)sent >= message.msg_iov->iov_len) {
+            sent -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = (char*)message.msg_iov->iov_base + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+static int respond(ServerWorker* worker, int client, int status, const char* contentType,
+                   const char* body, size_t bodyLength, int keepAlive) {
+    char header[512];
+    int headerLength;
+
+    if (status >= 400) {
+        atomic_fetch_add_explicit(&worker->server->stats.errors, 1, memory_order_relaxed);
+    }
+
+    if (status == 204) {
+        // CORS preflight from the web UI
+        headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 204 No Content\r\n"
+                                "Access-Control-Allow-Origin: *\r\n"
+                                "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+                                "Access-Control-Allow-Headers: Content-Type\r\n"
+                                "Access-Control-Max-Age: 86400\r\n"
+                                "Connection: %s\r\n\r\n",
+                                keepAlive ? "keep-alive" : "close");
+    } else {
+        headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.1 %d %s\r\n"
+                                "Content-Type: %s\r\n"
+                                "Content-Length: %zu\r\n"
+                                "Access-Control-Allow-Origin: *\r\n"
+                                "Connection: %s\r\n\r\n",
+                                status, statusText(status), contentType, bodyLength,
+                                keepAlive ? "keep-alive" : "close");
+    }
+
+    return sendResponse(client, header, headerLength, body, bodyLength);
+}
+
+// Error responses carry {"error": message}
+static int respondError(ServerWorker* worker, int client, int status, const char* message, int keepAlive) {
+    Writer* body = &worker->body;
+
+    resetWriter(body);
+    writerPutString(body, "{\"error\": \"");
+    for (const char* c = message; *c; c++) {
+        if (*c == '"' || *c == '\\') writerPutChar(body, '\\');
+        writerPutChar(body, *c);
+    }
+    writerPutString(body, "\"}\n");
+
+    return respond(worker, client, status, "application/json", body->buffer, body->length, keepAlive);
+}
+
+static void writeServerStatsJSON(Writer* writer, ServerStats* stats, PyramidCache* viewCache) {
+    writerPutString(writer, "{\"requests\": ");
+    writerPutInt(writer, atomic_load_explicit(&stats->requests, memory_order_relaxed));
+    writerPutString(writer, ", \"errors\": ");
+    writerPutInt(writer, atomic_load_explicit(&stats->errors, memory_order_relaxed));
+    writerPutString(writer, ", \"connections\": ");
+    writerPutInt(writer, atomic_load_explicit(&stats->connections, memory_order_relaxed));
+    writerPutString(writer, ", \"uptimeSeconds\": ");
+    writerPutFixed(writer, monotonicSeconds() - stats->startTime, 3);
+
+    // Latencies in microseconds
+    writerPutString(writer, ", \"latencyMicroseconds\": {\"p50\": ");
+    writerPutFixed(writer, latencyPercentile(&stats->latency, 0.50) / 1000.0, 1);
+    writerPutString(writer, ", \"p90\": ");
+    writerPutFixed(writer, latencyPercentile(&stats->latency, 0.90) / 1000.0, 1);
+    writerPutString(writer, ", \"p99\": ");
+    writerPutFixed(writer, latencyPercentile(&stats->latency, 0.99) / 1000.0, 1);
+    writerPutString(writer, ", \"max\": ");
+    writerPutFixed(writer, atomic_load_explicit(&stats->latency.maxNanoseconds, memory_order_relaxed) / 1000.0, 1);
+    writerPutString(writer, ", \"mean\": ");
+    writerPutFixed(writer, latencyMean(&stats->latency) / 1000.0, 1);
+
+    // Engine phase timers and counters
+    StatsSnapshot snapshot;
+    takeStatsSnapshot(&snapshot);
+    writerPutString(writer, "}, \"engine\": ");
+    writeStatsJSON(writer, &snapshot);
+
+    LegCache* legCache = activeLegCache();
+    if (legCache) {
+        LegCacheStats cacheStats;
+        getLegCacheStats(legCache, &cacheStats);
+        writerPutString(writer, ", \"legCache\": {\"hits\": ");
+        writerPutInt(writer, (long long)cacheStats.hits);
+        writerPutString(writer, ", \"misses\": ");
+        writerPutInt(writer, (long long)cacheStats.misses);
+        writerPutString(writer, ", \"evictions\": ");
+        writerPutInt(writer, (long long)cacheStats.evictions);
+        writerPutString(writer, ", \"entries\": ");
+        writerPutInt(writer, cacheStats.entries);
+        writerPutString(writer, ", \"capacity\": ");
+        writerPutInt(writer, cacheStats.capacity);
+        writerPutString(writer, ", \"hitRate\": ");
+        writerPutFixed(writer, legCacheHitRate(&cacheStats), 4);
+        writerPutChar(writer, '}');
+    }
+    if (viewCache) {
+        unsigned long long hits, misses;
+        getPyramidCacheStats(viewCache, &hits, &misses);
+        writerPutString(writer, ", \"viewCache\": {\"hits\": ");
+        writerPutInt(writer, (long long)hits);
+        writerPutString(writer, ", \"misses\": ");
+        writerPutInt(writer, (long long)misses);
+        writerPutChar(writer, '}');
+    }
+    writerPutString(writer, "}\n");
+}
+
+// Server counters and engine statistics in the Prometheus text format
+static void writeServerMetrics(Writer* writer, ServerStats* stats) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    static const char* const quantileLabels[] = { "0.5", "0.9", "0.99" };
+
+    writerPutString(writer, "# HELP trajectory_server_requests_total Requests answered\n"
+                            "# TYPE trajectory_server_requests_total counter\n"
+                            "trajectory_server_requests_total ");
+    writerPutInt(writer, atomic_load_explicit(&stats->requests, memory_order_relaxed));
+    writerPutString(writer, "\n# HELP trajectory_server_errors_total Responses with a 4xx or 5xx status\n"
+                            "# TYPE trajectory_server_errors_total counter\n"
+                            "trajectory_server_errors_total ");
+    writerPutInt(writer, atomic_load_explicit(&stats->errors, memory_order_relaxed));
+    writerPutString(writer, "\n# HELP trajectory_server_connections_total Connections accepted\n"
+                            "# TYPE trajectory_server_connections_total counter\n"
+                            "trajectory_server_connections_total ");
+    writerPutInt(writer, atomic_load_explicit(&stats->connections, memory_order_relaxed));
+
+    writerPutString(writer, "\n# HELP trajectory_server_request_seconds Time from a complete request to its response\n"
+                            "# TYPE trajectory_server_request_seconds summary\n");
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        writerPutString(writer, "trajectory_server_request_seconds{quantile=\"");
+        writerPutString(writer, quantileLabels[i]);
+        writerPutString(writer, "\"} ");
+        writerPutFixed(writer, latencyPercentile(&stats->latency, quantiles[i]) / 1e9, 9);
+        writerPutChar(writer, '\n');
+    }
+    writerPutString(writer, "trajectory_server_request_seconds_sum ");
+    writerPutFixed(writer, atomic_load_explicit(&stats->latency.sumNanoseconds, memory_order_relaxed) / 1e9, 9);
+    writerPutString(writer, "\ntrajectory_server_request_seconds_count ");
+    writerPutInt(writer, (long long)atomic_load_explicit(&stats->latency.total, memory_order_relaxed));
+    writerPutChar(writer, '\n');
+
+    LegCache* legCache = activeLegCache();
+    if (legCache) {
+        LegCacheStats cacheStats;
+        getLegCacheStats(legCache, &cacheStats);
+        writerPutString(writer, "# HELP trajectory_leg_cache_lookups_total Leg cache lookups by result\n"
+                                "# TYPE trajectory_leg_cache_lookups_total counter\n"
+                                "trajectory_leg_cache_lookups_total{result=\"hit\"} ");
+        writerPutInt(writer, (long long)cacheStats.hits);
+        writerPutString(writer, "\ntrajectory_leg_cache_lookups_total{result=\"miss\"} ");
+        writerPutInt(writer, (long long)cacheStats.misses);
+        writerPutString(writer, "\n# HELP trajectory_leg_cache_evictions_total Leg cache entries evicted\n"
+                                "# TYPE trajectory_leg_cache_evictions_total counter\n"
+                                "trajectory_leg_cache_evictions_total ");
+        writerPutInt(writer, (long long)cacheStats.evictions);
+        writerPutString(writer, "\n# HELP trajectory_leg_cache_entries Leg cache entries in use\n"
+                                "# TYPE trajectory_leg_cache_entries gauge\n"
+                                "trajectory_leg_cache_entries ");
+        writerPutInt(writer, cacheStats.entries);
+        writerPutChar(writer, '\n');
+    }
+
+    StatsSnapshot snapshot;
+    takeStatsSnapshot(&snapshot);
+    writeStatsPrometheus(writer, &snapshot);
+}
+
+// What a scenario request returns
+typedef enum {
+    SCENARIO_TRAJECTORY = 0,    // POST /trajectory: the trajectory document
+    SCENARIO_TELEMETRY,         // POST /telemetry: samples every "step" seconds as CSV
+    SCENARIO_POSITION,          // POST /position: the state at each requested "time"
+    SCENARIO_VIEW               // POST /view: the path at "zoom" within "bounds"
+} ScenarioResponse;
+
+// {"samples": [{"time": .., "latitude": .., ...}, ...]}
+static void writePositionsJSON(Writer* writer, const TelemetryTable* table, const TrajectoryRequest* request) {
+    writerPutString(writer, "{\"samples\": [");
+    for (int i = 0; i < request->timeCount; i++) {
+        TelemetrySample sample = telemetryAt(table, request->times[i]);
+        writerPutString(writer, i > 0 ? ", {\"time\": " : "{\"time\": ");
+        writerPutFixed(writer, sample.time, 6);
+        writerPutString(writer, ", \"latitude\": ");
+        writerPutFixed(writer, sample.position.latitude, 6);
+        writerPutString(writer, ", \"longitude\": ");
+        writerPutFixed(writer, sample.position.longitude, 6);
+        writerPutString(writer, ", \"altitude\": ");
+        writerPutFixed(writer, sample.position.altitude, 6);
+        writerPutString(writer, ", \"speed\": ");
+        writerPutFixed(writer, sample.speed, 6);
+        writerPutString(writer, ", \"eta\": ");
+        writerPutFixed(writer, sample.eta, 6);
+        writerPutString(writer, ", \"distance\": ");
+        writerPutFixed(writer, sample.distance, 6);
+        writerPutChar(writer, '}');
+    }
+    writerPutString(writer, "]}\n");
+}
+
+// Calculate the trajectory described by a POST body and answer with what was asked for
+static int handleScenario(ServerWorker* worker, int client, const char* data, size_t length, int keepAlive,
+                          ScenarioResponse response) {
+    TrajectoryRequest request;
+    char error[128];
+
+    resetArena(&worker->arena);
+    if (parseTrajectoryRequest(data, length, &request, &worker->arena, error, sizeof(error)) != 0) {
+        return respondError(worker, client, 400, error, keepAlive);
+    }
+    if (response == SCENARIO_POSITION && request.timeCount == 0) {
+        return respondError(worker, client, 400, "position lookups need a time", keepAlive);
+    }
+
+    // A map pans and zooms over one route, so views usually hit a cached pyramid
+    PyramidCache* viewCache = worker->server->viewCache;
+    if (response == SCENARIO_VIEW && viewCache) {
+        resetWriter(&worker->body);
+        if (writeCachedViewJSON(&worker->body, viewCache, &request.scenario, &request.output.sampling, request.zoom,
+                                request.hasBounds ? &request.bounds : NULL, &worker->arena) != 0) {
+            worker->body.error = 1;
+        }
+        if (worker->body.error) {
+            return respondError(worker, client, 500, "out of memory", keepAlive);
+        }
+        return respond(worker, client, 200, "application/json", worker->body.buffer, worker->body.length, keepAlive);
+    }
+
+    TrajectoryData trajectory = runScenario(&request.scenario, &worker->arena);
+    const char* contentType = "application/json";
+    const char* problem = NULL;
+    resetWriter(&worker->body);
+
+    if (response == SCENARIO_TRAJECTORY) {
+        writeTrajectoryJSON(&worker->body, &trajectory, &request.output);
+    } else if (response == SCENARIO_VIEW) {
+        if (writeTrajectoryViewJSON(&worker->body, &trajectory, &request.output.sampling, request.zoom,
+                                    request.hasBounds ? &request.bounds : NULL, &worker->arena) != 0) {
+            worker->body.error = 1;
+        }
+    } else {
+        TelemetryTable table;
+        if (buildTelemetryTable(&table, &trajectory, &worker->arena) != 0) {
+            worker->body.error = 1;
+        } else if (response == SCENARIO_POSITION) {
+            writePositionsJSON(&worker->body, &table, &request);
+        } else {
+            // The log is built in the response body, so its size has to be bounded
+            double rows = telemetryRowCount(&table, request.telemetryStep);
+            if (isnan(rows)) {
+                problem = "the flight time is not finite";
+            } else if (rows > TELEMETRY_MAX_ROWS) {
+                problem = "step is too small: the log would exceed 1000000 rows";
+            } else {
+                writeTelemetryCSV(&worker->body, &table, request.telemetryStep, TELEMETRY_MAX_ROWS);
+                contentType = "text/csv";
+            }
+        }
+    }
+    freeTrajectory(&trajectory);
+
+    if (problem) {
+        return respondError(worker, client, 422, problem, keepAlive);
+    }
+    if (worker->body.error) {
+        return respondError(worker, client, 500, "out of memory", keepAlive);
+    }
+    return respond(worker, client, 200, contentType, worker->body.buffer, worker->body.length, keepAlive);
+}
+
+static int handleRequest(ServerWorker* worker, int client, const HttpRequest* http, const char* body) {
+    const char* method = http->method;
+    size_t methodLength = http->methodLength;
+    int keepAlive = http->keepAlive;
+
+    if (matches(method, methodLength, "OPTIONS")) {
+        return respond(worker, client, 204, NULL, NULL, 0, keepAlive);
+    }
+
+    int telemetry = matches(http->path, http->pathLength, "/telemetry");
+    int position = matches(http->path, http->pathLength, "/position");
+    int view = matches(http->path, http->pathLength, "/view");
+    if (telemetry || position || view || matches(http->path, http->pathLength, "/trajectory")) {
+        if (!matches(method, methodLength, "POST")) {
+            return respondError(worker, client, 405, "use POST", keepAlive);
+        }
+        return handleScenario(worker, client, body, http->contentLength, keepAlive,
+                              telemetry ? SCENARIO_TELEMETRY : position ? SCENARIO_POSITION :
+                              view ? SCENARIO_VIEW : SCENARIO_TRAJECTORY);
+    }
+
+    int stats = matches(http->path, http->pathLength, "/stats");
+    int metrics = matches(http->path, http->pathLength, "/metrics");
+    if (stats || metrics || matches(http->path, http->pathLength, "/health")) {
+        if (!matches(method, methodLength, "GET")) {
+            return respondError(worker, client, 405, "use GET", keepAlive);
+        }
+        resetWriter(&worker->body);
+        if (stats) {
+            writeServerStatsJSON(&worker->body, &worker->server->stats, worker->server->viewCache);
+        } else if (metrics) {
+            writeServerMetrics(&worker->body, &worker->server->stats);
+            return respond(worker, client, 200, "text/plain; version=0.0.4", worker->body.buffer,
+                           worker->body.length, keepAlive);
+        } else {
+            writerPutString(&worker->body, "{\"status\": \"ok\"}\n");
+        }
+        return respond(worker, client, 200, "application/json", worker->body.buffer, worker->body.length, keepAlive);
+    }
+
+    return respondError(worker, client, 404, "no such endpoint", keepAlive);
+}
+
+static void closeConnection(ServerWorker* worker, Connection* connection) {
+    if (connection->previous) {
+        connection->previous->next = connection->next;
+    } else {
+        worker->connections = connection->next;
+    }
+    if (connection->next) connection->next->previous = connection->previous;
+
+    close(connection->fd); // Also removes it from the epoll set
+    free(connection->receive);
+    free(connection);
+}
+
+static void acceptConnections(ServerWorker* worker) {
+    Server* server = worker->server;
+    int one = 1;
+
+    for (;;) {
+        int client = accept(server->listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return; // EAGAIN once the backlog is empty
+        }
+        fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+
+        Connection* connection = (Connection*)calloc(1, sizeof(Connection));
+        char* receive = (char*)malloc(SERVER_RECEIVE_BUFFER);
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = connection;
+        if (!connection || !receive || epoll_ctl(worker->poller, EPOLL_CTL_ADD, client, &event) != 0) {
+            free(connection);
+            free(receive);
+            close(client);
+            continue;
+        }
+
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Fails harmlessly on Unix sockets
+        connection->fd = client;
+        connection->receive = receive;
+        connection->capacity = SERVER_RECEIVE_BUFFER;
+        connection->lastActive = monotonicSeconds();
+        connection->next = worker->connections;
+        if (worker->connections) worker->connections->previous = connection;
+        worker->connections = connection;
+        atomic_fetch_add_explicit(&server->stats.connections, 1, memory_order_relaxed);
+    }
+}
+
+// Read what the client sent and answer every complete request in it,
+// pipelined ones included. Reads once per readiness event, so a client that
+// keeps sending can't starve the worker's other connections.
+// Returns 0 to keep the connection, -1 to close it
+static int serveConnection(ServerWorker* worker, Connection* connection) {
+    Server* server = worker->server;
+    int open = 1;
+    int received = 0;
+
+    connection->lastActive = monotonicSeconds();
+    for (;;) {
+        HttpRequest http;
+        int parsed = parseHttpRequest(connection->receive, connection->length, &http);
+
+        if (parsed > 1) {
+            respondError(worker, connection->fd, parsed, statusText(parsed), 0);
+            return -1;
+        }
+
+        // Make room for the whole body once the headers are in
+        size_t needed = parsed == 1 ? http.headerLength + http.contentLength : connection->length + 1;
+        if (needed > connection->capacity) {
+            size_t capacity = connection->capacity;
+            while (capacity < needed) capacity *= 2;
+            char* grown = (char*)realloc(connection->receive, capacity);
+            if (!grown) {
+                respondError(worker, connection->fd, 500, "out of memory", 0);
+                return -1;
+            }
+            connection->receive = grown;
+            connection->capacity = capacity;
+        }
+
+        if (parsed == 1 && connection->length >= needed) {
+            double startTime = monotonicSeconds();
+            int status = handleRequest(worker, connection->fd, &http, connection->receive + http.headerLength);
+            recordLatency(&server->stats.latency, (uint64_t)((monotonicSeconds() - startTime) * 1e9));
+            atomic_fetch_add_explicit(&server->stats.requests, 1, memory_order_relaxed);
+
+            if (status != 0 || !http.keepAlive) return -1;
+
+            // Keep any pipelined bytes that follow
+            connection->length -= needed;
+            memmove(connection->receive, connection->receive + needed, connection->length);
+            continue;
+        }
+
+        if (!open) return -1; // Closed by the client mid-request
+        if (received) return 0; // epoll reports anything still unread
+
+        ssize_t count = recv(connection->fd, connection->receive + connection->length,
+                             connection->capacity - connection->length, 0);
+        if (count > 0) {
+            connection->length += count;
+            received = 1;
+        } else if (count == 0) {
+            // Answer what is already buffered before closing
+            if (connection->length == 0) return -1;
+            open = 0;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0; // Wait for the rest
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static void* serverWorkerMain(void* argument) {
+    ServerWorker* worker = (ServerWorker*)argument;
+    Server* server = worker->server;
+    struct epoll_event events[SERVER_EVENTS];
+    double lastSweep = monotonicSeconds();
+
+    while (!atomic_load(&server->stopping)) {
+        // The timeout bounds how long shutdown and idle sweeps wait
+        int count = epoll_wait(worker->poller, events, SERVER_EVENTS, 1000);
+
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL) {
+                acceptConnections(worker);
+            } else {
+                Connection* connection = (Connection*)events[i].data.ptr;
+                if (serveConnection(worker, connection) != 0) closeConnection(worker, connection);
+            }
+        }
+
+        double now = monotonicSeconds();
+        if (now - lastSweep >= 1.0) {
+            for (Connection* connection = worker->connections; connection;) {
+                Connection* next = connection->next;
+                if (now - connection->lastActive >= SERVER_IDLE_SECONDS) closeConnection(worker, connection);
+                connection = next;
+            }
+            lastSweep = now;
+        }
+    }
+
+    while (worker->connections) {
+        closeConnection(worker, worker->connections);
+    }
+    return NULL;
+}
+
+static int listenTCP(const char* host, int port) {
+    struct addrinfo hints;
+    struct addrinfo* addresses;
+    char service[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    snprintf(service, sizeof(service), "%d", port);
+
+    int status = getaddrinfo(host, service, &hints, &addresses);
+    if (status != 0) {
+        fprintf(stderr, "Error resolving %s: %s\n", host, gai_strerror(status));
+        return -1;
+    }
+
+    int listener = -1;
+    for (struct addrinfo* address = addresses; address && listener < 0; address = address->ai_next) {
+        listener = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (listener < 0) continue;
+
+        int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(listener, address->ai_addr, address->ai_addrlen) != 0) {
+            close(listener);
+            listener = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+
+    if (listener < 0) {
+        fprintf(stderr, "Error binding %s:%d: %s\n", host, port, strerror(errno));
+    }
+    return listener;
+}
+
+static int listenUnix(const char* path) {
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path); // Remove a socket left behind by an earlier run
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error binding %s: %s\n", path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// Serve trajectory requests until SIGINT or SIGTERM. Returns 0 after a clean shutdown
+int runServer(const ServerOptions* options) {
+    Server server;
+    int threadCount = options->threadCount > 0 ? options->threadCount : availableProcessors();
+
+    memset(&server, 0, sizeof(server));
+    initLatencyHistogram(&server.stats.latency);
+    server.stats.startTime = monotonicSeconds();
+
+    server.listener = options->socketPath ? listenUnix(options->socketPath) : listenTCP(options->host, options->port);
+    if (server.listener < 0) return 1;
+    if (listen(server.listener, SOMAXCONN) != 0 ||
+        fcntl(server.listener, F_SETFL, fcntl(server.listener, F_GETFL) | O_NONBLOCK) != 0) {
+        fprintf(stderr, "Error listening: %s\n", strerror(errno));
+        close(server.listener);
+        return 1;
+    }
+
+    // Requests for the same route with different missiles share leg geometry
+    LegCache* legCache = createLegCache(options->legCacheEntries);
+    setActiveLegCache(legCache);
+    server.viewCache = createPyramidCache(PYRAMID_CACHE_DEFAULT_ENTRIES);
+
+    // Workers inherit this mask, so the signals are only seen by sigwait below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    ServerWorker* workers = (ServerWorker*)calloc(threadCount, sizeof(ServerWorker));
+    if (!workers) {
+        fprintf(stderr, "Error allocating server workers\n");
+        close(server.listener);
+        destroyLegCache(legCache);
+        destroyPyramidCache(server.viewCache);
+        return 1;
+    }
+
+    int started = 0;
+    for (; started < threadCount; started++) {
+        ServerWorker* worker = &workers[started];
+        worker->server = &server;
+        initArena(&worker->arena, ARENA_DEFAULT_BLOCK_SIZE);
+
+        // Every worker watches the listener; EPOLLEXCLUSIVE wakes only one per connection
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+        worker->poller = epoll_create1(EPOLL_CLOEXEC);
+
+        if (worker->poller < 0 || epoll_ctl(worker->poller, EPOLL_CTL_ADD, server.listener, &event) != 0 ||
+            openMemoryWriter(&worker->body, SERVER_RESPONSE_BUFFER) != 0 ||
+            pthread_create(&worker->thread, NULL, serverWorkerMain, worker) != 0) {
+            fprintf(stderr, "Error starting server worker %d\n", started);
+            if (worker->poller >= 0) close(worker->poller);
+            closeWriter(&worker->body);
+            freeArena(&worker->arena);
+            break;
+        }
+    }
+
+    if (started > 0) {
+        if (options->socketPath) {
+            fprintf(stderr, "Serving on %s with %d threads\n", options->socketPath, started);
+        } else {
+            fprintf(stderr, "Serving on http://%s:%d with %d threads\n", options->host, options->port, started);
+        }
+
+        int signal;
+        sigwait(&signals, &signal);
+    }
+
+    // Workers notice within one epoll timeout and close their connections
+    atomic_store(&server.stopping, 1);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].poller);
+        closeWriter(&workers[i].body);
+        freeArena(&workers[i].arena);
+    }
+    free(workers);
+    close(server.listener);
+    if (options->socketPath) unlink(options->socketPath);
+    destroyLegCache(legCache);
+    destroyPyramidCache(server.viewCache);
+
+    fprintf(stderr, "Served %ld requests (%ld errors) on %ld connections, p50 %.1f us, p99 %.1f us\n",
+            (long)server.stats.requests, (long)server.stats.errors, (long)server.stats.connections,
+            latencyPercentile(&server.stats.latency, 0.50) / 1000.0,
+            latencyPercentile(&server.stats.latency, 0.99) / 1000.0);
+    return started > 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Default TCP endpoint of the trajectory server
+#define SERVER_DEFAULT_HOST "127.0.0.1"
+#define SERVER_DEFAULT_PORT 8080
+
+// Largest request header block and body the server accepts
+#define SERVER_MAX_HEADER (16 * 1024)
+#define SERVER_MAX_BODY (64 * 1024 * 1024)
+
+// Seconds a keep-alive connection may sit idle before it is closed
+#define SERVER_IDLE_SECONDS 30
+
+// Structure to hold server settings
+typedef struct {
+    const char* host;           // Address to listen on
+    int port;                   // TCP port
+    const char* socketPath;     // Listen on this Unix socket instead of TCP when set
+    int threadCount;            // Worker threads, 0 selects one per processor
+    long legCacheEntries;       // Size of the shared leg cache, 0 to compute every leg
+} ServerOptions;
+
+// Function declarations
+ServerOptions defaultServerOptions(void);
+int runServer(const ServerOptions* options);
+
+#endif /* SERVER_H */
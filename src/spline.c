@@ -0,0 +1,194 @@
+#include "spline.h"
+#include "geodesic.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Legs per batched distance call in splinePathDistance
+#define SPLINE_DISTANCE_CHUNK 256
+
+// One smoothed leg along one axis: value(t) = 0.5 * (c0 + c1 t + c2 t^2 + c3 t^3)
+typedef struct {
+    double c0, c1, c2, c3;
+} SplineCubic;
+
+// Parameter values of one leg and their powers, shared by every leg
+typedef struct {
+    int count;
+    double t[SPLINE_MAX_SEGMENTS + 2];
+    double t2[SPLINE_MAX_SEGMENTS + 2];
+    double t3[SPLINE_MAX_SEGMENTS + 2];
+} SplineBasis;
+
+static void* pathAlloc(Arena* arena, size_t size) {
+    return arena ? arenaAlloc(arena, size) : malloc(size);
+}
+
+// Same loop as the frontend: t += 1/n accumulates rounding, so the last
+// sample lands just below 1 or the loop stops short of it
+static void buildSplineBasis(SplineBasis* basis, int segments) {
+    int count = 0;
+    for (double t = 0.0; t <= 1.0 && count < SPLINE_MAX_SEGMENTS + 2; t += 1.0 / segments) {
+        basis->t[count] = t;
+        basis->t2[count] = t * t;
+        basis->t3[count] = basis->t2[count] * t;
+        count++;
+    }
+    basis->count = count;
+}
+
+// Coefficients of the leg from p1 to p2, written as the frontend's expression
+static SplineCubic splineCubic(double p0, double p1, double p2, double p3) {
+    SplineCubic cubic;
+    cubic.c0 = 2 * p1;
+    cubic.c1 = -p0 + p2;
+    cubic.c2 = 2 * p0 - 5 * p1 + 4 * p2 - p3;
+    cubic.c3 = -p0 + 3 * p1 - 3 * p2 + p3;
+    return cubic;
+}
+
+// Evaluate one leg along one axis for every sample. Each output depends only
+// on its own t, so the loop vectorises; sums stay in source order (the
+// Makefile builds this file without fused multiply-adds)
+static void evaluateCubic(SplineCubic cubic, const SplineBasis* basis, double* out) {
+    for (int k = 0; k < basis->count; k++) {
+        out[k] = 0.5 * (cubic.c0 + cubic.c1 * basis->t[k] + cubic.c2 * basis->t2[k] + cubic.c3 * basis->t3[k]);
+    }
+}
+
+static void copyControl(const Coordinates* control, double* latitude, double* longitude, double* altitude) {
+    *latitude = control->latitude;
+    *longitude = control->longitude;
+    *altitude = control->altitude;
+}
+
+// Steps per leg outside 1..SPLINE_MAX_SEGMENTS fall back to the frontend's 20
+static int splineSegments(int segments) {
+    return segments > 0 && segments <= SPLINE_MAX_SEGMENTS ? segments : SPLINE_DEFAULT_SEGMENTS;
+}
+
+// Samples per smoothed leg for segments steps
+int splineSampleCount(int segments) {
+    SplineBasis basis;
+    segments = splineSegments(segments);
+    buildSplineBasis(&basis, segments);
+    return basis.count;
+}
+
+// Number of points evaluateSpline produces for controlCount control points
+int splinePointCount(int controlCount, int segments) {
+    if (controlCount < 3) {
+        return controlCount > 0 ? controlCount : 0;
+    }
+    return 4 + (controlCount - 3) * splineSampleCount(segments);
+}
+
+// Smooth the polyline through controls into the latitude, longitude and
+// altitude arrays, each splinePointCount(controlCount, segments) long.
+// Fewer than three controls are copied unchanged. Returns the number of points
+int evaluateSpline(const Coordinates* controls, int controlCount, int segments,
+                   double* latitude, double* longitude, double* altitude) {
+    int count = 0;
+
+    if (controlCount < 3) {
+        for (; count < controlCount; count++) {
+            copyControl(&controls[count], &latitude[count], &longitude[count], &altitude[count]);
+        }
+        return count;
+    }
+
+    SplineBasis basis;
+    buildSplineBasis(&basis, splineSegments(segments));
+
+    STATS_BEGIN(STATS_PHASE_SAMPLING);
+
+    // First leg: straight
+    copyControl(&controls[0], &latitude[count], &longitude[count], &altitude[count]);
+    count++;
+    copyControl(&controls[1], &latitude[count], &longitude[count], &altitude[count]);
+    count++;
+
+    for (int i = 1; i < controlCount - 2; i++) {
+        const Coordinates* p = &controls[i - 1];
+        evaluateCubic(splineCubic(p[0].latitude, p[1].latitude, p[2].latitude, p[3].latitude),
+                      &basis, latitude + count);
+        evaluateCubic(splineCubic(p[0].longitude, p[1].longitude, p[2].longitude, p[3].longitude),
+                      &basis, longitude + count);
+        evaluateCubic(splineCubic(p[0].altitude, p[1].altitude, p[2].altitude, p[3].altitude),
+                      &basis, altitude + count);
+        count += basis.count;
+    }
+
+    // Last leg: straight
+    copyControl(&controls[controlCount - 2], &latitude[count], &longitude[count], &altitude[count]);
+    count++;
+    copyControl(&controls[controlCount - 1], &latitude[count], &longitude[count], &altitude[count]);
+    count++;
+
+    STATS_END();
+    return count;
+}
+
+// Smooth the route of trajectory (start, waypoints, end) into path; memory
+// comes from arena (heap if NULL, release with freeSplinePath).
+// Returns 0, or -1 if out of memory
+int buildTrajectorySpline(const TrajectoryData* trajectory, int segments, SplinePath* path, Arena* arena) {
+    int controlCount = trajectory->waypointCount + 2;
+    int count = splinePointCount(controlCount, segments);
+
+    memset(path, 0, sizeof(*path));
+    path->arena = arena;
+
+    Coordinates* controls = (Coordinates*)pathAlloc(arena, controlCount * sizeof(Coordinates));
+    double* values = (double*)pathAlloc(arena, 3 * (size_t)count * sizeof(double));
+    if (!controls || !values) {
+        if (!arena) {
+            free(controls);
+            free(values);
+        }
+        return -1;
+    }
+
+    controls[0] = trajectory->start;
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        controls[i + 1] = trajectory->waypoints[i].position;
+    }
+    controls[controlCount - 1] = trajectory->end;
+
+    path->latitude = values;
+    path->longitude = values + count;
+    path->altitude = values + 2 * (size_t)count;
+    path->count = evaluateSpline(controls, controlCount, segments, path->latitude, path->longitude, path->altitude);
+
+    if (!arena) free(controls);
+    return 0;
+}
+
+void freeSplinePath(SplinePath* path) {
+    if (!path->arena) {
+        free(path->latitude);
+    }
+    path->latitude = NULL;
+    path->longitude = NULL;
+    path->altitude = NULL;
+    path->count = 0;
+}
+
+// Length of the smoothed path in kilometers: the sum of the great-circle
+// distances between consecutive points, as the frontend measures it
+double splinePathDistance(const SplinePath* path) {
+    double distances[SPLINE_DISTANCE_CHUNK];
+    double total = 0.0;
+
+    for (int first = 0; first + 1 < path->count; first += SPLINE_DISTANCE_CHUNK) {
+        int legs = path->count - 1 - first;
+        if (legs > SPLINE_DISTANCE_CHUNK) legs = SPLINE_DISTANCE_CHUNK;
+
+        calculateDistances(path->latitude + first, path->longitude + first,
+                           path->latitude + first + 1, path->longitude + first + 1, distances, legs);
+        for (int i = 0; i < legs; i++) {
+            total += distances[i];
+        }
+    }
+    return total;
+}
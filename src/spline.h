@@ -0,0 +1,38 @@
+#ifndef SPLINE_H
+#define SPLINE_H
+
+#include "trajectory.h"
+#include "arena.h"
+
+// Catmull-Rom smoothing of the route through start, waypoints and end: the
+// path the web frontend draws (catmullRomSpline in web/script.js). The first
+// and last legs stay straight; each leg in between is sampled at t = 0, 1/n,
+// 2/n, ... with t accumulated the way the frontend's loop does, and evaluated
+// in the same order, so the points equal the browser's bit for bit.
+// Latitude, longitude and altitude are interpolated as plain numbers.
+
+// Samples per smoothed leg in the frontend
+#define SPLINE_DEFAULT_SEGMENTS 20
+
+// Largest accepted number of samples per leg
+#define SPLINE_MAX_SEGMENTS 1000
+
+// Smoothed path as separate latitude/longitude/altitude arrays
+typedef struct {
+    int count;
+    double* latitude;
+    double* longitude;
+    double* altitude;
+    Arena* arena;               // Arena backing the arrays, NULL for the heap
+} SplinePath;
+
+// Function declarations
+int splineSampleCount(int segments);
+int splinePointCount(int controlCount, int segments);
+int evaluateSpline(const Coordinates* controls, int controlCount, int segments,
+                   double* latitude, double* longitude, double* altitude);
+int buildTrajectorySpline(const TrajectoryData* trajectory, int segments, SplinePath* path, Arena* arena);
+void freeSplinePath(SplinePath* path);
+double splinePathDistance(const SplinePath* path);
+
+#endif /* SPLINE_H */
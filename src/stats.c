@@ -0,0 +1,301 @@
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_HAVE_TSC 1
+#endif
+
+// Names used in reports: JSON key, Prometheus metric and help text
+static const char* const phaseNames[STATS_PHASE_COUNT] = { "parse", "physics", "sampling", "output" };
+
+static const struct {
+    const char* json;
+    const char* metric;
+    const char* help;
+} counterNames[STATS_COUNTER_COUNT] = {
+    { "legs", "trajectory_legs_total", "Legs whose physics were computed" },
+    { "pathPoints", "trajectory_path_points_total", "Path points generated" },
+    { "bytesWritten", "trajectory_bytes_written_total", "Bytes written to files and sockets" },
+    { "allocations", "trajectory_allocations_total", "Heap allocations made by the engine" },
+    { "allocatedBytes", "trajectory_allocated_bytes_total", "Bytes requested by engine heap allocations" },
+};
+
+// One thread's statistics. Only the owning thread writes the values, so plain
+// relaxed loads and stores suffice; readers may see a value one update stale
+typedef struct StatsBlock {
+    _Atomic uint64_t calls[STATS_PHASE_COUNT];
+    _Atomic uint64_t ticks[STATS_PHASE_COUNT];
+    _Atomic uint64_t counters[STATS_COUNTER_COUNT];
+    int phase;                  // Phase being timed, -1 if none
+    uint64_t phaseStart;
+    struct StatsBlock* next;
+} StatsBlock;
+
+static pthread_once_t statsOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t statsKey;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlock* liveBlocks;          // Blocks of running threads
+static StatsBlock retiredBlock;         // Totals of threads that have exited
+static uint64_t startTicks;
+static double startSeconds;
+
+static double statsNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static inline uint64_t statsTicks(void) {
+#ifdef STATS_HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static inline void bump(_Atomic uint64_t* value, uint64_t amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// Thread exit: fold the block into the retired totals
+static void retireBlock(void* data) {
+    StatsBlock* block = (StatsBlock*)data;
+
+    pthread_mutex_lock(&statsLock);
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        bump(&retiredBlock.calls[i], atomic_load_explicit(&block->calls[i], memory_order_relaxed));
+        bump(&retiredBlock.ticks[i], atomic_load_explicit(&block->ticks[i], memory_order_relaxed));
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        bump(&retiredBlock.counters[i], atomic_load_explicit(&block->counters[i], memory_order_relaxed));
+    }
+    for (StatsBlock** link = &liveBlocks; *link; link = &(*link)->next) {
+        if (*link == block) {
+            *link = block->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&statsLock);
+
+    free(block);
+}
+
+static void initStats(void) {
+    pthread_key_create(&statsKey, retireBlock);
+    startTicks = statsTicks();
+    startSeconds = statsNow();
+}
+
+#ifndef TRAJECTORY_NO_STATS
+static _Thread_local StatsBlock* localBlock;
+
+static StatsBlock* threadBlock(void) {
+    if (localBlock) {
+        return localBlock;
+    }
+
+    pthread_once(&statsOnce, initStats);
+    StatsBlock* block = (StatsBlock*)calloc(1, sizeof(StatsBlock));
+    if (!block) {
+        return NULL; // Probes on this thread are dropped
+    }
+    block->phase = -1;
+
+    pthread_mutex_lock(&statsLock);
+    block->next = liveBlocks;
+    liveBlocks = block;
+    pthread_mutex_unlock(&statsLock);
+
+    pthread_setspecific(statsKey, block);
+    localBlock = block;
+    return block;
+}
+
+// Start timing phase, pausing the phase already running on this thread.
+// Returns the paused phase for statsLeave
+int statsEnter(StatsPhase phase) {
+    StatsBlock* block = threadBlock();
+    if (!block) {
+        return -1;
+    }
+
+    int previous = block->phase;
+    bump(&block->calls[phase], 1);
+    if (previous == (int)phase) {
+        return previous; // Nested call of the running phase: keep its timer going
+    }
+
+    uint64_t now = statsTicks();
+    if (previous >= 0) {
+        bump(&block->ticks[previous], now - block->phaseStart);
+    }
+    block->phase = phase;
+    block->phaseStart = now;
+    return previous;
+}
+
+// Stop timing the current phase and resume previousPhase
+void statsLeave(int previousPhase) {
+    StatsBlock* block = localBlock;
+    if (!block || block->phase < 0 || block->phase == previousPhase) {
+        return;
+    }
+
+    uint64_t now = statsTicks();
+    bump(&block->ticks[block->phase], now - block->phaseStart);
+    block->phase = previousPhase;
+    block->phaseStart = now;
+}
+
+void statsAdd(StatsCounter counter, uint64_t amount) {
+    StatsBlock* block = threadBlock();
+    if (block) {
+        bump(&block->counters[counter], amount);
+    }
+}
+#endif
+
+static void addBlock(StatsSnapshot* snapshot, StatsBlock* block) {
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        snapshot->calls[i] += atomic_load_explicit(&block->calls[i], memory_order_relaxed);
+        snapshot->ticks[i] += atomic_load_explicit(&block->ticks[i], memory_order_relaxed);
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        snapshot->counters[i] += atomic_load_explicit(&block->counters[i], memory_order_relaxed);
+    }
+}
+
+// Sum the statistics of every thread. A phase still running is counted up to
+// its last pause, so snapshots taken mid-request lag slightly
+void takeStatsSnapshot(StatsSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    pthread_once(&statsOnce, initStats);
+
+    pthread_mutex_lock(&statsLock);
+    addBlock(snapshot, &retiredBlock);
+    for (StatsBlock* block = liveBlocks; block; block = block->next) {
+        addBlock(snapshot, block);
+    }
+    pthread_mutex_unlock(&statsLock);
+
+    // Calibrate ticks against the monotonic clock over the whole run
+    uint64_t elapsedTicks = statsTicks() - startTicks;
+    snapshot->elapsedSeconds = statsNow() - startSeconds;
+#ifdef STATS_HAVE_TSC
+    double secondsPerTick = elapsedTicks > 0 ? snapshot->elapsedSeconds / (double)elapsedTicks : 0.0;
+#else
+    double secondsPerTick = 1e-9;
+    (void)elapsedTicks;
+#endif
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        snapshot->seconds[i] = snapshot->ticks[i] * secondsPerTick;
+    }
+}
+
+const char* statsPhaseName(StatsPhase phase) {
+    return phase >= 0 && phase < STATS_PHASE_COUNT ? phaseNames[phase] : "unknown";
+}
+
+// {"enabled": true, "elapsedSeconds": .., "phases": {"parse": {"calls": .., "seconds": .., "ticks": ..}, ..},
+//  "counters": {"legs": .., ..}}
+void writeStatsJSON(Writer* writer, const StatsSnapshot* snapshot) {
+    writerPutString(writer, STATS_ENABLED ? "{\"enabled\": true" : "{\"enabled\": false");
+    writerPutString(writer, ", \"elapsedSeconds\": ");
+    writerPutFixed(writer, snapshot->elapsedSeconds, 6);
+
+    writerPutString(writer, ", \"phases\": {");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        writerPutString(writer, i > 0 ? ", \"" : "\"");
+        writerPutString(writer, phaseNames[i]);
+        writerPutString(writer, "\": {\"calls\": ");
+        writerPutInt(writer, (long long)snapshot->calls[i]);
+        writerPutString(writer, ", \"seconds\": ");
+        writerPutFixed(writer, snapshot->seconds[i], 9);
+        writerPutString(writer, ", \"ticks\": ");
+        writerPutInt(writer, (long long)snapshot->ticks[i]);
+        writerPutChar(writer, '}');
+    }
+
+    writerPutString(writer, "}, \"counters\": {");
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        writerPutString(writer, i > 0 ? ", \"" : "\"");
+        writerPutString(writer, counterNames[i].json);
+        writerPutString(writer, "\": ");
+        writerPutInt(writer, (long long)snapshot->counters[i]);
+    }
+    writerPutString(writer, "}}");
+}
+
+// Prometheus text exposition format
+void writeStatsPrometheus(Writer* writer, const StatsSnapshot* snapshot) {
+    writerPutString(writer, "# HELP trajectory_phase_seconds_total Time spent in each phase, excluding nested phases\n"
+                            "# TYPE trajectory_phase_seconds_total counter\n");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        writerPutString(writer, "trajectory_phase_seconds_total{phase=\"");
+        writerPutString(writer, phaseNames[i]);
+        writerPutString(writer, "\"} ");
+        writerPutFixed(writer, snapshot->seconds[i], 9);
+        writerPutChar(writer, '\n');
+    }
+
+    writerPutString(writer, "# HELP trajectory_phase_calls_total Entries into each phase\n"
+                            "# TYPE trajectory_phase_calls_total counter\n");
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        writerPutString(writer, "trajectory_phase_calls_total{phase=\"");
+        writerPutString(writer, phaseNames[i]);
+        writerPutString(writer, "\"} ");
+        writerPutInt(writer, (long long)snapshot->calls[i]);
+        writerPutChar(writer, '\n');
+    }
+
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        writerPutString(writer, "# HELP ");
+        writerPutString(writer, counterNames[i].metric);
+        writerPutChar(writer, ' ');
+        writerPutString(writer, counterNames[i].help);
+        writerPutString(writer, "\n# TYPE ");
+        writerPutString(writer, counterNames[i].metric);
+        writerPutString(writer, " counter\n");
+        writerPutString(writer, counterNames[i].metric);
+        writerPutChar(writer, ' ');
+        writerPutInt(writer, (long long)snapshot->counters[i]);
+        writerPutChar(writer, '\n');
+    }
+}
+
+// Write a snapshot to stream; returns 0 on success
+int reportStats(FILE* stream, StatsFormat format) {
+    StatsSnapshot snapshot;
+    Writer writer;
+
+    takeStatsSnapshot(&snapshot);
+    if (openWriter(&writer, stream, 16 * 1024) != 0) {
+        return -1;
+    }
+    if (format == STATS_FORMAT_PROMETHEUS) {
+        writeStatsPrometheus(&writer, &snapshot);
+    } else {
+        writeStatsJSON(&writer, &snapshot);
+        writerPutChar(&writer, '\n');
+    }
+    return closeWriter(&writer);
+}
+
+// "json" or "prometheus"; returns 0 for an unknown name
+int parseStatsFormat(const char* name, StatsFormat* format) {
+    if (strcmp(name, "json") == 0) {
+        *format = STATS_FORMAT_JSON;
+    } else if (strcmp(name, "prometheus") == 0) {
+        *format = STATS_FORMAT_PROMETHEUS;
+    } else {
+        return 0;
+    }
+    return 1;
+}
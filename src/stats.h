@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "writer.h"
+
+// Hot-path instrumentation: call counts and time per phase plus a few work
+// counters, kept per thread and summed on demand. Phase time is exclusive:
+// a phase entered inside another (path sampling inside JSON output) pauses the
+// outer one, so the phase times add up to the instrumented total.
+// Build with -DTRAJECTORY_NO_STATS to compile every probe out.
+
+typedef enum {
+    STATS_PHASE_PARSE = 0,      // Scenario records, waypoint strings, server requests
+    STATS_PHASE_PHYSICS,        // Leg physics (calculateWaypointEffects and the final leg)
+    STATS_PHASE_SAMPLING,       // Path point generation
+    STATS_PHASE_OUTPUT,         // JSON, columnar and batch result serialisation
+    STATS_PHASE_COUNT
+} StatsPhase;
+
+typedef enum {
+    STATS_COUNTER_LEGS = 0,         // Legs whose physics were computed
+    STATS_COUNTER_PATH_POINTS,      // Path points generated
+    STATS_COUNTER_BYTES_WRITTEN,    // Bytes handed to files and sockets
+    STATS_COUNTER_ALLOCATIONS,      // Heap allocations made by the engine
+    STATS_COUNTER_ALLOCATED_BYTES,
+    STATS_COUNTER_COUNT
+} StatsCounter;
+
+// Totals over every thread since the process started
+typedef struct {
+    uint64_t calls[STATS_PHASE_COUNT];
+    uint64_t ticks[STATS_PHASE_COUNT];         // Timestamp counter ticks (TSC cycles on x86)
+    double seconds[STATS_PHASE_COUNT];
+    uint64_t counters[STATS_COUNTER_COUNT];
+    double elapsedSeconds;                      // Wall time since the first probe
+} StatsSnapshot;
+
+// Output formats of reportStats
+typedef enum {
+    STATS_FORMAT_JSON = 0,
+    STATS_FORMAT_PROMETHEUS
+} StatsFormat;
+
+// Function declarations
+void takeStatsSnapshot(StatsSnapshot* snapshot);
+void writeStatsJSON(Writer* writer, const StatsSnapshot* snapshot);
+void writeStatsPrometheus(Writer* writer, const StatsSnapshot* snapshot);
+int reportStats(FILE* stream, StatsFormat format);
+int parseStatsFormat(const char* name, StatsFormat* format);
+const char* statsPhaseName(StatsPhase phase);
+
+#ifndef TRAJECTORY_NO_STATS
+#define STATS_ENABLED 1
+
+int statsEnter(StatsPhase phase);
+void statsLeave(int previousPhase);
+void statsAdd(StatsCounter counter, uint64_t amount);
+
+// Bracket a phase; at most one pair per block
+#define STATS_BEGIN(phase) int statsPreviousPhase_ = statsEnter(phase)
+#define STATS_END() statsLeave(statsPreviousPhase_)
+#define STATS_ADD(counter, amount) statsAdd((counter), (uint64_t)(amount))
+#else
+#define STATS_ENABLED 0
+#define STATS_BEGIN(phase) ((void)0)
+#define STATS_END() ((void)0)
+#define STATS_ADD(counter, amount) ((void)0)
+#endif
+
+#endif /* STATS_H */
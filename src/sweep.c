@@ -0,0 +1,444 @@
+#include "sweep.h"
+#include "stats.h"
+#include "number.h"
+#include <stdio.h>
+#include <string.h>
+
+// Grid points evaluated together; the per-point state of a block stays in L1/L2
+#define SWEEP_BLOCK 1024
+
+// Decimals of every number in the sweep CSV
+#define SWEEP_DECIMALS 6
+
+// Per-point state of one block of grid points, one array per quantity so
+// the leg loop reads and writes contiguous doubles
+typedef struct {
+    double speed[SWEEP_BLOCK];              // Current speed, the next leg's approach speed
+    double turnRate[SWEEP_BLOCK];           // Effective maxTurnRate in degrees/second
+    double turnRateRadians[SWEEP_BLOCK];
+    double fuelNormal[SWEEP_BLOCK];
+    double fuelTurn[SWEEP_BLOCK];
+    double travelTime[SWEEP_BLOCK];
+    double fuel[SWEEP_BLOCK];
+    double maxGForce[SWEEP_BLOCK];
+    SweepResult results[SWEEP_BLOCK];
+} SweepBlock;
+
+static const char* const axisNames[SWEEP_AXIS_COUNT] = { "drag", "speed", "weight", "turn_rate" };
+
+// Convert degrees to radians
+static double deg2rad(double degrees) {
+    return degrees * M_PI / 180.0;
+}
+
+static void setParseError(ParseError* error, const char* message, const char* start, const char* at) {
+    if (error) {
+        error->message = message;
+        error->offset = (size_t)(at - start);
+    }
+}
+
+const char* sweepAxisName(SweepAxisField field) {
+    return field >= 0 && field < SWEEP_AXIS_COUNT ? axisNames[field] : "unknown";
+}
+
+// Copy count values into axis. Returns 0, or -1 if count is out of range or out of memory
+int setSweepAxis(SweepAxis* axis, const double* values, int count) {
+    axis->count = 0;
+    axis->values = NULL;
+    if (count < 1 || count > SWEEP_MAX_AXIS_VALUES) {
+        return -1;
+    }
+
+    axis->values = (double*)malloc(count * sizeof(double));
+    if (!axis->values) {
+        return -1;
+    }
+    memcpy(axis->values, values, count * sizeof(double));
+    axis->count = count;
+    return 0;
+}
+
+// first:last:step, both ends included. Values are first + i * step, so long
+// ranges don't accumulate rounding
+static int parseAxisRange(const char* text, const char* end, SweepAxis* axis, ParseError* error) {
+    double fields[3];
+    const char* ptr = text;
+
+    for (int i = 0; i < 3; i++) {
+        const char* next = parseDouble(ptr, end, &fields[i]);
+        if (!next) {
+            setParseError(error, "expected a number", text, ptr);
+            return -1;
+        }
+        ptr = next;
+        if (i < 2) {
+            if (ptr == end || *ptr != ':') {
+                setParseError(error, "expected ':' in first:last:step", text, ptr);
+                return -1;
+            }
+            ptr++;
+        }
+    }
+    if (ptr != end) {
+        setParseError(error, "unexpected character after step", text, ptr);
+        return -1;
+    }
+
+    double first = fields[0], last = fields[1], step = fields[2];
+    double steps = (last - first) / step;
+    if (!(step != 0.0) || !(steps >= -1e-9) || !(steps < SWEEP_MAX_AXIS_VALUES)) {
+        setParseError(error, "step must lead from first to last in at most 1000000 values", text, text);
+        return -1;
+    }
+
+    // Tolerate last being a hair short of first + n * step after rounding
+    int count = (int)floor(steps + 1e-9) + 1;
+    axis->values = (double*)malloc(count * sizeof(double));
+    if (!axis->values) {
+        setParseError(error, "out of memory", text, text);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        axis->values[i] = first + i * step;
+    }
+    axis->count = count;
+    return 0;
+}
+
+// v1,v2,... in the order given
+static int parseAxisList(const char* text, const char* end, SweepAxis* axis, ParseError* error) {
+    int capacity = 1;
+    for (const char* ptr = text; (ptr = memchr(ptr, ',', end - ptr)) != NULL; ptr++) {
+        capacity++;
+    }
+    if (capacity > SWEEP_MAX_AXIS_VALUES) {
+        setParseError(error, "too many values", text, text);
+        return -1;
+    }
+
+    axis->values = (double*)malloc(capacity * sizeof(double));
+    if (!axis->values) {
+        setParseError(error, "out of memory", text, text);
+        return -1;
+    }
+
+    const char* ptr = text;
+    for (int i = 0; i < capacity; i++) {
+        const char* next = parseDouble(ptr, end, &axis->values[i]);
+        if (!next) {
+            setParseError(error, "expected a number", text, ptr);
+            freeSweepAxis(axis);
+            return -1;
+        }
+        ptr = next;
+        if (i + 1 < capacity) {
+            if (*ptr != ',') {
+                setParseError(error, "expected ',' between values", text, ptr);
+                freeSweepAxis(axis);
+                return -1;
+            }
+            ptr++;
+        }
+    }
+    if (ptr != end) {
+        setParseError(error, "unexpected character after value", text, ptr);
+        freeSweepAxis(axis);
+        return -1;
+    }
+
+    axis->count = capacity;
+    return 0;
+}
+
+// Parse an axis span of length bytes: a list v1,v2,... or a range
+// first:last:step. Returns 0, or -1 with error set at the first invalid byte
+int parseSweepAxis(const char* text, size_t length, SweepAxis* axis, ParseError* error) {
+    const char* end = text + length;
+
+    axis->count = 0;
+    axis->values = NULL;
+    if (length == 0) {
+        setParseError(error, "expected a value list or first:last:step", text, text);
+        return -1;
+    }
+
+    STATS_BEGIN(STATS_PHASE_PARSE);
+    int status = memchr(text, ':', length) ? parseAxisRange(text, end, axis, error)
+                                           : parseAxisList(text, end, axis, error);
+    STATS_END();
+    return status;
+}
+
+void freeSweepAxis(SweepAxis* axis) {
+    free(axis->values);
+    axis->values = NULL;
+    axis->count = 0;
+}
+
+void freeSweepGrid(SweepGrid* grid) {
+    for (int i = 0; i < SWEEP_AXIS_COUNT; i++) {
+        freeSweepAxis(&grid->axes[i]);
+    }
+}
+
+// Number of grid points, or -1 if an axis is empty or the grid exceeds SWEEP_MAX_POINTS
+long sweepPointCount(const SweepGrid* grid) {
+    long count = 1;
+    for (int i = 0; i < SWEEP_AXIS_COUNT; i++) {
+        int values = grid->axes[i].count;
+        if (values < 1 || count > SWEEP_MAX_POINTS / values) {
+            return -1;
+        }
+        count *= values;
+    }
+    return count;
+}
+
+// Compute the route's geometry once through the engine, so distances come
+// from the same code (and leg cache) as every other calculation.
+// The engine never computes the first waypoint's effects: its leg adds
+// nothing, the second waypoint is reached straight from the start, and with
+// a single waypoint the final leg starts from its zero departure speed.
+// Returns 0, or -1 if out of memory
+int prepareSweepRoute(SweepRoute* route, Coordinates start, Coordinates end,
+                      const Coordinates* waypoints, const double* turnAngles, int waypointCount) {
+    memset(route, 0, sizeof(*route));
+
+    // Geometry doesn't depend on the missile
+    TrajectoryData trajectory = calculateTrajectory(start, end, defaultMissileAttributes(1.0, 1.0));
+    if (waypointCount > 0 && !reserveWaypoints(&trajectory, waypointCount)) {
+        freeTrajectory(&trajectory);
+        return -1;
+    }
+    addWaypoints(&trajectory, waypoints, turnAngles, waypointCount);
+
+    int legCount = waypointCount > 1 ? waypointCount - 1 : 0;
+    double* values = (double*)malloc((3 * (size_t)legCount + 1) * sizeof(double));
+    if (!values) {
+        freeTrajectory(&trajectory);
+        return -1;
+    }
+    route->legMeters = values;
+    route->turnRadians = values + legCount;
+    route->turnDegrees = values + 2 * (size_t)legCount;
+    route->legCount = legCount;
+
+    double distance = 0.0;
+    for (int i = 0; i < legCount; i++) {
+        const Waypoint* waypoint = &trajectory.waypoints[i + 1];
+        distance += waypoint->distanceFromPrevious;
+        route->legMeters[i] = waypoint->distanceFromPrevious * 1000 * 1000.0;
+        route->turnRadians[i] = fabs(deg2rad(waypoint->turnAngle));
+        route->turnDegrees[i] = fabs(waypoint->turnAngle);
+    }
+
+    // Final leg from the last waypoint (or the start), measured as recalculateTrajectory does
+    GeoVector* lastVector = waypointCount > 0 ? &trajectory.waypoints[waypointCount - 1].vector
+                                              : &trajectory.startVector;
+    Coordinates lastPosition = waypointCount > 0 ? trajectory.waypoints[waypointCount - 1].position : start;
+    double finalDistance = geoVectorDistance(updateGeoVector(lastVector, lastPosition),
+                                             updateGeoVector(&trajectory.endVector, end));
+    route->finalMeters = finalDistance * 1000 * 1000.0;
+    route->totalDistance = distance + finalDistance;
+    route->initialBearing = trajectory.initialBearing;
+    route->finalLegFromRest = waypointCount == 1;
+
+    freeTrajectory(&trajectory);
+    return 0;
+}
+
+void freeSweepRoute(SweepRoute* route) {
+    free(route->legMeters);
+    route->legMeters = NULL;
+    route->turnRadians = NULL;
+    route->turnDegrees = NULL;
+    route->legCount = 0;
+}
+
+// Missiles of count grid points, starting at index first of a drag block
+// (speed slowest, turn rate fastest)
+static void loadBlock(SweepBlock* block, const SweepGrid* grid, long first, int count, double drag) {
+    const SweepAxis* speeds = &grid->axes[SWEEP_SPEED];
+    const SweepAxis* weights = &grid->axes[SWEEP_WEIGHT];
+    const SweepAxis* turnRates = &grid->axes[SWEEP_TURN_RATE];
+
+    for (int g = 0; g < count; g++) {
+        long index = first + g;
+        double turnRate = turnRates->values[index % turnRates->count];
+        index /= turnRates->count;
+        double weight = weights->values[index % weights->count];
+        double speed = speeds->values[index / weights->count];
+
+        MissileAttributes missile = defaultMissileAttributes(weight, speed);
+        double effectiveTurnRate = turnRate > 0 ? turnRate : MISSILE_DEFAULT_MAX_TURN_RATE;
+
+        block->speed[g] = speed;
+        block->turnRate[g] = effectiveTurnRate;
+        block->turnRateRadians[g] = deg2rad(effectiveTurnRate);
+        block->fuelNormal[g] = missile.fuelConsumptionNormal;
+        block->fuelTurn[g] = missile.fuelConsumptionTurn;
+        block->travelTime[g] = 0.0;
+        block->fuel[g] = missile.fuel;
+        block->maxGForce[g] = 0.0;
+
+        SweepResult* result = &block->results[g];
+        result->dragCoefficient = drag;
+        result->speed = speed;
+        result->weight = weight;
+        result->maxTurnRate = turnRate;
+    }
+}
+
+// One leg for every point of a block: calculateWaypointEffects term for
+// term. Everything that depends on the leg alone arrives as a scalar, so
+// the body is straight-line arithmetic and vectorises across points
+static void sweepLeg(SweepBlock* block, int count, double meters, double turnDegrees, double turnFactor) {
+    for (int g = 0; g < count; g++) {
+        double approach = block->speed[g];
+        double time = meters / approach;
+        double reduced = approach * turnFactor;
+        double floor = 0.1 * approach;
+        double turnTime = turnDegrees / block->turnRate[g];
+        double radius = approach / block->turnRateRadians[g];
+        radius = radius < 0.1 ? 0.1 : radius;
+        double gForce = (approach * approach) / (radius * GRAVITY);
+
+        block->travelTime[g] += time;
+        block->fuel[g] -= time * block->fuelNormal[g] + turnTime * block->fuelTurn[g];
+        block->maxGForce[g] = gForce > block->maxGForce[g] ? gForce : block->maxGForce[g];
+        block->speed[g] = reduced > floor ? reduced : floor;   // fmax for these operands
+    }
+}
+
+static void finishBlock(SweepBlock* block, int count, const SweepRoute* route) {
+    for (int g = 0; g < count; g++) {
+        double speed = route->finalLegFromRest ? 0.0 : block->speed[g];
+        double time = route->finalMeters / speed;
+        double fuel = block->fuel[g] - time * block->fuelNormal[g];
+
+        SweepResult* result = &block->results[g];
+        result->totalDistance = route->totalDistance;
+        result->totalTravelTime = block->travelTime[g] + time;
+        result->finalSpeed = speed;
+        result->remainingFuel = fuel < 0 ? 0 : fuel;
+        result->maxGForce = block->maxGForce[g];
+    }
+}
+
+// Evaluate every grid point over route, handing results to sink in row order.
+// Returns the number of grid points evaluated, or -1 for an invalid grid or out of memory
+long runSweep(const SweepRoute* route, const SweepGrid* grid, SweepSink sink, void* context) {
+    long total = sweepPointCount(grid);
+    if (total < 0) {
+        return -1;
+    }
+
+    SweepBlock* block = (SweepBlock*)malloc(sizeof(SweepBlock));
+    double* turnFactors = (double*)malloc((route->legCount + 1) * sizeof(double));
+    if (!block || !turnFactors) {
+        free(block);
+        free(turnFactors);
+        return -1;
+    }
+
+    const SweepAxis* drags = &grid->axes[SWEEP_DRAG];
+    long perDrag = total / drags->count;
+    long evaluated = 0;
+    int stopped = 0;
+
+    for (int d = 0; d < drags->count && !stopped; d++) {
+        double drag = drags->values[d];
+        double effectiveDrag = drag > 0 ? drag : 0.1;
+
+        // calculateTurnEffect's cosine only sees the turn and the drag
+        STATS_BEGIN(STATS_PHASE_PHYSICS);
+        for (int i = 0; i < route->legCount; i++) {
+            turnFactors[i] = cos(route->turnRadians[i] * effectiveDrag);
+        }
+        STATS_END();
+
+        for (long first = 0; first < perDrag && !stopped; first += SWEEP_BLOCK) {
+            int count = perDrag - first < SWEEP_BLOCK ? (int)(perDrag - first) : SWEEP_BLOCK;
+
+            STATS_BEGIN(STATS_PHASE_PHYSICS);
+            STATS_ADD(STATS_COUNTER_LEGS, (uint64_t)count * (route->legCount + 1));
+            loadBlock(block, grid, first, count, drag);
+            for (int i = 0; i < route->legCount; i++) {
+                sweepLeg(block, count, route->legMeters[i], route->turnDegrees[i], turnFactors[i]);
+            }
+            finishBlock(block, count, route);
+            STATS_END();
+
+            evaluated += count;
+            if (sink && sink(context, block->results, count) != 0) {
+                stopped = 1;
+            }
+        }
+    }
+
+    free(block);
+    free(turnFactors);
+    return evaluated;
+}
+
+static int writeSweepRows(void* context, const SweepResult* results, int count) {
+    Writer* writer = (Writer*)context;
+
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    for (int i = 0; i < count; i++) {
+        const SweepResult* result = &results[i];
+        const double fields[] = {
+            result->dragCoefficient, result->speed, result->weight, result->maxTurnRate,
+            result->totalDistance, result->totalTravelTime, result->finalSpeed,
+            result->remainingFuel, result->maxGForce
+        };
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            if (f > 0) writerPutChar(writer, ',');
+            writerPutFixed(writer, fields[f], SWEEP_DECIMALS);
+        }
+        writerPutChar(writer, '\n');
+    }
+    STATS_END();
+
+    return writer->error;
+}
+
+// Stream the sweep as CSV, one row per grid point, formatted block by block.
+// Returns the number of rows, or -1 for an invalid grid, out of memory or a write error
+long writeSweepCSV(Writer* writer, const SweepRoute* route, const SweepGrid* grid) {
+    if (sweepPointCount(grid) < 0) {
+        return -1;
+    }
+
+    writerPutString(writer, SWEEP_CSV_HEADER);
+    long rows = runSweep(route, grid, writeSweepRows, writer);
+    return writer->error ? -1 : rows;
+}
+
+// Write the sweep CSV to a file, or to stdout for "-". Returns 0 on success
+int saveSweepCSV(const SweepRoute* route, const SweepGrid* grid, const char* outputFile) {
+    int toStdout = strcmp(outputFile, "-") == 0;
+    FILE* file = toStdout ? stdout : fopen(outputFile, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening sweep file\n");
+        return -1;
+    }
+
+    Writer writer;
+    if (openWriter(&writer, file, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error allocating output buffer\n");
+        if (!toStdout) fclose(file);
+        return -1;
+    }
+
+    long rows = writeSweepCSV(&writer, route, grid);
+    int status = closeWriter(&writer);
+    if (!toStdout && fclose(file) != 0) status = -1;
+
+    if (rows < 0 || status != 0) {
+        fprintf(stderr, "Error writing sweep file\n");
+        return -1;
+    }
+    return 0;
+}
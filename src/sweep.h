@@ -0,0 +1,91 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "trajectory.h"
+#include "scenario.h"
+#include "writer.h"
+
+// Parameter sweep over missile attributes for one fixed route. The route's
+// geometry (leg distances, turn angles, initial bearing) is computed once by
+// the engine; only the attribute-dependent terms of calculateWaypointEffects
+// (travel time, turn loss, fuel, g-force) are evaluated per grid point, as
+// loops over a block of grid points per leg. Each grid point gives exactly
+// the totals runScenario reports for that missile.
+//
+// The grid is the product of four axes. Rows come out with the drag
+// coefficient varying slowest, then speed, then weight, with the turn rate
+// fastest. Missiles are built like defaultMissileAttributes(weight, speed)
+// with the swept drag coefficient and turn rate; non-positive values of
+// those two take the engine's defaults, as calculateTrajectory does.
+
+// Largest number of values on one axis
+#define SWEEP_MAX_AXIS_VALUES 1000000
+
+// Largest number of grid points in one sweep
+#define SWEEP_MAX_POINTS 100000000L
+
+// Column header of the sweep CSV, one row per grid point
+#define SWEEP_CSV_HEADER "drag,speed,weight,turn_rate,distance,travel_time,final_speed,remaining_fuel,max_g_force\n"
+
+typedef enum {
+    SWEEP_DRAG = 0,
+    SWEEP_SPEED,
+    SWEEP_WEIGHT,
+    SWEEP_TURN_RATE,
+    SWEEP_AXIS_COUNT
+} SweepAxisField;
+
+// Values of one swept attribute (heap, release with freeSweepAxis)
+typedef struct {
+    int count;
+    double* values;
+} SweepAxis;
+
+// Axes in SweepAxisField order, slowest varying first
+typedef struct {
+    SweepAxis axes[SWEEP_AXIS_COUNT];
+} SweepGrid;
+
+// Route geometry shared by every grid point
+typedef struct {
+    int legCount;               // Legs with arrival effects (waypoints after the first)
+    double* legMeters;          // distanceFromPrevious * 1000 * 1000.0, the travel time numerator
+    double* turnRadians;        // |turn angle| at the arrival waypoint in radians
+    double* turnDegrees;        // |turn angle| in degrees
+    double finalMeters;         // Final leg, scaled like legMeters
+    double totalDistance;       // km, summed in the engine's order
+    double initialBearing;      // degrees
+    int finalLegFromRest;       // Final leg starts at zero speed (see prepareSweepRoute)
+} SweepRoute;
+
+// Totals for one grid point
+typedef struct {
+    double dragCoefficient;
+    double speed;
+    double weight;
+    double maxTurnRate;
+    double totalDistance;       // km
+    double totalTravelTime;     // seconds, on the engine's scale
+    double finalSpeed;          // m/s
+    double remainingFuel;       // kg
+    double maxGForce;           // Largest g-force over the waypoint turns, 0 without any
+} SweepResult;
+
+// Receives results in row order, count at a time; return non-zero to stop the sweep
+typedef int (*SweepSink)(void* context, const SweepResult* results, int count);
+
+// Function declarations
+int parseSweepAxis(const char* text, size_t length, SweepAxis* axis, ParseError* error);
+int setSweepAxis(SweepAxis* axis, const double* values, int count);
+void freeSweepAxis(SweepAxis* axis);
+void freeSweepGrid(SweepGrid* grid);
+const char* sweepAxisName(SweepAxisField field);
+long sweepPointCount(const SweepGrid* grid);
+int prepareSweepRoute(SweepRoute* route, Coordinates start, Coordinates end,
+                      const Coordinates* waypoints, const double* turnAngles, int waypointCount);
+void freeSweepRoute(SweepRoute* route);
+long runSweep(const SweepRoute* route, const SweepGrid* grid, SweepSink sink, void* context);
+long writeSweepCSV(Writer* writer, const SweepRoute* route, const SweepGrid* grid);
+int saveSweepCSV(const SweepRoute* route, const SweepGrid* grid, const char* outputFile);
+
+#endif /* SWEEP_H */
@@ -0,0 +1,252 @@
+#include "telemetry.h"
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Decimals of each CSV column, matching the web logbook
+#define TELEMETRY_TIME_DECIMALS 2
+#define TELEMETRY_COORDINATE_DECIMALS 6
+#define TELEMETRY_ALTITUDE_DECIMALS 1
+#define TELEMETRY_SPEED_DECIMALS 2
+#define TELEMETRY_ETA_DECIMALS 1
+#define TELEMETRY_DISTANCE_DECIMALS 1
+
+static void* tableAlloc(Arena* arena, size_t size) {
+    return arena ? arenaAlloc(arena, size) : malloc(size);
+}
+
+// Index of the first entry of the ascending array greater than value, clamped to the last entry.
+// Zero-length entries end where their predecessor does, so they are never picked
+static int upperBound(const double* values, int count, double value) {
+    int low = 0;
+    int high = count - 1;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (values[middle] > value) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+// Build the lookup tables of a calculated trajectory; memory comes from arena
+// (heap if NULL, release with freeTelemetryTable). Returns 0, or -1 if out of memory
+int buildTelemetryTable(TelemetryTable* table, TrajectoryData* trajectory, Arena* arena) {
+    if (trajectory->dirtyFrom != TRAJECTORY_CLEAN) {
+        recalculateTrajectory(trajectory);
+    }
+
+    int waypoints = trajectory->waypointCount;
+    memset(table, 0, sizeof(*table));
+    table->arena = arena;
+    table->legCount = waypoints + 1;
+    table->segmentCount = waypoints + 1;
+    table->legEndTime = (double*)tableAlloc(arena, table->legCount * sizeof(double));
+    table->legEndDistance = (double*)tableAlloc(arena, table->legCount * sizeof(double));
+    table->legSpeed = (double*)tableAlloc(arena, table->legCount * sizeof(double));
+    table->segmentEndArc = (double*)tableAlloc(arena, table->segmentCount * sizeof(double));
+    table->segments = (GeoSegment*)tableAlloc(arena, table->segmentCount * sizeof(GeoSegment));
+    if (!table->legEndTime || !table->legEndDistance || !table->legSpeed || !table->segmentEndArc || !table->segments) {
+        freeTelemetryTable(table);
+        return -1;
+    }
+
+    // Physics legs end at each waypoint, then the final leg to the target
+    for (int i = 0; i < waypoints; i++) {
+        const Waypoint* waypoint = &trajectory->waypoints[i];
+        table->legEndDistance[i] = waypoint->cumulativeDistance;
+        table->legSpeed[i] = waypoint->approachSpeed;
+    }
+    table->legEndDistance[waypoints] = trajectory->totalDistance;
+    table->legSpeed[waypoints] = waypoints > 0 ? trajectory->waypoints[waypoints - 1].departureSpeed
+                                               : trajectory->missile.speed;
+
+    // Each leg takes its length over its speed, as the web logbook and
+    // smoothedTravelTime reckon; the trajectory's travel times scale the
+    // distance by 1000 twice and would stretch the log a thousandfold
+    double time = 0.0;
+    for (int i = 0; i < table->legCount; i++) {
+        double legDistance = table->legEndDistance[i] - (i > 0 ? table->legEndDistance[i - 1] : 0.0);
+        if (legDistance > 0.0) time += legDistance * 1000.0 / table->legSpeed[i];
+        table->legEndTime[i] = time;
+    }
+    table->totalTime = time;
+    table->totalDistance = trajectory->totalDistance;
+
+    // Drawn segments: start, each waypoint, end
+    double arc = 0.0;
+    for (int i = 0; i < table->segmentCount; i++) {
+        initTrajectorySegment(trajectory, i, &table->segments[i]);
+        arc += EARTH_RADIUS * table->segments[i].angle;
+        table->segmentEndArc[i] = arc;
+    }
+    table->pathLength = arc;
+
+    return 0;
+}
+
+void freeTelemetryTable(TelemetryTable* table) {
+    if (!table->arena) {
+        free(table->legEndTime);
+        free(table->legEndDistance);
+        free(table->legSpeed);
+        free(table->segmentEndArc);
+        free(table->segments);
+    }
+    table->legEndTime = NULL;
+    table->legEndDistance = NULL;
+    table->legSpeed = NULL;
+    table->segmentEndArc = NULL;
+    table->segments = NULL;
+    table->legCount = 0;
+    table->segmentCount = 0;
+}
+
+// State of the missile at a time since launch (clamped to the flight), in O(log n)
+TelemetrySample telemetryAt(const TelemetryTable* table, double time) {
+    TelemetrySample sample;
+
+    if (!(time > 0.0)) time = 0.0;
+    if (time > table->totalTime) time = table->totalTime;
+    sample.time = time;
+    sample.eta = table->totalTime - time;
+
+    // Time to distance: constant speed within a leg
+    int leg = upperBound(table->legEndTime, table->legCount, time);
+    double legStartTime = leg > 0 ? table->legEndTime[leg - 1] : 0.0;
+    double legStartDistance = leg > 0 ? table->legEndDistance[leg - 1] : 0.0;
+    double legTime = table->legEndTime[leg] - legStartTime;
+    double legFraction = legTime > 0.0 ? (time - legStartTime) / legTime : 1.0;
+    double distance = legStartDistance + legFraction * (table->legEndDistance[leg] - legStartDistance);
+    sample.speed = table->legSpeed[leg];
+    sample.distance = distance * 1000.0;
+
+    // Distance to position: the physics legs and the drawn path measure the
+    // route differently, so distance is mapped by its fraction of the total
+    double arc = table->totalDistance > 0.0 ? distance / table->totalDistance * table->pathLength : 0.0;
+    int segment = upperBound(table->segmentEndArc, table->segmentCount, arc);
+    const GeoSegment* geoSegment = &table->segments[segment];
+    double segmentStart = segment > 0 ? table->segmentEndArc[segment - 1] : 0.0;
+    double segmentLength = table->segmentEndArc[segment] - segmentStart;
+
+    if (segmentLength > 0.0 && geoSegment->sinAngle != 0.0) {
+        double fraction = (arc - segmentStart) / segmentLength;
+        if (fraction > 1.0) fraction = 1.0;
+        if (fraction < 0.0) fraction = 0.0;
+        sample.position = geoSegmentPoint(geoSegment, fraction);
+    } else {
+        // Degenerate segment: both ends coincide
+        sample.position.latitude = geoSegment->start.sourceLatitude;
+        sample.position.longitude = geoSegment->start.sourceLongitude;
+        sample.position.altitude = 0.0;
+    }
+
+    return sample;
+}
+
+void writeTelemetryCSVHeader(Writer* writer) {
+    writerPutString(writer, TELEMETRY_CSV_HEADER);
+}
+
+void writeTelemetryCSVRow(Writer* writer, const TelemetrySample* sample) {
+    writerPutFixed(writer, sample->time, TELEMETRY_TIME_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->position.latitude, TELEMETRY_COORDINATE_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->position.longitude, TELEMETRY_COORDINATE_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->position.altitude, TELEMETRY_ALTITUDE_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->speed, TELEMETRY_SPEED_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->eta, TELEMETRY_ETA_DECIMALS);
+    writerPutChar(writer, ',');
+    writerPutFixed(writer, sample->distance, TELEMETRY_DISTANCE_DECIMALS);
+    writerPutChar(writer, '\n');
+}
+
+// Rows writeTelemetryCSV would write at step, as a double so an absurd step
+// can't overflow; NaN for a non-positive step or an endless flight
+double telemetryRowCount(const TelemetryTable* table, double step) {
+    if (!(step > 0.0) || !isfinite(table->totalTime)) {
+        return NAN;
+    }
+    return ceil(table->totalTime / step) + 1.0;
+}
+
+// Stream one sample every step seconds from launch, plus the arrival, as CSV.
+// Rows are formatted straight into the writer, so the log is never held whole.
+// Returns the number of rows, or -1 for a non-positive step, an endless flight
+// or a log of more than maxRows rows (nothing is written then)
+long writeTelemetryCSV(Writer* writer, const TelemetryTable* table, double step, long maxRows) {
+    double count = telemetryRowCount(table, step);
+    if (isnan(count) || count > (double)maxRows) {
+        return -1;
+    }
+
+    STATS_BEGIN(STATS_PHASE_OUTPUT);
+    writeTelemetryCSVHeader(writer);
+    long rows = 0;
+    for (long last = (long)count - 1; rows < last; rows++) {
+        double time = rows * step;   // Multiplied, not accumulated, so times don't drift
+        if (time >= table->totalTime) break;
+        TelemetrySample sample = telemetryAt(table, time);
+        writeTelemetryCSVRow(writer, &sample);
+    }
+    TelemetrySample arrival = telemetryAt(table, table->totalTime);
+    writeTelemetryCSVRow(writer, &arrival);
+    STATS_END();
+
+    return rows + 1;
+}
+
+// Write the telemetry CSV of a trajectory to a file. Returns 0 on success
+int saveTelemetryCSV(TrajectoryData* trajectory, const char* outputFile, double step, long maxRows) {
+    TelemetryTable table;
+    if (buildTelemetryTable(&table, trajectory, NULL) != 0) {
+        fprintf(stderr, "Error allocating telemetry tables\n");
+        return -1;
+    }
+    double rows = telemetryRowCount(&table, step);
+    if (isnan(rows)) {
+        fprintf(stderr, "Telemetry needs a positive step and a finite flight time\n");
+        freeTelemetryTable(&table);
+        return -1;
+    }
+    if (rows > (double)maxRows) {
+        fprintf(stderr, "Telemetry log would have %.3g rows, more than the limit of %ld: "
+                        "raise --telemetry-step or --telemetry-max-rows\n", rows, maxRows);
+        freeTelemetryTable(&table);
+        return -1;
+    }
+
+    FILE* file = fopen(outputFile, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening telemetry file\n");
+        freeTelemetryTable(&table);
+        return -1;
+    }
+
+    Writer writer;
+    if (openWriter(&writer, file, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error allocating output buffer\n");
+        fclose(file);
+        freeTelemetryTable(&table);
+        return -1;
+    }
+
+    writeTelemetryCSV(&writer, &table, step, maxRows);
+    int status = closeWriter(&writer);
+    if (fclose(file) != 0) status = -1;
+    freeTelemetryTable(&table);
+
+    if (status != 0) {
+        fprintf(stderr, "Error writing telemetry file\n");
+        return -1;
+    }
+    return 0;
+}
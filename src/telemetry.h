@@ -0,0 +1,61 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "trajectory.h"
+#include "writer.h"
+#include "arena.h"
+
+// Time-indexed view of a calculated trajectory. Flight time maps to distance
+// flown through the physics legs (constant speed per leg), and distance maps
+// to a position through the cumulative arc length of the drawn path, so the
+// position at any time is two binary searches away. Each leg takes its length
+// over its speed, like the web logbook, rather than TrajectoryData's travel
+// times, which carry the baseline's extra factor of 1000.
+
+// Default interval between telemetry samples in seconds
+#define TELEMETRY_DEFAULT_STEP 1.0
+
+// Most rows a telemetry log may have unless the caller allows more (the
+// server always applies it, since it builds the log in memory); about 60 MB of CSV
+#define TELEMETRY_MAX_ROWS 1000000
+
+// Largest row limit a caller may ask for: row numbers stay exact in a double
+#define TELEMETRY_ROW_LIMIT 1000000000000L
+
+// Column header of the telemetry CSV (same columns as the web logbook)
+#define TELEMETRY_CSV_HEADER "time,lat,lng,alt,speed,eta,dist\n"
+
+// State of the missile at one moment
+typedef struct {
+    double time;            // Seconds since launch
+    Coordinates position;   // Altitude in meters
+    double speed;           // m/s on the current leg
+    double eta;             // Seconds until arrival
+    double distance;        // Meters flown
+} TelemetrySample;
+
+typedef struct {
+    int legCount;
+    double* legEndTime;         // Flight time at the end of each physics leg (s)
+    double* legEndDistance;     // Distance flown at the end of each leg (km)
+    double* legSpeed;           // Speed on each leg (m/s)
+    int segmentCount;
+    double* segmentEndArc;      // Path length at the end of each drawn segment (km)
+    GeoSegment* segments;
+    double totalTime;           // Seconds of flight
+    double totalDistance;       // Kilometers, as in TrajectoryData
+    double pathLength;          // Kilometers along the drawn path
+    Arena* arena;               // Arena backing the tables, NULL for the heap
+} TelemetryTable;
+
+// Function declarations
+int buildTelemetryTable(TelemetryTable* table, TrajectoryData* trajectory, Arena* arena);
+void freeTelemetryTable(TelemetryTable* table);
+TelemetrySample telemetryAt(const TelemetryTable* table, double time);
+void writeTelemetryCSVHeader(Writer* writer);
+void writeTelemetryCSVRow(Writer* writer, const TelemetrySample* sample);
+double telemetryRowCount(const TelemetryTable* table, double step);
+long writeTelemetryCSV(Writer* writer, const TelemetryTable* table, double step, long maxRows);
+int saveTelemetryCSV(TrajectoryData* trajectory, const char* outputFile, double step, long maxRows);
+
+#endif /* TELEMETRY_H */
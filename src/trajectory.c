@@ -1,5 +1,9 @@
 #include "trajectory.h"
+#include "stats.h"
+#include "legcache.h"
+#include "kernels.h"
 #include <math.h>
+#include <string.h>
 
 // Convert degrees to radians
 static double deg2rad(double degrees) {
@@ -41,7 +45,10 @@ double calculateBearing(Coordinates start, Coordinates end) {
     double x = cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dlon);
     double bearing = atan2(y, x);
     
-    return fmod(rad2deg(bearing) + 360.0, 360.0); // in degrees
+    // atan2 lies in [-180, 180] degrees, so one conditional subtraction
+    // gives the same result as fmod(degrees + 360, 360)
+    double degrees = rad2deg(bearing) + 360.0;
+    return degrees >= 360.0 ? degrees - 360.0 : degrees; // in degrees
 }
 
 // Calculate travel time based on distance and speed
@@ -53,21 +60,116 @@ double calculateTravelTime(double distance, double speed) {
     return distanceInMeters / speed;
 }
 
-// Calculate intermediate point along the great circle path
-Coordinates calculateIntermediatePoint(Coordinates start, Coordinates end, double fraction) {
-    double lat1 = deg2rad(start.latitude);
-    double lon1 = deg2rad(start.longitude);
-    double lat2 = deg2rad(end.latitude);
-    double lon2 = deg2rad(end.longitude);
-    
-    double d = calculateDistance(start, end) / EARTH_RADIUS; // Angular distance
+// Mark a cached vector as stale so its next use recomputes it
+void invalidateGeoVector(GeoVector* vector) {
+    vector->sourceLatitude = NAN;
+    vector->sourceLongitude = NAN;
+}
+
+// Return the cached vector for a position, recomputing it only when the position changed
+const GeoVector* updateGeoVector(GeoVector* vector, Coordinates position) {
+    if (vector->sourceLatitude == position.latitude && vector->sourceLongitude == position.longitude) {
+        return vector;
+    }
+
+    double lat = deg2rad(position.latitude);
+    double lon = deg2rad(position.longitude);
+
+    vector->sinLat = sin(lat);
+    vector->cosLat = cos(lat);
+    vector->sinLon = sin(lon);
+    vector->cosLon = cos(lon);
+
+    vector->x = vector->cosLat * vector->cosLon;
+    vector->y = vector->cosLat * vector->sinLon;
+    vector->z = vector->sinLat;
+
+    vector->sourceLatitude = position.latitude;
+    vector->sourceLongitude = position.longitude;
+
+    return vector;
+}
+
+// Central angle in radians between two unit vectors
+static double geoVectorAngle(const GeoVector* start, const GeoVector* end) {
+    double dx = start->x - end->x;
+    double dy = start->y - end->y;
+    double dz = start->z - end->z;
+
+    // Quarter of the squared chord is the haversine of the central angle
+    double a = (dx * dx + dy * dy + dz * dz) / 4.0;
+    return 2 * atan2(sqrt(a), sqrt(1-a));
+}
+
+// Great-circle distance between cached vectors. Agrees with calculateDistance
+// to the last few ulps (the trig is regrouped), not bit for bit
+double geoVectorDistance(const GeoVector* start, const GeoVector* end) {
+    return EARTH_RADIUS * geoVectorAngle(start, end); // in kilometers
+}
+
+// Initial bearing between cached vectors. Agrees with calculateBearing to the
+// last few ulps (sin and cos of the longitude difference come from the cache)
+double geoVectorBearing(const GeoVector* start, const GeoVector* end) {
+    double sinDlon = 0.0;
+    double cosDlon = 1.0;
+
+    // Points on one meridian keep an exact zero so bearings stay 0 or 180
+    if (start->sourceLongitude != end->sourceLongitude) {
+        sinDlon = end->sinLon * start->cosLon - end->cosLon * start->sinLon;
+        cosDlon = end->cosLon * start->cosLon + end->sinLon * start->sinLon;
+    }
+
+    double y = sinDlon * end->cosLat;
+    double x = start->cosLat * end->sinLat - start->sinLat * end->cosLat * cosDlon;
+    double bearing = atan2(y, x);
+
+    // Normalised as calculateBearing does
+    double degrees = rad2deg(bearing) + 360.0;
+    return degrees >= 360.0 ? degrees - 360.0 : degrees; // in degrees
+}
+
+// Geometry of the leg from one position to another through the shared leg cache,
+// computing and inserting it on a miss. Returns 0 when no cache is active; the
+// cache only holds double geometry, so it is skipped under the float kernels
+static int cachedLegGeometry(GeoVector* fromVector, Coordinates from, GeoVector* toVector, Coordinates to,
+                             LegGeometry* geometry) {
+    LegCache* cache = activeLegCache();
+    if (!cache || activeKernelPrecision() != KERNEL_PRECISION_DOUBLE) {
+        return 0;
+    }
+
+    if (!legCacheLookup(cache, from, to, geometry)) {
+        const GeoVector* start = updateGeoVector(fromVector, from);
+        const GeoVector* end = updateGeoVector(toVector, to);
+        geometry->angle = kernelLegAngle(start, end);
+        geometry->sinAngle = sin(geometry->angle);
+        geometry->bearing = kernelLegBearing(start, end);
+        legCacheInsert(cache, from, to, geometry);
+    }
+    return 1;
+}
+
+// Prepare a segment for repeated sampling from two positions
+void initGeoSegment(GeoSegment* segment, Coordinates start, Coordinates end) {
+    invalidateGeoVector(&segment->start);
+    invalidateGeoVector(&segment->end);
+    updateGeoVector(&segment->start, start);
+    updateGeoVector(&segment->end, end);
+
+    segment->angle = geoVectorAngle(&segment->start, &segment->end);
+    segment->sinAngle = sin(segment->angle);
+}
+
+// Point at a fraction along a prepared segment (spherical linear interpolation)
+Coordinates geoSegmentPoint(const GeoSegment* segment, double fraction) {
+    double d = segment->angle; // Angular distance
     
-    double a = sin((1-fraction) * d) / sin(d);
-    double b = sin(fraction * d) / sin(d);
+    double a = sin((1-fraction) * d) / segment->sinAngle;
+    double b = sin(fraction * d) / segment->sinAngle;
     
-    double x = a * cos(lat1) * cos(lon1) + b * cos(lat2) * cos(lon2);
-    double y = a * cos(lat1) * sin(lon1) + b * cos(lat2) * sin(lon2);
-    double z = a * sin(lat1) + b * sin(lat2);
+    double x = a * segment->start.x + b * segment->end.x;
+    double y = a * segment->start.y + b * segment->end.y;
+    double z = a * segment->start.z + b * segment->end.z;
     
     double lat = atan2(z, sqrt(x*x + y*y));
     double lon = atan2(y, x);
@@ -84,10 +186,106 @@ Coordinates calculateIntermediatePoint(Coordinates start, Coordinates end, doubl
     return result;
 }
 
+// Calculate intermediate point along the great circle path
+Coordinates calculateIntermediatePoint(Coordinates start, Coordinates end, double fraction) {
+    GeoSegment segment;
+    initGeoSegment(&segment, start, end);
+    return geoSegmentPoint(&segment, fraction);
+}
+
+// Reset the calculated values of a waypoint, they will be calculated later
+static void resetWaypointResults(Waypoint* waypoint) {
+    waypoint->approachSpeed = 0.0;
+    waypoint->departureSpeed = 0.0;
+    waypoint->timeToReach = 0.0;
+    waypoint->distanceFromPrevious = 0.0;
+    waypoint->bearingFromPrevious = 0.0;
+    waypoint->fuelConsumed = 0.0;
+    waypoint->gForce = 0.0;
+    waypoint->geometryValid = 0;
+}
+
+// Recalculate now unless a batch of updates is still open
+static void trajectoryChanged(TrajectoryData* trajectory) {
+    if (trajectory->updateDepth == 0) {
+        recalculateTrajectory(trajectory);
+    }
+}
+
+// Mark a waypoint as modified: its own leg and the leg leaving it need new geometry,
+// and every later waypoint needs new speeds, times and fuel
+void markWaypointDirty(TrajectoryData* trajectory, int waypointIndex) {
+    if (waypointIndex < 0 || waypointIndex >= trajectory->waypointCount) {
+        return; // Invalid waypoint index
+    }
+    
+    trajectory->waypoints[waypointIndex].geometryValid = 0;
+    if (waypointIndex + 1 < trajectory->waypointCount) {
+        trajectory->waypoints[waypointIndex + 1].geometryValid = 0;
+    }
+    
+    if (waypointIndex < trajectory->dirtyFrom) {
+        trajectory->dirtyFrom = waypointIndex;
+    }
+}
+
+// Defer recalculation until the matching endTrajectoryUpdate
+void beginTrajectoryUpdate(TrajectoryData* trajectory) {
+    trajectory->updateDepth++;
+}
+
+// Close a batch of updates, recalculating once when the outermost batch ends
+void endTrajectoryUpdate(TrajectoryData* trajectory) {
+    if (trajectory->updateDepth > 0) {
+        trajectory->updateDepth--;
+    }
+    trajectoryChanged(trajectory);
+}
+
+// Make room for at least capacity waypoints; returns 0 if memory ran out
+int reserveWaypoints(TrajectoryData* trajectory, int capacity) {
+    if (capacity <= trajectory->waypointCapacity) {
+        return 1;
+    }
+    
+    Waypoint* waypoints;
+    if (trajectory->arena) {
+        // A moved array stays in the arena until the scenario's arena is reset
+        waypoints = (Waypoint*)arenaResize(trajectory->arena, trajectory->waypoints,
+                                           trajectory->waypointCapacity * sizeof(Waypoint),
+                                           capacity * sizeof(Waypoint));
+    } else {
+        waypoints = (Waypoint*)realloc(trajectory->waypoints, capacity * sizeof(Waypoint));
+        STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+        STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, capacity * sizeof(Waypoint));
+    }
+    
+    if (!waypoints) {
+        return 0;
+    }
+    
+    trajectory->waypoints = waypoints;
+    trajectory->waypointCapacity = capacity;
+    return 1;
+}
+
+// Release a heap-backed waypoint store; arena-backed stores go with their arena
+void freeTrajectory(TrajectoryData* trajectory) {
+    if (!trajectory->arena) {
+        free(trajectory->waypoints);
+    }
+    trajectory->waypoints = NULL;
+    trajectory->waypointCapacity = 0;
+    trajectory->waypointCount = 0;
+}
+
 // Add a waypoint to the trajectory
 void addWaypoint(TrajectoryData* trajectory, Coordinates position, double turnAngle) {
-    if (trajectory->waypointCount >= MAX_WAYPOINTS) {
-        return; // Maximum waypoints reached
+    if (trajectory->waypointCount >= trajectory->waypointCapacity) {
+        int capacity = trajectory->waypointCapacity > 0 ? trajectory->waypointCapacity * 2 : 8;
+        if (!reserveWaypoints(trajectory, capacity)) {
+            return; // Out of memory
+        }
     }
     
     int idx = trajectory->waypointCount;
@@ -95,18 +293,75 @@ void addWaypoint(TrajectoryData* trajectory, Coordinates position, double turnAn
     trajectory->waypoints[idx].turnAngle = turnAngle;
     
     // Initialize other values to zero, they will be calculated later
-    trajectory->waypoints[idx].approachSpeed = 0.0;
-    trajectory->waypoints[idx].departureSpeed = 0.0;
-    trajectory->waypoints[idx].timeToReach = 0.0;
-    trajectory->waypoints[idx].distanceFromPrevious = 0.0;
-    trajectory->waypoints[idx].bearingFromPrevious = 0.0;
-    trajectory->waypoints[idx].fuelConsumed = 0.0;
-    trajectory->waypoints[idx].gForce = 0.0;
+    resetWaypointResults(&trajectory->waypoints[idx]);
+    invalidateGeoVector(&trajectory->waypoints[idx].vector);
     
     trajectory->waypointCount++;
+    markWaypointDirty(trajectory, idx);
+    
+    // Only the new leg and the final leg need calculating
+    trajectoryChanged(trajectory);
+}
+
+// Add several waypoints, recalculating once at the end
+void addWaypoints(TrajectoryData* trajectory, const Coordinates positions[], const double turnAngles[], int count) {
+    beginTrajectoryUpdate(trajectory);
+    reserveWaypoints(trajectory, trajectory->waypointCount + count);
+    for (int i = 0; i < count; i++) {
+        addWaypoint(trajectory, positions[i], turnAngles[i]);
+    }
+    endTrajectoryUpdate(trajectory);
+}
+
+// Move a waypoint or change its turn angle; returns 0 for an invalid index
+int updateWaypoint(TrajectoryData* trajectory, int waypointIndex, Coordinates position, double turnAngle) {
+    if (waypointIndex < 0 || waypointIndex >= trajectory->waypointCount) {
+        return 0; // Invalid waypoint index
+    }
+    
+    Waypoint* waypoint = &trajectory->waypoints[waypointIndex];
+    int moved = waypoint->position.latitude != position.latitude ||
+                waypoint->position.longitude != position.longitude;
+    
+    waypoint->position = position;
+    waypoint->turnAngle = turnAngle;
+    
+    if (moved) {
+        markWaypointDirty(trajectory, waypointIndex);
+    } else if (waypointIndex < trajectory->dirtyFrom) {
+        // Same geometry, but speeds change from this waypoint on
+        trajectory->dirtyFrom = waypointIndex;
+    }
+    
+    trajectoryChanged(trajectory);
+    return 1;
+}
+
+// Remove a waypoint; returns 0 for an invalid index
+int removeWaypoint(TrajectoryData* trajectory, int waypointIndex) {
+    if (waypointIndex < 0 || waypointIndex >= trajectory->waypointCount) {
+        return 0; // Invalid waypoint index
+    }
+    
+    Waypoint* waypoints = trajectory->waypoints;
+    int following = trajectory->waypointCount - waypointIndex - 1;
+    memmove(&waypoints[waypointIndex], &waypoints[waypointIndex + 1], following * sizeof(Waypoint));
+    trajectory->waypointCount--;
+    
+    if (waypointIndex == 0 && trajectory->waypointCount > 0) {
+        // The first waypoint's effects are never calculated, as for a fresh route
+        resetWaypointResults(&waypoints[0]);
+    }
+    
+    if (waypointIndex < trajectory->waypointCount) {
+        // The waypoints around the gap now have different previous points
+        markWaypointDirty(trajectory, waypointIndex);
+    } else if (waypointIndex < trajectory->dirtyFrom) {
+        trajectory->dirtyFrom = waypointIndex; // Only the final leg changed
+    }
     
-    // Recalculate the full trajectory with the new waypoint
-    calculateFullTrajectory(trajectory);
+    trajectoryChanged(trajectory);
+    return 1;
 }
 
 // Calculate the effect of a turn on missile speed
@@ -140,94 +395,148 @@ void calculateWaypointEffects(TrajectoryData* trajectory, int waypointIndex) {
     }
     
     // Get the previous point (could be start or another waypoint)
-    Coordinates prevPoint;
+    GeoVector* prevVector;
+    Coordinates prevPosition;
     double prevSpeed;
     
     if (waypointIndex == 1) {
-        prevPoint = trajectory->start;
+        prevVector = &trajectory->startVector;
+        prevPosition = trajectory->start;
         prevSpeed = trajectory->missile.speed; // Initial speed
     } else {
-        prevPoint = trajectory->waypoints[waypointIndex - 1].position;
-        prevSpeed = trajectory->waypoints[waypointIndex - 1].departureSpeed;
+        Waypoint* previous = &trajectory->waypoints[waypointIndex - 1];
+        prevVector = &previous->vector;
+        prevPosition = previous->position;
+        prevSpeed = previous->departureSpeed;
     }
     
     Waypoint* waypoint = &trajectory->waypoints[waypointIndex];
     
-    // Calculate distance and bearing from previous point
-    waypoint->distanceFromPrevious = calculateDistance(prevPoint, waypoint->position);
-    waypoint->bearingFromPrevious = calculateBearing(prevPoint, waypoint->position);
+    // Calculate distance and bearing from previous point unless neither end moved
+    if (!waypoint->geometryValid) {
+        LegGeometry geometry;
+        if (cachedLegGeometry(prevVector, prevPosition, &waypoint->vector, waypoint->position, &geometry)) {
+            waypoint->distanceFromPrevious = EARTH_RADIUS * geometry.angle;
+            waypoint->bearingFromPrevious = geometry.bearing;
+        } else {
+            const GeoVector* previousVector = updateGeoVector(prevVector, prevPosition);
+            const GeoVector* waypointVector = updateGeoVector(&waypoint->vector, waypoint->position);
+            waypoint->distanceFromPrevious = EARTH_RADIUS * kernelLegAngle(previousVector, waypointVector);
+            waypoint->bearingFromPrevious = kernelLegBearing(previousVector, waypointVector);
+        }
+        waypoint->geometryValid = 1;
+    }
     
     // Set approach speed (same as departure speed from previous point)
     waypoint->approachSpeed = prevSpeed;
     
-    // Calculate time to reach this waypoint
-    waypoint->timeToReach = calculateTravelTime(waypoint->distanceFromPrevious * 1000, waypoint->approachSpeed);
-    
-    // Calculate speed after turn
-    waypoint->departureSpeed = calculateTurnEffect(
-        waypoint->approachSpeed,
-        waypoint->turnAngle,
-        trajectory->missile.dragCoefficient
-    );
-    
-    // Calculate fuel consumed to reach this waypoint
-    // Base fuel consumption during normal flight
-    double normalFuelConsumption = waypoint->timeToReach * trajectory->missile.fuelConsumptionNormal;
-    
-    // Additional fuel for the turn
-    double turnTime = fabs(waypoint->turnAngle) / trajectory->missile.maxTurnRate;
-    double turnFuelConsumption = turnTime * trajectory->missile.fuelConsumptionTurn;
-    
-    waypoint->fuelConsumed = normalFuelConsumption + turnFuelConsumption;
-    
-    // Calculate G-force during turn (simplified)
-    // Estimate turn radius based on speed and turn rate
-    double turnRadiusMeters = waypoint->approachSpeed / deg2rad(trajectory->missile.maxTurnRate);
-    waypoint->gForce = calculateGForce(waypoint->approachSpeed, turnRadiusMeters);
+    // Time to reach this waypoint, speed after the turn, fuel for the leg and
+    // turn, and G-force during the turn (calculateTravelTime, calculateTurnEffect
+    // and calculateGForce in the active kernel precision)
+    LegEffects effects;
+    kernelLegEffects(&trajectory->missile, waypoint->distanceFromPrevious, waypoint->approachSpeed,
+                     waypoint->turnAngle, &effects);
+    waypoint->timeToReach = effects.timeToReach;
+    waypoint->departureSpeed = effects.departureSpeed;
+    waypoint->fuelConsumed = effects.fuelConsumed;
+    waypoint->gForce = effects.gForce;
 }
 
 // Calculate the full trajectory with all waypoints
 void calculateFullTrajectory(TrajectoryData* trajectory) {
-    // Reset total values
-    trajectory->totalDistance = 0.0;
-    trajectory->totalTravelTime = 0.0;
-    trajectory->currentSpeed = trajectory->missile.speed;
-    trajectory->remainingFuel = trajectory->missile.fuel;
+    // Recompute every leg from scratch
+    for (int i = 0; i < trajectory->waypointCount; i++) {
+        trajectory->waypoints[i].geometryValid = 0;
+    }
+    trajectory->dirtyFrom = 0;
+    
+    recalculateTrajectory(trajectory);
+}
+
+// Recalculate legs from the first dirty waypoint onwards, reusing the totals before it
+void recalculateTrajectory(TrajectoryData* trajectory) {
+    STATS_BEGIN(STATS_PHASE_PHYSICS);
+    int firstDirty = trajectory->dirtyFrom;
+    if (firstDirty > trajectory->waypointCount) {
+        firstDirty = trajectory->waypointCount; // Only the final leg
+    }
+    STATS_ADD(STATS_COUNTER_LEGS, trajectory->waypointCount - firstDirty + 1);
+
+    // Resume totals from the last clean waypoint
+    if (firstDirty == 0) {
+        trajectory->totalDistance = 0.0;
+        trajectory->totalTravelTime = 0.0;
+        trajectory->currentSpeed = trajectory->missile.speed;
+        trajectory->remainingFuel = trajectory->missile.fuel;
+    } else {
+        Waypoint* clean = &trajectory->waypoints[firstDirty - 1];
+        trajectory->totalDistance = clean->cumulativeDistance;
+        trajectory->totalTravelTime = clean->cumulativeTravelTime;
+        trajectory->currentSpeed = clean->departureSpeed;
+        trajectory->remainingFuel = clean->cumulativeFuel;
+    }
     
     // Calculate initial bearing from start to first point (waypoint or end)
+    GeoVector* firstVector = &trajectory->endVector;
+    Coordinates firstPosition = trajectory->end;
     if (trajectory->waypointCount > 0) {
-        trajectory->initialBearing = calculateBearing(trajectory->start, trajectory->waypoints[0].position);
+        firstVector = &trajectory->waypoints[0].vector;
+        firstPosition = trajectory->waypoints[0].position;
+    }
+    LegGeometry geometry;
+    if (cachedLegGeometry(&trajectory->startVector, trajectory->start, firstVector, firstPosition, &geometry)) {
+        trajectory->initialBearing = geometry.bearing;
     } else {
-        trajectory->initialBearing = calculateBearing(trajectory->start, trajectory->end);
+        trajectory->initialBearing = kernelLegBearing(updateGeoVector(&trajectory->startVector, trajectory->start),
+                                                      updateGeoVector(firstVector, firstPosition));
     }
     
     // Calculate effects for each waypoint
-    for (int i = 0; i < trajectory->waypointCount; i++) {
+    for (int i = firstDirty; i < trajectory->waypointCount; i++) {
+        Waypoint* waypoint = &trajectory->waypoints[i];
         calculateWaypointEffects(trajectory, i);
         
         // Update totals
-        trajectory->totalDistance += trajectory->waypoints[i].distanceFromPrevious;
-        trajectory->totalTravelTime += trajectory->waypoints[i].timeToReach;
-        trajectory->remainingFuel -= trajectory->waypoints[i].fuelConsumed;
+        trajectory->totalDistance += waypoint->distanceFromPrevious;
+        trajectory->totalTravelTime += waypoint->timeToReach;
+        trajectory->remainingFuel -= waypoint->fuelConsumed;
         
         // Update current speed
-        trajectory->currentSpeed = trajectory->waypoints[i].departureSpeed;
+        trajectory->currentSpeed = waypoint->departureSpeed;
+        
+        waypoint->cumulativeDistance = trajectory->totalDistance;
+        waypoint->cumulativeTravelTime = trajectory->totalTravelTime;
+        waypoint->cumulativeFuel = trajectory->remainingFuel;
     }
+    trajectory->dirtyFrom = TRAJECTORY_CLEAN;
     
     // Calculate final leg (last waypoint to end or start to end if no waypoints)
-    Coordinates lastPoint;
+    GeoVector* lastVector;
+    Coordinates lastPosition;
     double lastSpeed;
     
     if (trajectory->waypointCount > 0) {
-        lastPoint = trajectory->waypoints[trajectory->waypointCount - 1].position;
-        lastSpeed = trajectory->waypoints[trajectory->waypointCount - 1].departureSpeed;
+        Waypoint* last = &trajectory->waypoints[trajectory->waypointCount - 1];
+        lastVector = &last->vector;
+        lastPosition = last->position;
+        lastSpeed = last->departureSpeed;
     } else {
-        lastPoint = trajectory->start;
+        lastVector = &trajectory->startVector;
+        lastPosition = trajectory->start;
         lastSpeed = trajectory->missile.speed;
     }
     
-    double finalDistance = calculateDistance(lastPoint, trajectory->end);
-    double finalTime = calculateTravelTime(finalDistance * 1000, lastSpeed);
+    double finalDistance;
+    if (cachedLegGeometry(lastVector, lastPosition, &trajectory->endVector, trajectory->end, &geometry)) {
+        finalDistance = EARTH_RADIUS * geometry.angle;
+    } else {
+        finalDistance = EARTH_RADIUS * kernelLegAngle(updateGeoVector(lastVector, lastPosition),
+                                                      updateGeoVector(&trajectory->endVector, trajectory->end));
+    }
+    // No turn at the end, so only the travel time applies
+    LegEffects effects;
+    kernelLegEffects(&trajectory->missile, finalDistance, lastSpeed, 0.0, &effects);
+    double finalTime = effects.timeToReach;
     double finalFuel = finalTime * trajectory->missile.fuelConsumptionNormal;
     
     // Update totals with final leg
@@ -239,67 +548,116 @@ void calculateFullTrajectory(TrajectoryData* trajectory) {
     if (trajectory->remainingFuel < 0) {
         trajectory->remainingFuel = 0;
     }
+    STATS_END();
 }
 
-// Generate path points for visualization
-Coordinates* generatePathPoints(TrajectoryData* trajectory, int* pointCount) {
+// Prepare segment (0..waypointCount) of the route for sampling, reusing the cached vectors
+void initTrajectorySegment(TrajectoryData* trajectory, int segment, GeoSegment* geoSegment) {
+    int segments = trajectory->waypointCount + 1;
+
+    if (segment == 0) {
+        geoSegment->start = *updateGeoVector(&trajectory->startVector, trajectory->start);
+    } else {
+        Waypoint* previous = &trajectory->waypoints[segment - 1];
+        geoSegment->start = *updateGeoVector(&previous->vector, previous->position);
+    }
+
+    if (segment == segments - 1) {
+        geoSegment->end = *updateGeoVector(&trajectory->endVector, trajectory->end);
+    } else {
+        Waypoint* next = &trajectory->waypoints[segment];
+        geoSegment->end = *updateGeoVector(&next->vector, next->position);
+    }
+
+    // The endpoint vectors are current, so a miss only costs the arc itself
+    LegGeometry geometry;
+    Coordinates from = { geoSegment->start.sourceLatitude, geoSegment->start.sourceLongitude, 0.0 };
+    Coordinates to = { geoSegment->end.sourceLatitude, geoSegment->end.sourceLongitude, 0.0 };
+    if (cachedLegGeometry(&geoSegment->start, from, &geoSegment->end, to, &geometry)) {
+        geoSegment->angle = geometry.angle;
+        geoSegment->sinAngle = geometry.sinAngle;
+    } else {
+        geoSegment->angle = geoVectorAngle(&geoSegment->start, &geoSegment->end);
+        geoSegment->sinAngle = sin(geoSegment->angle);
+    }
+}
+
+// Fill buffer with up to capacity path points (PATH_POINTS_PER_SEGMENT per
+// segment). Returns the number of points the whole path has, so a NULL buffer
+// with zero capacity queries the size to allocate
+int generatePathPointsInto(TrajectoryData* trajectory, Coordinates* buffer, int capacity) {
     // Determine how many segments we have (waypoints + 1)
     int segments = trajectory->waypointCount + 1;
+    int totalPoints = segments * PATH_POINTS_PER_SEGMENT;
+    int currentPoint = 0;
+    if (capacity <= 0) {
+        return totalPoints; // Size query
+    }
+    
+    STATS_BEGIN(STATS_PHASE_SAMPLING);
+    // Generate points for each segment with the kernel of the selected precision
+    for (int segment = 0; segment < segments && currentPoint < capacity; segment++) {
+        GeoSegment geoSegment;
+        initTrajectorySegment(trajectory, segment, &geoSegment);
+        
+        if (capacity - currentPoint >= KERNEL_SAMPLES_PER_SEGMENT) {
+            kernelSegmentPoints(&geoSegment, buffer + currentPoint);
+            currentPoint += KERNEL_SAMPLES_PER_SEGMENT;
+        } else {
+            Coordinates points[KERNEL_SAMPLES_PER_SEGMENT];
+            kernelSegmentPoints(&geoSegment, points);
+            memcpy(buffer + currentPoint, points, (capacity - currentPoint) * sizeof(Coordinates));
+            currentPoint = capacity;
+        }
+    }
+    STATS_ADD(STATS_COUNTER_PATH_POINTS, currentPoint);
+    STATS_END();
     
+    return totalPoints;
+}
+
+Coordinates* generatePathPoints(TrajectoryData* trajectory, int* pointCount) {
     // Allocate memory for path points (100 points per segment)
-    int totalPoints = segments * 100;
+    int totalPoints = generatePathPointsInto(trajectory, NULL, 0);
     Coordinates* pathPoints = (Coordinates*)malloc(totalPoints * sizeof(Coordinates));
-    
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, totalPoints * sizeof(Coordinates));
+
     if (!pathPoints) {
         *pointCount = 0;
         return NULL;
     }
     
-    int currentPoint = 0;
-    
-    // Generate points for each segment
-    for (int segment = 0; segment < segments; segment++) {
-        Coordinates segmentStart, segmentEnd;
-        
-        // Determine start and end of this segment
-        if (segment == 0) {
-            segmentStart = trajectory->start;
-        } else {
-            segmentStart = trajectory->waypoints[segment - 1].position;
-        }
-        
-        if (segment == segments - 1) {
-            segmentEnd = trajectory->end;
-        } else {
-            segmentEnd = trajectory->waypoints[segment].position;
-        }
-        
-        // Generate 100 points along this segment
-        for (int i = 0; i < 100; i++) {
-            double fraction = (double)i / 99.0;
-            pathPoints[currentPoint] = calculateIntermediatePoint(segmentStart, segmentEnd, fraction);
-            currentPoint++;
-        }
-    }
-    
-    *pointCount = currentPoint;
+    *pointCount = generatePathPointsInto(trajectory, pathPoints, totalPoints);
     return pathPoints;
 }
 
-// Calculate complete trajectory data
+// Calculate complete trajectory data; waypoints added later are stored on the heap
 TrajectoryData calculateTrajectory(Coordinates start, Coordinates end, MissileAttributes missile) {
+    return calculateTrajectoryInArena(start, end, missile, NULL);
+}
+
+// Calculate complete trajectory data with waypoints stored in arena (heap if NULL)
+TrajectoryData calculateTrajectoryInArena(Coordinates start, Coordinates end, MissileAttributes missile, Arena* arena) {
     TrajectoryData trajectory;
     
     trajectory.start = start;
     trajectory.end = end;
     trajectory.missile = missile;
     trajectory.waypointCount = 0;
+    trajectory.waypointCapacity = 0;
+    trajectory.waypoints = NULL;
+    trajectory.arena = arena;
+    invalidateGeoVector(&trajectory.startVector);
+    invalidateGeoVector(&trajectory.endVector);
+    trajectory.dirtyFrom = 0;
+    trajectory.updateDepth = 0;
     
     // Set default physics values if not provided
-    if (trajectory.missile.maxAcceleration <= 0) trajectory.missile.maxAcceleration = 30.0;
-    if (trajectory.missile.maxDeceleration <= 0) trajectory.missile.maxDeceleration = 50.0;
-    if (trajectory.missile.maxTurnRate <= 0) trajectory.missile.maxTurnRate = 20.0;
-    if (trajectory.missile.dragCoefficient <= 0) trajectory.missile.dragCoefficient = 0.1;
+    if (trajectory.missile.maxAcceleration <= 0) trajectory.missile.maxAcceleration = MISSILE_DEFAULT_MAX_ACCELERATION;
+    if (trajectory.missile.maxDeceleration <= 0) trajectory.missile.maxDeceleration = MISSILE_DEFAULT_MAX_DECELERATION;
+    if (trajectory.missile.maxTurnRate <= 0) trajectory.missile.maxTurnRate = MISSILE_DEFAULT_MAX_TURN_RATE;
+    if (trajectory.missile.dragCoefficient <= 0) trajectory.missile.dragCoefficient = MISSILE_DEFAULT_DRAG_COEFFICIENT;
     if (trajectory.missile.fuelConsumptionNormal <= 0) {
         trajectory.missile.fuelConsumptionNormal = trajectory.missile.burnRate;
     }
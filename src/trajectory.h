@@ -3,13 +3,24 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <limits.h>
+#include "arena.h"
 
 // Earth radius in kilometers
 #define EARTH_RADIUS 6371.0
 
 // Constants for physics calculations
 #define GRAVITY 9.81 // m/s^2
-#define MAX_WAYPOINTS 10 // Maximum number of waypoints
+#define TRAJECTORY_CLEAN INT_MAX // dirtyFrom value when no waypoint needs recalculation
+
+// Physics defaults for missile attributes given as <= 0
+#define MISSILE_DEFAULT_MAX_ACCELERATION 30.0  // m/s²
+#define MISSILE_DEFAULT_MAX_DECELERATION 50.0  // m/s²
+#define MISSILE_DEFAULT_MAX_TURN_RATE 20.0     // degrees/second
+#define MISSILE_DEFAULT_DRAG_COEFFICIENT 0.1   // dimensionless
+
+// Points per segment of the fixed path sampler
+#define PATH_POINTS_PER_SEGMENT 100
 
 // Structure to hold coordinates
 typedef struct {
@@ -18,6 +29,25 @@ typedef struct {
     double altitude; // in meters
 } Coordinates;
 
+// Unit vector (earth-centred, unit sphere) and trigonometry of a position.
+// Filled on first use and refreshed whenever the source coordinates change,
+// so legs and path sampling don't recompute sin/cos of the same endpoints.
+typedef struct {
+    double sourceLatitude;    // Coordinates the cache was computed from (degrees)
+    double sourceLongitude;
+    double x, y, z;           // Unit vector
+    double sinLat, cosLat;
+    double sinLon, cosLon;
+} GeoVector;
+
+// Great-circle segment with its endpoint vectors and angular length precomputed
+typedef struct {
+    GeoVector start;
+    GeoVector end;
+    double angle;             // Angular distance in radians
+    double sinAngle;
+} GeoSegment;
+
 // Structure to hold missile attributes
 typedef struct {
     double weight;            // in kg
@@ -44,6 +74,11 @@ typedef struct {
     double bearingFromPrevious;    // Bearing from previous point in degrees
     double fuelConsumed;           // Fuel consumed to reach this waypoint in kg
     double gForce;                 // G-force experienced during turn
+    GeoVector vector;              // Cached unit vector of position
+    int geometryValid;             // Distance and bearing from previous point are current
+    double cumulativeDistance;     // Totals after this waypoint, reused when only
+    double cumulativeTravelTime;   // later legs need recalculating
+    double cumulativeFuel;         // Remaining fuel after this waypoint
 } Waypoint;
 
 // Structure to hold trajectory data
@@ -55,9 +90,15 @@ typedef struct {
     double totalTravelTime;  // Total travel time in seconds
     double initialBearing;   // Initial bearing in degrees
     int waypointCount;       // Number of waypoints
-    Waypoint waypoints[MAX_WAYPOINTS]; // Array of waypoints
+    int waypointCapacity;    // Slots available in waypoints
+    Waypoint* waypoints;     // Waypoint store, shared by copies of this structure
+    Arena* arena;            // Arena backing the waypoint store, NULL for the heap
     double currentSpeed;     // Current speed in m/s
     double remainingFuel;    // Remaining fuel in kg
+    GeoVector startVector;   // Cached unit vector of start
+    GeoVector endVector;     // Cached unit vector of end
+    int dirtyFrom;           // First waypoint with stale effects, TRAJECTORY_CLEAN if none
+    int updateDepth;         // Open beginTrajectoryUpdate calls deferring recalculation
 } TrajectoryData;
 
 // Function declarations
@@ -66,6 +107,9 @@ double calculateBearing(Coordinates start, Coordinates end);
 double calculateTravelTime(double distance, double speed);
 Coordinates calculateIntermediatePoint(Coordinates start, Coordinates end, double fraction);
 TrajectoryData calculateTrajectory(Coordinates start, Coordinates end, MissileAttributes missile);
+TrajectoryData calculateTrajectoryInArena(Coordinates start, Coordinates end, MissileAttributes missile, Arena* arena);
+int reserveWaypoints(TrajectoryData* trajectory, int capacity);
+void freeTrajectory(TrajectoryData* trajectory);
 
 // New function declarations for waypoints and physics
 void addWaypoint(TrajectoryData* trajectory, Coordinates position, double turnAngle);
@@ -74,6 +118,26 @@ void calculateFullTrajectory(TrajectoryData* trajectory);
 double calculateTurnEffect(double speed, double turnAngle, double dragCoefficient);
 double calculateGForce(double speed, double turnRadius);
 Coordinates* generatePathPoints(TrajectoryData* trajectory, int* pointCount);
+int generatePathPointsInto(TrajectoryData* trajectory, Coordinates* buffer, int capacity);
+
+// Incremental recalculation: edits mark legs dirty and only legs from the first
+// modified waypoint onwards are recomputed. Between beginTrajectoryUpdate and
+// endTrajectoryUpdate recalculation is deferred until the batch finishes.
+void addWaypoints(TrajectoryData* trajectory, const Coordinates positions[], const double turnAngles[], int count);
+int updateWaypoint(TrajectoryData* trajectory, int waypointIndex, Coordinates position, double turnAngle);
+int removeWaypoint(TrajectoryData* trajectory, int waypointIndex);
+void markWaypointDirty(TrajectoryData* trajectory, int waypointIndex);
+void beginTrajectoryUpdate(TrajectoryData* trajectory);
+void endTrajectoryUpdate(TrajectoryData* trajectory);
+void recalculateTrajectory(TrajectoryData* trajectory);
 
+// Cached unit vector functions
+void invalidateGeoVector(GeoVector* vector);
+const GeoVector* updateGeoVector(GeoVector* vector, Coordinates position);
+double geoVectorDistance(const GeoVector* start, const GeoVector* end);
+double geoVectorBearing(const GeoVector* start, const GeoVector* end);
+void initGeoSegment(GeoSegment* segment, Coordinates start, Coordinates end);
+Coordinates geoSegmentPoint(const GeoSegment* segment, double fraction);
+void initTrajectorySegment(TrajectoryData* trajectory, int segment, GeoSegment* geoSegment);
 
 #endif /* TRAJECTORY_H */
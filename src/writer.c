@@ -0,0 +1,251 @@
+#include "writer.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+// Longest text formatFixed produces on its fast path
+#define FIXED_FAST_MAX 40
+
+// Largest decimals handled without stdio
+#define FIXED_MAX_DECIMALS 9
+
+// Scaled values below this are rounded exactly with integer arithmetic
+#define FIXED_FAST_LIMIT 1125899906842624.0 // 2^50
+
+static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+// Attach a writer to an open file with a buffer of bufferSize bytes
+int openWriter(Writer* writer, FILE* file, size_t bufferSize) {
+    writer->file = file;
+    writer->pipeline = NULL;
+    writer->capacity = bufferSize > 0 ? bufferSize : WRITER_DEFAULT_BUFFER;
+    writer->buffer = (char*)malloc(writer->capacity);
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, writer->capacity);
+    writer->length = 0;
+    writer->bytesWritten = 0;
+    writer->error = writer->buffer == NULL;
+    return writer->error ? -1 : 0;
+}
+
+// Collect output in memory; buffer and length hold the text written so far
+int openMemoryWriter(Writer* writer, size_t initialCapacity) {
+    int status = openWriter(writer, NULL, initialCapacity);
+    writer->file = NULL;
+    return status;
+}
+
+// Write through an output pipeline: the writer fills one of its buffers at a
+// time and never touches the file itself
+int openPipelineWriter(Writer* writer, OutputPipeline* pipeline) {
+    writer->file = NULL;
+    writer->pipeline = pipeline;
+    writer->capacity = outputPipelineBufferSize(pipeline);
+    writer->buffer = acquireOutputBuffer(pipeline);
+    writer->length = 0;
+    writer->bytesWritten = 0;
+    writer->error = 0;
+    return 0;
+}
+
+// Discard buffered output of a memory writer, keeping its buffer for reuse
+void resetWriter(Writer* writer) {
+    writer->length = 0;
+    writer->bytesWritten = 0;
+    writer->error = writer->buffer == NULL;
+}
+
+// Hand the buffered bytes to the file, or queue them on the pipeline and take
+// its next empty buffer (no-op for a memory writer)
+int flushWriter(Writer* writer) {
+    if (writer->pipeline) {
+        if (writer->length > 0) {
+            submitOutputBuffer(writer->pipeline, writer->buffer, writer->length);
+            writer->buffer = acquireOutputBuffer(writer->pipeline);
+            writer->length = 0;
+        }
+        if (outputPipelineError(writer->pipeline) != 0) writer->error = 1;
+        return writer->error ? -1 : 0;
+    }
+    if (!writer->file) {
+        return writer->error ? -1 : 0;
+    }
+    if (writer->length > 0 && !writer->error) {
+        if (fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length) {
+            writer->error = 1;
+        }
+        STATS_ADD(STATS_COUNTER_BYTES_WRITTEN, writer->length);
+    }
+    writer->length = 0;
+    return writer->error ? -1 : 0;
+}
+
+// Flush and release the buffer; the file stays open. A pipeline writer's
+// buffer goes back to the pipeline, whose writes may still be in flight
+int closeWriter(Writer* writer) {
+    if (writer->pipeline) {
+        submitOutputBuffer(writer->pipeline, writer->buffer, writer->length);
+        if (outputPipelineError(writer->pipeline) != 0) writer->error = 1;
+        writer->pipeline = NULL;
+        writer->buffer = NULL;
+        writer->length = 0;
+        writer->capacity = 0;
+        return writer->error ? -1 : 0;
+    }
+    int status = flushWriter(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->capacity = 0;
+    return status;
+}
+
+// Make room for length more bytes in the buffer: flush a file writer, grow a
+// memory writer. Returns 0 if they still don't fit
+static int reserveWriter(Writer* writer, size_t length) {
+    if (writer->length + length <= writer->capacity) {
+        return 1;
+    }
+
+    if (writer->file || writer->pipeline) {
+        flushWriter(writer);
+        return length <= writer->capacity;
+    }
+
+    size_t capacity = writer->capacity * 2;
+    if (capacity < writer->length + length) capacity = writer->length + length;
+    char* buffer = (char*)realloc(writer->buffer, capacity);
+    STATS_ADD(STATS_COUNTER_ALLOCATIONS, 1);
+    STATS_ADD(STATS_COUNTER_ALLOCATED_BYTES, capacity);
+    if (!buffer) {
+        writer->error = 1;
+        return 0;
+    }
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return 1;
+}
+
+void writerPut(Writer* writer, const char* data, size_t length) {
+    writer->bytesWritten += length;
+
+    if (!reserveWriter(writer, length)) {
+        // Larger than a pipeline buffer: fill buffer after buffer
+        while (writer->pipeline && length > 0) {
+            size_t part = writer->capacity - writer->length < length ? writer->capacity - writer->length : length;
+            memcpy(writer->buffer + writer->length, data, part);
+            writer->length += part;
+            data += part;
+            length -= part;
+            if (length > 0) flushWriter(writer);
+        }
+
+        // Larger than a file writer's whole buffer: write straight through
+        if (writer->file && !writer->error && fwrite(data, 1, length, writer->file) != length) {
+            writer->error = 1;
+        }
+        STATS_ADD(STATS_COUNTER_BYTES_WRITTEN, length);
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+void writerPutString(Writer* writer, const char* text) {
+    writerPut(writer, text, strlen(text));
+}
+
+void writerPutChar(Writer* writer, char c) {
+    if (writer->length == writer->capacity && !reserveWriter(writer, 1)) {
+        return;
+    }
+    writer->buffer[writer->length++] = c;
+    writer->bytesWritten++;
+}
+
+void writerPutInt(Writer* writer, long long value) {
+    char text[24];
+    char* end = text + sizeof(text);
+    char* ptr = end;
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do {
+        *--ptr = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) *--ptr = '-';
+    writerPut(writer, ptr, end - ptr);
+}
+
+// Format value like printf("%.*f", decimals, value), returning the length.
+// Values whose scaled magnitude fits in 2^50 are rounded exactly (ties to even,
+// as glibc does) using an FMA residual; anything else goes through snprintf.
+int formatFixed(char* buffer, size_t size, double value, int decimals) {
+    if (decimals < 0 || decimals > FIXED_MAX_DECIMALS || size < FIXED_FAST_MAX) {
+        return snprintf(buffer, size, "%.*f", decimals, value);
+    }
+
+    double magnitude = fabs(value);
+    double scale = powersOfTen[decimals];
+    double product = magnitude * scale;
+
+    if (!(product < FIXED_FAST_LIMIT)) {
+        return snprintf(buffer, size, "%.*f", decimals, value); // Large, infinite or NaN
+    }
+
+    // product + residual is the exact value of magnitude * scale
+    double residual = fma(magnitude, scale, -product);
+    double whole = floor(product);
+    double fraction = product - whole;
+    uint64_t digits = (uint64_t)whole;
+
+    if (fraction >= 0.25) {
+        double distance = fraction - 0.5; // Exact in this range
+        if (distance > -residual || (distance == 0.0 && residual == 0.0 && (digits & 1))) {
+            digits++;
+        }
+    }
+
+    // Emit digits right to left: fractional part, point, integer part
+    char text[FIXED_FAST_MAX];
+    char* end = text + sizeof(text);
+    char* ptr = end;
+
+    for (int i = 0; i < decimals; i++) {
+        *--ptr = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+    if (decimals > 0) *--ptr = '.';
+    do {
+        *--ptr = (char)('0' + digits % 10);
+        digits /= 10;
+    } while (digits);
+    if (signbit(value)) *--ptr = '-';
+
+    int length = (int)(end - ptr);
+    memcpy(buffer, ptr, length);
+    buffer[length] = '\0';
+    return length;
+}
+
+// Write value with a fixed number of decimals (same text as "%.<decimals>f")
+void writerPutFixed(Writer* writer, double value, int decimals) {
+    char text[FIXED_FAST_MAX + 8];
+    int length = formatFixed(text, sizeof(text), value, decimals);
+
+    if (length >= (int)sizeof(text)) {
+        // Only huge values need this; format them on the heap
+        char* large = (char*)malloc(length + 1);
+        if (large) {
+            snprintf(large, length + 1, "%.*f", decimals, value);
+            writerPut(writer, large, length);
+            free(large);
+        }
+        return;
+    }
+
+    writerPut(writer, text, length);
+}
@@ -0,0 +1,39 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pipeline.h"
+
+// Default size of a file writer's buffer
+#define WRITER_DEFAULT_BUFFER (1 << 20)
+
+// Buffered output stream: formats into a large user-space buffer and hands
+// full buffers to the file in single fwrite calls. A memory writer has no
+// file; its buffer grows to hold everything written. A pipeline writer fills
+// the buffers of an OutputPipeline and hands each full one to its writer thread
+typedef struct {
+    FILE* file;             // Destination, NULL for a memory writer
+    OutputPipeline* pipeline;   // Destination of a pipeline writer, else NULL
+    char* buffer;
+    size_t length;          // Bytes waiting in buffer
+    size_t capacity;
+    size_t bytesWritten;    // Total bytes accepted by the writer
+    int error;              // Non-zero once a write failed
+} Writer;
+
+// Function declarations
+int openWriter(Writer* writer, FILE* file, size_t bufferSize);
+int openMemoryWriter(Writer* writer, size_t initialCapacity);
+int openPipelineWriter(Writer* writer, OutputPipeline* pipeline);
+void resetWriter(Writer* writer);
+int flushWriter(Writer* writer);
+int closeWriter(Writer* writer);
+void writerPut(Writer* writer, const char* data, size_t length);
+void writerPutString(Writer* writer, const char* text);
+void writerPutChar(Writer* writer, char c);
+void writerPutInt(Writer* writer, long long value);
+void writerPutFixed(Writer* writer, double value, int decimals);
+int formatFixed(char* buffer, size_t size, double value, int decimals);
+
+#endif /* WRITER_H */
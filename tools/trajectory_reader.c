@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "columnar.h"
+#include "output.h"
+
+// Convert a columnar trajectory file back to the JSON document or CSV tables:
+// trajectory_reader <file.trjc> [info|json|compact-json|path-csv|waypoints-csv] [output_file]
+
+static void writeCsvRow(Writer* writer, const ColumnarFile* file, int firstColumn, int lastColumn, size_t row) {
+    for (int column = firstColumn; column <= lastColumn; column++) {
+        if (column > firstColumn) writerPutChar(writer, ',');
+        writerPutFixed(writer, file->columns[column][row], 6);
+    }
+    writerPutChar(writer, '\n');
+}
+
+// Header line plus one row per element of the columns firstColumn..lastColumn
+static void writeCsv(Writer* writer, const ColumnarFile* file, int firstColumn, int lastColumn, size_t rows) {
+    for (int column = firstColumn; column <= lastColumn; column++) {
+        const char* name = strchr(columnarColumnName((ColumnarColumnId)column), '.') + 1;
+        if (column > firstColumn) writerPutChar(writer, ',');
+        writerPutString(writer, name);
+    }
+    writerPutChar(writer, '\n');
+
+    for (size_t row = 0; row < rows; row++) {
+        writeCsvRow(writer, file, firstColumn, lastColumn, row);
+    }
+}
+
+static int writeJson(Writer* writer, const ColumnarFile* file, int compact) {
+    Waypoint* waypoints = (Waypoint*)malloc((file->waypointCount + 1) * sizeof(Waypoint));
+    Coordinates* pathPoints = (Coordinates*)malloc((file->pathPointCount + 1) * sizeof(Coordinates));
+    if (!waypoints || !pathPoints) {
+        fprintf(stderr, "Error allocating conversion buffers\n");
+        free(waypoints);
+        free(pathPoints);
+        return 1;
+    }
+
+    TrajectoryData trajectory;
+    columnarTrajectory(file, &trajectory, waypoints);
+    columnarPathPoints(file, pathPoints);
+
+    OutputOptions options = defaultOutputOptions();
+    options.compact = compact;
+    writeTrajectoryJSONWithPath(writer, &trajectory, pathPoints, (int)file->pathPointCount, &options);
+
+    free(waypoints);
+    free(pathPoints);
+    return 0;
+}
+
+static void writeInfo(FILE* stream, const ColumnarFile* file) {
+    const ColumnarHeader* header = file->header;
+
+    fprintf(stream, "Schema version: %u\n", header->version);
+    fprintf(stream, "File size: %llu bytes\n", (unsigned long long)header->fileSize);
+    fprintf(stream, "Path points: %zu\n", file->pathPointCount);
+    fprintf(stream, "Waypoints: %zu\n", file->waypointCount);
+    fprintf(stream, "Total distance: %.2f km\n", header->totalDistance);
+    fprintf(stream, "Total travel time: %.2f seconds\n", header->totalTravelTime);
+    for (int column = 0; column < COLUMNAR_COLUMN_COUNT; column++) {
+        fprintf(stream, "  %-30s offset %10llu  rows %zu\n", file->directory[column].name,
+                (unsigned long long)file->directory[column].offset, (size_t)file->directory[column].count);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s <file.trjc> [info|json|compact-json|path-csv|waypoints-csv] [output_file]\n", argv[0]);
+        return 1;
+    }
+
+    const char* mode = argc > 2 ? argv[2] : "json";
+    char error[256];
+    ColumnarFile file;
+
+    if (openColumnarFile(argv[1], &file, error, sizeof(error)) != 0) {
+        fprintf(stderr, "Error reading %s: %s\n", argv[1], error);
+        return 1;
+    }
+
+    FILE* output = argc > 3 ? fopen(argv[3], "w") : stdout;
+    if (!output) {
+        fprintf(stderr, "Error opening output file\n");
+        closeColumnarFile(&file);
+        return 1;
+    }
+
+    Writer writer;
+    if (openWriter(&writer, output, WRITER_DEFAULT_BUFFER) != 0) {
+        fprintf(stderr, "Error allocating output buffer\n");
+        closeColumnarFile(&file);
+        if (output != stdout) fclose(output);
+        return 1;
+    }
+
+    int status = 0;
+    if (strcmp(mode, "info") == 0) {
+        writeInfo(output, &file);
+    } else if (strcmp(mode, "json") == 0 || strcmp(mode, "compact-json") == 0) {
+        status = writeJson(&writer, &file, strcmp(mode, "compact-json") == 0);
+    } else if (strcmp(mode, "path-csv") == 0) {
+        writeCsv(&writer, &file, COLUMN_PATH_LATITUDE, COLUMN_PATH_ALTITUDE, file.pathPointCount);
+    } else if (strcmp(mode, "waypoints-csv") == 0) {
+        writeCsv(&writer, &file, COLUMN_WAYPOINT_LATITUDE, COLUMN_WAYPOINT_G_FORCE, file.waypointCount);
+    } else {
+        fprintf(stderr, "Unknown mode: %s\n", mode);
+        status = 1;
+    }
+
+    if (closeWriter(&writer) != 0) {
+        fprintf(stderr, "Error writing output\n");
+        status = 1;
+    }
+    if (output != stdout) fclose(output);
+    closeColumnarFile(&file);
+    return status;
+}
@@ -11,7 +11,7 @@ document.addEventListener('DOMContentLoaded', function() {
     let trajectoryLine = null;
     let missileMarker = null;
     let missileAnimation = null;
-    let logData = [];
+    let flight = null; // Arc-length table and speed of the last launch, for the logbook
 
     // Sidebar elements
     const manualLatInput = document.getElementById('manual-lat');
@@ -99,7 +99,7 @@ document.addEventListener('DOMContentLoaded', function() {
             cancelAnimationFrame(missileAnimation);
             missileAnimation = null;
         }
-        logData = [];
+        flight = null;
         currentPositionOutput.textContent = '-';
         currentSpeedOutput.textContent = '-';
         etaOutput.textContent = '-';
@@ -161,7 +161,7 @@ document.addEventListener('DOMContentLoaded', function() {
         return R * c;
     }
 
-    // Catmull-Rom Spline interpolation
+    // Catmull-Rom Spline interpolation (src/spline.c evaluates the same spline in the engine)
     function catmullRomSpline(pointsArr, numSegments = 20) {
         if (pointsArr.length < 3) return pointsArr.map(p => [p.lat, p.lng, p.alt]);
         let splinePoints = [];
@@ -201,36 +201,178 @@ document.addEventListener('DOMContentLoaded', function() {
     let trajectoryPath = [];
     let totalTravelTime = 0;
 
-    calcTrajectoryBtn.addEventListener('click', function() {
-        if (points.length < 2) {
-            alert('Add at least two points to calculate trajectory.');
-            return;
+    // Cumulative arc length (meters) at each path vertex
+    function buildArcTable(path) {
+        const cumulative = new Float64Array(path.length);
+        for (let i = 1; i < path.length; i++) {
+            cumulative[i] = cumulative[i-1] +
+                calculateDistance(path[i-1][0], path[i-1][1], path[i][0], path[i][1]) * 1000;
         }
-        // Remove old line
-        if (trajectoryLine) {
-            map.removeLayer(trajectoryLine);
+        return {path, cumulative, total: cumulative[path.length - 1]};
+    }
+
+    // Position after flying distance meters along the path (binary search over the arc table)
+    function positionAt(table, distance) {
+        const {path, cumulative} = table;
+        let low = 1;
+        let high = path.length - 1;
+        while (low < high) {
+            const middle = (low + high) >> 1;
+            if (cumulative[middle] < distance) low = middle + 1; else high = middle;
+        }
+        const prev = path[low-1];
+        const next = path[low];
+        const segDist = cumulative[low] - cumulative[low-1];
+        const segProgress = segDist === 0 ? 0 : Math.min(1, Math.max(0, (distance - cumulative[low-1]) / segDist));
+        return {
+            lat: prev[0] + (next[0] - prev[0]) * segProgress,
+            lng: prev[1] + (next[1] - prev[1]) * segProgress,
+            alt: prev[2] + (next[2] - prev[2]) * segProgress
+        };
+    }
+
+    // The engine (missile_calc --serve) smooths and measures the path with the
+    // same spline; the browser only computes it when the engine can't be reached
+    const engineUrl = 'http://127.0.0.1:8080/trajectory';
+    const engineViewUrl = 'http://127.0.0.1:8080/view';
+
+    // Decoders for the engine's encoded path (src/polyline.h): every value is
+    // the difference to the previous one, zigzag encoded in 5-bit groups of
+    // one character each (group + 63, plus 0x20 while more follow).
+    // Differences must fit 30 bits, which holds at these precisions
+    function decodeValues(text, precision, dimensions) {
+        const scale = Math.pow(10, precision);
+        const current = [0, 0];
+        const values = [];
+        let index = 0;
+        while (index < text.length) {
+            const point = dimensions === 1 ? null : new Array(dimensions);
+            for (let d = 0; d < dimensions; d++) {
+                let bits = 0, shift = 0, group;
+                do {
+                    group = text.charCodeAt(index++) - 63;
+                    bits |= (group & 0x1f) << shift;
+                    shift += 5;
+                } while (group >= 0x20);
+                current[d] += (bits & 1) ? ~(bits >>> 1) : (bits >>> 1);
+                if (point) point[d] = current[d] / scale; else values.push(current[d] / scale);
+            }
+            if (point) values.push(point);
         }
-        let pathLatLngs = [];
-        if (points.length === 2) {
+        return values;
+    }
+
+    // [[lat, lng], ...], ready for L.polyline
+    function decodePolyline(text, precision) {
+        return decodeValues(text, precision, 2);
+    }
+
+    function engineTrajectory(pts, speed) {
+        const coordinates = p => ({latitude: p.lat, longitude: p.lng, altitude: p.alt});
+        const body = {
+            start: coordinates(pts[0]),
+            end: coordinates(pts[pts.length - 1]),
+            weight: 1000, speed: speed,
+            waypoints: pts.slice(1, -1).map(coordinates),
+            compact: true, smooth: true, encodedPath: true
+        };
+        return fetch(engineUrl, {method: 'POST', headers: {'Content-Type': 'application/json'}, body: JSON.stringify(body)})
+            .then(response => {
+                if (!response.ok) throw new Error('engine answered ' + response.status);
+                return response.json();
+            })
+            .then(doc => {
+                if (doc.pathEncoding !== 'polyline') {
+                    return {
+                        path: doc.path.map(p => [p.latitude, p.longitude, p.altitude]),
+                        distance: doc.smoothedDistance,
+                        time: doc.smoothedTravelTime,
+                        request: body
+                    };
+                }
+                const latLngs = decodePolyline(doc.path, doc.pathPrecision);
+                const altitudes = decodeValues(doc.pathAltitudes, doc.altitudePrecision, 1);
+                return {
+                    path: latLngs.map((p, i) => [p[0], p[1], altitudes[i]]),
+                    latLngs: latLngs,
+                    distance: doc.smoothedDistance,
+                    time: doc.smoothedTravelTime,
+                    request: body
+                };
+            });
+    }
+
+    function localTrajectory(pts, speed) {
+        let path = [];
+        if (pts.length === 2) {
             // Only straight line
-            pathLatLngs = [[points[0].lat, points[0].lng, points[0].alt], [points[1].lat, points[1].lng, points[1].alt]];
+            path = [[pts[0].lat, pts[0].lng, pts[0].alt], [pts[1].lat, pts[1].lng, pts[1].alt]];
         } else {
             // First segment straight, rest Catmull-Rom
-            pathLatLngs = catmullRomSpline(points);
+            path = catmullRomSpline(pts);
         }
-        trajectoryPath = pathLatLngs;
-        trajectoryLine = L.polyline(pathLatLngs.map(p=>[p[0],p[1]]), {color: 'red', weight: 3}).addTo(map);
-        // Calculate total distance
         let totalDist = 0;
-        for (let i = 1; i < pathLatLngs.length; i++) {
-            totalDist += calculateDistance(pathLatLngs[i-1][0], pathLatLngs[i-1][1], pathLatLngs[i][0], pathLatLngs[i][1]);
+        for (let i = 1; i < path.length; i++) {
+            totalDist += calculateDistance(path[i-1][0], path[i-1][1], path[i][0], path[i][1]);
         }
-        distanceOutput.textContent = (totalDist * 1000).toFixed(0) + ' m';
+        return {path, distance: totalDist, time: totalDist * 1000 / speed};
+    }
 
-        // Calculate travel time
-        const speed = parseFloat(speedInput.value) || 1;
-        totalTravelTime = totalDist * 1000 / speed; // seconds
+    // The drawn line comes from the engine's path pyramid: only the points
+    // visible at the map's zoom inside its bounds, refetched as the map moves.
+    // The request repeats the route, which the engine uses to find the pyramid
+    // it built for the first view. trajectoryPath keeps the full path for the animation
+    let viewRequest = null;
+    let viewSequence = 0;
+
+    function refreshView() {
+        if (!viewRequest || !trajectoryLine) return;
+        const bounds = map.getBounds();
+        const body = Object.assign({}, viewRequest, {
+            zoom: map.getZoom(),
+            bounds: {south: bounds.getSouth(), west: bounds.getWest(), north: bounds.getNorth(), east: bounds.getEast()}
+        });
+        const sequence = ++viewSequence;
+        fetch(engineViewUrl, {method: 'POST', headers: {'Content-Type': 'application/json'}, body: JSON.stringify(body)})
+            .then(response => {
+                if (!response.ok) throw new Error('engine answered ' + response.status);
+                return response.json();
+            })
+            .then(doc => {
+                // A newer view or trajectory replaced this one while it was in flight
+                if (sequence !== viewSequence || !trajectoryLine) return;
+                trajectoryLine.setLatLngs(doc.paths.map(run => run.map(p => [p[0], p[1]])));
+            })
+            .catch(() => {}); // Keep the full path drawn
+    }
+
+    map.on('moveend', refreshView);
+
+    function showTrajectory(result) {
+        // Remove old line
+        if (trajectoryLine) {
+            map.removeLayer(trajectoryLine);
+        }
+        trajectoryPath = result.path;
+        trajectoryLine = L.polyline(result.latLngs || result.path.map(p=>[p[0],p[1]]), {color: 'red', weight: 3}).addTo(map);
+        viewRequest = result.request || null;
+        viewSequence++;
+        refreshView();
+        distanceOutput.textContent = (result.distance * 1000).toFixed(0) + ' m';
+        totalTravelTime = result.time; // seconds
         travelTimeOutput.textContent = totalTravelTime.toFixed(1) + ' s';
+    }
+
+    calcTrajectoryBtn.addEventListener('click', function() {
+        if (points.length < 2) {
+            alert('Add at least two points to calculate trajectory.');
+            return;
+        }
+        const pts = points.slice();
+        const speed = parseFloat(speedInput.value) || 1;
+        engineTrajectory(pts, speed)
+            .catch(() => localTrajectory(pts, speed))
+            .then(showTrajectory);
     });
 
     // Missile simulation
@@ -248,31 +390,15 @@ document.addEventListener('DOMContentLoaded', function() {
             missileAnimation = null;
         }
         const speed = parseFloat(speedInput.value) || 1;
-        let t = 0;
-        let totalDist = 0;
-        let distArr = [0];
-        for (let i = 1; i < trajectoryPath.length; i++) {
-            totalDist += calculateDistance(trajectoryPath[i-1][0], trajectoryPath[i-1][1], trajectoryPath[i][0], trajectoryPath[i][1]);
-            distArr.push(totalDist);
-        }
-        const totalDistMeters = totalDist * 1000;
+        const table = buildArcTable(trajectoryPath);
+        const totalDistMeters = table.total;
         let startTime = null;
-        logData = [];
+        flight = {table, speed};
         function animate(ts) {
             if (!startTime) startTime = ts;
             const elapsed = (ts - startTime) / 1000; // seconds
             const progress = Math.min(elapsed * speed, totalDistMeters);
-            // Find segment
-            let segIdx = 1;
-            while (segIdx < distArr.length && distArr[segIdx]*1000 < progress) segIdx++;
-            segIdx = Math.min(segIdx, trajectoryPath.length-1);
-            const prev = trajectoryPath[segIdx-1];
-            const next = trajectoryPath[segIdx];
-            const segDist = calculateDistance(prev[0], prev[1], next[0], next[1]) * 1000;
-            const segProgress = segDist === 0 ? 0 : (progress - distArr[segIdx-1]*1000) / segDist;
-            const lat = prev[0] + (next[0] - prev[0]) * segProgress;
-            const lng = prev[1] + (next[1] - prev[1]) * segProgress;
-            const alt = prev[2] + (next[2] - prev[2]) * segProgress;
+            const {lat, lng, alt} = positionAt(table, progress);
             if (!missileMarker) {
                 missileMarker = L.marker([lat, lng], {icon: L.divIcon({className:'missile-marker',html:'🚀',iconSize:[24,24]})}).addTo(map);
             } else {
@@ -283,8 +409,6 @@ document.addEventListener('DOMContentLoaded', function() {
             currentSpeedOutput.textContent = speed + ' m/s';
             const eta = Math.max(0, totalTravelTime - elapsed);
             etaOutput.textContent = eta.toFixed(1) + ' s';
-            // Log
-            logData.push({time: elapsed, lat, lng, alt, speed, eta, dist: progress});
             if (progress < totalDistMeters) {
                 missileAnimation = requestAnimationFrame(animate);
             } else {
@@ -294,28 +418,38 @@ document.addEventListener('DOMContentLoaded', function() {
         missileAnimation = requestAnimationFrame(animate);
     });
 
-    // Export logbook as CSV with user-selected interval
+    // Export logbook as CSV, sampled at a fixed time or distance interval from the
+    // launched flight (independent of the animation frame rate)
     exportLogBtn.addEventListener('click', function() {
-        if (!logData.length) {
+        if (!flight) {
             alert('No log data to export. Launch the missile first.');
             return;
         }
         const interval = parseFloat(exportIntervalInput.value) || 1;
         const intervalType = exportIntervalType.value;
-        let csv = 'time,lat,lng,alt,speed,eta,dist\n';
-        let lastValue = 0;
-        for (let i = 0; i < logData.length; i++) {
-            const d = logData[i];
-            let value = intervalType === 'seconds' ? d.time : d.dist;
-            if (value - lastValue >= interval || i === 0) {
-                csv += `${d.time.toFixed(2)},${d.lat.toFixed(6)},${d.lng.toFixed(6)},${d.alt.toFixed(1)},${d.speed},${d.eta.toFixed(1)},${d.dist.toFixed(1)}\n`;
-                lastValue = value;
+        const {table, speed} = flight;
+        const totalTime = table.total / speed;
+        const parts = ['time,lat,lng,alt,speed,eta,dist\n'];
+        let rows = [];
+        function logRow(time) {
+            const dist = Math.min(time * speed, table.total);
+            const {lat, lng, alt} = positionAt(table, dist);
+            const eta = Math.max(0, totalTime - time);
+            rows.push(`${time.toFixed(2)},${lat.toFixed(6)},${lng.toFixed(6)},${alt.toFixed(1)},${speed},${eta.toFixed(1)},${dist.toFixed(1)}\n`);
+            if (rows.length === 4096) {
+                parts.push(rows.join(''));
+                rows = [];
             }
         }
-        // Always add last point
-        const last = logData[logData.length-1];
-        csv += `${last.time.toFixed(2)},${last.lat.toFixed(6)},${last.lng.toFixed(6)},${last.alt.toFixed(1)},${last.speed},${last.eta.toFixed(1)},${last.dist.toFixed(1)}\n`;
-        const blob = new Blob([csv], {type: 'text/csv'});
+        // Multiples of the interval, so sample times don't drift
+        const limit = intervalType === 'seconds' ? totalTime : table.total;
+        for (let i = 0; i * interval < limit; i++) {
+            logRow(intervalType === 'seconds' ? i * interval : i * interval / speed);
+        }
+        // Always add the arrival
+        logRow(totalTime);
+        parts.push(rows.join(''));
+        const blob = new Blob(parts, {type: 'text/csv'});
         const url = URL.createObjectURL(blob);
         const a = document.createElement('a');
         a.href = url;